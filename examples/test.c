@@ -44,6 +44,7 @@ void app_main(void) {
 
     littlefs_init(root, label);
     LFRingInit(&ringbuf_meta, root, label, sizeof(test_data_t), samples);
+    LFRingSetReadAhead(&ringbuf_meta, 1);
 
     xTaskCreatePinnedToCore(ReadTestTask, "ReadTestTask", 4096, NULL, 5, NULL, 1);
     xTaskCreatePinnedToCore(WriteTestTask, "WriteTestTask", 4096, NULL, 5, NULL, 1);
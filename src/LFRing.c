@@ -1,20 +1,17 @@
-#include "LFRing.h"
-#include "nvs.h"
-#include <string.h>
-#include "esp_log.h"
-#include <errno.h>
+#include "LFRingInternal.h"
 
 static const char *TAG = "LFRING";
 
-int save_ringbuf_meta(ringbuf_meta_t *meta);
-void ringbuf_get_path(ringbuf_meta_t *meta, char *path);
+void ringbuf_cache_update(ringbuf_meta_t *meta, uint64_t pos, const void *data, size_t len);
+int ringbuf_read_file(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num);
+int ringbuf_init(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config);
 
 // -------------------- meta data -------------------- //
 /**
  * @brief Reset the ring buffer metadata and save it to NVS.
  *
  * This function initializes the ring buffer metadata with the given item size
- * and item number, resets the head and tail pointers to 0, and persists the
+ * and item number, resets the head and tail offsets to 0, and persists the
  * new metadata to NVS.
  *
  * @param meta Pointer to the ring buffer metadata structure to reset.
@@ -29,17 +26,69 @@ int reset_ringbuf_meta(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum
     meta->head = 0;
     meta->tail = 0;
     meta->item_size = itemSize;
-    meta->item_num = itemNum;
+    ringbuf_set_item_num(meta, itemNum);
+    meta->codec.frame_head = 0;
+    meta->codec.frame_tail = 0;
+    meta->codec.tail_pos = 0;
+    meta->codec.open_num = 0;
+    meta->codec.dec_seq = UINT64_MAX;
+    meta->codec.idx_block = UINT32_MAX;
+    meta->codec.agg_block = UINT32_MAX;
+    memset(meta->codec.open_bits, 0, sizeof(meta->codec.open_bits));
     return save_ringbuf_meta(meta);
 }
 
+/**
+ * @brief Check the loaded offsets for consistency with the ring geometry.
+ *
+ * @return 1 if the offsets describe a valid ring, 0 otherwise.
+ */
+int ringbuf_meta_valid(ringbuf_meta_t *meta) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(meta->tail > meta->head) return 0;
+    if(c->type == LFRB_CODEC_NONE) {
+        return meta->head - meta->tail <= meta->item_num;
+    }
+    // Frames counted in the stored geometry, which differs while a migration is pending
+    uint32_t frame_num = (uint32_t)((uint64_t)meta->item_size * meta->item_num / c->frame_size);
+    return c->frame_tail <= c->frame_head && c->frame_head - c->frame_tail <= frame_num &&
+           c->open_num <= c->block_items && c->open_num <= meta->head &&
+           (c->frame_tail < c->frame_head || c->tail_pos <= c->open_num);
+}
+
+/**
+ * @brief Convert the 32-bit head/tail slot indexes of older releases.
+ *
+ * Slot indexes map onto logical offsets with the same slot (offset % item_num),
+ * so the data file stays valid: tail keeps its value and head becomes
+ * tail + number of used slots.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param handle Open NVS handle of the ring's namespace.
+ *
+ * @return 1 if old indexes were found and converted, 0 otherwise.
+ */
+int ringbuf_meta_upgrade(ringbuf_meta_t *meta, nvs_handle_t handle) {
+    uint32_t head, tail;
+    if(nvs_get_u32(handle, "head", &head) != ESP_OK || nvs_get_u32(handle, "tail", &tail) != ESP_OK) {
+        return 0;
+    }
+    uint32_t used = (head >= tail) ? (head - tail) : (meta->item_num - tail + head);
+    meta->tail = tail;
+    meta->head = (uint64_t)tail + used;
+    ESP_LOGI(TAG, "Converted 32-bit head/tail (%u/%u) to offsets", (unsigned int)head, (unsigned int)tail);
+    return 1;
+}
+
 /**
  * @brief Initialize ring buffer metadata from NVS or create new metadata.
  *
  * This function attempts to load ring buffer metadata (head, tail, item size,
  * number of items) from the specified NVS namespace. If the NVS namespace does
  * not exist or the structure has changed, it resets the metadata to the provided
- * item size and item number.
+ * item size and item number. A change of item number (or of item size, for raw
+ * rings with a conversion callback) keeps the stored geometry in @p meta
+ * instead, to be migrated by ringbuf_migrate_begin() once the file system is set up.
  *
  * @param meta Pointer to the ring buffer metadata structure to initialize.
  * @param nvs_namespace The NVS namespace used to store metadata.
@@ -61,22 +110,61 @@ int init_ringbuf_meta(ringbuf_meta_t *meta, const char *nvs_namespace, uint32_t
     if (err == ESP_OK) {
         // Successfully opened NVS, read existing metadata
         ESP_LOGI(TAG, "Opened NVS namespace: %s", meta->nvs_namespace);
-        nvs_get_u32(handle, "head", &meta->head);
-        nvs_get_u32(handle, "tail", &meta->tail);
+        meta->head = 0;
+        meta->tail = 0;
         nvs_get_u32(handle, "size", &meta->item_size);
-        nvs_get_u32(handle, "num", &meta->item_num);
+        uint32_t item_num = meta->item_num;
+        nvs_get_u32(handle, "num", &item_num);
+        ringbuf_set_item_num(meta, item_num);
+        int upgraded = 0;
+        if(nvs_get_u64(handle, "ohead", &meta->head) != ESP_OK ||
+           nvs_get_u64(handle, "otail", &meta->tail) != ESP_OK) {
+            upgraded = ringbuf_meta_upgrade(meta, handle);
+        }
+        // Rings written before the codec existed have no layout hash (raw = 0)
+        uint32_t layout_hash = 0;
+        nvs_get_u32(handle, "lhash", &layout_hash);
+        if(meta->codec.type != LFRB_CODEC_NONE) {
+            nvs_get_u64(handle, "fhead", &meta->codec.frame_head);
+            nvs_get_u64(handle, "ftail", &meta->codec.frame_tail);
+            nvs_get_u32(handle, "tpos", &meta->codec.tail_pos);
+            nvs_get_u32(handle, "onum", &meta->codec.open_num);
+        }
         nvs_close(handle);
 
         ESP_LOGI(TAG, "%u/%u", (unsigned int)meta->item_size, (unsigned int)meta->item_num);
 
+        // Capacity changes are migrated, the item layout only through a conversion callback
+        int geometry_changed = meta->item_size != itemSize || meta->item_num != itemNum;
+        int migratable = geometry_changed && layout_hash == meta->codec.layout_hash &&
+                         meta->item_size != 0 && meta->item_num != 0 &&
+                         (meta->item_size == itemSize ||
+                          (meta->codec.type == LFRB_CODEC_NONE && meta->codec.convert != NULL));
+
         // Check if the saved metadata matches the expected item size/num
-        if (meta->item_size != itemSize || meta->item_num != itemNum) {
+        if (migratable && ringbuf_meta_valid(meta)) {
+            ESP_LOGW(TAG, "Item geometry changed (%u/%u -> %u/%u). Migrating ring buffer.",
+                     (unsigned int)meta->item_size, (unsigned int)meta->item_num, (unsigned int)itemSize, (unsigned int)itemNum);
+        } else if (geometry_changed || layout_hash != meta->codec.layout_hash) {
             ESP_LOGW(TAG, "Item structure changed. Resetting ring buffer meta.");
             int status = reset_ringbuf_meta(meta, itemSize, itemNum);
             if (status < 0) {
                 ESP_LOGE(TAG, "Failed to reset meta, status=%d", status);
                 return status;
             }
+        } else if(!ringbuf_meta_valid(meta)) {
+            ESP_LOGW(TAG, "Offsets out of range. Resetting ring buffer meta.");
+            int status = reset_ringbuf_meta(meta, itemSize, itemNum);
+            if (status < 0) {
+                ESP_LOGE(TAG, "Failed to reset meta, status=%d", status);
+                return status;
+            }
+        } else if(upgraded) {
+            int status = save_ringbuf_meta(meta);
+            if (status < 0) {
+                ESP_LOGE(TAG, "Failed to save converted meta, status=%d", status);
+                return status;
+            }
         } else {
             ESP_LOGI(TAG, "Meta loaded successfully. No reset needed.");
         }
@@ -90,7 +178,7 @@ int init_ringbuf_meta(ringbuf_meta_t *meta, const char *nvs_namespace, uint32_t
         }
     }
 
-    ESP_LOGI(TAG, "Loaded meta from NVS: head=%" PRIu32 " tail=%" PRIu32 " size=%" PRIu32 " num=%" PRIu32,
+    ESP_LOGI(TAG, "Loaded meta from NVS: head=%" PRIu64 " tail=%" PRIu64 " size=%" PRIu32 " num=%" PRIu32,
             meta->head, meta->tail, meta->item_size, meta->item_num);
 
     return LFRB_OK;
@@ -107,18 +195,42 @@ int init_ringbuf_meta(ringbuf_meta_t *meta, const char *nvs_namespace, uint32_t
  *
  * @return
  *      - LFRB_OK : Metadata successfully saved to NVS.
- *      - LFRB_NVS_ERROR: NVS namespace cannot be opened.
+ *      - LFRB_NVS_ERROR: NVS namespace cannot be opened or the commit failed;
+ *        the metadata stays dirty and is saved again by the next commit.
  */
 int save_ringbuf_meta(ringbuf_meta_t *meta) {
+    // Rings inside a shared log are covered by the log checkpoint
+    if(meta->log != NULL) return ringbuf_log_save(meta->log);
+    if(meta->lanes.num != 0) return ringbuf_lanes_save(meta);
+
     nvs_handle_t handle;
     esp_err_t err = nvs_open(meta->nvs_namespace, NVS_READWRITE, &handle);
     if (err == ESP_OK) {
-        nvs_set_u32(handle, "head", meta->head);
-        nvs_set_u32(handle, "tail", meta->tail);
+        nvs_set_u64(handle, "ohead", meta->head);
+        nvs_set_u64(handle, "otail", meta->tail);
         nvs_set_u32(handle, "size", meta->item_size);
         nvs_set_u32(handle, "num", meta->item_num);
-        nvs_commit(handle);
+        if(meta->codec.layout_hash != 0) {
+            nvs_set_u32(handle, "lhash", meta->codec.layout_hash);
+        }
+        if(meta->codec.type != LFRB_CODEC_NONE) {
+            nvs_set_u64(handle, "fhead", meta->codec.frame_head);
+            nvs_set_u64(handle, "ftail", meta->codec.frame_tail);
+            nvs_set_u32(handle, "tpos", meta->codec.tail_pos);
+            nvs_set_u32(handle, "onum", meta->codec.open_num);
+        }
+        // 32-bit indexes of older releases are superseded by the offsets
+        nvs_erase_key(handle, "head");
+        nvs_erase_key(handle, "tail");
+        ringbuf_fault_point(LFRB_FAULT_NVS);
+        err = nvs_commit(handle);
         nvs_close(handle);
+        if(err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit meta of %s (%s)", meta->nvs_namespace, esp_err_to_name(err));
+            meta->dirty = 1;
+            return -LFRB_NVS_ERROR;
+        }
+        meta->dirty = 0;
         return LFRB_OK;
     }
     return -LFRB_NVS_ERROR;
@@ -127,9 +239,10 @@ int save_ringbuf_meta(ringbuf_meta_t *meta) {
 /**
  * @brief Load ring buffer metadata (head and tail) from NVS.
  *
- * This function reads the current head and tail indices of the ring buffer
+ * This function reads the current head and tail offsets of the ring buffer
  * from the specified NVS namespace. If successful, the metadata in the
- * provided structure is updated.
+ * provided structure is updated. Encoded rings also reload the read
+ * position inside the tail block; the open block is owned by RAM.
  *
  * @param meta Pointer to the ring buffer metadata structure containing
  *             the NVS namespace and fields to be updated.
@@ -137,13 +250,36 @@ int save_ringbuf_meta(ringbuf_meta_t *meta) {
  * @return
  *      - LFRB_OK: Metadata successfully loaded from NVS.
  *      - LFRB_NVS_ERROR: NVS namespace cannot be opened.
+ *      - Propagate errors from ringbuf_migrate_step().
  */
 int load_ringbuf_meta(ringbuf_meta_t *meta) {
+    if(meta->log != NULL) {
+        ringbuf_log_sync_meta(meta);
+        return LFRB_OK;
+    }
+    // The lanes are owned by RAM, checkpointed by every write and read
+    if(meta->lanes.num != 0) {
+        ringbuf_lanes_sync_meta(meta);
+        return LFRB_OK;
+    }
+    // A migration init left unfinished completes before the ring is used
+    if(meta->boot.migrate_size != 0) {
+        int status = ringbuf_migrate_step(meta, UINT32_MAX);
+        if(status < 0) return status;
+    }
+    // Written by the flush scheduler but not committed yet: RAM is newer
+    if(meta->dirty) return LFRB_OK;
+
     nvs_handle_t handle;
     esp_err_t err = nvs_open(meta->nvs_namespace, NVS_READONLY, &handle);
     if (err == ESP_OK) {
-        nvs_get_u32(handle, "head", &meta->head);
-        nvs_get_u32(handle, "tail", &meta->tail);
+        nvs_get_u64(handle, "ohead", &meta->head);
+        nvs_get_u64(handle, "otail", &meta->tail);
+        if(meta->codec.type != LFRB_CODEC_NONE) {
+            nvs_get_u64(handle, "fhead", &meta->codec.frame_head);
+            nvs_get_u64(handle, "ftail", &meta->codec.frame_tail);
+            nvs_get_u32(handle, "tpos", &meta->codec.tail_pos);
+        }
         nvs_close(handle);
         return LFRB_OK;
     } else {
@@ -152,6 +288,44 @@ int load_ringbuf_meta(ringbuf_meta_t *meta) {
 }
 
 // -------------------- LFS ring buf -------------------- //
+/**
+ * @brief Seek to a 64-bit byte position.
+ *
+ * Positions that the platform's off_t cannot represent are rejected instead
+ * of silently wrapping.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int ringbuf_seek(FILE *f, uint64_t pos) {
+    const uint64_t off_max = ((uint64_t)1 << (sizeof(off_t) * 8 - 1)) - 1;
+    if(pos > off_max) return -1;
+    return fseeko(f, (off_t)pos, SEEK_SET);
+}
+
+/**
+ * @brief pread()/pwrite() @p len bytes at a 64-bit byte position.
+ *
+ * Raw item I/O goes through file descriptors instead of stdio: no FILE
+ * buffer between the caller and the LittleFS cache, and no separate seek,
+ * so an operation is exactly open + one transfer per contiguous range +
+ * close. Short transfers are continued; positions that the platform's
+ * off_t cannot represent are rejected.
+ *
+ * @return Number of bytes transferred.
+ */
+size_t ringbuf_pio(int fd, uint64_t pos, void *buf, size_t len, int write) {
+    const uint64_t off_max = ((uint64_t)1 << (sizeof(off_t) * 8 - 1)) - 1;
+    size_t done = 0;
+    while(done < len && pos + done <= off_max) {
+        if(write) ringbuf_fault_point(LFRB_FAULT_LFS);
+        ssize_t k = write ? pwrite(fd, (const uint8_t *)buf + done, len - done, (off_t)(pos + done))
+                          : pread(fd, (uint8_t *)buf + done, len - done, (off_t)(pos + done));
+        if(k <= 0) break;
+        done += k;
+    }
+    return done;
+}
+
 /**
  * @brief Reset the LittleFS ring buffer file.
  *
@@ -170,6 +344,10 @@ int reset_ringbuf_lfs(ringbuf_meta_t *meta) {
     ringbuf_get_path(meta, path);
     ESP_LOGI(TAG, "Resetting ring buffer file: %s", path);
 
+    meta->cache.len = 0;
+    // Summaries are matched by logical offset, which starts over
+    ringbuf_stats_reset(meta);
+    ringbuf_fault_point(LFRB_FAULT_LFS);
     FILE* f = fopen(path, "wb");
     if(f == NULL) {
         ESP_LOGE(TAG, "Failed to open file for reset: errno=%d", errno);
@@ -185,9 +363,9 @@ int reset_ringbuf_lfs(ringbuf_meta_t *meta) {
  * @brief Initialize the LittleFS-based ring buffer file.
  *
  * This function sets the root directory for the ring buffer and ensures
- * the filesystem path exists. If the ring buffer is empty (head and tail
- * are both zero), it resets the corresponding LittleFS file to prepare
- * it for writing.
+ * the filesystem path exists. If nothing was ever written to the ring
+ * buffer (head is zero), it resets the corresponding LittleFS file to
+ * prepare it for writing.
  *
  * @param meta Pointer to the ring buffer metadata structure.
  * @param root Path to the root directory for storing ring buffer data.
@@ -211,12 +389,12 @@ int init_ringbuf_lfs(ringbuf_meta_t *meta, const char *root) {
     ESP_LOGI(TAG, "Ring buffer root set to: %s", meta->root);
 
     // Reset ring buffer if empty
-    if(meta->head == 0 && meta->tail == 0) {
+    if(meta->head == 0) {
         ESP_LOGI(TAG, "Ring buffer empty, resetting file");
         return reset_ringbuf_lfs(meta);
     }
 
-    ESP_LOGI(TAG, "Ring buffer already initialized (head=%u, tail=%u)", (unsigned int)meta->head, (unsigned int)meta->tail);
+    ESP_LOGI(TAG, "Ring buffer already initialized (head=%" PRIu64 ", tail=%" PRIu64 ")", meta->head, meta->tail);
     return LFRB_OK;
 }
 
@@ -224,10 +402,12 @@ int init_ringbuf_lfs(ringbuf_meta_t *meta, const char *root) {
  * @brief Write items to the ring buffer stored in LittleFS.
  *
  * This function writes up to @p num items into the ring buffer file,
- * starting from the current head position. If the file cannot be opened,
- * it attempts to reset the ring buffer metadata and recreate the file.
+ * starting at the slot of logical offset @p offset. The caller splits
+ * writes at the end of the file. If the file cannot be opened, it
+ * attempts to reset the ring buffer metadata and recreate the file.
  *
  * @param meta Pointer to the ring buffer metadata structure.
+ * @param offset Logical offset of the first item to write.
  * @param data Pointer to the data to be written into the ring buffer.
  * @param num Number of items to write.
  *
@@ -235,34 +415,149 @@ int init_ringbuf_lfs(ringbuf_meta_t *meta, const char *root) {
  *      - Number of items successfully written.
  *      - LFRB_NFILE_ERROR: failed to recreate file
  */
-int ringbuf_write(ringbuf_meta_t *meta, const void* data, size_t num) {
-    // Calculate byte offset based on the current head position
-    uint32_t pos = meta->head * meta->item_size;
+int ringbuf_write(ringbuf_meta_t *meta, uint64_t offset, const void* data, size_t num) {
+    // Calculate byte offset based on the slot of the logical offset
+    uint64_t pos = (uint64_t)ringbuf_slot(meta, offset) * meta->item_size;
 
     // Construct full path to the ring buffer file using root and namespace
     char path[LFRB_MAX_PATH];
     ringbuf_get_path(meta, path);
 
-    // Open the ring buffer file in read-write binary mode
-    FILE* f = fopen(path, "rb+");
-    if(f == NULL) {
+    // Open the ring buffer file for reading and writing
+    int fd = open(path, O_RDWR);
+    if(fd < 0) {
         // If the file cannot be opened, reset metadata and the file
         reset_ringbuf_meta(meta, meta->item_size, meta->item_num);
         reset_ringbuf_lfs(meta);
+        // The items now go to the slot of the reset head
+        pos = (uint64_t)ringbuf_slot(meta, meta->head) * meta->item_size;
 
         // Attempt to reopen the file after reset
-        f = fopen(path, "rb+");
-        if(f == NULL) {
+        fd = open(path, O_RDWR);
+        if(fd < 0) {
             ESP_LOGE(TAG, "ringbuf_write: failed to recreate file %s", path);
             return -LFRB_NFILE_ERROR;
         }
     }
 
     // Write up to 'num' items from 'data' into the file
-    fseek(f, pos, SEEK_SET);
-    size_t n = fwrite(data, meta->item_size, num, f);
-    fclose(f);
+    size_t n = ringbuf_pio(fd, pos, (void *)data, num * meta->item_size, 1) / meta->item_size;
+    if(close(fd) != 0) n = 0;
+
+    // Keep the read-ahead window in step with the file
+    ringbuf_cache_update(meta, pos, data, n * meta->item_size);
+    if(n != num) meta->cache.len = 0;
+
+    return n;
+}
+
+/**
+ * @brief Refresh the part of the read-ahead window overwritten by a write.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param pos  File position of the written bytes.
+ * @param data Written bytes.
+ * @param len  Number of written bytes.
+ */
+void ringbuf_cache_update(ringbuf_meta_t *meta, uint64_t pos, const void *data, size_t len) {
+    ringbuf_cache_t *c = &meta->cache;
+    uint64_t lo = pos > c->pos ? pos : c->pos;
+    uint64_t hi = pos + len < c->pos + c->len ? pos + len : c->pos + c->len;
+    if(c->len == 0 || lo >= hi) return;
+    memcpy(c->buf + (lo - c->pos), (const uint8_t *)data + (lo - pos), hi - lo);
+}
+
+/**
+ * @brief Read items through the read-ahead window.
+ *
+ * Misses load the LFRB_LFS_BLOCK_SIZE-aligned window holding the item, so
+ * a run of small reads costs one file access per window instead of one
+ * per call.
+ *
+ * @return
+ *      - Number of items successfully read.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ */
+int ringbuf_cache_read(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num) {
+    ringbuf_cache_t *c = &meta->cache;
+    uint64_t file_end = (uint64_t)meta->item_num * meta->item_size;
+    int fd = -1;
+    size_t n = 0;
+    while(n < num) {
+        uint32_t slot = ringbuf_slot(meta, offset + n);
+        uint64_t pos = (uint64_t)slot * meta->item_size;
+        if(c->len == 0 || pos < c->pos || pos + meta->item_size > c->pos + c->len) {
+            if(fd < 0) {
+                char path[LFRB_MAX_PATH];
+                ringbuf_get_path(meta, path);
+                fd = open(path, O_RDONLY);
+                if(fd < 0) return n > 0 ? (int)n : -LFRB_NFILE_ERROR;
+            }
+            uint64_t start = pos - pos % LFRB_LFS_BLOCK_SIZE;
+            if(start + c->size < pos + meta->item_size) start = pos;
+            uint32_t len = file_end - start < c->size ? (uint32_t)(file_end - start) : c->size;
+            c->pos = start;
+            c->len = ringbuf_pio(fd, start, c->buf, len, 0);
+            if(pos + meta->item_size > c->pos + c->len) break;
+        }
+        size_t k = (c->pos + c->len - pos) / meta->item_size;
+        if(k > meta->item_num - slot) k = meta->item_num - slot;
+        if(k > num - n) k = num - n;
+        memcpy((uint8_t *)out_data + n * meta->item_size, c->buf + (pos - c->pos), k * meta->item_size);
+        n += k;
+    }
+    if(fd >= 0) close(fd);
+    return n;
+}
+
+/**
+ * @brief Read items at a logical offset without touching the metadata.
+ *
+ * Reads wrap around the end of the file. Rings with a read-ahead window
+ * are served from it.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param offset Logical offset of the first item to read.
+ * @param out_data Pointer to the buffer where read data will be stored.
+ * @param num Number of items to read.
+ *
+ * @return
+ *      - Number of items successfully read.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ */
+int ringbuf_read_items(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num) {
+    if(meta->cache.size > 0) return ringbuf_cache_read(meta, offset, out_data, num);
+    return ringbuf_read_file(meta, offset, out_data, num);
+}
+
+/**
+ * @brief Read items at a logical offset straight from the data file.
+ *
+ * Touches no shared state of @p meta besides its constant geometry, so it
+ * may run without the ring mutex (see LFRingSnapshotRead()).
+ *
+ * @return
+ *      - Number of items successfully read.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ */
+int ringbuf_read_file(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num) {
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
 
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return -LFRB_NFILE_ERROR;
+
+    size_t n = 0;
+    while(n < num) {
+        uint32_t slot = ringbuf_slot(meta, offset + n);
+        size_t k = meta->item_num - slot;
+        if(k > num - n) k = num - n;
+        size_t got = ringbuf_pio(fd, (uint64_t)slot * meta->item_size, (uint8_t *)out_data + n * meta->item_size,
+                                 k * meta->item_size, 0) / meta->item_size;
+        n += got;
+        if(got != k) break;
+    }
+    close(fd);
     return n;
 }
 
@@ -270,9 +565,9 @@ int ringbuf_write(ringbuf_meta_t *meta, const void* data, size_t num) {
  * @brief Read items from the ring buffer stored in LittleFS.
  *
  * This function reads up to @p num items from the ring buffer file,
- * starting from the current tail position. If the file cannot be opened,
- * it resets both the ring buffer metadata and the corresponding file
- * to recover from potential corruption.
+ * starting from the current tail position and never past head. If the
+ * file cannot be opened, it resets both the ring buffer metadata and the
+ * corresponding file to recover from potential corruption.
  *
  * @param meta Pointer to the ring buffer metadata structure.
  * @param out_data Pointer to the buffer where read data will be stored.
@@ -283,25 +578,15 @@ int ringbuf_write(ringbuf_meta_t *meta, const void* data, size_t num) {
  *      - 0 if the file could not be opened or no data is available.
  */
 int ringbuf_read(ringbuf_meta_t *meta, void* out_data, size_t num) {
-    uint32_t pos = meta->tail * meta->item_size;
+    if(num > meta->head - meta->tail) num = meta->head - meta->tail;
 
-    char path[LFRB_MAX_PATH];
-    ringbuf_get_path(meta, path);
-
-    // Open the ring buffer file in read-binary mode
-    FILE* f = fopen(path, "rb");
-    if(f == NULL) {
+    int n = ringbuf_read_items(meta, meta->tail, out_data, num);
+    if(n < 0) {
         // If the file cannot be opened, reset both metadata and file to recover
         reset_ringbuf_meta(meta, meta->item_size, meta->item_num);
         reset_ringbuf_lfs(meta);
         return 0;
     }
-
-    // Read up to 'num' items from the file into 'out_data'
-    fseek(f, pos, SEEK_SET);
-    size_t n = fread(out_data, meta->item_size, num, f);
-    fclose(f);
-
     return n;
 }
 
@@ -322,151 +607,1484 @@ int ringbuf_read(ringbuf_meta_t *meta, void* out_data, size_t num) {
  *             Must be at least LFRB_MAX_PATH bytes long.
  */
 void ringbuf_get_path(ringbuf_meta_t *meta, char *path) {
-    snprintf(path, LFRB_MAX_PATH, "%s/%s.bin", meta->root, meta->nvs_namespace);
+    ringbuf_get_path_ext(meta, path, "bin");
 }
 
-// -------------------- User Layer -------------------- //
 /**
- * @brief Initialize the LittleFS-based ring buffer system.
+ * @brief Construct the path of a companion file of the ring buffer.
  *
- * This function sets up both the NVS-stored metadata and the LittleFS
- * storage backend for the ring buffer. It initializes key parameters
- * such as the item size, total number of items, and the file system root
- * path where data will be stored. A mutex lock is also created to ensure
- * thread-safe operations.
+ * Same naming scheme as ringbuf_get_path(), with a caller-chosen extension
+ * (e.g. "stg" → "/ringbuf/sensor.stg").
  *
  * @param meta Pointer to the ring buffer metadata structure.
- * @param root Path to the LittleFS directory used for storing ring buffer data.
- * @param nvs_namespace Name of the NVS namespace used to store metadata.
- * @param itemSize Size (in bytes) of each data item in the ring buffer.
- * @param itemNum Total number of data items the ring buffer can store.
- *
- * @return Propagate errors from init_ringbuf_meta() and init_ringbuf_lfs()
+ * @param path Output buffer, at least LFRB_MAX_PATH bytes long.
+ * @param ext  File extension without the dot.
  */
-int LFRingInit(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum) {
-    int status;
-    status = init_ringbuf_meta(meta, nvs_namespace, itemSize, itemNum);
-    if(status < 0) return status;
-    status = init_ringbuf_lfs(meta, root);
-    meta->lock = xSemaphoreCreateMutex();
-    return status;
+void ringbuf_get_path_ext(ringbuf_meta_t *meta, char *path, const char *ext) {
+    snprintf(path, LFRB_MAX_PATH, "%s/%s.%s", meta->root, meta->nvs_namespace, ext);
 }
 
+// -------------------- rollup -------------------- //
 /**
- * @brief Check if the LittleFS-based ring buffer is empty.
- *
- * This function loads the current ring buffer metadata and determines
- * whether the buffer contains any unread data. It returns a boolean-like
- * value indicating the buffer’s empty state.
+ * @brief Fold items about to be overwritten and append the records to the rollup ring.
  *
- * @param meta Pointer to the ring buffer metadata structure.
+ * Runs under the ring mutex and takes the rollup ring's mutex in turn.
+ */
+void ringbuf_rollup_feed(ringbuf_meta_t *meta, const uint8_t *rows, size_t num) {
+    ringbuf_rollup_t *r = &meta->rollup;
+    for(size_t done = 0; done < num; ) {
+        size_t k = num - done < r->cap ? num - done : r->cap;
+        size_t m = r->fold(rows + done * meta->item_size, k, r->out, r->cap, r->ctx);
+        if(m > r->cap) m = r->cap;
+        if(m > 0 && LFRingWrite(r->ring, r->out, m) < 0) {
+            ESP_LOGW(TAG, "Rollup of %s failed, %u records lost", meta->nvs_namespace, (unsigned int)m);
+        }
+        done += k;
+    }
+}
+
+/**
+ * @brief Feed the unread items of a raw ring below offset @p end to the rollup ring.
  *
- * @return
- *      - 1 : Ring buffer is empty.  
- *      - 0 : Ring buffer is not empty.  
- *      - <0 : Error code (if loading metadata fails).
+ * Called by a write before it overwrites them.
  */
-int LFRingIsEmpty(ringbuf_meta_t *meta) {
-    int err = load_ringbuf_meta(meta);
-    if(err < 0) return err;
-    return meta->tail == meta->head;
+void ringbuf_rollup_raw(ringbuf_meta_t *meta, uint64_t end) {
+    ringbuf_rollup_t *r = &meta->rollup;
+    if(end > meta->head) end = meta->head;
+    for(uint64_t o = meta->tail; o < end; ) {
+        size_t k = end - o < r->cap ? (size_t)(end - o) : r->cap;
+        int n = ringbuf_read_items(meta, o, r->buf, k);
+        if(n <= 0) break;
+        ringbuf_rollup_feed(meta, r->buf, n);
+        o += n;
+    }
 }
 
 /**
- * @brief Write items to the LittleFS-based ring buffer.
+ * @brief Free the buffers of the rollup tier.
+ */
+void ringbuf_rollup_release(ringbuf_meta_t *meta) {
+    if(meta->mem == NULL) {
+        free(meta->rollup.buf);
+        free(meta->rollup.out);
+    }
+    memset(&meta->rollup, 0, sizeof(meta->rollup));
+}
+
+/**
+ * @brief Check whether @p meta is reached by following the rollup tiers from @p ring.
  *
- * This function writes data into the ring buffer stored in LittleFS.
- * It ensures thread safety using a mutex and maintains metadata consistency
- * by updating the head and tail pointers. If the buffer becomes full,
- * the oldest data will be overwritten.
+ * Each ring's mutex is held only while its link is read, so the walk never
+ * nests locks.
+ */
+int ringbuf_rollup_reaches(ringbuf_meta_t *ring, ringbuf_meta_t *meta) {
+    while(ring != NULL) {
+        if(ring == meta) return 1;
+        xSemaphoreTake(ring->lock, portMAX_DELAY);
+        ringbuf_meta_t *next = ring->rollup.ring;
+        xSemaphoreGive(ring->lock);
+        ring = next;
+    }
+    return 0;
+}
+
+// -------------------- offsets -------------------- //
+/**
+ * @brief Copy items from logical offset @p offset on without consuming them.
  *
- * @param meta Pointer to the ring buffer metadata structure.
- * @param data Pointer to the data to be written into the ring buffer.
- * @param num Number of items to write to the ring buffer.
+ * Caller holds the ring mutex with the offsets loaded.
  *
- * @return >= 0 as number of items successfully written, or:
- *          - Propagate errors from ringbuf_write();
+ * @return >= 0 as number of items copied, or a negative error
+ *         (see LFRingReadAt()).
  */
-int LFRingWrite(ringbuf_meta_t *meta, void* data, size_t num) {
-    xSemaphoreTake(meta->lock, portMAX_DELAY);
+int ringbuf_read_at(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num) {
+    if(offset < meta->tail) return -LFRB_OFFSET_ERROR;
+    if(offset >= meta->head) return 0;
+    if(meta->log != NULL) {
+        uint64_t next;
+        return ringbuf_log_copy(meta->log, meta->log_ring, offset, out_data, num, &next);
+    }
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        return ringbuf_codec_read_at(meta, meta->codec.frame_tail, offset, out_data, num);
+    }
+    if(num > meta->head - offset) num = meta->head - offset;
+    return ringbuf_read_items(meta, offset, out_data, num);
+}
 
-    // Read meta data
-    load_ringbuf_meta(meta);
+/**
+ * @brief Consume the items below logical offset @p offset and commit.
+ *
+ * Offsets at or below tail are left alone (already consumed or
+ * overwritten), offsets past head stop at head. Encoded rings locate the
+ * block holding the new tail like LFRingReadAt() does.
+ */
+int ringbuf_tail_to(ringbuf_meta_t *meta, uint64_t offset) {
+    if(offset <= meta->tail) return LFRB_OK;
+    if(offset > meta->head) offset = meta->head;
 
-    // Reject requests that exceed buffer capacity
-    if(num > meta->item_num-1) {
-        xSemaphoreGive(meta->lock);
-        return -LFRB_ENUM_EXCEED;
+    if(meta->log != NULL) {
+        ringbuf_log_t *log = meta->log;
+        ringbuf_log_ring_t *r = &log->rings[meta->log_ring];
+        // Move the search start past the records consumed now
+        char path[LFRB_MAX_PATH];
+        ringbuf_log_path(log, path);
+        FILE *f = fopen(path, "rb");
+        if(f != NULL) {
+            uint64_t pos = r->pos > log->tail ? r->pos : log->tail;
+            ringbuf_log_hdr_t hdr;
+            while(pos < log->head && ringbuf_log_header(log, f, pos, &hdr) == LFRB_OK &&
+                  (hdr.ring != meta->log_ring || hdr.first + hdr.count <= offset)) {
+                pos += sizeof(hdr) + hdr.len;
+            }
+            fclose(f);
+            r->pos = pos;
+        }
+        r->tail = offset;
+        int status = ringbuf_log_save(log);
+        ringbuf_log_sync_meta(meta);
+        return status;
     }
 
-    // Attempt to write data into the ring buffer
-    // Case 1: Enough space from current head to the end of buffer
-    // -> Write data in one contiguous block
-    int n = 0;
-    if(meta->item_num - meta->head >= num) {
-        n += ringbuf_write(meta, data, num);
+    ringbuf_codec_t *c = &meta->codec;
+    if(c->type != LFRB_CODEC_NONE) {
+        uint64_t open_first = meta->head - c->open_num;
+        if(offset >= open_first) {
+            c->frame_tail = c->frame_head;
+            c->tail_pos = offset - open_first;
+        } else {
+            uint64_t seq;
+            int status = ringbuf_codec_find(meta, c->frame_tail, offset, &seq);
+            if(status == LFRB_OK) status = ringbuf_codec_load_frame(meta, seq, LFRB_ALL_FIELDS);
+            if(status < 0) return status;
+            c->frame_tail = seq;
+            c->tail_pos = offset > c->dec_first ? offset - c->dec_first : 0;
+        }
     }
-    // Case 2: Data to write exceeds remaining space at buffer end
-    // -> Split into two writes (wrap-around)
-    else {
-        int write_num = meta->item_num - meta->head;
-        n += ringbuf_write(meta, data, write_num);
-        meta->head = 0;
-        n += ringbuf_write(meta, (uint8_t*)data + write_num * meta->item_size, num - write_num);
+    meta->tail = offset;
+    return save_ringbuf_meta(meta);
+}
+
+/**
+ * @brief Check that the items of a snapshot from @p offset on are still stored.
+ *
+ * Raw slots and encoded frames are only lost to overwrite; being consumed
+ * by a reader leaves them readable. Caller holds the ring mutex with the
+ * offsets loaded.
+ *
+ * @param lo Set to the oldest frame of the snapshot still on flash (encoded rings).
+ *
+ * @return LFRB_OK, LFRB_OFFSET_ERROR once overwritten, or a load error.
+ */
+int ringbuf_snapshot_check(const ringbuf_snapshot_t *snap, uint64_t offset, uint64_t *lo) {
+    ringbuf_meta_t *meta = snap->meta;
+    ringbuf_codec_t *c = &meta->codec;
+    // A reset starts the offsets over
+    if(meta->head < snap->to) return -LFRB_OFFSET_ERROR;
+    if(c->type == LFRB_CODEC_NONE) {
+        return meta->head > offset + meta->item_num ? -LFRB_OFFSET_ERROR : LFRB_OK;
     }
 
-    // Update head & tail ptr
-    // Calculate how much of the buffer is currently used
-    uint32_t used = (meta->head >= meta->tail)
-                    ? (meta->head - meta->tail)
-                    : (meta->item_num - meta->tail + meta->head);
-    // Advance the head pointer
-    meta->head = (meta->head + n) % meta->item_num;
-    // Handle buffer overflow (overwrite oldest data)
-    if(used + n > meta->item_num-1) {
-        uint32_t overwrite = used + n - meta->item_num + 1;
-        meta->tail = (meta->tail + overwrite) % meta->item_num;
-        ESP_LOGW(TAG, "LFRingWrite: buffer overflow, overwrote %u old items", (unsigned int)overwrite);
+    uint64_t oldest = c->frame_head > c->frame_num ? c->frame_head - c->frame_num : 0;
+    *lo = snap->seq > oldest ? snap->seq : oldest;
+    if(*lo == snap->seq || offset >= meta->head - c->open_num) return LFRB_OK;
+    if(*lo == c->frame_head) return -LFRB_OFFSET_ERROR;
+    int status = ringbuf_codec_load_frame(meta, *lo, LFRB_ALL_FIELDS);
+    if(status < 0) return status;
+    return offset < c->dec_first ? -LFRB_OFFSET_ERROR : LFRB_OK;
+}
+
+// -------------------- boot -------------------- //
+/**
+ * @brief Open a ring whose stored geometry matches its configuration.
+ *
+ * Reloads the open block of an encoded ring and sets the range left to
+ * LFRingVerify(), which keeps init independent of the ring size.
+ *
+ * @return Propagate errors from ringbuf_stage_load().
+ */
+int ringbuf_boot_finish(ringbuf_meta_t *meta) {
+    int raw = meta->codec.type == LFRB_CODEC_NONE;
+    meta->boot.verify_next = raw ? meta->tail : meta->codec.frame_tail;
+    meta->boot.verify_end = raw ? meta->head : meta->codec.frame_head;
+    return raw ? LFRB_OK : ringbuf_stage_load(meta);
+}
+
+/**
+ * @brief Microseconds since @p *t, which is moved on to now.
+ */
+uint32_t ringbuf_boot_lap(int64_t *t) {
+    int64_t now = esp_timer_get_time();
+    uint32_t us = (uint32_t)(now - *t);
+    *t = now;
+    return us;
+}
+
+/**
+ * @brief Add @p num findings to meta->boot.corrupt, saturating.
+ */
+static void ringbuf_verify_count(ringbuf_meta_t *meta, uint64_t num) {
+    uint32_t room = UINT32_MAX - meta->boot.corrupt;
+    meta->boot.corrupt += num < room ? (uint32_t)num : room;
+}
+
+/**
+ * @brief Check the length of the data file of a raw ring against the loaded offsets.
+ *
+ * A file shorter than the slots in use (cut before LittleFS committed the
+ * growth) loses the items stored past its end. The oldest items up to the
+ * newest lost one are dropped, so what remains is contiguous and in order.
+ *
+ * @return Number of items dropped, or a negative error.
+ */
+int64_t ringbuf_verify_length(ringbuf_meta_t *meta, const char *path) {
+    struct stat st;
+    if(stat(path, &st) != 0) return meta->head > meta->tail ? -LFRB_NFILE_ERROR : 0;
+
+    uint64_t slots = (uint64_t)st.st_size / meta->item_size;
+    if(slots >= meta->item_num || meta->head == meta->tail) return 0;
+
+    // Newest offset below head whose slot lies past the end of the file
+    uint64_t last = meta->head - 1;
+    if(ringbuf_slot(meta, last) < slots) {
+        if(last < (uint64_t)ringbuf_slot(meta, last) + 1) return 0;
+        last -= ringbuf_slot(meta, last) + 1;
     }
+    if(last < meta->tail) return 0;
 
-    // Update meta date
+    uint64_t lost = last + 1 - meta->tail;
+    ESP_LOGW(TAG, "Data file short (%" PRIu64 " slots), dropping %" PRIu64 " items", slots, lost);
+    meta->tail = last + 1;
     save_ringbuf_meta(meta);
-
-    xSemaphoreGive(meta->lock);
-    return n;
+    return (int64_t)lost;
 }
 
 /**
- * @brief  Read items from the LittleFS-based ring buffer.
+ * @brief Check up to @p max LittleFS blocks of a raw ring written before boot.
  *
- * This function reads up to `num` items from the ring buffer into `out_data`.
- * The function is thread-safe; it locks the buffer with a semaphore during access.
+ * The file length is checked first (see ringbuf_verify_length()). The slots
+ * in use are then read back one block at a time, so LittleFS reports the
+ * ones it cannot read; their items are counted only, like corrupt frames.
  *
- * @param meta      Pointer to the ring buffer metadata structure.
- * @param out_data  Pointer to a buffer where the read items will be stored.
- * @param num       Number of items to read.
- * 
- * @return Number of items successfully read.
+ * @return 1 once all slots are checked, 0 if more remain, or a negative error.
  */
-int LFRingRead(ringbuf_meta_t *meta, void* out_data, size_t num) {
-    xSemaphoreTake(meta->lock, portMAX_DELAY);
+int ringbuf_verify_raw(ringbuf_meta_t *meta, uint32_t max) {
+    ringbuf_boot_t *b = &meta->boot;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    int64_t lost = ringbuf_verify_length(meta, path);
+    if(lost < 0) return (int)lost;
+    ringbuf_verify_count(meta, (uint64_t)lost);
 
-    // Read meta data from NVS
-    load_ringbuf_meta(meta);
+    uint64_t offset = b->verify_next > meta->tail ? b->verify_next : meta->tail;
+    uint64_t end = b->verify_end < meta->head ? b->verify_end : meta->head;
+    if(offset >= end) return 1;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return -LFRB_NFILE_ERROR;
 
-    // Check if the buffer is empty
-    if(meta->tail == meta->head) {
-        xSemaphoreGive(meta->lock);
-        return 0;
+    uint32_t block_items = LFRB_LFS_BLOCK_SIZE / meta->item_size > 0 ? LFRB_LFS_BLOCK_SIZE / meta->item_size : 1;
+    uint8_t buf[256];
+    for(uint32_t i = 0; i < max && offset < end; i++) {
+        uint32_t slot = ringbuf_slot(meta, offset);
+        uint64_t k = end - offset < block_items ? end - offset : block_items;
+        if(k > meta->item_num - slot) k = meta->item_num - slot;
+        uint64_t pos = (uint64_t)slot * meta->item_size, len = k * meta->item_size, done = 0;
+        while(done < len) {
+            size_t n = len - done < sizeof(buf) ? len - done : sizeof(buf);
+            if(ringbuf_pio(fd, pos + done, buf, n, 0) != n) break;
+            done += n;
+        }
+        if(done < len) {
+            ESP_LOGW(TAG, "LFRingVerify: unreadable items at %" PRIu64, offset + done / meta->item_size);
+            ringbuf_verify_count(meta, k - done / meta->item_size);
+        }
+        offset += k;
     }
+    close(fd);
+    b->verify_next = offset;
+    return offset >= end;
+}
 
-    // Read data from the ring buffer
-    int n = ringbuf_read(meta, out_data, num);
+/**
+ * @brief Check up to @p max frames of an encoded ring written before boot.
+ *
+ * Each frame is decoded, which checks its header and crc. Corrupt frames
+ * are counted only: readers skip them when they reach them.
+ *
+ * @return 1 once all frames are checked, 0 if more remain, or a negative error.
+ */
+int ringbuf_verify_frames(ringbuf_meta_t *meta, uint32_t max) {
+    ringbuf_codec_t *c = &meta->codec;
+    ringbuf_boot_t *b = &meta->boot;
+    uint64_t seq = b->verify_next > c->frame_tail ? b->verify_next : c->frame_tail;
+    uint64_t end = b->verify_end < c->frame_head ? b->verify_end : c->frame_head;
+    for(uint32_t i = 0; i < max && seq < end; i++, seq++) {
+        int status = ringbuf_codec_load_frame(meta, seq, LFRB_ALL_FIELDS);
+        if(status == -LFRB_NFILE_ERROR) return status;
+        if(status < 0) {
+            ESP_LOGW(TAG, "LFRingVerify: corrupt block %" PRIu64, seq);
+            ringbuf_verify_count(meta, 1);
+        }
+    }
+    b->verify_next = seq;
+    return seq >= end;
+}
 
-    // Update the tail pointer after reading
-    meta->tail = (meta->tail + n) % meta->item_num;
-    save_ringbuf_meta(meta);
+// -------------------- fault injection -------------------- //
+static ringbuf_fault_t fault_hook;
+static void *fault_ctx;
+static uint32_t fault_seq;
 
-    xSemaphoreGive(meta->lock);
-    return n;
-}
\ No newline at end of file
+/**
+ * @brief Report a storage operation about to happen to the fault hook.
+ *
+ * Placed right before every LittleFS write, truncate or rename and every
+ * NVS commit, so a harness that stops at operation N sees the device state
+ * a power cut at that point would leave behind.
+ *
+ * @param op ringbuf_fault_op_t of the operation.
+ */
+void ringbuf_fault_point(uint8_t op) {
+    ringbuf_fault_t hook = fault_hook;
+    if(hook != NULL) hook(op, fault_seq++, fault_ctx);
+}
+
+// -------------------- User Layer -------------------- //
+/**
+ * @brief Initialize the LittleFS-based ring buffer system.
+ *
+ * This function sets up both the NVS-stored metadata and the LittleFS
+ * storage backend for the ring buffer. It initializes key parameters
+ * such as the item size, total number of items, and the file system root
+ * path where data will be stored. A mutex lock is also created to ensure
+ * thread-safe operations.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param root Path to the LittleFS directory used for storing ring buffer data.
+ * @param nvs_namespace Name of the NVS namespace used to store metadata.
+ * @param itemSize Size (in bytes) of each data item in the ring buffer.
+ * @param itemNum Total number of data items the ring buffer can store.
+ *
+ * @return Propagate errors from init_ringbuf_meta() and init_ringbuf_lfs()
+ */
+int LFRingInit(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum) {
+    return LFRingInitEx(meta, root, nvs_namespace, itemSize, itemNum, NULL);
+}
+
+/**
+ * @brief Initialize the ring buffer with optional settings.
+ *
+ * Same as LFRingInit(), with a configuration selecting the item schema and
+ * the block codec. With LFRB_CODEC_DELTA the ring stores delta/XOR-encoded
+ * blocks; @p itemNum * @p itemSize then sets the flash budget and the ring
+ * retains as many items as fit once encoded. Changing the schema or block
+ * geometry resets the ring like a change of item size does.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param root Path to the LittleFS directory used for storing ring buffer data.
+ * @param nvs_namespace Name of the NVS namespace used to store metadata.
+ * @param itemSize Size (in bytes) of each data item in the ring buffer.
+ * @param itemNum Total number of data items the ring buffer can store.
+ * @param config Optional settings, NULL behaves like LFRingInit().
+ *
+ * @return Propagate errors from ringbuf_codec_config(), init_ringbuf_meta()
+ *         and init_ringbuf_lfs()
+ */
+int LFRingInitEx(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config) {
+    meta->mem = NULL;
+    return ringbuf_init(meta, root, nvs_namespace, itemSize, itemNum, config);
+}
+
+/**
+ * @brief Initialize a ring whose buffers and mutex live in caller-provided memory.
+ *
+ * Same as LFRingInitEx(), but the ring never touches the heap: its mutex,
+ * block buffers, pending buffer, ISR staging ring, read-ahead window,
+ * rollup and stream buffers, the chunks of LFRingDrainTo() and of
+ * geometry migrations and the block buffer of iterators come from @p mem, sized at compile time with
+ * LFRB_STATIC_BYTES() and the LFRB_*_BYTES() macros. Each feature fails
+ * with LFRB_NO_MEM_ERROR beyond the capacities given in @p mem; mem->iter
+ * serves one iterator at a time. Start the
+ * flush task with LFRingFlushStartStatic() to keep it off the heap as well.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param root Path to the LittleFS directory used for storing ring buffer data.
+ * @param nvs_namespace Name of the NVS namespace used to store metadata.
+ * @param itemSize Size (in bytes) of each data item in the ring buffer.
+ * @param itemNum Total number of data items the ring buffer can store.
+ * @param config Optional settings; encoded rings need an explicit frame_size.
+ * @param mem Buffers of the ring, must stay valid until LFRingDeinit().
+ *
+ * @return
+ *      - LFRB_CONFIG_ERROR: @p mem is NULL.
+ *      - LFRB_NO_MEM_ERROR: mem->codec is too small for the configuration, or
+ *        mem->scratch cannot hold the items of a pending geometry migration.
+ *      - Propagate errors from LFRingInitEx().
+ */
+int LFRingInitStatic(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config, ringbuf_static_t *mem) {
+    if(mem == NULL) return -LFRB_CONFIG_ERROR;
+    meta->mem = mem;
+    return ringbuf_init(meta, root, nvs_namespace, itemSize, itemNum, config);
+}
+
+/**
+ * @brief Body of LFRingInitEx() and LFRingInitStatic(), meta->mem already set.
+ */
+int ringbuf_init(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config) {
+    int64_t start = esp_timer_get_time(), t = start;
+    int status;
+    meta->log = NULL;
+    memset(&meta->lanes, 0, sizeof(meta->lanes));
+    memset(&meta->boot, 0, sizeof(meta->boot));
+    memset(&meta->pending, 0, sizeof(meta->pending));
+    memset(&meta->isr, 0, sizeof(meta->isr));
+    memset(&meta->stream, 0, sizeof(meta->stream));
+    memset(&meta->cache, 0, sizeof(meta->cache));
+    memset(&meta->rollup, 0, sizeof(meta->rollup));
+    memset(&meta->ttl, 0, sizeof(meta->ttl));
+    meta->wake = NULL;
+    meta->wake_ctx = NULL;
+    meta->dirty = 0;
+    status = ringbuf_codec_config(meta, itemSize, itemNum, config);
+    if(status < 0) return status;
+    status = ringbuf_migrate_resume(meta, root, nvs_namespace);
+    meta->boot.migrate_us = ringbuf_boot_lap(&t);
+    if(status == LFRB_OK) {
+        status = init_ringbuf_meta(meta, nvs_namespace, itemSize, itemNum);
+    }
+    meta->boot.meta_us = ringbuf_boot_lap(&t);
+    if(status < 0) {
+        ringbuf_codec_free(meta);
+        return status;
+    }
+    status = init_ringbuf_lfs(meta, root);
+    meta->boot.lfs_us = ringbuf_boot_lap(&t);
+    int migrating = status == LFRB_OK && (meta->item_size != itemSize || meta->item_num != itemNum);
+    if(migrating) {
+        // Bounded copy at boot, the rest is left to LFRingVerify() or the first access
+        status = ringbuf_migrate_begin(meta, itemSize, itemNum);
+        if(status == LFRB_OK) {
+            status = ringbuf_migrate_step(meta, LFRB_MIGRATE_BOOT_CHUNKS);
+            if(status > 0) status = LFRB_OK;
+        } else if(status == -LFRB_NO_MEM_ERROR) {
+            // Static ring without scratch space: the stored ring stays as it is
+            ringbuf_codec_free(meta);
+            return status;
+        } else {
+            ESP_LOGE(TAG, "Migration failed (status=%d). Resetting ring buffer.", status);
+            reset_ringbuf_meta(meta, itemSize, itemNum);
+            status = reset_ringbuf_lfs(meta);
+            migrating = 0;
+        }
+        meta->boot.migrate_us += ringbuf_boot_lap(&t);
+    }
+    if(status == LFRB_OK && !migrating) status = ringbuf_boot_finish(meta);
+    meta->boot.stage_us = ringbuf_boot_lap(&t);
+    meta->pending.durable = meta->pending.notified = meta->head;
+    meta->lock = meta->mem != NULL ? xSemaphoreCreateMutexStatic(&meta->mem->lock) : xSemaphoreCreateMutex();
+    meta->boot.total_us = (uint32_t)(esp_timer_get_time() - start);
+    return status;
+}
+
+/**
+ * @brief Release the resources held by an initialized ring buffer.
+ *
+ * Items staged in an open block stay in the staging file and are picked up
+ * again by the next LFRingInitEx() with the same configuration. Pending
+ * and streamed items (see LFRingSetFlush(), LFRingSetStream()) are written
+ * out first.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ */
+void LFRingDeinit(ringbuf_meta_t *meta) {
+    if(meta->pending.cap > 0 || meta->stream.cap > 0) {
+        ringbuf_flush_register(meta, 0);
+        ringbuf_stream_release(meta);
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        ringbuf_isr_collect(meta);
+        ringbuf_pending_release(meta);
+        ringbuf_isr_release(meta);
+        xSemaphoreGive(meta->lock);
+    }
+    if(meta->mem == NULL) free(meta->cache.buf);
+    memset(&meta->cache, 0, sizeof(meta->cache));
+    ringbuf_rollup_release(meta);
+    if(meta->log != NULL) {
+        // The lock belongs to the shared log
+        ringbuf_codec_free(meta);
+        meta->log = NULL;
+        meta->lock = NULL;
+        return;
+    }
+    if(meta->lock != NULL) {
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+    }
+    ringbuf_codec_free(meta);
+    ringbuf_lanes_free(meta);
+    if(meta->lock != NULL) {
+        xSemaphoreGive(meta->lock);
+        vSemaphoreDelete(meta->lock);
+        meta->lock = NULL;
+    }
+}
+
+/**
+ * @brief Check if the LittleFS-based ring buffer is empty.
+ *
+ * This function loads the current ring buffer metadata under the ring
+ * mutex and determines whether the buffer contains any unread data,
+ * pending items included. It returns a boolean-like
+ * value indicating the buffer’s empty state.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ *
+ * @return
+ *      - 1 : Ring buffer is empty.  
+ *      - 0 : Ring buffer is not empty.  
+ *      - <0 : Error code (if loading metadata fails).
+ */
+int LFRingIsEmpty(ringbuf_meta_t *meta) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    // Pending items are unread items too
+    int status = 0;
+    if(meta->pending.num == 0) {
+        status = load_ringbuf_meta(meta);
+        if(status == LFRB_OK) status = ringbuf_is_empty(meta);
+    }
+    xSemaphoreGive(meta->lock);
+    return status;
+}
+
+/**
+ * @brief Write items to the LittleFS-based ring buffer.
+ *
+ * This function writes data into the ring buffer stored in LittleFS.
+ * It ensures thread safety using a mutex and maintains metadata consistency
+ * by updating the head and tail offsets. Each item receives the next
+ * logical offset. If the buffer becomes full, the oldest data will be
+ * overwritten.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param data Pointer to the data to be written into the ring buffer.
+ * @param num Number of items to write to the ring buffer.
+ *
+ * Rings with a pending buffer (see LFRingSetFlush()) only copy the items
+ * into RAM; they get their logical offsets right away but reach flash with
+ * the next flush.
+ *
+ * If the items reach flash but the metadata commit fails, they still count
+ * as written: the ring stays dirty and the next commit makes them durable.
+ * Until then LFRingDurableOffset() stays below LFRingNewestOffset(), so
+ * callers that need durability check it rather than retrying the write.
+ *
+ * @return >= 0 as number of items successfully written, or:
+ *          - LFRB_ENUM_EXCEED: @p num exceeds the ring capacity.
+ *          - Propagate errors from ringbuf_write();
+ */
+int LFRingWrite(ringbuf_meta_t *meta, void* data, size_t num) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    // Read meta data
+    load_ringbuf_meta(meta);
+
+    // Reject requests that exceed buffer capacity
+    if(num > meta->item_num) {
+        xSemaphoreGive(meta->lock);
+        return -LFRB_ENUM_EXCEED;
+    }
+
+    // Rings with a pending buffer only copy the items into RAM
+    if(meta->pending.cap > 0) {
+        int n = ringbuf_pending_put(meta, data, num);
+        xSemaphoreGive(meta->lock);
+        return n;
+    }
+
+    int n = ringbuf_write_through(meta, data, num);
+
+    // Update meta date; a failed commit leaves the ring dirty for the next one
+    ringbuf_commit(meta);
+    ringbuf_wake(meta, n);
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Read items from the LittleFS-based ring buffer.
+ *
+ * This function reads up to `num` items from the ring buffer into `out_data`.
+ * The function is thread-safe; it locks the buffer with a semaphore during access.
+ *
+ * @param meta      Pointer to the ring buffer metadata structure.
+ * @param out_data  Pointer to a buffer where the read items will be stored.
+ * @param num       Number of items to read.
+ * 
+ * @return Number of items successfully read.
+ */
+int LFRingRead(ringbuf_meta_t *meta, void* out_data, size_t num) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    // Read meta data from NVS
+    load_ringbuf_meta(meta);
+    ringbuf_ttl_expire(meta);
+    ringbuf_pending_need(meta, meta->tail + num);
+
+    // Check if the buffer is empty
+    if(ringbuf_is_empty(meta)) {
+        xSemaphoreGive(meta->lock);
+        return 0;
+    }
+
+    if(meta->log != NULL) {
+        int n = ringbuf_log_read(meta, out_data, num);
+        ringbuf_log_sync_meta(meta);
+        xSemaphoreGive(meta->lock);
+        return n;
+    }
+
+    // Rings with lanes serve the highest lane first
+    if(meta->lanes.num != 0) {
+        int n = ringbuf_lanes_read(meta, out_data, num);
+        ringbuf_lanes_sync_meta(meta);
+        xSemaphoreGive(meta->lock);
+        return n;
+    }
+
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        int n = ringbuf_codec_read(meta, out_data, num, LFRB_ALL_FIELDS);
+        save_ringbuf_meta(meta);
+        xSemaphoreGive(meta->lock);
+        return n;
+    }
+
+    // Read data from the ring buffer
+    int n = ringbuf_read(meta, out_data, num);
+
+    // Update the tail offset after reading
+    meta->tail += n;
+    save_ringbuf_meta(meta);
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Read selected fields of items from an encoded ring buffer.
+ *
+ * Works like LFRingRead() and consumes the same items, but only the
+ * columns of the fields selected in @p field_mask (bit i = i-th schema
+ * field) are fetched from flash. Items are still returned in row format;
+ * bytes outside the selected fields are zeroed.
+ *
+ * @param meta       Pointer to the ring buffer metadata structure.
+ * @param field_mask Schema fields to return, LFRB_ALL_FIELDS for whole items.
+ * @param out_data   Pointer to a buffer where the read items will be stored.
+ * @param num        Number of items to read.
+ *
+ * @return >= 0 as number of items successfully read, or:
+ *          - LFRB_CONFIG_ERROR: The ring has no block codec.
+ */
+int LFRingReadColumns(ringbuf_meta_t *meta, uint32_t field_mask, void* out_data, size_t num) {
+    if(meta->codec.type == LFRB_CODEC_NONE) return -LFRB_CONFIG_ERROR;
+    if(field_mask != LFRB_ALL_FIELDS && meta->codec.user_field_num < 32) {
+        field_mask &= (1u << meta->codec.user_field_num) - 1;
+    }
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    load_ringbuf_meta(meta);
+    ringbuf_ttl_expire(meta);
+    ringbuf_pending_need(meta, meta->tail + num);
+    if(ringbuf_is_empty(meta)) {
+        xSemaphoreGive(meta->lock);
+        return 0;
+    }
+
+    int n = ringbuf_codec_read(meta, out_data, num, field_mask);
+    save_ringbuf_meta(meta);
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Move the read position to the first item at or after a timestamp.
+ *
+ * Unread items older than @p ts are dropped. Blocks whose index entry ends
+ * before @p ts are skipped without reading their payload; the search
+ * assumes timestamps do not decrease within the ring.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param ts   Timestamp to seek to, in the unit of the timestamp field.
+ *
+ * @return
+ *      - LFRB_OK: Read position moved (to head if no item is recent enough).
+ *      - LFRB_CONFIG_ERROR: The ring has no time index.
+ */
+int LFRingSeekTime(ringbuf_meta_t *meta, uint64_t ts) {
+    if(!(meta->codec.flags & LFRB_TIME_INDEX)) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    load_ringbuf_meta(meta);
+    ringbuf_pending_need(meta, UINT64_MAX);
+    ringbuf_seek_time(meta, ts);
+    save_ringbuf_meta(meta);
+
+    xSemaphoreGive(meta->lock);
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Expire unread items once they are older than a lifetime.
+ *
+ * Before each LFRingRead(), LFRingReadColumns() and LFRingDrainTo() the
+ * items whose timestamp is older than clock() - @p ttl are dropped unread.
+ * Expired blocks are recognised from their time index entry alone, so a
+ * stale backlog costs index reads rather than payload reads and is never
+ * handed to the reader; while nothing expired, the check is one index read.
+ * Pending items are written out only once every stored item expired and
+ * the oldest pending one did too.
+ * Assumes timestamps do not decrease within the ring; the number of items
+ * expired is counted in meta->ttl.expired.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param ttl   Lifetime, in the unit of the timestamp field.
+ * @param clock Returns the current time in that unit, NULL to disable expiry.
+ * @param ctx   Passed to @p clock.
+ *
+ * @return
+ *      - LFRB_OK: TTL set (or removed).
+ *      - LFRB_CONFIG_ERROR: The ring has no time index.
+ */
+int LFRingSetTTL(ringbuf_meta_t *meta, uint64_t ttl, ringbuf_clock_t clock, void *ctx) {
+    if(!(meta->codec.flags & LFRB_TIME_INDEX)) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    meta->ttl.ttl = ttl;
+    meta->ttl.clock = clock;
+    meta->ttl.ctx = ctx;
+    xSemaphoreGive(meta->lock);
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Copy the unread items whose timestamp lies in [from, to].
+ *
+ * The items are not consumed. Blocks whose index entry does not overlap
+ * the range are skipped without reading their payload.
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param from     First timestamp of the range (inclusive).
+ * @param to       Last timestamp of the range (inclusive).
+ * @param out_data Pointer to a buffer where the matching items will be stored.
+ * @param max      Maximum number of items to copy.
+ *
+ * @return >= 0 as number of items copied, or:
+ *          - LFRB_CONFIG_ERROR: The ring has no time index.
+ */
+int LFRingReadRange(ringbuf_meta_t *meta, uint64_t from, uint64_t to, void* out_data, size_t max) {
+    if(!(meta->codec.flags & LFRB_TIME_INDEX)) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    load_ringbuf_meta(meta);
+    ringbuf_pending_need(meta, UINT64_MAX);
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "idx");
+    FILE *idx = fopen(path, "rb");
+
+    ringbuf_block_t blk;
+    size_t n = 0;
+    for(int ok = ringbuf_block_first(meta, &blk); ok && n < max; ok = ringbuf_block_next(meta, &blk)) {
+        if(ringbuf_block_outside(idx, &blk, from, to)) continue;
+        const uint8_t *rows = ringbuf_block_rows(meta, &blk);
+        if(rows == NULL) continue;
+        for(uint32_t i = 0; i < blk.num && n < max; i++) {
+            const uint8_t *item = rows + i * meta->item_size;
+            uint64_t ts = ringbuf_item_ts(meta, item);
+            if(ts >= from && ts <= to) {
+                memcpy((uint8_t *)out_data + n * meta->item_size, item, meta->item_size);
+                n++;
+            }
+        }
+    }
+    if(idx != NULL) fclose(idx);
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Copy items starting at a logical offset without consuming them.
+ *
+ * Every item written to the ring receives the next logical offset. Items
+ * from LFRingOldestOffset() up to (excluding) LFRingNewestOffset() can be
+ * read in any order. Raw rings map an offset straight to its slot; encoded
+ * rings locate the block holding it by a binary search over the block
+ * headers.
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param offset   Logical offset of the first item to copy.
+ * @param out_data Pointer to a buffer where the items will be stored.
+ * @param num      Maximum number of items to copy.
+ *
+ * @return >= 0 as number of items copied (0 at or past the newest offset), or:
+ *          - LFRB_OFFSET_ERROR: @p offset was consumed or overwritten.
+ *          - LFRB_NFILE_ERROR: Data file could not be opened.
+ *          - LFRB_CORRUPT_ERROR: The block holding @p offset is corrupt.
+ *          - LFRB_CONFIG_ERROR: Ring with lanes, whose items have no common offsets.
+ */
+int LFRingReadAt(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num) {
+    if(meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    load_ringbuf_meta(meta);
+    ringbuf_pending_need(meta, offset + num);
+
+    int n = ringbuf_read_at(meta, offset, out_data, num);
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Logical offset of the oldest unread item.
+ *
+ * Equals LFRingNewestOffset() when the ring is empty.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ *
+ * @return Logical offset of the oldest item still retained.
+ */
+uint64_t LFRingOldestOffset(ringbuf_meta_t *meta) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    load_ringbuf_meta(meta);
+    // Overwrites caused by pending items move the oldest offset
+    ringbuf_pending_need(meta, UINT64_MAX);
+    uint64_t offset = meta->tail;
+    xSemaphoreGive(meta->lock);
+    return offset;
+}
+
+/**
+ * @brief  Logical offset the next written item will receive.
+ *
+ * The newest item in the ring has this offset minus one. Pending items
+ * count, except under LFRB_OVERFLOW_DROP_OLD: LFRingWriteAsync() may still
+ * discard them, so they receive their offsets once written.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ *
+ * @return One past the logical offset of the newest item.
+ */
+uint64_t LFRingNewestOffset(ringbuf_meta_t *meta) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    load_ringbuf_meta(meta);
+    // Pending items already have their offsets, unless they may still be dropped
+    uint64_t offset = meta->head;
+    if(meta->pending.overflow != LFRB_OVERFLOW_DROP_OLD) offset += meta->pending.num;
+    xSemaphoreGive(meta->lock);
+    return offset;
+}
+
+/**
+ * @brief  Serve small reads of a raw ring from a read-ahead window.
+ *
+ * Reads that miss the window load @p blocks LittleFS blocks around the
+ * requested item at once; following reads of nearby items (LFRingRead(),
+ * LFRingReadAt(), time index scans) are served from RAM. Writes update the
+ * overlapping part of the window, so it never returns stale slots.
+ *
+ * @param meta   Pointer to the ring buffer metadata structure.
+ * @param blocks Window size in LFRB_LFS_BLOCK_SIZE blocks, 0 to disable.
+ *
+ * @return
+ *      - LFRB_OK: Window set up (or removed).
+ *      - LFRB_CONFIG_ERROR: Encoded, shared-log or lane ring (encoded rings
+ *        already read whole blocks), or window smaller than one item.
+ *      - LFRB_NO_MEM_ERROR: Window could not be allocated.
+ */
+int LFRingSetReadAhead(ringbuf_meta_t *meta, uint32_t blocks) {
+    if(meta->codec.type != LFRB_CODEC_NONE || meta->log != NULL || meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+    if(blocks > 0 && (uint64_t)blocks * LFRB_LFS_BLOCK_SIZE < meta->item_size) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    ringbuf_cache_t *c = &meta->cache;
+    if(meta->mem == NULL) free(c->buf);
+    memset(c, 0, sizeof(*c));
+    int status = LFRB_OK;
+    if(blocks > 0) {
+        if(meta->mem != NULL) c->buf = blocks <= meta->mem->cache_blocks ? meta->mem->cache : NULL;
+        else c->buf = malloc((size_t)blocks * LFRB_LFS_BLOCK_SIZE);
+        if(c->buf == NULL) status = -LFRB_NO_MEM_ERROR;
+        else c->size = blocks * LFRB_LFS_BLOCK_SIZE;
+    }
+    xSemaphoreGive(meta->lock);
+    return status;
+}
+
+/**
+ * @brief  Install a hook called before every storage operation.
+ *
+ * Meant for power-cut testing: the hook sees each LittleFS write, truncate
+ * or rename and each NVS commit with a running sequence number. A host
+ * harness cuts power at operation N by not returning from the hook (e.g.
+ * longjmp), drops the simulated device state not yet persisted, runs
+ * LFRingInit() again and checks the ring; meta->boot gives the recovery
+ * time of that cut point. Not for production use: the hook runs in every
+ * writer's context, including the flush task.
+ *
+ * @param hook Called with the operation and its sequence number, NULL to remove.
+ * @param ctx  Passed to @p hook.
+ */
+void LFRingSetFaultHook(ringbuf_fault_t hook, void *ctx) {
+    fault_hook = NULL;
+    fault_ctx = ctx;
+    fault_seq = 0;
+    fault_hook = hook;
+}
+
+/**
+ * @brief  Verify part of a ring left by the previous boot.
+ *
+ * LFRingInit() only loads and range-checks the offsets, so boot time does
+ * not grow with the ring. The scan of the stored data is deferred to this
+ * function, which checks at most @p maxBlocks blocks per call under the
+ * ring mutex; call it from a low-priority task until it returns 1. Writes
+ * and reads are accepted meanwhile: readers skip corrupt blocks on their
+ * own, and blocks written after boot are not scanned.
+ *
+ * Raw rings check the data file length against the slots in use and drop
+ * the oldest items up to the newest one lost, then read back the slots in
+ * use one LittleFS block at a time. Encoded rings decode every block
+ * written before boot. Findings are counted in meta->boot.corrupt.
+ *
+ * A geometry migration init left unfinished (see LFRB_MIGRATE_BOOT_CHUNKS)
+ * is continued first, @p maxBlocks chunks per call.
+ *
+ * @param meta      Pointer to the ring buffer metadata structure.
+ * @param maxBlocks Blocks (or migration chunks) to check in this call.
+ *
+ * @return
+ *      - 1: The ring is verified.
+ *      - 0: More blocks remain.
+ *      - LFRB_NFILE_ERROR: Data file missing while the ring holds items.
+ */
+int LFRingVerify(ringbuf_meta_t *meta, uint32_t maxBlocks) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    ringbuf_boot_t *b = &meta->boot;
+    int status = 1;
+    if(b->migrate_size != 0) {
+        status = ringbuf_migrate_step(meta, maxBlocks);
+        if(status > 0) status = 0;
+    } else if(b->verify_next != UINT64_MAX) {
+        load_ringbuf_meta(meta);
+        if(meta->codec.type == LFRB_CODEC_NONE) {
+            status = ringbuf_verify_raw(meta, maxBlocks);
+        } else {
+            status = ringbuf_verify_frames(meta, maxBlocks);
+        }
+        if(status == 1) {
+            b->verify_next = UINT64_MAX;
+            ESP_LOGI(TAG, "%s verified, %u corrupt", meta->nvs_namespace, (unsigned int)b->corrupt);
+        }
+    }
+    xSemaphoreGive(meta->lock);
+    return status;
+}
+
+/**
+ * @brief  Stream retained items to a sink and consume what it accepted.
+ *
+ * Items are copied from tail on in chunks of up to LFRB_LFS_BLOCK_SIZE
+ * bytes (at least one item) and handed to @p sink without the ring mutex
+ * held, so writers keep going while the sink uploads. After each chunk the
+ * tail moves past the whole items the sink accepted, with one NVS commit
+ * per chunk. A sink that fails or accepts less than offered stops the
+ * drain; the rest stays in the ring for the next attempt.
+ *
+ * Items overwritten while a chunk is in the sink are not sent again. Bytes
+ * of a partially accepted item are offered again next time. Static rings
+ * copy the chunks through mem->scratch, so only one drain may run at a time.
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param sink     Called with each chunk, returns the bytes it accepted.
+ * @param ctx      Passed to @p sink.
+ * @param maxBytes Maximum number of bytes offered in this call, SIZE_MAX for
+ *                 all; capped at INT_MAX so the count fits the return value.
+ *
+ * @return >= 0 as number of bytes accepted and consumed, or:
+ *          - LFRB_NO_MEM_ERROR: Chunk buffer could not be allocated, or
+ *            mem->scratch of a static ring cannot hold one item.
+ *          - LFRB_CONFIG_ERROR: Ring with lanes.
+ *          - Read errors of LFRingReadAt() if nothing was consumed yet.
+ */
+int LFRingDrainTo(ringbuf_meta_t *meta, ringbuf_sink_t sink, void *ctx, size_t maxBytes) {
+    if(meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+    if(maxBytes > INT_MAX) maxBytes = INT_MAX;
+    size_t chunk = LFRB_LFS_BLOCK_SIZE / meta->item_size;
+    if(chunk == 0) chunk = 1;
+    if(meta->mem != NULL) {
+        size_t fit = meta->mem->scratch != NULL ? meta->mem->scratch_size / meta->item_size : 0;
+        if(fit == 0) return -LFRB_NO_MEM_ERROR;
+        if(chunk > fit) chunk = fit;
+    }
+    if(chunk > maxBytes / meta->item_size) chunk = maxBytes / meta->item_size;
+    if(chunk == 0) return 0;
+
+    uint8_t *buf = meta->mem != NULL ? meta->mem->scratch : malloc(chunk * meta->item_size);
+    if(buf == NULL) return -LFRB_NO_MEM_ERROR;
+
+    size_t done = 0;
+    int status = LFRB_OK;
+    while(done + meta->item_size <= maxBytes) {
+        size_t num = (maxBytes - done) / meta->item_size;
+        if(num > chunk) num = chunk;
+
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        load_ringbuf_meta(meta);
+        ringbuf_ttl_expire(meta);
+        ringbuf_pending_need(meta, meta->tail + num);
+        uint64_t from = meta->tail;
+        int n = ringbuf_read_at(meta, from, buf, num);
+        xSemaphoreGive(meta->lock);
+        if(n <= 0) {
+            status = n;
+            break;
+        }
+
+        size_t len = (size_t)n * meta->item_size;
+        size_t accepted = sink(buf, len, ctx);
+        if(accepted > len) accepted = len;
+        uint32_t items = accepted / meta->item_size;
+
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        load_ringbuf_meta(meta);
+        status = items > 0 ? ringbuf_tail_to(meta, from + items) : LFRB_OK;
+        xSemaphoreGive(meta->lock);
+
+        done += (size_t)items * meta->item_size;
+        if(status < 0 || accepted < len) break;
+    }
+    if(meta->mem == NULL) free(buf);
+    return done > 0 || status >= 0 ? (int)done : status;
+}
+
+/**
+ * @brief  Open a stable view of the items retained now.
+ *
+ * The snapshot covers [LFRingOldestOffset(), LFRingNewestOffset()) at the
+ * time of the call; pending items are written out first. Writers are not
+ * held back: items of the snapshot stay readable after being consumed, and
+ * LFRingSnapshotRead() reports the ones lost to overwrite instead.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param snap Snapshot to fill in.
+ *
+ * @return >= 0 as number of items in the snapshot, or:
+ *          - LFRB_CONFIG_ERROR: Ring inside a shared log or with lanes.
+ */
+int LFRingSnapshotOpen(ringbuf_meta_t *meta, ringbuf_snapshot_t *snap) {
+    if(meta->log != NULL || meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    load_ringbuf_meta(meta);
+    ringbuf_pending_need(meta, UINT64_MAX);
+    snap->meta = meta;
+    snap->from = meta->tail;
+    snap->to = meta->head;
+    snap->seq = meta->codec.frame_tail;
+    xSemaphoreGive(meta->lock);
+    return (int)(snap->to - snap->from);
+}
+
+/**
+ * @brief  Copy items of a snapshot.
+ *
+ * Raw rings read the data file without the ring mutex and check afterwards
+ * that the slots were not rewritten meanwhile. Encoded rings decode under
+ * the mutex, one call at a time; keep @p num small to let writers in
+ * between.
+ *
+ * @param snap     Snapshot opened by LFRingSnapshotOpen().
+ * @param offset   Logical offset of the first item to copy.
+ * @param out_data Pointer to a buffer where the items will be stored.
+ * @param num      Maximum number of items to copy.
+ *
+ * @return >= 0 as number of items copied (0 at the end of the snapshot), or:
+ *          - LFRB_OFFSET_ERROR: @p offset is outside the snapshot or was overwritten.
+ *          - LFRB_NFILE_ERROR, LFRB_CORRUPT_ERROR: See LFRingReadAt().
+ */
+int LFRingSnapshotRead(ringbuf_snapshot_t *snap, uint64_t offset, void* out_data, size_t num) {
+    ringbuf_meta_t *meta = snap->meta;
+    if(meta == NULL || offset < snap->from) return -LFRB_OFFSET_ERROR;
+    if(offset >= snap->to) return 0;
+    if(num > snap->to - offset) num = snap->to - offset;
+
+    uint64_t lo = 0;
+    int n;
+    if(meta->codec.type == LFRB_CODEC_NONE) {
+        n = ringbuf_read_file(meta, offset, out_data, num);
+        if(n <= 0) return n;
+        // Writes are done under the mutex: once it is ours, any write that overlapped the read shows in head
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        load_ringbuf_meta(meta);
+        int status = ringbuf_snapshot_check(snap, offset, &lo);
+        xSemaphoreGive(meta->lock);
+        return status < 0 ? status : n;
+    }
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    load_ringbuf_meta(meta);
+    n = ringbuf_snapshot_check(snap, offset, &lo);
+    if(n == LFRB_OK) n = ringbuf_codec_read_at(meta, lo, offset, out_data, num);
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Close a snapshot opened by LFRingSnapshotOpen().
+ *
+ * @param snap Snapshot to close.
+ */
+void LFRingSnapshotClose(ringbuf_snapshot_t *snap) {
+    snap->meta = NULL;
+}
+
+/**
+ * @brief  Start a walk over the retained items without consuming them.
+ *
+ * The walk covers the items retained now (see LFRingSnapshotOpen()) and
+ * reads them LFRB_LFS_BLOCK_SIZE bytes at a time, so LFRingIterNext()
+ * touches flash once per block instead of once per item. The block buffer
+ * comes from the heap, or from mem->iter (LFRB_ITER_BYTES()) for rings set
+ * up with LFRingInitStatic(), which then walk with one iterator at a time.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param it   Iterator to set up; release it with LFRingIterEnd().
+ *
+ * @return
+ *      - LFRB_OK: Iterator ready.
+ *      - LFRB_CONFIG_ERROR: Ring inside a shared log or with lanes.
+ *      - LFRB_NO_MEM_ERROR: Block buffer could not be allocated, or mem->iter
+ *        is missing, smaller than one item or held by another iterator.
+ */
+int LFRingIterBegin(ringbuf_meta_t *meta, ringbuf_iter_t *it) {
+    memset(it, 0, sizeof(*it));
+    if(meta->log != NULL || meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+    it->cap = LFRB_LFS_BLOCK_SIZE / meta->item_size;
+    if(it->cap == 0) it->cap = 1;
+    ringbuf_static_t *mem = meta->mem;
+    if(mem != NULL) {
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        int claimed = mem->iter != NULL && mem->iter_size >= meta->item_size && !mem->iter_claimed;
+        if(claimed) mem->iter_claimed = 1;
+        xSemaphoreGive(meta->lock);
+        if(!claimed) return -LFRB_NO_MEM_ERROR;
+        if(it->cap > mem->iter_size / meta->item_size) it->cap = mem->iter_size / meta->item_size;
+        it->buf = mem->iter;
+    } else {
+        it->buf = malloc((size_t)it->cap * meta->item_size);
+        if(it->buf == NULL) return -LFRB_NO_MEM_ERROR;
+    }
+
+    // Lets LFRingIterEnd() find the ring if the snapshot fails
+    it->snap.meta = meta;
+    int status = LFRingSnapshotOpen(meta, &it->snap);
+    if(status < 0) {
+        LFRingIterEnd(it);
+        return status;
+    }
+    it->offset = it->snap.from;
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Step to the next item of a walk.
+ *
+ * @param it   Iterator set up by LFRingIterBegin().
+ * @param item Set to the item, valid until the next call.
+ *
+ * @return
+ *      - 1: @p item points to the next item.
+ *      - 0: All items were visited.
+ *      - LFRB_OFFSET_ERROR: Writers overwrote the rest of the walk.
+ *      - Other errors of LFRingSnapshotRead().
+ */
+int LFRingIterNext(ringbuf_iter_t *it, const void **item) {
+    if(it->pos == it->num) {
+        it->offset += it->num;
+        it->num = it->pos = 0;
+        int n = LFRingSnapshotRead(&it->snap, it->offset, it->buf, it->cap);
+        if(n <= 0) return n;
+        it->num = n;
+    }
+    *item = it->buf + (size_t)it->pos++ * it->snap.meta->item_size;
+    return 1;
+}
+
+/**
+ * @brief  Release an iterator set up by LFRingIterBegin().
+ *
+ * @param it Iterator to release.
+ */
+void LFRingIterEnd(ringbuf_iter_t *it) {
+    ringbuf_meta_t *meta = it->snap.meta;
+    LFRingSnapshotClose(&it->snap);
+    if(meta != NULL && meta->mem != NULL && it->buf == meta->mem->iter) {
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        meta->mem->iter_claimed = 0;
+        xSemaphoreGive(meta->lock);
+    } else {
+        free(it->buf);
+    }
+    it->buf = NULL;
+    it->num = it->pos = 0;
+}
+
+/**
+ * @brief LFRingScanRange() without a block buffer, for static rings.
+ *
+ * Each block is read into @p out_data behind the matches found so far and
+ * the matches are moved down over the rejected items.
+ */
+static int ringbuf_scan_in_place(ringbuf_meta_t *meta, uint64_t from, uint64_t to, ringbuf_pred_t pred, void *ctx,
+                                 void *out_data, size_t max) {
+    ringbuf_snapshot_t snap;
+    int status = LFRingSnapshotOpen(meta, &snap);
+    if(status < 0) return status;
+    uint64_t offset = from > snap.from ? from : snap.from;
+    uint64_t end = to < snap.to ? to : snap.to;
+    size_t block = LFRB_LFS_BLOCK_SIZE / meta->item_size > 0 ? LFRB_LFS_BLOCK_SIZE / meta->item_size : 1;
+    uint8_t *out = out_data;
+    size_t n = 0;
+    while(n < max && offset < end) {
+        size_t k = max - n < block ? max - n : block;
+        if(k > end - offset) k = end - offset;
+        status = LFRingSnapshotRead(&snap, offset, out + n * meta->item_size, k);
+        if(status <= 0) break;
+        size_t found = n;
+        for(int i = 0; i < status; i++) {
+            uint8_t *item = out + (n + i) * meta->item_size;
+            if(!pred(item, offset + i, ctx)) continue;
+            if(found != n + i) memmove(out + found * meta->item_size, item, meta->item_size);
+            found++;
+        }
+        offset += status;
+        n = found;
+    }
+    LFRingSnapshotClose(&snap);
+    return n > 0 || status >= 0 ? (int)n : status;
+}
+
+/**
+ * @brief  Copy out the retained items a filter accepts, without consuming.
+ *
+ * Same as LFRingScanRange() over every retained item.
+ */
+int LFRingScan(ringbuf_meta_t *meta, ringbuf_pred_t pred, void *ctx, void *out_data, size_t max) {
+    return LFRingScanRange(meta, 0, UINT64_MAX, pred, ctx, out_data, max);
+}
+
+/**
+ * @brief  Copy out the items of an offset range a filter accepts.
+ *
+ * Items are read a block at a time like LFRingIterNext() does and @p pred
+ * runs on them in the block buffer; only the matches are copied to
+ * @p out_data, oldest first. The ring mutex is not held while @p pred runs
+ * on raw rings. Rings set up with LFRingInitStatic() leave mem->iter to
+ * iterators: their blocks are read into the unused part of @p out_data
+ * instead and the matches are kept in place.
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param from     First logical offset to look at.
+ * @param to       Logical offset to stop at (exclusive), UINT64_MAX for head.
+ * @param pred     Called with each item and its offset, nonzero to copy it.
+ * @param ctx      Passed to @p pred.
+ * @param out_data Pointer to a buffer where the matching items will be stored.
+ * @param max      Maximum number of items to copy.
+ *
+ * @return >= 0 as number of items copied, or the errors of LFRingIterBegin()
+ *         and LFRingIterNext() if nothing was copied.
+ */
+int LFRingScanRange(ringbuf_meta_t *meta, uint64_t from, uint64_t to, ringbuf_pred_t pred, void *ctx, void *out_data, size_t max) {
+    if(meta->mem != NULL) return ringbuf_scan_in_place(meta, from, to, pred, ctx, out_data, max);
+    ringbuf_iter_t it;
+    int status = LFRingIterBegin(meta, &it);
+    if(status < 0) return status;
+    if(from > it.offset) it.offset = from;
+
+    size_t n = 0;
+    const void *item;
+    while(n < max && it.offset + it.pos < to && (status = LFRingIterNext(&it, &item)) == 1) {
+        if(pred(item, it.offset + it.pos - 1, ctx)) {
+            memcpy((uint8_t *)out_data + n * meta->item_size, item, meta->item_size);
+            n++;
+        }
+    }
+    LFRingIterEnd(&it);
+    return n > 0 || status >= 0 ? (int)n : status;
+}
+
+/**
+ * @brief  Aggregate a summarised field over a range of logical offsets.
+ *
+ * Blocks whose summary lies entirely inside the range and the live items
+ * are answered from <namespace>.agg; only the edge blocks (and blocks
+ * without a usable summary) are read. Nothing is consumed.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param field Schema index of a field named in agg_fields.
+ * @param from  First logical offset (inclusive).
+ * @param to    Last logical offset (exclusive), UINT64_MAX for head.
+ * @param out   Count, min, max and sum of the field; min/max are only set when count > 0.
+ *
+ * @return
+ *      - LFRB_OK: @p out filled in.
+ *      - LFRB_CONFIG_ERROR: @p field is not summarised.
+ */
+int LFRingAggregate(ringbuf_meta_t *meta, uint8_t field, uint64_t from, uint64_t to, ringbuf_agg_t *out) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(field >= LFRB_MAX_FIELDS || !(c->agg_mask & (1u << field))) return -LFRB_CONFIG_ERROR;
+    uint8_t k = __builtin_popcount(c->agg_mask & ((1u << field) - 1));
+    const ringbuf_field_t *fd = &c->fields[field];
+    out->count = 0;
+    out->min = DBL_MAX;
+    out->max = -DBL_MAX;
+    out->sum = 0;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+
+    load_ringbuf_meta(meta);
+    ringbuf_pending_need(meta, to);
+    uint64_t lo = from > meta->tail ? from : meta->tail;
+    uint64_t hi = to < meta->head ? to : meta->head;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "agg");
+    FILE *agg = fopen(path, "rb");
+
+    ringbuf_block_t blk;
+    // Raw blocks are addressed by offset; frames are walked from tail
+    int ok = lo < hi && (c->type == LFRB_CODEC_NONE ? ringbuf_block_at_offset(meta, lo, &blk) : ringbuf_block_first(meta, &blk));
+    for(; ok; ok = ringbuf_block_next(meta, &blk)) {
+        ringbuf_block_stats_t rec;
+        int have = blk.index != UINT32_MAX && ringbuf_stats_get(meta, agg, blk.index, &rec) && rec.first >= meta->tail;
+        if(c->type == LFRB_CODEC_NONE || have) {
+            // Live items of the block, known without reading it
+            uint64_t bs = c->type == LFRB_CODEC_NONE ? blk.offset : rec.first + blk.first;
+            uint64_t be = c->type == LFRB_CODEC_NONE ? blk.offset + blk.num : rec.first + rec.count;
+            if(bs >= hi) break;
+            if(be <= lo) continue;
+            if(have && rec.first == (bs > lo ? bs : lo) && rec.first + rec.count == (be < hi ? be : hi)) {
+                if(rec.f[k].min < out->min) out->min = rec.f[k].min;
+                if(rec.f[k].max > out->max) out->max = rec.f[k].max;
+                out->sum += rec.f[k].sum;
+                out->count += rec.count;
+                continue;
+            }
+        }
+        const uint8_t *rows = ringbuf_block_rows(meta, &blk);
+        if(rows == NULL) continue;
+        if(blk.offset >= hi) break;
+        for(uint32_t i = 0; i < blk.num && blk.offset + i < hi; i++) {
+            if(blk.offset + i < lo) continue;
+            double v = ringbuf_field_value(rows + i * meta->item_size, fd);
+            if(v < out->min) out->min = v;
+            if(v > out->max) out->max = v;
+            out->sum += v;
+            out->count++;
+        }
+    }
+    if(agg != NULL) fclose(agg);
+
+    xSemaphoreGive(meta->lock);
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Fold items into a coarser ring before they are overwritten.
+ *
+ * When a write is about to overwrite unread items, they are read first and
+ * passed to @p fold, oldest first, and the records it produces (e.g. one
+ * min/avg/max record per minute) are written to @p rollup. The rollup ring
+ * keeps a long horizon at a fraction of the flash; items consumed by a
+ * reader are not folded. The rollup ring is written under this ring's
+ * mutex, so tiers that would lead back to this ring are refused: the
+ * mutexes are then always taken in tier order.
+ *
+ * Rings set up with LFRingInitStatic() take the buffers from mem->rollup,
+ * sized with LFRB_ROLLUP_BYTES() for mem->rollup_items items.
+ *
+ * @param meta   Pointer to the ring buffer metadata structure.
+ * @param rollup Ring receiving the records, NULL to disable.
+ * @param fold   Turns items into records of @p rollup's item size.
+ * @param ctx    Passed to @p fold.
+ *
+ * @return
+ *      - LFRB_OK: Rollup set up (or removed).
+ *      - LFRB_CONFIG_ERROR: Ring inside a shared log (its records are evicted, not overwritten),
+ *        ring with lanes, or @p rollup is the ring itself or rolls up into it.
+ *      - LFRB_NO_MEM_ERROR: Buffers could not be allocated, or mem->rollup is missing.
+ */
+int LFRingSetRollup(ringbuf_meta_t *meta, ringbuf_meta_t *rollup, ringbuf_fold_t fold, void *ctx) {
+    if(meta->log != NULL || meta->lanes.num != 0 || (rollup != NULL && fold == NULL)) return -LFRB_CONFIG_ERROR;
+    if(ringbuf_rollup_reaches(rollup, meta)) {
+        ESP_LOGE(TAG, "LFRingSetRollup: %s would roll up into itself", meta->nvs_namespace);
+        return -LFRB_CONFIG_ERROR;
+    }
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    ringbuf_rollup_release(meta);
+    int status = LFRB_OK;
+    if(rollup != NULL) {
+        ringbuf_rollup_t *r = &meta->rollup;
+        if(meta->mem != NULL) {
+            r->cap = meta->mem->rollup != NULL ? meta->mem->rollup_items : 0;
+            if(r->cap > 0) {
+                r->buf = meta->mem->rollup;
+                r->out = meta->mem->rollup + (size_t)r->cap * meta->item_size;
+            }
+        } else {
+            r->cap = LFRB_LFS_BLOCK_SIZE / meta->item_size;
+            if(r->cap == 0) r->cap = 1;
+            if(meta->codec.type == LFRB_CODEC_NONE) r->buf = malloc((size_t)r->cap * meta->item_size);
+            r->out = malloc((size_t)r->cap * rollup->item_size);
+        }
+        if(r->out == NULL || (meta->codec.type == LFRB_CODEC_NONE && r->buf == NULL)) {
+            ringbuf_rollup_release(meta);
+            status = -LFRB_NO_MEM_ERROR;
+        } else {
+            r->fold = fold;
+            r->ctx = ctx;
+            r->ring = rollup;
+        }
+    }
+    xSemaphoreGive(meta->lock);
+    return status;
+}
+
+/**
+ * @brief  Get notified when items can be read, instead of polling.
+ *
+ * @p wake is called after every write that adds items: LFRingWrite(),
+ * LFRingWriteAsync(), items collected from LFRingWriteFromISR() and stream
+ * buffers once written. It runs in the writer's context with the ring's
+ * lock held, so it must only signal (give a semaphore, notify a task, post
+ * to an executor) and leave the reading to the consumer.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param wake Callback, NULL to remove it.
+ * @param ctx  Passed to @p wake.
+ *
+ * @return LFRB_OK.
+ */
+int LFRingSetWake(ringbuf_meta_t *meta, ringbuf_wake_t wake, void *ctx) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    meta->wake = wake;
+    meta->wake_ctx = ctx;
+    xSemaphoreGive(meta->lock);
+    return LFRB_OK;
+}
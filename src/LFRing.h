@@ -3,6 +3,7 @@
 #include "nvs_flash.h"
 #include "esp_vfs.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 
 #ifndef LFRING_H
 #define LFRING_H
@@ -12,6 +13,23 @@ extern "C" {
 #endif
 
 #define LFRB_MAX_PATH 64
+#define LFRB_MAX_FIELDS 32
+#define LFRB_DEFAULT_BLOCK_ITEMS 32
+#define LFRB_DEFAULT_FRAME_SIZE 512
+#define LFRB_ALL_FIELDS 0xFFFFFFFFu
+#define LFRB_LOG_MAX_RINGS 16
+#define LFRB_LOG_SYNC_RECORDS 64    // appends and reads between two shared log checkpoints
+#define LFRB_FLUSH_MAX_RINGS 16     // rings serviced by the flush task
+#define LFRB_FLUSH_RETRY_MS 100     // delay before a failed flush is retried
+#define LFRB_LFS_BLOCK_SIZE 4096    // LittleFS block size, unit of the read-ahead cache
+#define LFRB_AGG_MAX_FIELDS 4       // schema fields with per-block summaries
+#define LFRB_MIGRATE_BOOT_CHUNKS 8  // migration chunks copied by init, see LFRingVerify()
+#define LFRB_MIGRATE_CHUNK 16       // items of a raw ring copied per migration chunk
+#define LFRB_LANE_MAX 8             // priority lanes of one ring, see LFRingInitLanes()
+#define LFRB_LANE_BATCH 16          // items of a lane write committed together
+
+// ringbuf_config_t flags
+#define LFRB_TIME_INDEX 0x01        // keep a per-block timestamp index
 
 typedef enum {
     LFRB_OK = 0,
@@ -19,23 +37,416 @@ typedef enum {
     LFRB_LFS_ERROR = 2,
     LFRB_ROOT_NOT_FOUND_ERROR = 3,
     LFRB_NFILE_ERROR = 4,
-    LFRB_ENUM_EXCEED = 5
+    LFRB_ENUM_EXCEED = 5,
+    LFRB_CONFIG_ERROR = 6,
+    LFRB_NO_MEM_ERROR = 7,
+    LFRB_CORRUPT_ERROR = 8,
+    LFRB_OFFSET_ERROR = 9
 } ringbuf_error_t;
 
+typedef enum {
+    LFRB_FIELD_INT = 0,     // signed integer, delta-encoded
+    LFRB_FIELD_UINT = 1,    // unsigned integer, delta-encoded
+    LFRB_FIELD_FLOAT = 2,   // IEEE-754 float/double, XOR-encoded
+    LFRB_FIELD_RAW = 3      // opaque bytes, XOR-encoded
+} ringbuf_field_type_t;
+
+typedef enum {
+    LFRB_CODEC_NONE = 0,    // items stored verbatim, one slot per item
+    LFRB_CODEC_DELTA = 1,   // delta/XOR residuals bit-packed per block, one column per field
+    LFRB_CODEC_COLUMNAR = 2 // plain per-field columns per block
+} ringbuf_codec_type_t;
+
+// What LFRingWriteAsync() does when the pending buffer is full.
+typedef enum {
+    LFRB_OVERFLOW_BLOCK = 0,    // write the pending items out in the caller
+    LFRB_OVERFLOW_DROP_NEW = 1, // queue only what fits
+    LFRB_OVERFLOW_DROP_OLD = 2  // discard the oldest pending items, like the ring overwrites its oldest;
+                                // pending items get their offsets when written
+} ringbuf_overflow_t;
+
+// One numeric field inside a fixed-layout item.
+typedef struct {
+    uint16_t offset;        // byte offset inside the item
+    uint8_t width;          // 1, 2, 4 or 8 bytes
+    uint8_t type;           // ringbuf_field_type_t
+} ringbuf_field_t;
+
+// Converts one stored item to the new layout when itemSize changes.
+typedef void (*ringbuf_convert_t)(const void *old_item, uint32_t old_size, void *new_item, uint32_t new_size, void *ctx);
+
+// Optional settings for LFRingInitEx(). Zeroed fields select the defaults.
+typedef struct {
+    const ringbuf_field_t *fields;  // item schema
+    uint8_t field_num;
+    uint8_t codec;                  // ringbuf_codec_type_t
+    uint16_t block_items;           // max items per encoded block
+    uint16_t frame_size;            // bytes reserved per encoded block on flash
+    uint8_t flags;                  // LFRB_TIME_INDEX, ...
+    uint8_t ts_field;               // schema index of the timestamp field
+    uint32_t agg_fields;            // numeric schema fields summarised per block (bit i = fields[i])
+    ringbuf_convert_t convert;      // migrates stored items to a new itemSize (raw rings)
+    void *convert_ctx;
+} ringbuf_config_t;
+
+// Caller-provided memory of a ring set up with LFRingInitStatic(). Size the
+// buffers with the LFRB_*_BYTES() macros; a feature whose buffer is NULL
+// fails with LFRB_NO_MEM_ERROR instead of falling back to the heap.
+typedef struct {
+    StaticSemaphore_t lock;         // storage of the ring's mutex
+    uint8_t *codec;                 // block buffers of rings with a schema
+    uint32_t codec_size;            // bytes, LFRB_CODEC_BYTES()
+    uint8_t *pending;               // LFRingSetFlush() buffer
+    uint32_t pending_items;
+    uint8_t *isr;                   // LFRingSetISR() staging ring, internal RAM
+    uint32_t isr_items;
+    uint8_t *cache;                 // LFRingSetReadAhead() window
+    uint32_t cache_blocks;
+    uint8_t *rollup;                // LFRingSetRollup() item and record buffers
+    uint32_t rollup_items;          // items per fold call
+    uint8_t *stream;                // LFRingSetStream() double buffer
+    uint32_t stream_items;          // items per buffer
+    StaticSemaphore_t stream_lock;  // storage of the stream's semaphores
+    StaticSemaphore_t stream_free;
+    uint8_t *scratch;               // LFRingDrainTo() chunks, geometry migration copies
+    uint32_t scratch_size;          // bytes, LFRB_SCRATCH_BYTES()
+    uint8_t *iter;                  // LFRingIterBegin() block buffer, one iterator at a time
+    uint32_t iter_size;             // bytes, LFRB_ITER_BYTES()
+    uint8_t iter_claimed;           // set while an iterator holds iter
+} ringbuf_static_t;
+
+// Bytes of the ringbuf_static_t buffers, usable in array sizes. frameSize is
+// the configured frame_size of an encoded ring (which must be set explicitly),
+// 0 for a raw ring with a schema; blockItems is 0 for a ring without schema.
+#define LFRB_CODEC_BYTES(itemSize, blockItems, frameSize) \
+    ((frameSize) ? 2u * (blockItems) * (itemSize) + (frameSize) : (blockItems) * (itemSize))
+#define LFRB_ITEMS_BYTES(itemSize, items) ((items) * (itemSize))
+#define LFRB_CACHE_BYTES(blocks) ((blocks) * LFRB_LFS_BLOCK_SIZE)
+#define LFRB_ROLLUP_BYTES(itemSize, recordSize, items) ((items) * ((itemSize) + (recordSize)))
+#define LFRB_STREAM_BYTES(itemSize, items) (2u * (items) * (itemSize))
+// itemSize is the larger of the stored and the new item size if a migration
+// converts items. Drains copy as many items per chunk as fit, here
+// 2 * LFRB_MIGRATE_CHUNK, and never more than one LittleFS block.
+#define LFRB_SCRATCH_BYTES(itemSize) (2u * LFRB_MIGRATE_CHUNK * (itemSize))
+// One LittleFS block of whole items, or one item if larger; smaller buffers
+// make iterators read fewer items at a time.
+#define LFRB_ITER_BYTES(itemSize) \
+    ((itemSize) > LFRB_LFS_BLOCK_SIZE ? (itemSize) : LFRB_LFS_BLOCK_SIZE / ((itemSize) ? (itemSize) : 1u) * (itemSize))
+// Whole static footprint of one ring besides its ringbuf_meta_t. Pass 0 for
+// the features not used; scratchItemSize is the itemSize of LFRB_SCRATCH_BYTES(),
+// iterators is 1 if LFRingIterBegin() is used.
+#define LFRB_STATIC_BYTES(itemSize, blockItems, frameSize, pendingItems, isrItems, cacheBlocks, \
+                          rollupRecordSize, rollupItems, streamItems, scratchItemSize, iterators) \
+    (sizeof(ringbuf_static_t) + LFRB_CODEC_BYTES(itemSize, blockItems, frameSize) + \
+     LFRB_ITEMS_BYTES(itemSize, pendingItems) + LFRB_ITEMS_BYTES(itemSize, isrItems) + LFRB_CACHE_BYTES(cacheBlocks) + \
+     LFRB_ROLLUP_BYTES(itemSize, rollupRecordSize, rollupItems) + \
+     LFRB_STREAM_BYTES(itemSize, streamItems) + LFRB_SCRATCH_BYTES(scratchItemSize) + \
+     ((iterators) ? LFRB_ITER_BYTES(itemSize) : 0u))
+
+// Receives a chunk of whole items from LFRingDrainTo(). Returns the number of
+// bytes it accepted; fewer than len stops the drain.
+typedef size_t (*ringbuf_sink_t)(const void *data, size_t len, void *ctx);
+
+// Folds items about to be overwritten into records of the rollup ring, see
+// LFRingSetRollup(). Called with the oldest items first; writes up to max
+// records to out and returns how many. State spanning calls (e.g. the
+// current minute) lives in ctx.
+typedef size_t (*ringbuf_fold_t)(const void *items, size_t num, void *out, size_t max, void *ctx);
+
+// Filter of LFRingScan(): returns nonzero for the items to copy out.
+typedef int (*ringbuf_pred_t)(const void *item, uint64_t offset, void *ctx);
+
+// Called with the ring's lock held once new items can be read, see
+// LFRingSetWake(). Must only signal a consumer, not access the ring.
+typedef void (*ringbuf_wake_t)(void *ctx);
+
+// Current time in the unit of the timestamp field, see LFRingSetTTL().
+typedef uint64_t (*ringbuf_clock_t)(void *ctx);
+
+// Storage operations reported to the fault hook, see LFRingSetFaultHook().
+typedef enum {
+    LFRB_FAULT_LFS = 0,         // a write, truncate or rename on LittleFS
+    LFRB_FAULT_NVS = 1          // an NVS commit
+} ringbuf_fault_op_t;
+
+// Called right before each storage operation. seq counts operations since
+// the hook was installed; a test harness cuts power by not returning.
+typedef void (*ringbuf_fault_t)(uint8_t op, uint32_t seq, void *ctx);
+
+// Called by the flush task once items are durable. durable is one past the
+// logical offset of the newest durable item, status the result of the flush.
+typedef void (*ringbuf_done_t)(uint64_t durable, int status, void *ctx);
+
+// Sparse time index entry, one per block
+typedef struct {
+    uint64_t ts_min;
+    uint64_t ts_max;
+} ringbuf_block_index_t;
+
+// Per-block summary of the fields in agg_fields, one per block in <namespace>.agg
+typedef struct {
+    uint64_t first;                 // logical offset of the first item summarised
+    uint32_t count;                 // items summarised, all stored in this block
+    uint32_t mask;                  // agg_fields the entry was built for
+    struct {
+        double min;
+        double max;
+        double sum;
+    } f[LFRB_AGG_MAX_FIELDS];       // one per bit of mask, lowest first
+} ringbuf_block_stats_t;
+
+// Result of LFRingAggregate().
+typedef struct {
+    uint64_t count;
+    double min;
+    double max;
+    double sum;
+} ringbuf_agg_t;
+
+// Runtime state of the block codec.
 typedef struct {
+    uint8_t type;                   // ringbuf_codec_type_t
+    uint8_t field_num;              // schema fields plus generated gap fields
+    uint8_t user_field_num;         // fields supplied by the caller
+    uint8_t flags;
+    uint8_t ts_field;
+    ringbuf_field_t fields[LFRB_MAX_FIELDS];
+    uint16_t block_items;
+    uint16_t frame_size;
+    uint32_t frame_num;
+    uint32_t layout_hash;
+    uint64_t frame_head;            // sequence number of the next sealed frame
+    uint64_t frame_tail;            // sequence number of the oldest live frame
+    uint32_t tail_pos;              // items already read from the block at frame_tail
+    uint32_t open_num;              // items staged in the open block
+    uint8_t open_bits[LFRB_MAX_FIELDS];
+    uint8_t *open_buf;              // open block, row format
+    uint8_t *frame_buf;             // encode/decode scratch, frame_size bytes
+    uint8_t *dec_buf;               // decoded rows of frame dec_seq
+    uint64_t dec_seq;
+    uint64_t dec_first;             // logical offset of the first item in dec_buf
+    uint32_t dec_mask;              // fields decoded in dec_buf
+    uint32_t dec_num;
+    uint8_t *scan_buf;              // block read buffer of raw rings
+    ringbuf_convert_t convert;
+    void *convert_ctx;
+    ringbuf_block_index_t idx_cur;  // index entry of the block at head
+    uint32_t idx_block;
+    uint32_t agg_mask;              // agg_fields
+    ringbuf_block_stats_t agg_cur;  // summary of the block at head (raw rings)
+    uint32_t agg_block;
+} ringbuf_codec_t;
+
+// State of one logical ring inside a shared log.
+typedef struct {
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t item_size;
+    uint32_t item_num;
+    uint64_t head;                  // logical offset of the next item written
+    uint64_t tail;                  // logical offset of the oldest unread item
+    uint64_t pos;                   // log position to search for tail from
+} ringbuf_log_ring_t;
+
+// Physical log shared by several logical rings, see LFRingLogInit().
+typedef struct {
+    char root[ESP_VFS_PATH_MAX];
+    char nvs_namespace[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t capacity;              // bytes of <namespace>.log
+    uint64_t head;                  // log position of the next record
+    uint64_t tail;                  // log position of the oldest record
+    uint32_t unsynced;              // appends and reads since the last checkpoint
+    uint64_t synced;                // head of the last checkpoint, where replay starts
+    uint8_t ring_num;
+    ringbuf_log_ring_t rings[LFRB_LOG_MAX_RINGS];
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_buf;         // storage of lock, the log needs no heap
+} ringbuf_log_t;
+
+// Items accepted by LFRingWrite() and not yet written, see LFRingSetFlush().
+typedef struct {
+    uint8_t *buf;
+    uint32_t cap;                   // capacity in items, 0 for synchronous writes
+    uint32_t num;
+    uint8_t priority;               // rings with a higher priority are flushed first
+    uint32_t deadline_ms;           // maximum age of a pending item, 0 for none
+    int64_t since;                  // esp_timer time of the oldest pending item
+    uint8_t overflow;               // ringbuf_overflow_t, see LFRingSetAsync()
+    int status;                     // result of the last flush
+    uint64_t durable;               // offsets below are written and committed
+    uint64_t notified;              // durable offset last reported to done
+    ringbuf_done_t done;
+    void *done_ctx;
+} ringbuf_pending_t;
+
+// Read-ahead window over the data file of a raw ring, see LFRingSetReadAhead().
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;                  // capacity in bytes, 0 if disabled
+    uint32_t len;                   // valid bytes
+    uint64_t pos;                   // file position of buf[0]
+} ringbuf_cache_t;
+
+// Ping-pong buffers of LFRingWriteStream(), see LFRingSetStream().
+typedef struct {
+    uint8_t *buf[2];
+    uint32_t cap;                   // capacity of each buffer in items, 0 if unused
+    uint32_t num;                   // items in the buffer being filled
+    uint8_t fill;                   // index of the buffer being filled
+    uint8_t busy;                   // state of the other buffer: free, full or being written
+    uint32_t busy_num;              // items in the other buffer
+    uint32_t waiters;               // tasks blocked on free
+    SemaphoreHandle_t lock;         // guards the fields above, never held across flash I/O
+    SemaphoreHandle_t free;         // given when the other buffer has been written and a task waits
+} ringbuf_stream_t;
+
+// Lock-free staging ring filled by LFRingWriteFromISR(), see LFRingSetISR().
+typedef struct {
+    uint8_t *buf;                   // internal RAM
+    uint32_t cap;                   // capacity in items, power of two, 0 if unused
+    uint32_t head;                  // advanced by the ISR only
+    uint32_t tail;                  // advanced by the flush task only
+    uint32_t dropped;               // items rejected because the staging ring was full
+} ringbuf_isr_t;
+
+// Init timing and deferred verification of one ring, see LFRingVerify().
+typedef struct {
+    uint32_t migrate_us;            // resuming or running a geometry migration
+    uint32_t meta_us;               // loading and checking the offsets from NVS
+    uint32_t lfs_us;                // checking the root, resetting an empty data file
+    uint32_t stage_us;              // reloading the open block of an encoded ring
+    uint32_t total_us;              // whole LFRingInitEx()/LFRingInitShared()
+    uint64_t verify_next;           // next frame (encoded) or offset (raw) LFRingVerify() checks, UINT64_MAX once done
+    uint64_t verify_end;            // frame_head or head at init, later ones were written by this boot
+    uint32_t corrupt;               // corrupt blocks (encoded) or missing items (raw) found
+    uint32_t migrate_size;          // stored item size while a migration is left to finish, 0 otherwise
+    uint32_t migrate_num;           // stored item number while a migration is left to finish
+    uint64_t migrate_next;          // next offset (raw) or frame (encoded) the migration copies
+} ringbuf_boot_t;
+
+// Coarser ring fed with the items a ring overwrites, see LFRingSetRollup().
+typedef struct {
+    struct ringbuf_meta *ring;      // receives the records, NULL if unused
+    ringbuf_fold_t fold;
+    void *ctx;
+    uint8_t *buf;                   // items read before they are overwritten (raw rings)
+    uint8_t *out;                   // records produced by fold
+    uint32_t cap;                   // items per fold call
+} ringbuf_rollup_t;
+
+// Expiry of unread items, see LFRingSetTTL().
+typedef struct {
+    uint64_t ttl;                   // lifetime in the unit of the timestamp field
+    ringbuf_clock_t clock;          // NULL if items never expire
+    void *ctx;
+    uint64_t expired;               // items skipped unread since init
+} ringbuf_ttl_t;
+
+// Priority lanes of a ring set up with LFRingInitLanes(). Lane i holds the
+// items written with priority i, oldest first; slots are shared by all lanes.
+typedef struct {
+    uint8_t num;                    // lanes, 0 for a ring without lanes
+    uint32_t *next;                 // per slot: next slot of the same lane or of the free list
+    uint8_t *buf;                   // one slot, header and item
+    uint32_t free;                  // first free slot, UINT32_MAX if none
+    uint64_t head[LFRB_LANE_MAX];   // lane offset of the next item written
+    uint64_t tail[LFRB_LANE_MAX];   // lane offset below which items are read or evicted
+    uint32_t first[LFRB_LANE_MAX];  // slot of the oldest item
+    uint32_t last[LFRB_LANE_MAX];   // slot of the newest item
+    uint32_t count[LFRB_LANE_MAX];  // items held
+    uint64_t evicted[LFRB_LANE_MAX];    // items lost to overflow since init
+} ringbuf_lanes_t;
+
+typedef struct ringbuf_meta {
     char root[ESP_VFS_PATH_MAX];
     char nvs_namespace[NVS_KEY_NAME_MAX_SIZE];
-    uint32_t head;
-    uint32_t tail;
+    uint64_t head;                  // logical offset of the next item written
+    uint64_t tail;                  // logical offset of the oldest unread item
     uint32_t item_size;
     uint32_t item_num;
+    uint32_t slot_mask;             // item_num - 1 if item_num is a power of two, else 0
     SemaphoreHandle_t lock;
+    ringbuf_codec_t codec;
+    ringbuf_log_t *log;             // shared log, NULL for a ring with its own file
+    uint8_t log_ring;               // index in log->rings
+    ringbuf_lanes_t lanes;
+    ringbuf_pending_t pending;
+    ringbuf_isr_t isr;
+    ringbuf_stream_t stream;
+    ringbuf_cache_t cache;
+    uint8_t dirty;                  // head/tail changed since the last NVS commit
+    ringbuf_boot_t boot;
+    ringbuf_rollup_t rollup;
+    ringbuf_ttl_t ttl;
+    ringbuf_wake_t wake;            // NULL if no consumer waits for items
+    void *wake_ctx;
+    ringbuf_static_t *mem;          // caller-provided buffers, NULL if allocated
 } ringbuf_meta_t;
 
+// Stable view of the items retained when LFRingSnapshotOpen() was called.
+typedef struct {
+    ringbuf_meta_t *meta;
+    uint64_t from;                  // tail when opened
+    uint64_t to;                    // head when opened
+    uint64_t seq;                   // frame holding from (encoded rings)
+} ringbuf_snapshot_t;
+
+// Non-consuming walk over the retained items, see LFRingIterBegin().
+typedef struct {
+    ringbuf_snapshot_t snap;
+    uint64_t offset;                // logical offset of buf[0]
+    uint8_t *buf;                   // items read ahead
+    uint32_t cap;                   // capacity of buf in items
+    uint32_t num;                   // items in buf
+    uint32_t pos;                   // next item of buf returned
+} ringbuf_iter_t;
+
 int LFRingInit(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum);
+int LFRingInitEx(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config);
+int LFRingInitStatic(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config, ringbuf_static_t *mem);
+void LFRingDeinit(ringbuf_meta_t *meta);
 int LFRingIsEmpty(ringbuf_meta_t *meta);
 int LFRingWrite(ringbuf_meta_t *meta, void* data, size_t num);
 int LFRingRead(ringbuf_meta_t *meta, void* out_data, size_t num);
+int LFRingReadColumns(ringbuf_meta_t *meta, uint32_t field_mask, void* out_data, size_t num);
+int LFRingSeekTime(ringbuf_meta_t *meta, uint64_t ts);
+int LFRingSetTTL(ringbuf_meta_t *meta, uint64_t ttl, ringbuf_clock_t clock, void *ctx);
+int LFRingReadRange(ringbuf_meta_t *meta, uint64_t from, uint64_t to, void* out_data, size_t max);
+int LFRingReadAt(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num);
+uint64_t LFRingOldestOffset(ringbuf_meta_t *meta);
+uint64_t LFRingNewestOffset(ringbuf_meta_t *meta);
+int LFRingLogInit(ringbuf_log_t *log, const char *root, const char *nvs_namespace, uint32_t capacity);
+int LFRingInitShared(ringbuf_meta_t *meta, ringbuf_log_t *log, const char *name, uint32_t itemSize, uint32_t itemNum);
+int LFRingLogSync(ringbuf_log_t *log);
+void LFRingLogDeinit(ringbuf_log_t *log);
+int LFRingInitLanes(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, uint8_t laneNum);
+int LFRingWriteLane(ringbuf_meta_t *meta, uint8_t lane, const void* data, size_t num);
+int LFRingFlushStart(UBaseType_t taskPriority, uint32_t stackSize);
+int LFRingFlushStartStatic(UBaseType_t taskPriority, uint32_t stackSize, StackType_t *stack, StaticTask_t *task);
+void LFRingFlushStop(void);
+int LFRingSetFlush(ringbuf_meta_t *meta, uint32_t pendingItems, uint8_t priority, uint32_t deadlineMs);
+int LFRingFlush(ringbuf_meta_t *meta);
+int LFRingSetAsync(ringbuf_meta_t *meta, uint8_t overflow, ringbuf_done_t done, void *ctx);
+int LFRingWriteAsync(ringbuf_meta_t *meta, const void* data, size_t num);
+uint64_t LFRingDurableOffset(ringbuf_meta_t *meta);
+int LFRingSetISR(ringbuf_meta_t *meta, uint32_t stagingItems);
+int LFRingWriteFromISR(ringbuf_meta_t *meta, const void* data, size_t num);
+int LFRingSetStream(ringbuf_meta_t *meta, uint32_t bufferItems);
+int LFRingWriteStream(ringbuf_meta_t *meta, const void* data, size_t num);
+int LFRingSetReadAhead(ringbuf_meta_t *meta, uint32_t blocks);
+void LFRingSetFaultHook(ringbuf_fault_t hook, void *ctx);
+int LFRingVerify(ringbuf_meta_t *meta, uint32_t maxBlocks);
+int LFRingDrainTo(ringbuf_meta_t *meta, ringbuf_sink_t sink, void *ctx, size_t maxBytes);
+int LFRingSnapshotOpen(ringbuf_meta_t *meta, ringbuf_snapshot_t *snap);
+int LFRingSnapshotRead(ringbuf_snapshot_t *snap, uint64_t offset, void* out_data, size_t num);
+void LFRingSnapshotClose(ringbuf_snapshot_t *snap);
+int LFRingIterBegin(ringbuf_meta_t *meta, ringbuf_iter_t *it);
+int LFRingIterNext(ringbuf_iter_t *it, const void **item);
+void LFRingIterEnd(ringbuf_iter_t *it);
+int LFRingScan(ringbuf_meta_t *meta, ringbuf_pred_t pred, void *ctx, void *out_data, size_t max);
+int LFRingSetRollup(ringbuf_meta_t *meta, ringbuf_meta_t *rollup, ringbuf_fold_t fold, void *ctx);
+int LFRingAggregate(ringbuf_meta_t *meta, uint8_t field, uint64_t from, uint64_t to, ringbuf_agg_t *out);
+int LFRingScanRange(ringbuf_meta_t *meta, uint64_t from, uint64_t to, ringbuf_pred_t pred, void *ctx, void *out_data, size_t max);
+int LFRingSetWake(ringbuf_meta_t *meta, ringbuf_wake_t wake, void *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "LFRing.h"
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define LFRING_HAS_SPAN 1
+#endif
+
+namespace lfring {
+
+// Typed ring of N items of T over the C API. Every member forwards to one
+// LFRing*() call with the geometry as compile-time constants; errors are the
+// negative LFRB_* codes of the C functions. Opened rings are closed (pending
+// and streamed items written out) when the object goes out of scope.
+//
+// The object holds the ringbuf_meta_t the library registers with the flush
+// task and rollup rings, so it can be neither copied nor moved.
+template <typename T, uint32_t N>
+class Ring {
+    static_assert(std::is_trivially_copyable<T>::value, "items are stored as raw bytes");
+    static_assert(sizeof(T) <= UINT32_MAX, "item too large");
+    static_assert(N > 0, "ring needs at least one item");
+
+public:
+    static constexpr uint32_t item_size = sizeof(T);
+    static constexpr uint32_t item_num = N;
+
+    Ring() = default;
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+    ~Ring() { close(); }
+
+    int open(const char *root, const char *nvs_namespace, const ringbuf_config_t *config = nullptr) {
+        close();
+        int status = LFRingInitEx(&meta_, root, nvs_namespace, item_size, item_num, config);
+        open_ = status >= 0;
+        return status;
+    }
+
+    int open_static(const char *root, const char *nvs_namespace, ringbuf_static_t *mem, const ringbuf_config_t *config = nullptr) {
+        close();
+        int status = LFRingInitStatic(&meta_, root, nvs_namespace, item_size, item_num, config, mem);
+        open_ = status >= 0;
+        return status;
+    }
+
+    int open_shared(ringbuf_log_t *log, const char *name) {
+        close();
+        int status = LFRingInitShared(&meta_, log, name, item_size, item_num);
+        open_ = status >= 0;
+        return status;
+    }
+
+    void close() {
+        if(!open_) return;
+        LFRingDeinit(&meta_);
+        open_ = false;
+    }
+
+    bool is_open() const { return open_; }
+    bool empty() { return LFRingIsEmpty(&meta_) != 0; }
+
+    int write(const T &item) { return write(&item, 1); }
+    int write(const T *items, size_t num) { return LFRingWrite(&meta_, const_cast<T *>(items), num); }
+    int read(T &item) { return read(&item, 1); }
+    int read(T *items, size_t num) { return LFRingRead(&meta_, items, num); }
+    int read_at(uint64_t offset, T *items, size_t num) { return LFRingReadAt(&meta_, offset, items, num); }
+
+#ifdef LFRING_HAS_SPAN
+    int write(std::span<const T> items) { return write(items.data(), items.size()); }
+    int read(std::span<T> items) { return read(items.data(), items.size()); }
+    int read_at(uint64_t offset, std::span<T> items) { return read_at(offset, items.data(), items.size()); }
+#endif
+
+    int flush() { return LFRingFlush(&meta_); }
+    uint64_t oldest_offset() { return LFRingOldestOffset(&meta_); }
+    uint64_t newest_offset() { return LFRingNewestOffset(&meta_); }
+
+    // The underlying ring, for the parts of the C API not wrapped here.
+    ringbuf_meta_t *meta() { return &meta_; }
+
+private:
+    ringbuf_meta_t meta_{};
+    bool open_ = false;
+};
+
+} // namespace lfring
@@ -0,0 +1,236 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include "LFRing.hpp"
+
+#ifndef LFRING_EXECUTOR_QUEUE
+#define LFRING_EXECUTOR_QUEUE 32    // work items an Executor holds at once
+#endif
+
+namespace lfring {
+
+// Single-threaded executor: run() executes posted work in the calling task,
+// one item at a time, and sleeps while the queue is empty. post() may be
+// called from any task. Uses only the standard library, so consumers can be
+// run and tested on the host as well.
+//
+// The queue has a fixed size. Each Consumer has at most one poll queued and
+// each suspended Task at most one resumption, so LFRING_EXECUTOR_QUEUE only
+// has to cover the consumers and tasks of one executor.
+class Executor {
+public:
+    using Fn = void (*)(void *arg);
+
+    Executor() = default;
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    // Queue fn(arg). Returns false if the queue is full.
+    bool post(Fn fn, void *arg) {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if(num_ == LFRING_EXECUTOR_QUEUE) return false;
+            q_[(head_ + num_) % LFRING_EXECUTOR_QUEUE] = {fn, arg};
+            num_++;
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    bool post(std::coroutine_handle<> h) { return post(&Executor::resume, h.address()); }
+
+    // Run until stop() is called.
+    void run() {
+        for(;;) {
+            Work w;
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                cv_.wait(lock, [this] { return num_ > 0 || stop_; });
+                if(stop_) {
+                    stop_ = false;
+                    return;
+                }
+                w = pop();
+            }
+            w.fn(w.arg);
+        }
+    }
+
+    // Run the work queued now without waiting. Returns the number of items run.
+    size_t poll() {
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            n = num_;
+        }
+        for(size_t i = 0; i < n; i++) {
+            Work w;
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                w = pop();
+            }
+            w.fn(w.arg);
+        }
+        return n;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    // co_await exec.yield() lets the other queued work run first.
+    auto yield() {
+        struct Awaiter {
+            Executor *exec;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) { return exec->post(h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{this};
+    }
+
+private:
+    struct Work {
+        Fn fn;
+        void *arg;
+    };
+
+    static void resume(void *arg) { std::coroutine_handle<>::from_address(arg).resume(); }
+
+    Work pop() {
+        Work w = q_[head_];
+        head_ = (head_ + 1) % LFRING_EXECUTOR_QUEUE;
+        num_--;
+        return w;
+    }
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    Work q_[LFRING_EXECUTOR_QUEUE];
+    size_t head_ = 0;
+    size_t num_ = 0;
+    bool stop_ = false;
+};
+
+// Fire-and-forget coroutine started with spawn(). The frame is allocated
+// once when the coroutine is called and freed when it returns.
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Start a Task on an executor. Returns false if the queue is full; the
+// task is then destroyed without having run.
+inline bool spawn(Executor &exec, Task task) {
+    if(exec.post(task.handle)) return true;
+    task.handle.destroy();
+    return false;
+}
+
+// Awaitable reader of a Ring. Writers wake it through LFRingSetWake(), so a
+// waiting consumer costs nothing until items arrive; the read itself then
+// runs in the executor's task. One coroutine at a time may await a consumer,
+// and the consumer must outlive it.
+template <typename T, uint32_t N>
+class Consumer {
+public:
+    Consumer(Ring<T, N> &ring, Executor &exec) : ring_(ring), exec_(exec) {
+        LFRingSetWake(ring_.meta(), &Consumer::wake, this);
+    }
+    Consumer(const Consumer &) = delete;
+    Consumer &operator=(const Consumer &) = delete;
+    ~Consumer() { LFRingSetWake(ring_.meta(), nullptr, nullptr); }
+
+    // co_await next_batch(out, num) resumes with 1..num items read into out,
+    // or a negative LFRB_* error; it never completes with 0.
+    auto next_batch(T *out, size_t num) { return Awaiter{this, out, num, 0}; }
+
+#ifdef LFRING_HAS_SPAN
+    auto next_batch(std::span<T> out) { return next_batch(out.data(), out.size()); }
+#endif
+
+private:
+    struct Awaiter {
+        Consumer *c;
+        T *out;
+        size_t num;
+        int n;
+
+        bool await_ready() {
+            {
+                std::lock_guard<std::mutex> lock(c->m_);
+                c->signalled_ = false;
+            }
+            n = c->ring_.read(out, num);
+            return n != 0;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            c->waiter_ = h;
+            c->awaiter_ = this;
+            c->arm();
+        }
+
+        int await_resume() const noexcept { return n; }
+    };
+
+    // Called by the writer with the ring's lock held. If the executor's
+    // queue is full the consumer stays armed and the next wake retries.
+    static void wake(void *ctx) {
+        Consumer *c = static_cast<Consumer *>(ctx);
+        std::lock_guard<std::mutex> lock(c->m_);
+        c->signalled_ = true;
+        if(c->armed_ && c->exec_.post(&Consumer::poll, c)) c->armed_ = false;
+    }
+
+    // Wait for the next wake, or poll at once if one came in meanwhile
+    void arm() {
+        std::lock_guard<std::mutex> lock(m_);
+        armed_ = !(signalled_ && exec_.post(&Consumer::poll, this));
+    }
+
+    // Runs on the executor after a wake
+    static void poll(void *arg) {
+        Consumer *c = static_cast<Consumer *>(arg);
+        {
+            std::lock_guard<std::mutex> lock(c->m_);
+            c->signalled_ = false;
+        }
+        Awaiter *a = c->awaiter_;
+        a->n = c->ring_.read(a->out, a->num);
+        if(a->n == 0) {
+            // Another reader took the items
+            c->arm();
+            return;
+        }
+        c->awaiter_ = nullptr;
+        std::coroutine_handle<> h = c->waiter_;
+        c->waiter_ = nullptr;
+        h.resume();
+    }
+
+    Ring<T, N> &ring_;
+    Executor &exec_;
+    std::mutex m_;
+    bool signalled_ = false;        // a write happened since the last read started
+    bool armed_ = false;            // the next wake has to queue a poll
+    std::coroutine_handle<> waiter_;
+    Awaiter *awaiter_ = nullptr;
+};
+
+} // namespace lfring
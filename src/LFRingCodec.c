@@ -0,0 +1,930 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+// -------------------- block codec -------------------- //
+/*
+ * Encoded rings store items in blocks of up to block_items items. Each sealed
+ * block occupies one frame_size-byte frame of the .bin file, transposed into
+ * one byte-aligned column per field:
+ *
+ *     LFRB_CODEC_DELTA:    [ringbuf_frame_hdr_t][first item][bits per field][columns]
+ *     LFRB_CODEC_COLUMNAR: [ringbuf_frame_hdr_t][columns]
+ *
+ * A delta column holds (count - 1) residuals against the previous item,
+ * packed at the widest residual width of that block. Integers store the
+ * zigzagged delta, floats and raw bytes the XOR of the bit patterns, so
+ * slowly changing samples shrink to a few bits each. A columnar column holds
+ * the count field values verbatim. Column offsets follow from the header
+ * alone, so a reader can fetch just the fields it needs.
+ *
+ * The block being filled lives in RAM (open_buf) and is mirrored to
+ * <namespace>.stg so that unsealed items survive a reset. A block is sealed
+ * when it holds block_items items or when the next item would not fit in
+ * frame_size bytes anymore.
+ *
+ * Sealed frames are numbered by a 64-bit sequence; frame seq lives in slot
+ * seq % frame_num of the file. The header records the logical offset of the
+ * block's first item, which makes any retained offset reachable by a binary
+ * search over the live frame headers.
+ */
+static void ringbuf_put_bits(uint8_t *buf, uint32_t pos, uint64_t v, uint8_t bits) {
+    while(bits) {
+        uint8_t shift = pos & 7;
+        uint8_t take = 8 - shift;
+        if(take > bits) take = bits;
+        buf[pos >> 3] |= (uint8_t)((v & ((1u << take) - 1)) << shift);
+        v >>= take;
+        bits -= take;
+        pos += take;
+    }
+}
+
+static uint64_t ringbuf_get_bits(const uint8_t *buf, uint32_t pos, uint8_t bits) {
+    uint64_t v = 0;
+    uint8_t done = 0;
+    while(done < bits) {
+        uint8_t shift = pos & 7;
+        uint8_t take = 8 - shift;
+        if(take > bits - done) take = bits - done;
+        v |= (uint64_t)((buf[pos >> 3] >> shift) & ((1u << take) - 1)) << done;
+        done += take;
+        pos += take;
+    }
+    return v;
+}
+
+/**
+ * @brief Compute the residual of one field against the previous item.
+ *
+ * Integers are delta-encoded in the field's own width and zigzagged so that
+ * small steps in either direction give small values. Floats and raw bytes
+ * are XORed, which leaves only the bits that actually changed.
+ */
+uint64_t ringbuf_codec_residual(const ringbuf_field_t *f, uint64_t prev, uint64_t cur) {
+    if(f->type == LFRB_FIELD_INT || f->type == LFRB_FIELD_UINT) {
+        uint8_t bits = f->width * 8;
+        uint64_t d = (cur - prev) & ringbuf_field_mask(f);
+        int64_t s = bits >= 64 ? (int64_t)d : (int64_t)(d << (64 - bits)) >> (64 - bits);
+        return ((uint64_t)s << 1) ^ (uint64_t)(s >> 63);
+    }
+    return cur ^ prev;
+}
+
+/**
+ * @brief Inverse of ringbuf_codec_residual().
+ */
+uint64_t ringbuf_codec_restore(const ringbuf_field_t *f, uint64_t prev, uint64_t res) {
+    if(f->type == LFRB_FIELD_INT || f->type == LFRB_FIELD_UINT) {
+        int64_t s = (int64_t)(res >> 1) ^ -(int64_t)(res & 1);
+        return (prev + (uint64_t)s) & ringbuf_field_mask(f);
+    }
+    return (prev ^ res) & ringbuf_field_mask(f);
+}
+
+/**
+ * @brief Locate the field columns of an encoded block.
+ *
+ * @param meta    Pointer to the ring buffer metadata structure.
+ * @param count   Number of items in the block.
+ * @param bits    Residual width per field (LFRB_CODEC_DELTA only).
+ * @param col_off Output, field_num + 1 entries: byte offset of each column
+ *                inside the frame, the last entry is the encoded length.
+ */
+void ringbuf_codec_columns(ringbuf_meta_t *meta, uint32_t count, const uint8_t *bits, uint32_t *col_off) {
+    ringbuf_codec_t *c = &meta->codec;
+    uint32_t off = sizeof(ringbuf_frame_hdr_t);
+    if(c->type == LFRB_CODEC_DELTA) {
+        off += meta->item_size + c->field_num;
+    }
+    for(uint8_t f = 0; f < c->field_num; f++) {
+        col_off[f] = off;
+        if(c->type == LFRB_CODEC_DELTA) {
+            off += count > 1 ? ((uint32_t)bits[f] * (count - 1) + 7) / 8 : 0;
+        } else {
+            off += count * c->fields[f].width;
+        }
+    }
+    col_off[c->field_num] = off;
+}
+
+/**
+ * @brief Size in bytes of a block of @p count items encoded with @p bits.
+ */
+uint32_t ringbuf_codec_encoded_size(ringbuf_meta_t *meta, uint32_t count, const uint8_t *bits) {
+    uint32_t col_off[LFRB_MAX_FIELDS + 1];
+    ringbuf_codec_columns(meta, count, bits, col_off);
+    return col_off[meta->codec.field_num];
+}
+
+/**
+ * @brief Encode a block of row-format items into a frame.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param rows  Items to encode, row format.
+ * @param count Number of items in @p rows (1..block_items).
+ * @param first Logical offset of the first item.
+ * @param frame Output buffer, at least frame_size bytes long.
+ *
+ * @return Encoded frame length in bytes.
+ */
+uint32_t ringbuf_codec_encode(ringbuf_meta_t *meta, const uint8_t *rows, uint32_t count, uint64_t first, uint8_t *frame) {
+    ringbuf_codec_t *c = &meta->codec;
+    uint8_t bits[LFRB_MAX_FIELDS] = {0};
+    uint32_t col_off[LFRB_MAX_FIELDS + 1];
+
+    // Widest residual per field decides the column width
+    if(c->type == LFRB_CODEC_DELTA) {
+        for(uint8_t f = 0; f < c->field_num; f++) {
+            const ringbuf_field_t *fd = &c->fields[f];
+            for(uint32_t i = 1; i < count; i++) {
+                uint64_t prev = ringbuf_field_load(rows + (i - 1) * meta->item_size, fd);
+                uint64_t cur = ringbuf_field_load(rows + i * meta->item_size, fd);
+                uint8_t w = ringbuf_bit_width(ringbuf_codec_residual(fd, prev, cur));
+                if(w > bits[f]) bits[f] = w;
+            }
+        }
+    }
+
+    ringbuf_codec_columns(meta, count, bits, col_off);
+    uint32_t bytes = col_off[c->field_num];
+    memset(frame, 0, bytes);
+
+    if(c->type == LFRB_CODEC_DELTA) {
+        uint8_t *p = frame + sizeof(ringbuf_frame_hdr_t);
+        memcpy(p, rows, meta->item_size);
+        memcpy(p + meta->item_size, bits, c->field_num);
+    }
+
+    // One byte-aligned column per field
+    for(uint8_t f = 0; f < c->field_num; f++) {
+        const ringbuf_field_t *fd = &c->fields[f];
+        uint8_t *p = frame + col_off[f];
+        if(c->type == LFRB_CODEC_COLUMNAR) {
+            for(uint32_t i = 0; i < count; i++) {
+                memcpy(p + i * fd->width, rows + i * meta->item_size + fd->offset, fd->width);
+            }
+            continue;
+        }
+        uint32_t pos = 0;
+        for(uint32_t i = 1; i < count && bits[f]; i++) {
+            uint64_t prev = ringbuf_field_load(rows + (i - 1) * meta->item_size, fd);
+            uint64_t cur = ringbuf_field_load(rows + i * meta->item_size, fd);
+            ringbuf_put_bits(p, pos, ringbuf_codec_residual(fd, prev, cur), bits[f]);
+            pos += bits[f];
+        }
+    }
+
+    ringbuf_frame_hdr_t hdr = {
+        .magic = LFRB_FRAME_MAGIC,
+        .count = (uint16_t)count,
+        .bytes = (uint16_t)bytes,
+        .field_num = c->field_num,
+        .codec = c->type,
+        .first = first,
+    };
+    hdr.crc = esp_rom_crc32_le(esp_rom_crc32_le(0, (const uint8_t *)&hdr.first, sizeof(hdr.first)),
+                               frame + sizeof(hdr), bytes - sizeof(hdr));
+    memcpy(frame, &hdr, sizeof(hdr));
+    return bytes;
+}
+
+/**
+ * @brief Check a frame header against the ring configuration.
+ *
+ * @return
+ *      - LFRB_OK: Header is plausible.
+ *      - LFRB_CORRUPT_ERROR: Header does not belong to this ring.
+ */
+int ringbuf_codec_check_header(ringbuf_meta_t *meta, const ringbuf_frame_hdr_t *hdr) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(hdr->magic != LFRB_FRAME_MAGIC || hdr->codec != c->type || hdr->field_num != c->field_num ||
+       hdr->count == 0 || hdr->count > c->block_items ||
+       hdr->bytes < sizeof(*hdr) || hdr->bytes > c->frame_size) {
+        return -LFRB_CORRUPT_ERROR;
+    }
+    return LFRB_OK;
+}
+
+/**
+ * @brief Rebuild the selected fields of a block from its columns.
+ *
+ * Only the columns of fields in @p mask are touched, so a frame of which
+ * only those columns were read from flash decodes correctly. The other bytes
+ * of @p rows are left zeroed.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param frame Frame buffer, header (and first item/bits for LFRB_CODEC_DELTA)
+ *              plus the selected columns filled in.
+ * @param rows  Output buffer, at least count * item_size bytes long.
+ * @param mask  Bit mask of the fields to rebuild.
+ */
+void ringbuf_codec_unpack(ringbuf_meta_t *meta, const uint8_t *frame, uint8_t *rows, uint32_t mask) {
+    ringbuf_codec_t *c = &meta->codec;
+    ringbuf_frame_hdr_t hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+
+    const uint8_t *first = frame + sizeof(hdr);
+    const uint8_t *bits = first + meta->item_size;
+    uint32_t col_off[LFRB_MAX_FIELDS + 1];
+    ringbuf_codec_columns(meta, hdr.count, bits, col_off);
+
+    memset(rows, 0, hdr.count * meta->item_size);
+    for(uint8_t f = 0; f < c->field_num; f++) {
+        if(!(mask & (1u << f))) continue;
+        const ringbuf_field_t *fd = &c->fields[f];
+        const uint8_t *p = frame + col_off[f];
+        if(c->type == LFRB_CODEC_COLUMNAR) {
+            for(uint32_t i = 0; i < hdr.count; i++) {
+                memcpy(rows + i * meta->item_size + fd->offset, p + i * fd->width, fd->width);
+            }
+            continue;
+        }
+        memcpy(rows + fd->offset, first + fd->offset, fd->width);
+        uint32_t pos = 0;
+        for(uint32_t i = 1; i < hdr.count; i++) {
+            uint8_t *row = rows + i * meta->item_size;
+            uint64_t prev = ringbuf_field_load(row - meta->item_size, fd);
+            uint64_t res = ringbuf_get_bits(p, pos, bits[f]);
+            ringbuf_field_store(row, fd, ringbuf_codec_restore(fd, prev, res));
+            pos += bits[f];
+        }
+    }
+}
+
+/**
+ * @brief Decode a frame back into row-format items.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param frame Frame as read from flash (frame_size bytes).
+ * @param rows  Output buffer, at least block_items * item_size bytes long.
+ *
+ * @return
+ *      - Number of decoded items.
+ *      - LFRB_CORRUPT_ERROR: Header, length or checksum mismatch.
+ */
+int ringbuf_codec_decode(ringbuf_meta_t *meta, const uint8_t *frame, uint8_t *rows) {
+    ringbuf_frame_hdr_t hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+
+    if(ringbuf_codec_check_header(meta, &hdr) < 0) {
+        return -LFRB_CORRUPT_ERROR;
+    }
+    const uint8_t *bits = frame + sizeof(hdr) + meta->item_size;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr.first, sizeof(hdr.first));
+    if(ringbuf_codec_encoded_size(meta, hdr.count, bits) != hdr.bytes ||
+       esp_rom_crc32_le(crc, frame + sizeof(hdr), hdr.bytes - sizeof(hdr)) != hdr.crc) {
+        return -LFRB_CORRUPT_ERROR;
+    }
+
+    ringbuf_codec_unpack(meta, frame, rows, LFRB_ALL_FIELDS);
+    return hdr.count;
+}
+
+/**
+ * @brief Get a codec buffer of @p len bytes.
+ *
+ * Static rings carve it from mem->codec, @p used bytes of which are taken.
+ *
+ * @return The buffer, NULL if it does not fit.
+ */
+uint8_t *ringbuf_codec_alloc(ringbuf_meta_t *meta, size_t *used, size_t len) {
+    if(meta->mem == NULL) return malloc(len);
+    if(meta->mem->codec == NULL || *used + len > meta->mem->codec_size) return NULL;
+    uint8_t *buf = meta->mem->codec + *used;
+    *used += len;
+    return buf;
+}
+
+/**
+ * @brief Validate the codec settings and allocate the block buffers.
+ *
+ * Caller fields keep their indexes; bytes of the item not covered by any
+ * field are appended as raw fields so the codec always round-trips the
+ * whole item.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param itemSize Size of each item in the ring buffer (in bytes).
+ * @param itemNum Total number of items in the ring buffer.
+ * @param config Optional settings, NULL for a raw ring.
+ *
+ * @return
+ *      - LFRB_OK: Codec configured (or disabled).
+ *      - LFRB_CONFIG_ERROR: Invalid schema or geometry.
+ *      - LFRB_NO_MEM_ERROR: Block buffers could not be allocated.
+ */
+int ringbuf_codec_config(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config) {
+    ringbuf_codec_t *c = &meta->codec;
+    memset(c, 0, sizeof(*c));
+    c->dec_seq = UINT64_MAX;
+    c->dec_mask = LFRB_ALL_FIELDS;
+    if(config != NULL) {
+        c->convert = config->convert;
+        c->convert_ctx = config->convert_ctx;
+    }
+    if(config == NULL || (config->codec == LFRB_CODEC_NONE && config->flags == 0 && config->agg_fields == 0)) return LFRB_OK;
+
+    if(config->codec > LFRB_CODEC_COLUMNAR || config->fields == NULL ||
+       config->field_num == 0 || config->field_num > LFRB_MAX_FIELDS) {
+        ESP_LOGE(TAG, "Invalid codec configuration");
+        return -LFRB_CONFIG_ERROR;
+    }
+
+    for(uint8_t i = 0; i < config->field_num; i++) {
+        const ringbuf_field_t *f = &config->fields[i];
+        int width_ok = (f->type == LFRB_FIELD_RAW) ? (f->width >= 1 && f->width <= 8)
+                                                   : (f->width == 1 || f->width == 2 || f->width == 4 || f->width == 8);
+        if(!width_ok || f->type > LFRB_FIELD_RAW || f->offset + f->width > itemSize) {
+            ESP_LOGE(TAG, "Invalid field %u (offset=%u width=%u)", i, f->offset, f->width);
+            return -LFRB_CONFIG_ERROR;
+        }
+        for(uint8_t j = 0; j < i; j++) {
+            const ringbuf_field_t *g = &config->fields[j];
+            if(f->offset < g->offset + g->width && g->offset < f->offset + f->width) {
+                ESP_LOGE(TAG, "Fields %u and %u overlap", j, i);
+                return -LFRB_CONFIG_ERROR;
+            }
+        }
+        c->fields[i] = *f;
+    }
+    c->field_num = c->user_field_num = config->field_num;
+
+    // Cover the gaps between fields with raw fields of up to 8 bytes
+    uint32_t off = 0;
+    while(off < itemSize) {
+        uint32_t next = itemSize;
+        int covered = 0;
+        for(uint8_t i = 0; i < c->user_field_num; i++) {
+            const ringbuf_field_t *f = &c->fields[i];
+            if(off >= f->offset && off < (uint32_t)f->offset + f->width) {
+                off = f->offset + f->width;
+                covered = 1;
+                break;
+            }
+            if(f->offset > off && f->offset < next) next = f->offset;
+        }
+        if(covered) continue;
+        while(off < next) {
+            if(c->field_num == LFRB_MAX_FIELDS) {
+                ESP_LOGE(TAG, "Item needs more than %d fields", LFRB_MAX_FIELDS);
+                return -LFRB_CONFIG_ERROR;
+            }
+            uint32_t width = next - off > 8 ? 8 : next - off;
+            c->fields[c->field_num++] = (ringbuf_field_t){ .offset = (uint16_t)off, .width = (uint8_t)width, .type = LFRB_FIELD_RAW };
+            off += width;
+        }
+    }
+
+    if(config->flags & LFRB_TIME_INDEX) {
+        if(config->ts_field >= c->user_field_num || (c->fields[config->ts_field].type != LFRB_FIELD_UINT &&
+                                                     c->fields[config->ts_field].type != LFRB_FIELD_INT)) {
+            ESP_LOGE(TAG, "Timestamp field must be an integer field of the schema");
+            return -LFRB_CONFIG_ERROR;
+        }
+    }
+    if(config->agg_fields != 0) {
+        uint8_t agg_num = 0;
+        for(uint8_t i = 0; i < LFRB_MAX_FIELDS; i++) {
+            if(!(config->agg_fields & (1u << i))) continue;
+            if(i >= c->user_field_num || c->fields[i].type == LFRB_FIELD_RAW || ++agg_num > LFRB_AGG_MAX_FIELDS) {
+                ESP_LOGE(TAG, "agg_fields must name up to %d numeric fields of the schema", LFRB_AGG_MAX_FIELDS);
+                return -LFRB_CONFIG_ERROR;
+            }
+        }
+    }
+    size_t used = 0;
+    c->flags = config->flags;
+    c->ts_field = config->ts_field;
+    c->agg_mask = config->agg_fields;
+    c->block_items = config->block_items ? config->block_items : LFRB_DEFAULT_BLOCK_ITEMS;
+    c->idx_block = UINT32_MAX;
+    c->agg_block = UINT32_MAX;
+    if(c->block_items < 2) {
+        ESP_LOGE(TAG, "Invalid block_items=%u", c->block_items);
+        return -LFRB_CONFIG_ERROR;
+    }
+
+    if(config->codec == LFRB_CODEC_NONE) {
+        // Raw ring with a schema: blocks are groups of block_items slots
+        uint32_t geometry[3] = { c->block_items, c->flags, c->ts_field };
+        c->layout_hash = esp_rom_crc32_le(0, (const uint8_t *)geometry, sizeof(geometry));
+        if(c->layout_hash == 0) c->layout_hash = 1;
+        c->scan_buf = ringbuf_codec_alloc(meta, &used, (size_t)c->block_items * itemSize);
+        if(c->scan_buf == NULL) {
+            ringbuf_codec_free(meta);
+            return -LFRB_NO_MEM_ERROR;
+        }
+        return LFRB_OK;
+    }
+
+    // Every frame must hold at least two items, even when nothing compresses
+    uint32_t min_frame = sizeof(ringbuf_frame_hdr_t) + c->field_num + 2 * itemSize;
+    c->type = config->codec;
+    c->frame_size = config->frame_size;
+    if(c->frame_size == 0 && meta->mem != NULL) {
+        ESP_LOGE(TAG, "Static rings need an explicit frame_size to size their buffers");
+        c->type = LFRB_CODEC_NONE;
+        return -LFRB_CONFIG_ERROR;
+    }
+    if(c->frame_size == 0 && c->type == LFRB_CODEC_COLUMNAR) {
+        // Plain columns do not shrink: size the frame for a full block
+        uint32_t full = sizeof(ringbuf_frame_hdr_t) + c->block_items * itemSize;
+        c->frame_size = full > 0xFFFF ? 0xFFFF : full;
+    } else if(c->frame_size == 0) {
+        c->frame_size = min_frame > LFRB_DEFAULT_FRAME_SIZE ? min_frame : LFRB_DEFAULT_FRAME_SIZE;
+    }
+    c->frame_num = (uint32_t)((uint64_t)itemSize * itemNum / c->frame_size);
+    if(min_frame > 0xFFFF || c->frame_size < min_frame || c->frame_num < 2) {
+        ESP_LOGE(TAG, "Invalid block geometry (block_items=%u frame_size=%u frame_num=%u)",
+                 c->block_items, c->frame_size, (unsigned int)c->frame_num);
+        c->type = LFRB_CODEC_NONE;
+        return -LFRB_CONFIG_ERROR;
+    }
+
+    // Any change of frame format, schema or block geometry invalidates stored frames
+    uint32_t geometry[6] = { LFRB_FRAME_VERSION, c->type, c->block_items, c->frame_size, c->flags, c->ts_field };
+    c->layout_hash = esp_rom_crc32_le(0, (const uint8_t *)geometry, sizeof(geometry));
+    c->layout_hash = esp_rom_crc32_le(c->layout_hash, (const uint8_t *)c->fields, c->field_num * sizeof(ringbuf_field_t));
+    if(c->layout_hash == 0) c->layout_hash = 1;
+
+    c->open_buf = ringbuf_codec_alloc(meta, &used, (size_t)c->block_items * itemSize);
+    c->dec_buf = ringbuf_codec_alloc(meta, &used, (size_t)c->block_items * itemSize);
+    c->frame_buf = ringbuf_codec_alloc(meta, &used, c->frame_size);
+    if(c->open_buf == NULL || c->dec_buf == NULL || c->frame_buf == NULL) {
+        ringbuf_codec_free(meta);
+        return -LFRB_NO_MEM_ERROR;
+    }
+    return LFRB_OK;
+}
+
+/**
+ * @brief Release the codec buffers and fall back to the raw layout.
+ */
+void ringbuf_codec_free(ringbuf_meta_t *meta) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(meta->mem == NULL) {
+        free(c->open_buf);
+        free(c->dec_buf);
+        free(c->frame_buf);
+        free(c->scan_buf);
+    }
+    c->open_buf = c->dec_buf = c->frame_buf = c->scan_buf = NULL;
+    c->type = LFRB_CODEC_NONE;
+}
+
+/**
+ * @brief Recompute the residual width of open item @p idx against its predecessor.
+ */
+void ringbuf_codec_track_bits(ringbuf_meta_t *meta, uint32_t idx, uint8_t *bits) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(idx == 0 || c->type != LFRB_CODEC_DELTA) return;
+    const uint8_t *cur = c->open_buf + idx * meta->item_size;
+    for(uint8_t f = 0; f < c->field_num; f++) {
+        const ringbuf_field_t *fd = &c->fields[f];
+        uint64_t res = ringbuf_codec_residual(fd, ringbuf_field_load(cur - meta->item_size, fd), ringbuf_field_load(cur, fd));
+        uint8_t w = ringbuf_bit_width(res);
+        if(w > bits[f]) bits[f] = w;
+    }
+}
+
+/**
+ * @brief Mirror open items [from, open_num) to the staging file.
+ *
+ * @return
+ *      - LFRB_OK: Items staged.
+ *      - LFRB_LFS_ERROR: Staging file could not be written.
+ */
+int ringbuf_stage_write(ringbuf_meta_t *meta, uint32_t from) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(from >= c->open_num) return LFRB_OK;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "stg");
+    FILE* f = fopen(path, "rb+");
+    if(f == NULL) f = fopen(path, "wb+");
+    if(f == NULL) {
+        ESP_LOGE(TAG, "ringbuf_stage_write: failed to open %s", path);
+        return -LFRB_LFS_ERROR;
+    }
+
+    fseek(f, from * meta->item_size, SEEK_SET);
+    ringbuf_fault_point(LFRB_FAULT_LFS);
+    size_t n = fwrite(c->open_buf + from * meta->item_size, meta->item_size, c->open_num - from, f);
+    fclose(f);
+    return n == c->open_num - from ? LFRB_OK : -LFRB_LFS_ERROR;
+}
+
+/**
+ * @brief Reload the open block from the staging file after a restart.
+ *
+ * Items the staging file cannot provide are dropped from the open block.
+ *
+ * @return LFRB_OK
+ */
+int ringbuf_stage_load(ringbuf_meta_t *meta) {
+    ringbuf_codec_t *c = &meta->codec;
+    memset(c->open_bits, 0, sizeof(c->open_bits));
+    if(c->open_num == 0) return LFRB_OK;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "stg");
+    FILE* f = fopen(path, "rb");
+    size_t n = 0;
+    if(f != NULL) {
+        n = fread(c->open_buf, meta->item_size, c->open_num, f);
+        fclose(f);
+    }
+    if(n != c->open_num) {
+        ESP_LOGW(TAG, "Staging file short, dropping %u open items", (unsigned int)(c->open_num - n));
+        meta->head -= c->open_num - n;
+        c->open_num = n;
+        if(meta->tail > meta->head) meta->tail = meta->head;
+        if(c->tail_pos > n && c->frame_tail == c->frame_head) c->tail_pos = n;
+        save_ringbuf_meta(meta);
+    }
+    for(uint32_t i = 1; i < c->open_num; i++) {
+        ringbuf_codec_track_bits(meta, i, c->open_bits);
+    }
+    return LFRB_OK;
+}
+
+/**
+ * @brief Read the header of frame @p seq from an open data file.
+ *
+ * @return
+ *      - LFRB_OK: @p hdr holds a plausible header.
+ *      - LFRB_CORRUPT_ERROR: Header could not be read or is invalid.
+ */
+int ringbuf_codec_header(ringbuf_meta_t *meta, FILE *f, uint64_t seq, ringbuf_frame_hdr_t *hdr) {
+    uint64_t pos = (seq % meta->codec.frame_num) * meta->codec.frame_size;
+    if(ringbuf_seek(f, pos) != 0 || fread(hdr, sizeof(*hdr), 1, f) != 1) return -LFRB_CORRUPT_ERROR;
+    return ringbuf_codec_check_header(meta, hdr);
+}
+
+/**
+ * @brief Encode the open block and write it as frame frame_head.
+ *
+ * The metadata is committed right after the frame so that the staging file
+ * is never reused before the frame it mirrors is durable. If all frames are
+ * live, the oldest one is dropped and that drop is committed before its slot
+ * is overwritten.
+ *
+ * @return
+ *      - LFRB_OK: Block sealed.
+ *      - LFRB_NFILE_ERROR: Data file could not be recreated.
+ *      - LFRB_LFS_ERROR: Frame write failed.
+ */
+int ringbuf_codec_seal(ringbuf_meta_t *meta) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(c->open_num == 0) return LFRB_OK;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    FILE* f = fopen(path, "rb+");
+    if(f == NULL) {
+        // Same recovery as ringbuf_write(): start over with the open block
+        uint32_t open_num = c->open_num;
+        reset_ringbuf_meta(meta, meta->item_size, meta->item_num);
+        reset_ringbuf_lfs(meta);
+        c->open_num = open_num;
+        meta->head = open_num;
+        f = fopen(path, "rb+");
+        if(f == NULL) {
+            ESP_LOGE(TAG, "ringbuf_codec_seal: failed to recreate file %s", path);
+            return -LFRB_NFILE_ERROR;
+        }
+    }
+
+    // The new frame takes the slot of the oldest one: drop it first
+    if(c->frame_head - c->frame_tail >= c->frame_num) {
+        if(meta->rollup.ring != NULL && ringbuf_codec_load_frame(meta, c->frame_tail, LFRB_ALL_FIELDS) == LFRB_OK &&
+           c->tail_pos < c->dec_num) {
+            ringbuf_rollup_feed(meta, c->dec_buf + c->tail_pos * meta->item_size, c->dec_num - c->tail_pos);
+        }
+        ringbuf_frame_hdr_t next;
+        if(ringbuf_codec_header(meta, f, c->frame_tail + 1, &next) == LFRB_OK && next.first > meta->tail) {
+            meta->tail = next.first;
+        }
+        if(c->dec_seq == c->frame_tail) c->dec_seq = UINT64_MAX;
+        c->frame_tail++;
+        c->tail_pos = 0;
+        save_ringbuf_meta(meta);
+        ESP_LOGW(TAG, "LFRingWrite: buffer overflow, overwrote oldest block");
+    }
+
+    uint32_t slot = c->frame_head % c->frame_num;
+    if(c->flags & LFRB_TIME_INDEX) {
+        ringbuf_block_index_t rec;
+        ringbuf_index_rows(meta, c->open_buf, c->open_num, &rec);
+        ringbuf_index_put(meta, NULL, slot, &rec);
+    }
+    if(c->agg_mask != 0) {
+        ringbuf_block_stats_t rec;
+        ringbuf_stats_rows(meta, c->open_buf, c->open_num, meta->head - c->open_num, &rec);
+        ringbuf_stats_put(meta, NULL, slot, &rec);
+    }
+
+    uint32_t bytes = ringbuf_codec_encode(meta, c->open_buf, c->open_num, meta->head - c->open_num, c->frame_buf);
+    size_t n = 0;
+    if(ringbuf_seek(f, (uint64_t)slot * c->frame_size) == 0) {
+        ringbuf_fault_point(LFRB_FAULT_LFS);
+        n = fwrite(c->frame_buf, 1, bytes, f);
+    }
+    fclose(f);
+    if(n != bytes) {
+        ESP_LOGE(TAG, "ringbuf_codec_seal: short frame write");
+        return -LFRB_LFS_ERROR;
+    }
+
+    if(c->dec_seq == c->frame_head) c->dec_seq = UINT64_MAX;
+    c->frame_head++;
+    c->open_num = 0;
+    memset(c->open_bits, 0, sizeof(c->open_bits));
+    return save_ringbuf_meta(meta);
+}
+
+/**
+ * @brief Append items to an encoded ring.
+ *
+ * @return
+ *      - Number of items appended.
+ *      - Propagate errors from ringbuf_codec_seal() and ringbuf_stage_write().
+ */
+int ringbuf_codec_write(ringbuf_meta_t *meta, const void* data, size_t num) {
+    ringbuf_codec_t *c = &meta->codec;
+    uint32_t stage_from = c->open_num;
+
+    for(size_t i = 0; i < num; i++) {
+        const uint8_t *item = (const uint8_t *)data + i * meta->item_size;
+
+        // Seal first if the item would overflow the block or its frame
+        if(c->open_num > 0) {
+            uint8_t bits[LFRB_MAX_FIELDS];
+            int seal = c->open_num == c->block_items;
+            if(!seal) {
+                memcpy(bits, c->open_bits, sizeof(bits));
+                memcpy(c->open_buf + c->open_num * meta->item_size, item, meta->item_size);
+                ringbuf_codec_track_bits(meta, c->open_num, bits);
+                seal = ringbuf_codec_encoded_size(meta, c->open_num + 1, bits) > c->frame_size;
+            }
+            if(!seal) {
+                memcpy(c->open_bits, bits, sizeof(bits));
+                c->open_num++;
+                meta->head++;
+                continue;
+            }
+            // The seal commits head, so the items of this call must be staged first
+            int status = ringbuf_stage_write(meta, stage_from);
+            if(status == LFRB_OK) status = ringbuf_codec_seal(meta);
+            if(status < 0) return i > 0 ? (int)i : status;
+            stage_from = 0;
+        }
+        memcpy(c->open_buf, item, meta->item_size);
+        c->open_num = 1;
+        meta->head++;
+    }
+
+    int status = ringbuf_stage_write(meta, stage_from);
+    return status < 0 ? status : (int)num;
+}
+
+/**
+ * @brief Decode frame @p seq into dec_buf unless it is already cached there.
+ *
+ * With LFRB_ALL_FIELDS the whole frame is read and its checksum verified.
+ * With a narrower mask only the header and the selected columns are read
+ * from flash; the checksum cannot be verified in that case.
+ *
+ * @param meta  Pointer to the ring buffer metadata structure.
+ * @param seq   Sequence number of the frame.
+ * @param mask  Bit mask of the fields that must be decoded.
+ *
+ * @return
+ *      - LFRB_OK: dec_buf holds the frame.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ *      - LFRB_CORRUPT_ERROR: Frame failed validation.
+ */
+int ringbuf_codec_load_frame(ringbuf_meta_t *meta, uint64_t seq, uint32_t mask) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(c->dec_seq == seq && (c->dec_mask & mask) == mask) return LFRB_OK;
+    c->dec_seq = UINT64_MAX;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) return -LFRB_NFILE_ERROR;
+
+    uint64_t base = (seq % c->frame_num) * c->frame_size;
+    int count;
+    if(mask == LFRB_ALL_FIELDS) {
+        size_t n = ringbuf_seek(f, base) == 0 ? fread(c->frame_buf, 1, c->frame_size, f) : 0;
+        fclose(f);
+        if(n < sizeof(ringbuf_frame_hdr_t)) return -LFRB_CORRUPT_ERROR;
+        memset(c->frame_buf + n, 0, c->frame_size - n);
+        count = ringbuf_codec_decode(meta, c->frame_buf, c->dec_buf);
+    } else {
+        // Header (plus first item and widths) first, then the selected columns
+        uint32_t prefix = sizeof(ringbuf_frame_hdr_t);
+        if(c->type == LFRB_CODEC_DELTA) prefix += meta->item_size + c->field_num;
+        size_t n = ringbuf_seek(f, base) == 0 ? fread(c->frame_buf, 1, prefix, f) : 0;
+
+        ringbuf_frame_hdr_t hdr;
+        memcpy(&hdr, c->frame_buf, sizeof(hdr));
+        uint32_t col_off[LFRB_MAX_FIELDS + 1];
+        if(n == prefix && ringbuf_codec_check_header(meta, &hdr) == LFRB_OK) {
+            ringbuf_codec_columns(meta, hdr.count, c->frame_buf + sizeof(hdr) + meta->item_size, col_off);
+        }
+        if(n != prefix || ringbuf_codec_check_header(meta, &hdr) < 0 || col_off[c->field_num] != hdr.bytes) {
+            fclose(f);
+            return -LFRB_CORRUPT_ERROR;
+        }
+        for(uint8_t i = 0; i < c->field_num; i++) {
+            if(!(mask & (1u << i))) continue;
+            uint32_t len = col_off[i + 1] - col_off[i];
+            if(ringbuf_seek(f, base + col_off[i]) != 0 || fread(c->frame_buf + col_off[i], 1, len, f) != len) {
+                fclose(f);
+                return -LFRB_CORRUPT_ERROR;
+            }
+        }
+        fclose(f);
+        ringbuf_codec_unpack(meta, c->frame_buf, c->dec_buf, mask);
+        count = hdr.count;
+    }
+
+    if(count < 0) return count;
+    ringbuf_frame_hdr_t hdr;
+    memcpy(&hdr, c->frame_buf, sizeof(hdr));
+    c->dec_seq = seq;
+    c->dec_first = hdr.first;
+    c->dec_mask = mask;
+    c->dec_num = count;
+    return LFRB_OK;
+}
+
+/**
+ * @brief Copy the fields selected by @p mask of @p count row-format items.
+ *
+ * Bytes of unselected fields are zeroed in @p dst.
+ */
+void ringbuf_codec_copy_rows(ringbuf_meta_t *meta, uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t mask) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(mask == LFRB_ALL_FIELDS) {
+        memcpy(dst, src, count * meta->item_size);
+        return;
+    }
+    memset(dst, 0, count * meta->item_size);
+    for(uint32_t i = 0; i < count; i++) {
+        for(uint8_t f = 0; f < c->field_num; f++) {
+            if(!(mask & (1u << f))) continue;
+            const ringbuf_field_t *fd = &c->fields[f];
+            uint32_t off = i * meta->item_size + fd->offset;
+            memcpy(dst + off, src + off, fd->width);
+        }
+    }
+}
+
+/**
+ * @brief Consume items from an encoded ring, sealed blocks first.
+ *
+ * Frames that fail validation are skipped with a warning. If the data file
+ * is gone, the ring is reset like in ringbuf_read().
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param out_data Output buffer, row format.
+ * @param num      Number of items to read.
+ * @param mask     Fields to fill in, LFRB_ALL_FIELDS for whole items.
+ *
+ * @return Number of items read.
+ */
+int ringbuf_codec_read(ringbuf_meta_t *meta, void* out_data, size_t num, uint32_t mask) {
+    ringbuf_codec_t *c = &meta->codec;
+    size_t n = 0;
+
+    while(n < num) {
+        const uint8_t *rows = c->open_buf;
+        uint32_t avail = c->open_num;
+        uint64_t first = meta->head - c->open_num;
+        if(c->frame_tail != c->frame_head) {
+            int status = ringbuf_codec_load_frame(meta, c->frame_tail, mask);
+            if(status == -LFRB_NFILE_ERROR) {
+                reset_ringbuf_meta(meta, meta->item_size, meta->item_num);
+                reset_ringbuf_lfs(meta);
+                break;
+            }
+            if(status < 0) {
+                ESP_LOGW(TAG, "LFRingRead: skipping corrupt block %" PRIu64, c->frame_tail);
+                c->frame_tail++;
+                c->tail_pos = 0;
+                continue;
+            }
+            rows = c->dec_buf;
+            avail = c->dec_num;
+            first = c->dec_first;
+        }
+        // The block header is authoritative for the offset of its items
+        meta->tail = first + c->tail_pos;
+
+        if(c->tail_pos < avail) {
+            size_t k = avail - c->tail_pos;
+            if(k > num - n) k = num - n;
+            ringbuf_codec_copy_rows(meta, (uint8_t *)out_data + n * meta->item_size,
+                                    rows + c->tail_pos * meta->item_size, k, mask);
+            n += k;
+            c->tail_pos += k;
+            meta->tail += k;
+        }
+        if(c->frame_tail == c->frame_head) break;
+        if(c->tail_pos >= avail) {
+            c->frame_tail++;
+            c->tail_pos = 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Find the live frame holding logical offset @p offset.
+ *
+ * Binary search over the headers of frames [@p lo, frame_head).
+ *
+ * @return
+ *      - LFRB_OK: @p seq is the frame holding @p offset.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ *      - LFRB_CORRUPT_ERROR: A frame header on the search path is invalid.
+ */
+int ringbuf_codec_find(ringbuf_meta_t *meta, uint64_t lo, uint64_t offset, uint64_t *seq) {
+    ringbuf_codec_t *c = &meta->codec;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) return -LFRB_NFILE_ERROR;
+
+    // Last frame whose first offset is <= offset
+    uint64_t hi = c->frame_head - 1;
+    while(lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        ringbuf_frame_hdr_t hdr;
+        if(ringbuf_codec_header(meta, f, mid, &hdr) < 0) {
+            fclose(f);
+            return -LFRB_CORRUPT_ERROR;
+        }
+        if(hdr.first <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    fclose(f);
+    *seq = lo;
+    return LFRB_OK;
+}
+
+/**
+ * @brief Copy items starting at logical offset @p offset of an encoded ring.
+ *
+ * The read position is not touched. Frames from @p lo on are searched,
+ * normally frame_tail.
+ *
+ * @return
+ *      - Number of items copied.
+ *      - Propagate errors from ringbuf_codec_find() and ringbuf_codec_load_frame().
+ */
+int ringbuf_codec_read_at(ringbuf_meta_t *meta, uint64_t lo, uint64_t offset, void* out_data, size_t num) {
+    ringbuf_codec_t *c = &meta->codec;
+    uint64_t open_first = meta->head - c->open_num;
+    uint64_t seq = c->frame_head;
+    if(offset < open_first) {
+        int status = ringbuf_codec_find(meta, lo, offset, &seq);
+        if(status < 0) return status;
+    }
+
+    size_t n = 0;
+    while(n < num && offset + n < meta->head) {
+        const uint8_t *rows = c->open_buf;
+        uint64_t first = open_first;
+        uint32_t avail = c->open_num;
+        if(seq != c->frame_head) {
+            int status = ringbuf_codec_load_frame(meta, seq, LFRB_ALL_FIELDS);
+            if(status < 0) return n > 0 ? (int)n : status;
+            rows = c->dec_buf;
+            first = c->dec_first;
+            avail = c->dec_num;
+        }
+        uint64_t pos = offset + n;
+        if(pos < first || pos >= first + avail) {
+            ESP_LOGW(TAG, "LFRingReadAt: block %" PRIu64 " does not hold offset %" PRIu64, seq, pos);
+            return n > 0 ? (int)n : -LFRB_CORRUPT_ERROR;
+        }
+        size_t k = first + avail - pos;
+        if(k > num - n) k = num - n;
+        memcpy((uint8_t *)out_data + n * meta->item_size, rows + (pos - first) * meta->item_size, k * meta->item_size);
+        n += k;
+        seq++;
+    }
+    return n;
+}
+
+/**
+ * @brief Check whether the ring holds no unread items.
+ */
+int ringbuf_is_empty(ringbuf_meta_t *meta) {
+    if(meta->codec.type == LFRB_CODEC_NONE) return meta->tail == meta->head;
+    return meta->codec.frame_tail == meta->codec.frame_head && meta->codec.tail_pos >= meta->codec.open_num;
+}
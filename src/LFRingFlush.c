@@ -0,0 +1,1105 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+// -------------------- flush scheduler -------------------- //
+/*
+ * Rings configured with LFRingSetFlush() keep up to pending.cap items in RAM;
+ * LFRingWrite() only copies into that buffer. The items reach flash through
+ * the regular write path, one batch per ring, written by the library's flush
+ * task (LFRingFlushStart()) or, without the task, by the writer itself once
+ * the buffer is full or its deadline has passed.
+ *
+ * Every cycle of the flush task picks the rings whose buffer is half full or
+ * whose oldest pending item reached its deadline, writes their data by
+ * descending priority and earliest deadline, and only then commits the
+ * metadata of all of them. Between the data write and the commit a ring is
+ * marked dirty so that load_ringbuf_meta() keeps the head held in RAM.
+ *
+ * LFRingWriteStream() fills one of two buffers under a lock of its own while
+ * the flush task writes the other one, so producers never wait for flash
+ * unless both buffers are full.
+ *
+ * LFRingWriteFromISR() cannot take a mutex, so it fills a single-producer,
+ * single-consumer staging ring (meta->isr) instead. Only the ISR advances its
+ * head and only the flush task advances its tail; every cycle moves the
+ * staged items into the pending buffer, from where they follow the rules
+ * above.
+ */
+static ringbuf_meta_t *flush_rings[LFRB_FLUSH_MAX_RINGS];
+static SemaphoreHandle_t flush_lock;
+static SemaphoreHandle_t flush_done;
+static StaticSemaphore_t flush_lock_buf;    // the flush task needs no heap
+static StaticSemaphore_t flush_done_buf;
+static volatile int flush_lock_claimed;
+static TaskHandle_t volatile flush_task;
+static volatile int flush_stop;
+static portMUX_TYPE flush_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Write items through to flash without committing the metadata.
+ *
+ * Raw and encoded rings are marked dirty until ringbuf_commit().
+ *
+ * @return
+ *      - Number of items written.
+ *      - Propagate errors from ringbuf_write(), ringbuf_codec_write() and ringbuf_log_append().
+ */
+int ringbuf_write_through(ringbuf_meta_t *meta, const void* data, size_t num) {
+    // Rings inside a shared log append one record
+    if(meta->log != NULL) {
+        int n = ringbuf_log_append(meta->log, meta->log_ring, data, num);
+        ringbuf_log_sync_meta(meta);
+        return n;
+    }
+
+    // Rings with lanes take plain writes into their lowest lane
+    if(meta->lanes.num != 0) {
+        int n = ringbuf_lanes_write(meta, 0, data, num);
+        ringbuf_lanes_sync_meta(meta);
+        return n;
+    }
+
+    // Encoded rings append to the open block instead of fixed slots
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        int n = ringbuf_codec_write(meta, data, num);
+        meta->dirty = 1;
+        return n;
+    }
+
+    if(meta->codec.flags & LFRB_TIME_INDEX) {
+        ringbuf_index_append(meta, ringbuf_slot(meta, meta->head), data, num);
+    }
+    if(meta->rollup.ring != NULL && meta->head + num > meta->tail + meta->item_num) {
+        ringbuf_rollup_raw(meta, meta->head + num - meta->item_num);
+    }
+    // Handle buffer overflow (overwrite oldest data). The new tail is
+    // committed before the slots are reused: after a power cut in between,
+    // the old tail would point at slots already holding newer items.
+    if(meta->head + num > meta->tail + meta->item_num) {
+        uint64_t overwrite = meta->head + num - meta->tail - meta->item_num;
+        meta->tail += overwrite;
+        ESP_LOGW(TAG, "LFRingWrite: buffer overflow, overwrote %" PRIu64 " old items", overwrite);
+        int status = save_ringbuf_meta(meta);
+        if(status < 0) return status;
+    }
+
+    // Attempt to write data into the ring buffer
+    // Writes are split where the slots wrap around the end of the file
+    int n = 0;
+    while((size_t)n < num) {
+        uint32_t room = meta->item_num - ringbuf_slot(meta, meta->head + n);
+        size_t write_num = num - n < room ? num - n : room;
+        int w = ringbuf_write(meta, meta->head + n, (const uint8_t*)data + n * meta->item_size, write_num);
+        if(w < 0 && n == 0) return w;
+        if(w <= 0) break;
+        n += w;
+        if((size_t)w != write_num) break;
+    }
+    if(meta->codec.agg_mask != 0 && n > 0) {
+        ringbuf_stats_fold(meta, meta->head, data, n);
+    }
+
+    // Advance the head offset
+    meta->head += n;
+    meta->dirty = 1;
+    return n;
+}
+
+/**
+ * @brief Save the metadata if it changed since the last commit.
+ *
+ * Everything below head is durable once the metadata is committed.
+ *
+ * @return Propagate errors from save_ringbuf_meta().
+ */
+int ringbuf_commit(ringbuf_meta_t *meta) {
+    int status = meta->dirty ? save_ringbuf_meta(meta) : LFRB_OK;
+    if(!meta->dirty) meta->pending.durable = meta->head;
+    return status;
+}
+
+/**
+ * @brief Write the pending items of a ring, without committing the metadata.
+ *
+ * Items that could not be written stay pending, oldest first.
+ *
+ * @return
+ *      - Number of items written.
+ *      - Propagate errors from ringbuf_write_through().
+ */
+int ringbuf_pending_drain(ringbuf_meta_t *meta) {
+    ringbuf_pending_t *p = &meta->pending;
+    if(p->num == 0) return 0;
+
+    load_ringbuf_meta(meta);
+    int n = ringbuf_write_through(meta, p->buf, p->num);
+    if(n <= 0) {
+        ESP_LOGE(TAG, "Flush of %s failed, %u items pending", meta->nvs_namespace, (unsigned int)p->num);
+        p->status = n < 0 ? n : -LFRB_LFS_ERROR;
+        return p->status;
+    }
+    p->num -= n;
+    memmove(p->buf, p->buf + (size_t)n * meta->item_size, (size_t)p->num * meta->item_size);
+    return n;
+}
+
+/**
+ * @brief Write the pending items of a ring and commit its metadata.
+ *
+ * @return
+ *      - LFRB_OK: Nothing is pending anymore.
+ *      - Propagate errors from ringbuf_pending_drain() and save_ringbuf_meta().
+ */
+int ringbuf_pending_flush(ringbuf_meta_t *meta) {
+    int n = ringbuf_pending_drain(meta);
+    int status = ringbuf_commit(meta);
+    return n < 0 ? n : status;
+}
+
+/**
+ * @brief Time (esp_timer, us) by which the pending items of a ring must be written.
+ */
+int64_t ringbuf_pending_deadline(const ringbuf_pending_t *p) {
+    if(p->num == 0 || p->deadline_ms == 0) return INT64_MAX;
+    return p->since + (int64_t)p->deadline_ms * 1000;
+}
+
+/**
+ * @brief Append items to the pending buffer and wake the flush task if needed.
+ *
+ * The caller makes sure the items fit.
+ */
+void ringbuf_pending_queue(ringbuf_meta_t *meta, const void *data, size_t num) {
+    ringbuf_pending_t *p = &meta->pending;
+    int was_empty = p->num == 0;
+    memcpy(p->buf + (size_t)p->num * meta->item_size, data, num * meta->item_size);
+    p->num += num;
+    if(was_empty) p->since = esp_timer_get_time();
+
+    // New deadline to wait for, or enough items to make a batch
+    TaskHandle_t task = flush_task;
+    if(task != NULL && (was_empty || p->num * 2 >= p->cap)) xTaskNotifyGive(task);
+    ringbuf_wake(meta, num);
+}
+
+/**
+ * @brief Tell the waiting consumer, if any, that @p num new items can be read.
+ *
+ * Called with the ring's lock held where items enter the ring: queued to the
+ * pending buffer or written through. Writing pending items out adds none.
+ */
+void ringbuf_wake(ringbuf_meta_t *meta, int num) {
+    if(num > 0 && meta->wake != NULL) meta->wake(meta->wake_ctx);
+}
+
+/**
+ * @brief Move items staged by LFRingWriteFromISR() into the pending buffer.
+ *
+ * Must be called with the ring's lock held, by the consumer of the staging
+ * ring only.
+ *
+ * @return Number of items left staged because the pending buffer is full.
+ */
+uint32_t ringbuf_isr_collect(ringbuf_meta_t *meta) {
+    ringbuf_isr_t *s = &meta->isr;
+    ringbuf_pending_t *p = &meta->pending;
+    if(s->cap == 0) return 0;
+
+    uint32_t tail = s->tail;
+    uint32_t staged = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) - tail;
+    uint32_t n = staged < p->cap - p->num ? staged : p->cap - p->num;
+    for(uint32_t done = 0; done < n; ) {
+        uint32_t at = (tail + done) & (s->cap - 1);
+        uint32_t k = s->cap - at < n - done ? s->cap - at : n - done;
+        ringbuf_pending_queue(meta, s->buf + (size_t)at * meta->item_size, k);
+        done += k;
+    }
+    __atomic_store_n(&s->tail, tail + n, __ATOMIC_RELEASE);
+    return staged - n;
+}
+
+// Completion callback call collected under the ring's lock, made after releasing it
+typedef struct {
+    ringbuf_done_t done;
+    void *ctx;
+    uint64_t durable;
+    int status;
+} ringbuf_completion_t;
+
+/**
+ * @brief Collect the completion to report for newly durable items or a failed flush.
+ *
+ * Must be called with the ring's lock held.
+ *
+ * @return 1 if @p out has to be called, 0 otherwise.
+ */
+int ringbuf_pending_completion(ringbuf_meta_t *meta, ringbuf_completion_t *out) {
+    ringbuf_pending_t *p = &meta->pending;
+    int fire = p->done != NULL && (p->durable != p->notified || p->status < 0);
+    out->done = p->done;
+    out->ctx = p->done_ctx;
+    out->durable = p->durable;
+    out->status = p->status;
+    p->notified = p->durable;
+    p->status = LFRB_OK;
+    return fire;
+}
+
+/**
+ * @brief Accept items into the pending buffer of a ring.
+ *
+ * A full buffer is written out first. Batches larger than the whole buffer
+ * are written through directly. Without a flush task, the writer also
+ * flushes once the deadline of the oldest pending item has passed.
+ *
+ * @return
+ *      - Number of items accepted.
+ *      - LFRB_LFS_ERROR: Buffer full and could not be written.
+ *      - Propagate errors from ringbuf_pending_flush() and ringbuf_write_through().
+ */
+int ringbuf_pending_put(ringbuf_meta_t *meta, const void *data, size_t num) {
+    ringbuf_pending_t *p = &meta->pending;
+    if(num > p->cap - p->num) {
+        int status = ringbuf_pending_flush(meta);
+        if(status < 0) return status;
+    }
+    if(num > p->cap) {
+        int n = ringbuf_write_through(meta, data, num);
+        ringbuf_commit(meta);
+        ringbuf_wake(meta, n);
+        return n;
+    }
+    if(num > p->cap - p->num) return -LFRB_LFS_ERROR;
+
+    ringbuf_pending_queue(meta, data, num);
+    if(flush_task == NULL && ringbuf_pending_deadline(p) <= esp_timer_get_time()) {
+        ringbuf_pending_flush(meta);
+    }
+    return num;
+}
+
+/**
+ * @brief Write the pending items before an access that reaches past head.
+ *
+ * Pending items are newer than every stored one, so reads that stop short
+ * of head leave them in RAM.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param end  One past the last logical offset the caller needs.
+ */
+void ringbuf_pending_need(ringbuf_meta_t *meta, uint64_t end) {
+    if(meta->pending.num > 0 && end > meta->head) {
+        ringbuf_pending_flush(meta);
+    }
+}
+
+/**
+ * @brief Write out and free the pending buffer of a ring.
+ *
+ * @return Propagate errors from ringbuf_pending_flush().
+ */
+int ringbuf_pending_release(ringbuf_meta_t *meta) {
+    int status = ringbuf_pending_flush(meta);
+    if(meta->pending.num > 0) {
+        ESP_LOGW(TAG, "Dropping %u pending items of %s", (unsigned int)meta->pending.num, meta->nvs_namespace);
+    }
+    if(meta->mem == NULL) free(meta->pending.buf);
+    meta->pending.buf = NULL;
+    meta->pending.cap = 0;
+    meta->pending.num = 0;
+    return status;
+}
+
+/**
+ * @brief Write the full stream buffer, without committing the metadata.
+ *
+ * Claims the buffer first, so only one caller writes it. Items that cannot
+ * be written stay in the buffer, which is left full for the next attempt;
+ * the producer waits for it meanwhile.
+ *
+ * @return
+ *      - Number of items written (0 if no buffer was full).
+ *      - LFRB_LFS_ERROR: Only part of the buffer was written.
+ *      - Propagate errors from ringbuf_write_through().
+ */
+int ringbuf_stream_persist(ringbuf_meta_t *meta) {
+    ringbuf_stream_t *s = &meta->stream;
+    if(s->cap == 0) return 0;
+
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    int claimed = s->busy == LFRB_STREAM_FULL;
+    if(claimed) s->busy = LFRB_STREAM_WRITING;
+    const uint8_t *buf = s->buf[s->fill ^ 1];
+    uint32_t num = s->busy_num;
+    xSemaphoreGive(s->lock);
+    if(!claimed) return 0;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    load_ringbuf_meta(meta);
+    int n = ringbuf_write_through(meta, buf, num);
+    ringbuf_wake(meta, n);
+    xSemaphoreGive(meta->lock);
+    uint32_t written = n > 0 ? (uint32_t)n : 0;
+    if(written < num) {
+        ESP_LOGE(TAG, "Stream flush of %s failed, kept %u items for retry", meta->nvs_namespace, (unsigned int)(num - written));
+        memmove((uint8_t *)buf, buf + (size_t)written * meta->item_size, (size_t)(num - written) * meta->item_size);
+    }
+
+    // Waiters are woken either way; those writing the buffer themselves retry
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    s->busy = written < num ? LFRB_STREAM_FULL : LFRB_STREAM_FREE;
+    s->busy_num = num - written;
+    if(s->waiters > 0) xSemaphoreGive(s->free);
+    xSemaphoreGive(s->lock);
+    if(written < num) return n < 0 ? n : -LFRB_LFS_ERROR;
+    return n;
+}
+
+/**
+ * @brief Wait until the other stream buffer is free.
+ *
+ * Must be called with the stream lock held; the lock is released while
+ * waiting. A full buffer is written by the caller itself if @p write is set,
+ * otherwise the flush task is expected to claim it. Every completion wakes
+ * one waiter, which passes the signal on to the next one.
+ *
+ * @return
+ *      - LFRB_OK: The other buffer is free.
+ *      - Propagate errors from ringbuf_stream_persist() if @p write is set.
+ */
+int ringbuf_stream_wait(ringbuf_meta_t *meta, int write) {
+    ringbuf_stream_t *s = &meta->stream;
+    while(s->busy != LFRB_STREAM_FREE) {
+        if(write && s->busy == LFRB_STREAM_FULL) {
+            xSemaphoreGive(s->lock);
+            int status = ringbuf_stream_persist(meta);
+            xSemaphoreTake(s->lock, portMAX_DELAY);
+            if(status < 0) return status;
+            continue;
+        }
+        s->waiters++;
+        xSemaphoreGive(s->lock);
+        xSemaphoreTake(s->free, portMAX_DELAY);
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        s->waiters--;
+        if(s->waiters > 0 && s->busy == LFRB_STREAM_FREE) xSemaphoreGive(s->free);
+    }
+    return LFRB_OK;
+}
+
+/**
+ * @brief Hand the filled stream buffer over for writing.
+ *
+ * Must be called with the stream lock held and the other buffer free.
+ */
+static void ringbuf_stream_hand_over(ringbuf_stream_t *s) {
+    s->busy = LFRB_STREAM_FULL;
+    s->busy_num = s->num;
+    s->fill ^= 1;
+    s->num = 0;
+}
+
+/**
+ * @brief Wait until the other stream buffer is free, then swap it with the filled one.
+ *
+ * Must be called with the stream lock held; the lock is released while waiting.
+ * Without the flush task, the caller writes the buffer itself and retries
+ * every LFRB_FLUSH_RETRY_MS until it succeeds.
+ */
+void ringbuf_stream_swap(ringbuf_meta_t *meta) {
+    ringbuf_stream_t *s = &meta->stream;
+    while(ringbuf_stream_wait(meta, flush_task == NULL) < 0) {
+        xSemaphoreGive(s->lock);
+        vTaskDelay(pdMS_TO_TICKS(LFRB_FLUSH_RETRY_MS));
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+    }
+    ringbuf_stream_hand_over(s);
+    xSemaphoreGive(s->lock);
+
+    TaskHandle_t task = flush_task;
+    if(task != NULL) {
+        xTaskNotifyGive(task);
+    } else {
+        ringbuf_stream_persist(meta);
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        ringbuf_commit(meta);
+        xSemaphoreGive(meta->lock);
+    }
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+}
+
+/**
+ * @brief Hand a partly filled stream buffer over for writing, if the other one is free.
+ *
+ * Never waits, so the flush task can call it without waiting on itself.
+ */
+void ringbuf_stream_seal(ringbuf_meta_t *meta) {
+    ringbuf_stream_t *s = &meta->stream;
+    if(s->cap == 0) return;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    if(s->busy == LFRB_STREAM_FREE && s->num > 0) ringbuf_stream_hand_over(s);
+    xSemaphoreGive(s->lock);
+}
+
+/**
+ * @brief Write both stream buffers and wait until they are on flash.
+ *
+ * The metadata is not committed. Items that cannot be written stay buffered.
+ *
+ * @return
+ *      - LFRB_OK: Both buffers are empty.
+ *      - Propagate errors from ringbuf_stream_persist().
+ */
+int ringbuf_stream_flush(ringbuf_meta_t *meta) {
+    ringbuf_stream_t *s = &meta->stream;
+    if(s->cap == 0) return LFRB_OK;
+
+    // The flush task may have claimed the full buffer first
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    int status = ringbuf_stream_wait(meta, 1);
+    if(status == LFRB_OK && s->num > 0) {
+        ringbuf_stream_hand_over(s);
+        status = ringbuf_stream_wait(meta, 1);
+    }
+    xSemaphoreGive(s->lock);
+    return status;
+}
+
+/**
+ * @brief Write both stream buffers and free them.
+ *
+ * No producer may use the stream anymore. Items that cannot be written are dropped.
+ */
+void ringbuf_stream_release(ringbuf_meta_t *meta) {
+    ringbuf_stream_t *s = &meta->stream;
+    if(s->cap == 0) return;
+    if(ringbuf_stream_flush(meta) < 0) {
+        uint32_t num = s->num + (s->busy == LFRB_STREAM_FULL ? s->busy_num : 0);
+        ESP_LOGW(TAG, "Dropping %u stream items of %s", (unsigned int)num, meta->nvs_namespace);
+    }
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    ringbuf_commit(meta);
+    xSemaphoreGive(meta->lock);
+
+    if(meta->mem == NULL) {
+        free(s->buf[0]);
+        free(s->buf[1]);
+    }
+    vSemaphoreDelete(s->lock);
+    vSemaphoreDelete(s->free);
+    memset(s, 0, sizeof(*s));
+}
+
+/**
+ * @brief Free the staging ring of LFRingWriteFromISR().
+ *
+ * Staged items that were not collected are dropped.
+ */
+void ringbuf_isr_release(ringbuf_meta_t *meta) {
+    ringbuf_isr_t *s = &meta->isr;
+    if(s->head != s->tail) {
+        ESP_LOGW(TAG, "Dropping %u staged items of %s", (unsigned int)(s->head - s->tail), meta->nvs_namespace);
+    }
+    if(meta->mem == NULL) heap_caps_free(s->buf);
+    memset(s, 0, sizeof(*s));
+}
+
+/**
+ * @brief Mutex guarding flush_rings, created in static storage on first use.
+ */
+SemaphoreHandle_t ringbuf_flush_lock(void) {
+    if(flush_lock == NULL) {
+        taskENTER_CRITICAL(&flush_mux);
+        int create = !flush_lock_claimed;
+        flush_lock_claimed = 1;
+        taskEXIT_CRITICAL(&flush_mux);
+        if(create) {
+            flush_lock = xSemaphoreCreateMutexStatic(&flush_lock_buf);
+        } else {
+            // Another task is creating it
+            while(flush_lock == NULL) vTaskDelay(1);
+        }
+    }
+    return flush_lock;
+}
+
+/**
+ * @brief Add a ring to, or remove it from, the rings serviced by the flush task.
+ *
+ * @return
+ *      - LFRB_OK: Registration updated.
+ *      - LFRB_CONFIG_ERROR: LFRB_FLUSH_MAX_RINGS rings already registered.
+ *      - LFRB_NO_MEM_ERROR: Mutex could not be created.
+ */
+int ringbuf_flush_register(ringbuf_meta_t *meta, int add) {
+    SemaphoreHandle_t lock = ringbuf_flush_lock();
+    if(lock == NULL) return -LFRB_NO_MEM_ERROR;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int slot = -1;
+    for(int i = 0; i < LFRB_FLUSH_MAX_RINGS; i++) {
+        if(flush_rings[i] == meta) {
+            slot = i;
+            break;
+        }
+        if(flush_rings[i] == NULL && slot < 0) slot = i;
+    }
+    int status = LFRB_OK;
+    if(add && slot < 0) {
+        status = -LFRB_CONFIG_ERROR;
+    } else if(slot >= 0 && (add || flush_rings[slot] == meta)) {
+        flush_rings[slot] = add ? meta : NULL;
+    }
+    xSemaphoreGive(lock);
+    return status;
+}
+
+/**
+ * @brief Run one cycle of the flush task.
+ *
+ * @param all Flush every ring with pending items, due or not.
+ *
+ * @return Ticks until the next ring becomes due.
+ */
+TickType_t ringbuf_flush_cycle(int all) {
+    ringbuf_meta_t *due[LFRB_FLUSH_MAX_RINGS];
+    int64_t due_at[LFRB_FLUSH_MAX_RINGS];
+    uint8_t due_prio[LFRB_FLUSH_MAX_RINGS];
+    int due_num = 0;
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+
+    SemaphoreHandle_t lock = ringbuf_flush_lock();
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    // Pick the due rings, by descending priority, then earliest deadline
+    for(int i = 0; i < LFRB_FLUSH_MAX_RINGS; i++) {
+        ringbuf_meta_t *meta = flush_rings[i];
+        if(meta == NULL) continue;
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        if(ringbuf_isr_collect(meta) > 0) next = now;
+        const ringbuf_pending_t *p = &meta->pending;
+        int64_t at = ringbuf_pending_deadline(p);
+        // A ring left dirty by a failed commit is due again
+        int is_due = (p->num > 0 && (all || at <= now || p->num * 2 >= p->cap)) ||
+                     meta->stream.busy == LFRB_STREAM_FULL || (all && meta->stream.num > 0) || meta->dirty;
+        uint8_t priority = p->priority;
+        xSemaphoreGive(meta->lock);
+
+        if(!is_due) {
+            if(at < next) next = at;
+            continue;
+        }
+        int k = due_num++;
+        while(k > 0 && (due_prio[k-1] < priority || (due_prio[k-1] == priority && due_at[k-1] > at))) {
+            due[k] = due[k-1];
+            due_at[k] = due_at[k-1];
+            due_prio[k] = due_prio[k-1];
+            k--;
+        }
+        due[k] = meta;
+        due_at[k] = at;
+        due_prio[k] = priority;
+    }
+
+    // Data of all due rings first, then their metadata in one pass
+    for(int k = 0; k < due_num; k++) {
+        xSemaphoreTake(due[k]->lock, portMAX_DELAY);
+        int status = ringbuf_pending_drain(due[k]);
+        xSemaphoreGive(due[k]->lock);
+        // A stream buffer that failed stays full and is written again
+        int stream = ringbuf_stream_persist(due[k]);
+        if(stream >= 0 && all) {
+            ringbuf_stream_seal(due[k]);
+            stream = ringbuf_stream_persist(due[k]);
+        }
+        if(status < 0 || stream < 0) {
+            int64_t retry = now + (int64_t)LFRB_FLUSH_RETRY_MS * 1000;
+            if(retry < next) next = retry;
+        }
+    }
+    for(int k = 0; k < due_num; k++) {
+        xSemaphoreTake(due[k]->lock, portMAX_DELAY);
+        int status = ringbuf_commit(due[k]);
+        if(status < 0) {
+            // Still dirty: the next cycle commits again
+            due[k]->pending.status = status;
+            int64_t retry = now + (int64_t)LFRB_FLUSH_RETRY_MS * 1000;
+            if(retry < next) next = retry;
+        }
+        xSemaphoreGive(due[k]->lock);
+    }
+
+    // Also reports items made durable by reads or LFRingWrite() since the last cycle
+    ringbuf_completion_t calls[LFRB_FLUSH_MAX_RINGS];
+    int call_num = 0;
+    for(int i = 0; i < LFRB_FLUSH_MAX_RINGS; i++) {
+        ringbuf_meta_t *meta = flush_rings[i];
+        if(meta == NULL) continue;
+        xSemaphoreTake(meta->lock, portMAX_DELAY);
+        call_num += ringbuf_pending_completion(meta, &calls[call_num]);
+        xSemaphoreGive(meta->lock);
+    }
+    xSemaphoreGive(lock);
+
+    // Callbacks run without any lock held, they may call back into the library
+    for(int k = 0; k < call_num; k++) {
+        calls[k].done(calls[k].durable, calls[k].status, calls[k].ctx);
+    }
+    if(next == INT64_MAX) return portMAX_DELAY;
+    now = esp_timer_get_time();
+    return next <= now ? 1 : pdMS_TO_TICKS((next - now + 999) / 1000) + 1;
+}
+
+/**
+ * @brief Body of the flush task started by LFRingFlushStart().
+ */
+void ringbuf_flush_task(void *arg) {
+    TickType_t wait = portMAX_DELAY;
+    while(!flush_stop) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = ringbuf_flush_cycle(0);
+    }
+    ringbuf_flush_cycle(1);
+    xSemaphoreGive(flush_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief  Start the flush task shared by all rings.
+ *
+ * The task writes the pending items of every ring configured with
+ * LFRingSetFlush() once its buffer is half full or its oldest item reaches
+ * the deadline. Rings due in the same cycle are written by descending
+ * priority, then earliest deadline, and their metadata is committed to NVS
+ * after all of their data.
+ *
+ * @param taskPriority FreeRTOS priority of the flush task.
+ * @param stackSize    Stack size of the flush task.
+ *
+ * @return
+ *      - LFRB_OK: Task running.
+ *      - LFRB_NO_MEM_ERROR: Task or semaphores could not be created.
+ */
+int LFRingFlushStart(UBaseType_t taskPriority, uint32_t stackSize) {
+    return LFRingFlushStartStatic(taskPriority, stackSize, NULL, NULL);
+}
+
+/**
+ * @brief  Start the flush task in caller-provided memory.
+ *
+ * Same as LFRingFlushStart(), but the task's stack and control block come
+ * from @p stack and @p task (xTaskCreateStatic()), so together with rings
+ * set up by LFRingInitStatic() nothing is taken from the heap. Both must
+ * stay valid until LFRingFlushStop() has returned.
+ *
+ * @param taskPriority FreeRTOS priority of the flush task.
+ * @param stackSize    Size of @p stack in StackType_t units (bytes on ESP-IDF).
+ * @param stack        Stack of the task, NULL to allocate it like LFRingFlushStart().
+ * @param task         Control block of the task, NULL to allocate it.
+ *
+ * @return
+ *      - LFRB_OK: Task running.
+ *      - LFRB_CONFIG_ERROR: Only one of @p stack and @p task given.
+ *      - LFRB_NO_MEM_ERROR: Task could not be created.
+ */
+int LFRingFlushStartStatic(UBaseType_t taskPriority, uint32_t stackSize, StackType_t *stack, StaticTask_t *task) {
+    if((stack == NULL) != (task == NULL)) return -LFRB_CONFIG_ERROR;
+    if(flush_task != NULL) return LFRB_OK;
+    if(ringbuf_flush_lock() == NULL) return -LFRB_NO_MEM_ERROR;
+    if(flush_done == NULL) flush_done = xSemaphoreCreateBinaryStatic(&flush_done_buf);
+    if(flush_done == NULL) return -LFRB_NO_MEM_ERROR;
+
+    flush_stop = 0;
+    TaskHandle_t handle = NULL;
+    if(stack != NULL) {
+        handle = xTaskCreateStatic(ringbuf_flush_task, "lfring_flush", stackSize, NULL, taskPriority, stack, task);
+    } else if(xTaskCreate(ringbuf_flush_task, "lfring_flush", stackSize, NULL, taskPriority, &handle) != pdPASS) {
+        handle = NULL;
+    }
+    if(handle == NULL) return -LFRB_NO_MEM_ERROR;
+    flush_task = handle;
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Stop the flush task after writing every pending item.
+ *
+ * Rings keep their pending buffers; without the task, writers flush them
+ * when they are full or past their deadline.
+ */
+void LFRingFlushStop(void) {
+    TaskHandle_t task = flush_task;
+    if(task == NULL) return;
+    flush_task = NULL;
+    flush_stop = 1;
+    xTaskNotifyGive(task);
+    xSemaphoreTake(flush_done, portMAX_DELAY);
+}
+
+/**
+ * @brief  Buffer the writes of a ring in RAM.
+ *
+ * LFRingWrite() then copies up to @p pendingItems items into RAM and returns.
+ * They are written by the flush task (LFRingFlushStart()), by LFRingFlush(),
+ * by reads that reach them, or by the writer when the buffer is full. Items
+ * still pending at a power cut are lost.
+ *
+ * @param meta         Pointer to the ring buffer metadata structure.
+ * @param pendingItems Capacity of the buffer in items, 0 for synchronous writes.
+ * @param priority     Rings with a higher priority are flushed first.
+ * @param deadlineMs   Maximum time an item stays pending, 0 for no deadline.
+ *
+ * @return
+ *      - LFRB_OK: Settings applied.
+ *      - LFRB_ENUM_EXCEED: @p pendingItems exceeds the ring capacity.
+ *      - LFRB_NO_MEM_ERROR: Buffer could not be allocated.
+ *      - LFRB_CONFIG_ERROR: LFRB_FLUSH_MAX_RINGS rings already buffered, or ring with lanes.
+ *      - Propagate errors from writing the items pending so far.
+ */
+int LFRingSetFlush(ringbuf_meta_t *meta, uint32_t pendingItems, uint8_t priority, uint32_t deadlineMs) {
+    if(meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+    if(pendingItems > meta->item_num) return -LFRB_ENUM_EXCEED;
+    if(pendingItems == 0 && meta->stream.cap == 0) ringbuf_flush_register(meta, 0);
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    int status = LFRB_OK;
+    if(meta->pending.cap != pendingItems) {
+        ringbuf_isr_collect(meta);
+        status = ringbuf_pending_release(meta);
+        if(pendingItems == 0) ringbuf_isr_release(meta);
+        if(status == LFRB_OK && pendingItems > 0) {
+            if(meta->mem != NULL) {
+                meta->pending.buf = pendingItems <= meta->mem->pending_items ? meta->mem->pending : NULL;
+            } else {
+                meta->pending.buf = malloc((size_t)pendingItems * meta->item_size);
+            }
+            if(meta->pending.buf == NULL) status = -LFRB_NO_MEM_ERROR;
+            else meta->pending.cap = pendingItems;
+        }
+    }
+    meta->pending.priority = priority;
+    meta->pending.deadline_ms = deadlineMs;
+    xSemaphoreGive(meta->lock);
+
+    if(status == LFRB_OK && pendingItems > 0) {
+        status = ringbuf_flush_register(meta, 1);
+        if(status < 0) {
+            xSemaphoreTake(meta->lock, portMAX_DELAY);
+            ringbuf_pending_release(meta);
+            xSemaphoreGive(meta->lock);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Write the pending items of a ring and commit its metadata now.
+ *
+ * Items staged by LFRingWriteFromISR() and buffered by LFRingWriteStream()
+ * are written as well. Stream items that cannot be written stay buffered
+ * for the next attempt.
+ * The completion callback set by LFRingSetAsync() is called from the
+ * calling task.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ *
+ * @return
+ *      - LFRB_OK: Nothing is pending anymore.
+ *      - Propagate errors from the write path and save_ringbuf_meta().
+ */
+int LFRingFlush(ringbuf_meta_t *meta) {
+    int stream = ringbuf_stream_flush(meta);
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    int status;
+    do {
+        ringbuf_isr_collect(meta);
+        status = ringbuf_pending_flush(meta);
+    } while(status == LFRB_OK && meta->isr.head != meta->isr.tail);
+    ringbuf_completion_t call;
+    int fire = ringbuf_pending_completion(meta, &call);
+    xSemaphoreGive(meta->lock);
+
+    if(fire) call.done(call.durable, call.status, call.ctx);
+    return stream < 0 ? stream : status;
+}
+
+/**
+ * @brief  Configure asynchronous writes of a ring.
+ *
+ * LFRingWriteAsync() queues into the pending buffer set up by
+ * LFRingSetFlush(). Once items are written and committed, the flush task
+ * calls @p done with the new durable offset; LFRingDurableOffset() returns
+ * the same value for polling.
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param overflow What LFRingWriteAsync() does when the buffer is full (ringbuf_overflow_t).
+ * @param done     Completion callback, NULL to only poll. Runs in the flush task
+ *                 without any lock held.
+ * @param ctx      Passed to @p done.
+ *
+ * @return
+ *      - LFRB_OK: Settings applied.
+ *      - LFRB_CONFIG_ERROR: Unknown overflow policy.
+ */
+int LFRingSetAsync(ringbuf_meta_t *meta, uint8_t overflow, ringbuf_done_t done, void *ctx) {
+    if(overflow > LFRB_OVERFLOW_DROP_OLD) return -LFRB_CONFIG_ERROR;
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    meta->pending.overflow = overflow;
+    meta->pending.done = done;
+    meta->pending.done_ctx = ctx;
+    xSemaphoreGive(meta->lock);
+    return LFRB_OK;
+}
+
+/**
+ * @brief  Queue items for writing and return without touching flash.
+ *
+ * The items are copied into the ring's pending buffer and written by the
+ * flush task. When the buffer cannot take them all, the overflow policy of
+ * LFRingSetAsync() applies; only LFRB_OVERFLOW_BLOCK writes in the caller.
+ * Discarded items never receive a logical offset: under
+ * LFRB_OVERFLOW_DROP_OLD, queued items get theirs only when written, and
+ * LFRingNewestOffset() does not count them before.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param data Pointer to the items to queue.
+ * @param num  Number of items to queue.
+ *
+ * @return >= 0 as number of items queued (or written, for LFRB_OVERFLOW_BLOCK), or:
+ *          - LFRB_CONFIG_ERROR: The ring has no pending buffer (see LFRingSetFlush()).
+ *          - Propagate errors from LFRingWrite().
+ */
+int LFRingWriteAsync(ringbuf_meta_t *meta, const void* data, size_t num) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    ringbuf_pending_t *p = &meta->pending;
+    if(p->cap == 0) {
+        xSemaphoreGive(meta->lock);
+        return -LFRB_CONFIG_ERROR;
+    }
+
+    int n;
+    if(num <= p->cap - p->num) {
+        ringbuf_pending_queue(meta, data, num);
+        n = num;
+    } else if(p->overflow == LFRB_OVERFLOW_BLOCK) {
+        load_ringbuf_meta(meta);
+        n = num > meta->item_num ? -LFRB_ENUM_EXCEED : ringbuf_pending_put(meta, data, num);
+    } else if(p->overflow == LFRB_OVERFLOW_DROP_NEW) {
+        n = p->cap - p->num;
+        ESP_LOGW(TAG, "LFRingWriteAsync: queue full, dropped %u new items", (unsigned int)(num - n));
+        ringbuf_pending_queue(meta, data, n);
+    } else {
+        // Keep the newest cap items of pending + data
+        if(num >= p->cap) {
+            data = (const uint8_t *)data + (num - p->cap) * meta->item_size;
+            num = p->cap;
+        }
+        uint32_t drop = num - (p->cap - p->num);
+        if(drop > p->num) drop = p->num;
+        ESP_LOGW(TAG, "LFRingWriteAsync: queue full, dropped %u old items", (unsigned int)drop);
+        p->num -= drop;
+        memmove(p->buf, p->buf + (size_t)drop * meta->item_size, (size_t)p->num * meta->item_size);
+        ringbuf_pending_queue(meta, data, num);
+        n = num;
+    }
+
+    xSemaphoreGive(meta->lock);
+    return n;
+}
+
+/**
+ * @brief  Logical offset up to which items are written and committed.
+ *
+ * Every item below the returned offset survives a reset; queued items
+ * at or above it may not.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ *
+ * @return One past the logical offset of the newest durable item.
+ */
+uint64_t LFRingDurableOffset(ringbuf_meta_t *meta) {
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    uint64_t offset = meta->pending.durable;
+    xSemaphoreGive(meta->lock);
+    return offset;
+}
+
+/**
+ * @brief  Set up the staging ring used by LFRingWriteFromISR().
+ *
+ * The ring needs a pending buffer (LFRingSetFlush()) and is serviced by
+ * the flush task. Must not run while an ISR may write to the ring.
+ *
+ * @param meta         Pointer to the ring buffer metadata structure.
+ * @param stagingItems Capacity of the staging ring, a power of two, 0 to remove it.
+ *
+ * @return
+ *      - LFRB_OK: Staging ring ready (or removed).
+ *      - LFRB_CONFIG_ERROR: No pending buffer, or @p stagingItems not a power of two.
+ *      - LFRB_NO_MEM_ERROR: Staging ring could not be allocated in internal RAM.
+ */
+int LFRingSetISR(ringbuf_meta_t *meta, uint32_t stagingItems) {
+    if(stagingItems & (stagingItems - 1)) return -LFRB_CONFIG_ERROR;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    int status = LFRB_OK;
+    if(stagingItems > 0 && meta->pending.cap == 0) {
+        status = -LFRB_CONFIG_ERROR;
+    } else {
+        // Items still staged go to the pending buffer first
+        while(ringbuf_isr_collect(meta) > 0 && ringbuf_pending_flush(meta) == LFRB_OK);
+        ringbuf_isr_release(meta);
+        if(stagingItems > 0) {
+            if(meta->mem != NULL) {
+                meta->isr.buf = stagingItems <= meta->mem->isr_items ? meta->mem->isr : NULL;
+            } else {
+                meta->isr.buf = heap_caps_malloc((size_t)stagingItems * meta->item_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            }
+            if(meta->isr.buf == NULL) status = -LFRB_NO_MEM_ERROR;
+            else meta->isr.cap = stagingItems;
+        }
+    }
+    xSemaphoreGive(meta->lock);
+    return status;
+}
+
+/**
+ * @brief  Stage items from an interrupt handler.
+ *
+ * Lock-free and without flash access: the items are copied into the
+ * staging ring set up by LFRingSetISR() and the flush task is woken to move
+ * them into the ring in batches. Only one ISR (or task) may write to a ring
+ * this way at a time. Items that do not fit are dropped and counted in
+ * meta->isr.dropped.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param data Pointer to the items to stage.
+ * @param num  Number of items to stage.
+ *
+ * @return Number of items staged.
+ */
+int IRAM_ATTR LFRingWriteFromISR(ringbuf_meta_t *meta, const void* data, size_t num) {
+    ringbuf_isr_t *s = &meta->isr;
+    if(s->cap == 0) return 0;
+
+    uint32_t head = s->head;
+    uint32_t used = head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+    uint32_t n = num < s->cap - used ? num : s->cap - used;
+    for(uint32_t done = 0; done < n; ) {
+        uint32_t at = (head + done) & (s->cap - 1);
+        uint32_t k = s->cap - at < n - done ? s->cap - at : n - done;
+        memcpy(s->buf + (size_t)at * meta->item_size, (const uint8_t *)data + (size_t)done * meta->item_size,
+               (size_t)k * meta->item_size);
+        done += k;
+    }
+    __atomic_store_n(&s->head, head + n, __ATOMIC_RELEASE);
+    if(n < num) s->dropped += num - n;
+
+    // Wake the flush task for the first staged item and at half capacity
+    TaskHandle_t task = flush_task;
+    if(task != NULL && n > 0 && (used == 0 || (used + n) * 2 >= s->cap)) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task, &woken);
+        if(woken == pdTRUE) portYIELD_FROM_ISR();
+    }
+    return n;
+}
+
+/**
+ * @brief  Set up double-buffered ingestion for LFRingWriteStream().
+ *
+ * Two buffers of @p bufferItems items each: the producer fills one while
+ * the flush task writes the other through the regular write path. The
+ * buffers swap when the one being filled is full. A ring with a stream
+ * takes its items through LFRingWriteStream() only. Rings set up with
+ * LFRingInitStatic() use mem->stream (LFRB_STREAM_BYTES()) and the
+ * semaphore storage in mem.
+ *
+ * @param meta        Pointer to the ring buffer metadata structure.
+ * @param bufferItems Capacity of each buffer in items.
+ *
+ * @return
+ *      - LFRB_OK: Buffers ready.
+ *      - LFRB_ENUM_EXCEED: @p bufferItems is 0 or exceeds the ring capacity.
+ *      - LFRB_CONFIG_ERROR: Stream already set up, LFRB_FLUSH_MAX_RINGS rings registered, or ring with lanes.
+ *      - LFRB_NO_MEM_ERROR: Buffers could not be allocated, or exceed mem->stream_items.
+ */
+int LFRingSetStream(ringbuf_meta_t *meta, uint32_t bufferItems) {
+    ringbuf_stream_t *s = &meta->stream;
+    ringbuf_static_t *mem = meta->mem;
+    if(bufferItems == 0 || bufferItems > meta->item_num) return -LFRB_ENUM_EXCEED;
+    if(s->cap > 0 || meta->lanes.num != 0) return -LFRB_CONFIG_ERROR;
+
+    memset(s, 0, sizeof(*s));
+    if(mem != NULL) {
+        if(mem->stream == NULL || bufferItems > mem->stream_items) return -LFRB_NO_MEM_ERROR;
+        s->buf[0] = mem->stream;
+        s->buf[1] = mem->stream + (size_t)bufferItems * meta->item_size;
+        s->lock = xSemaphoreCreateMutexStatic(&mem->stream_lock);
+        s->free = xSemaphoreCreateBinaryStatic(&mem->stream_free);
+    } else {
+        s->buf[0] = malloc((size_t)bufferItems * meta->item_size);
+        s->buf[1] = malloc((size_t)bufferItems * meta->item_size);
+        s->lock = xSemaphoreCreateMutex();
+        s->free = xSemaphoreCreateBinary();
+    }
+    if(s->buf[0] == NULL || s->buf[1] == NULL || s->lock == NULL || s->free == NULL) {
+        if(mem == NULL) {
+            free(s->buf[0]);
+            free(s->buf[1]);
+        }
+        if(s->lock != NULL) vSemaphoreDelete(s->lock);
+        if(s->free != NULL) vSemaphoreDelete(s->free);
+        memset(s, 0, sizeof(*s));
+        return -LFRB_NO_MEM_ERROR;
+    }
+    s->cap = bufferItems;
+
+    int status = ringbuf_flush_register(meta, 1);
+    if(status < 0) ringbuf_stream_release(meta);
+    return status;
+}
+
+/**
+ * @brief  Append items to a continuous stream.
+ *
+ * Items are copied into the buffer being filled; when it is full, it is
+ * swapped with the other buffer and handed to the flush task. The call
+ * only waits when the other buffer is still being written, so sustained
+ * throughput is bounded by flash bandwidth rather than per-call latency.
+ * A buffer that fails to write keeps its items and is retried every
+ * LFRB_FLUSH_RETRY_MS; the call waits until it succeeds.
+ *
+ * Do not mix with LFRingWrite(), LFRingWriteAsync() or LFRingWriteFromISR()
+ * on the same ring: buffered stream items reach the ring only when their
+ * buffer is written, after direct writes made in the meantime, so the ring
+ * no longer holds the items in call order.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param data Pointer to the items to append.
+ * @param num  Number of items to append.
+ *
+ * @return >= 0 as number of items accepted, or:
+ *          - LFRB_CONFIG_ERROR: LFRingSetStream() was not called.
+ */
+int LFRingWriteStream(ringbuf_meta_t *meta, const void* data, size_t num) {
+    ringbuf_stream_t *s = &meta->stream;
+    if(s->cap == 0) return -LFRB_CONFIG_ERROR;
+
+    const uint8_t *src = data;
+    size_t left = num;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    while(left > 0) {
+        size_t k = s->cap - s->num < left ? s->cap - s->num : left;
+        memcpy(s->buf[s->fill] + (size_t)s->num * meta->item_size, src, k * meta->item_size);
+        s->num += k;
+        src += k * meta->item_size;
+        left -= k;
+        if(s->num == s->cap) ringbuf_stream_swap(meta);
+    }
+    xSemaphoreGive(s->lock);
+    return num;
+}
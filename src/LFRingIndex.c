@@ -0,0 +1,536 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+// -------------------- time index -------------------- //
+/*
+ * Rings configured with LFRB_TIME_INDEX keep one ringbuf_block_index_t per
+ * block in <namespace>.idx: the smallest and largest timestamp written to
+ * the block. For encoded rings a block is a frame slot and its entry is
+ * written when the frame is sealed. For raw rings a block is a group of block_items
+ * slots; its entry restarts when head enters the block and grows with every
+ * item written to it, so it covers all live items of the block unless head
+ * currently sits inside it.
+ *
+ * Time queries walk the live blocks from tail to head, skip the blocks whose
+ * entry rules them out and only read the payload of the others.
+ */
+/**
+ * @brief Timestamp of a row-format item.
+ */
+uint64_t ringbuf_item_ts(ringbuf_meta_t *meta, const uint8_t *item) {
+    const ringbuf_field_t *f = &meta->codec.fields[meta->codec.ts_field];
+    uint64_t v = ringbuf_field_load(item, f);
+    if(f->type == LFRB_FIELD_INT && f->width < 8 && (v >> (f->width * 8 - 1)) & 1) {
+        v |= ~ringbuf_field_mask(f);
+    }
+    return v;
+}
+
+/**
+ * @brief Compute the index entry of @p count row-format items.
+ */
+void ringbuf_index_rows(ringbuf_meta_t *meta, const uint8_t *rows, uint32_t count, ringbuf_block_index_t *rec) {
+    rec->ts_min = UINT64_MAX;
+    rec->ts_max = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t ts = ringbuf_item_ts(meta, rows + i * meta->item_size);
+        if(ts < rec->ts_min) rec->ts_min = ts;
+        if(ts > rec->ts_max) rec->ts_max = ts;
+    }
+}
+
+/**
+ * @brief Read the index entry of @p block from an open index file.
+ *
+ * @return 1 if the entry was read, 0 otherwise.
+ */
+int ringbuf_index_get(FILE *f, uint32_t block, ringbuf_block_index_t *rec) {
+    if(f == NULL || ringbuf_seek(f, (uint64_t)block * sizeof(*rec)) != 0) return 0;
+    return fread(rec, sizeof(*rec), 1, f) == 1;
+}
+
+/**
+ * @brief Write the index entry of @p block.
+ *
+ * @return
+ *      - LFRB_OK: Entry written.
+ *      - LFRB_LFS_ERROR: Index file could not be written.
+ */
+int ringbuf_index_put(ringbuf_meta_t *meta, FILE *f, uint32_t block, const ringbuf_block_index_t *rec) {
+    char path[LFRB_MAX_PATH];
+    int own = (f == NULL);
+    if(own) {
+        ringbuf_get_path_ext(meta, path, "idx");
+        f = fopen(path, "rb+");
+        if(f == NULL) f = fopen(path, "wb+");
+        if(f == NULL) {
+            ESP_LOGE(TAG, "ringbuf_index_put: failed to open %s", path);
+            return -LFRB_LFS_ERROR;
+        }
+    }
+    size_t n = 0;
+    if(ringbuf_seek(f, (uint64_t)block * sizeof(*rec)) == 0) {
+        ringbuf_fault_point(LFRB_FAULT_LFS);
+        n = fwrite(rec, sizeof(*rec), 1, f);
+    }
+    if(own) fclose(f);
+    return n == 1 ? LFRB_OK : -LFRB_LFS_ERROR;
+}
+
+/**
+ * @brief Fold items written to raw slots starting at @p slot into the index.
+ *
+ * Must be called before head is advanced past the new items.
+ *
+ * @return
+ *      - LFRB_OK: Index updated.
+ *      - LFRB_LFS_ERROR: Index file could not be written.
+ */
+int ringbuf_index_append(ringbuf_meta_t *meta, uint32_t slot, const uint8_t *data, size_t num) {
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "idx");
+    FILE *f = fopen(path, "rb+");
+    if(f == NULL) f = fopen(path, "wb+");
+    if(f == NULL) {
+        ESP_LOGE(TAG, "ringbuf_index_append: failed to open %s", path);
+        return -LFRB_LFS_ERROR;
+    }
+
+    int status = ringbuf_index_fold(meta, f, slot, data, num);
+    fclose(f);
+    return status;
+}
+
+/**
+ * @brief Fold items written to raw slots starting at @p slot into an open index file.
+ *
+ * @return
+ *      - LFRB_OK: Index updated.
+ *      - LFRB_LFS_ERROR: Index file could not be written.
+ */
+int ringbuf_index_fold(ringbuf_meta_t *meta, FILE *f, uint32_t slot, const uint8_t *data, size_t num) {
+    ringbuf_codec_t *c = &meta->codec;
+    int status = LFRB_OK;
+    for(size_t i = 0; i < num; i++) {
+        uint32_t s = ringbuf_slot(meta, (uint64_t)slot + i);
+        uint32_t block = s / c->block_items;
+        uint64_t ts = ringbuf_item_ts(meta, data + i * meta->item_size);
+
+        if(c->idx_block != block) {
+            if(c->idx_block != UINT32_MAX && ringbuf_index_put(meta, f, c->idx_block, &c->idx_cur) < 0) {
+                status = -LFRB_LFS_ERROR;
+            }
+            // Entering a block restarts its entry, otherwise continue the stored one
+            if(s % c->block_items == 0 || !ringbuf_index_get(f, block, &c->idx_cur)) {
+                c->idx_cur.ts_min = c->idx_cur.ts_max = ts;
+            }
+            c->idx_block = block;
+        } else if(s % c->block_items == 0) {
+            c->idx_cur.ts_min = c->idx_cur.ts_max = ts;
+        }
+        if(ts < c->idx_cur.ts_min) c->idx_cur.ts_min = ts;
+        if(ts > c->idx_cur.ts_max) c->idx_cur.ts_max = ts;
+    }
+    if(c->idx_block != UINT32_MAX && ringbuf_index_put(meta, f, c->idx_block, &c->idx_cur) < 0) {
+        status = -LFRB_LFS_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief Describe the live part of the raw block holding offset @p offset.
+ *
+ * @return 1 if @p offset is a live item, 0 at head.
+ */
+int ringbuf_block_at_offset(ringbuf_meta_t *meta, uint64_t offset, ringbuf_block_t *blk) {
+    if(offset >= meta->head) return 0;
+    uint32_t B = meta->codec.block_items;
+    uint32_t slot = ringbuf_slot(meta, offset);
+    uint32_t head_slot = ringbuf_slot(meta, meta->head);
+    uint32_t start = slot - slot % B;
+    uint32_t end = start + B > meta->item_num ? meta->item_num : start + B;
+    int head_inside = head_slot > start && head_slot < end;
+
+    blk->offset = offset;
+    blk->index = slot / B;
+    blk->first = slot - start;
+    blk->num = end - slot;
+    if(blk->num > meta->head - offset) blk->num = meta->head - offset;
+    blk->exact = !head_inside;
+    return 1;
+}
+
+/**
+ * @brief Describe the live part of frame @p seq of an encoded ring.
+ *
+ * The item count and offset of sealed frames are only known once the frame
+ * is loaded by ringbuf_block_rows().
+ *
+ * @return 1 if the block holds live items, 0 past the open block.
+ */
+int ringbuf_block_at_frame(ringbuf_meta_t *meta, uint64_t seq, uint32_t first, ringbuf_block_t *blk) {
+    ringbuf_codec_t *c = &meta->codec;
+    blk->seq = seq;
+    blk->first = first;
+    if(seq == c->frame_head) {
+        blk->index = UINT32_MAX;
+        blk->offset = meta->head - c->open_num + first;
+        blk->num = c->open_num > first ? c->open_num - first : 0;
+        blk->exact = 0;
+        return blk->num > 0;
+    }
+    blk->index = seq % c->frame_num;
+    blk->num = UINT32_MAX;
+    blk->exact = 1;
+    return 1;
+}
+
+/**
+ * @brief Start a walk over the live blocks, oldest first.
+ *
+ * @return 1 if @p blk describes a block, 0 if the ring is empty.
+ */
+int ringbuf_block_first(ringbuf_meta_t *meta, ringbuf_block_t *blk) {
+    if(ringbuf_is_empty(meta)) return 0;
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        return ringbuf_block_at_frame(meta, meta->codec.frame_tail, meta->codec.tail_pos, blk);
+    }
+    return ringbuf_block_at_offset(meta, meta->tail, blk);
+}
+
+/**
+ * @brief Advance a walk started by ringbuf_block_first().
+ *
+ * @return 1 if @p blk describes the next block, 0 at head.
+ */
+int ringbuf_block_next(ringbuf_meta_t *meta, ringbuf_block_t *blk) {
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        if(blk->seq == meta->codec.frame_head) return 0;
+        return ringbuf_block_at_frame(meta, blk->seq + 1, 0, blk);
+    }
+    return ringbuf_block_at_offset(meta, blk->offset + blk->num, blk);
+}
+
+/**
+ * @brief Load the live items of a block in row format.
+ *
+ * Raw blocks are read into scan_buf, sealed frames decoded into dec_buf.
+ * For frames, blk->num and blk->offset are filled in here.
+ *
+ * @return Pointer to the first live item, NULL if the block cannot be read.
+ */
+const uint8_t *ringbuf_block_rows(ringbuf_meta_t *meta, ringbuf_block_t *blk) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(c->type == LFRB_CODEC_NONE) {
+        if(ringbuf_read_items(meta, blk->offset, c->scan_buf, blk->num) != (int)blk->num) return NULL;
+        return c->scan_buf;
+    }
+    if(blk->index == UINT32_MAX) {
+        return c->open_buf + blk->first * meta->item_size;
+    }
+    if(ringbuf_codec_load_frame(meta, blk->seq, LFRB_ALL_FIELDS) < 0) return NULL;
+    blk->num = c->dec_num > blk->first ? c->dec_num - blk->first : 0;
+    blk->offset = c->dec_first + blk->first;
+    return c->dec_buf + blk->first * meta->item_size;
+}
+
+/**
+ * @brief Check whether the index entry of a block rules out [from, to].
+ */
+int ringbuf_block_outside(FILE *idx, const ringbuf_block_t *blk, uint64_t from, uint64_t to) {
+    ringbuf_block_index_t rec;
+    if(!blk->exact || !ringbuf_index_get(idx, blk->index, &rec)) return 0;
+    return rec.ts_max < from || rec.ts_min > to;
+}
+
+/**
+ * @brief Fill in the offset of a sealed frame's first live item from its header.
+ *
+ * @return 1 if blk->offset is known, 0 if the header cannot be read.
+ */
+static int ringbuf_block_locate(ringbuf_meta_t *meta, FILE *data, ringbuf_block_t *blk) {
+    if(meta->codec.type == LFRB_CODEC_NONE || blk->index == UINT32_MAX) return 1;
+    ringbuf_frame_hdr_t hdr;
+    if(data == NULL || ringbuf_codec_header(meta, data, blk->seq, &hdr) < 0) return 0;
+    blk->offset = hdr.first + blk->first;
+    return 1;
+}
+
+/**
+ * @brief Move tail onto the first unread item at or after @p ts.
+ *
+ * Blocks whose index entry lies entirely before @p ts are skipped, and
+ * the search stops at a block entirely at or after it, without reading
+ * their payload (a frame's header tells where it starts); only a block
+ * straddling @p ts is decoded. Pending items must have been written out.
+ *
+ * @return Number of unread items dropped.
+ */
+uint64_t ringbuf_seek_time(ringbuf_meta_t *meta, uint64_t ts) {
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "idx");
+    FILE *idx = fopen(path, "rb");
+    FILE *data = NULL;
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        ringbuf_get_path(meta, path);
+        data = fopen(path, "rb");
+    }
+
+    ringbuf_block_t blk;
+    int found = 0;
+    for(int ok = ringbuf_block_first(meta, &blk); ok; ok = ringbuf_block_next(meta, &blk)) {
+        ringbuf_block_index_t rec;
+        if(blk.exact && ringbuf_index_get(idx, blk.index, &rec)) {
+            if(rec.ts_max < ts) continue;
+            // Sealed frames only learn their offset from the header
+            if(rec.ts_min >= ts && ringbuf_block_locate(meta, data, &blk)) {
+                found = 1;
+                break;
+            }
+        }
+        const uint8_t *rows = ringbuf_block_rows(meta, &blk);
+        if(rows == NULL) continue;
+        for(uint32_t i = 0; i < blk.num && !found; i++) {
+            if(ringbuf_item_ts(meta, rows + i * meta->item_size) >= ts) {
+                found = 1;
+                blk.first += i;
+                blk.offset += i;
+            }
+        }
+        if(found) break;
+    }
+    if(idx != NULL) fclose(idx);
+    if(data != NULL) fclose(data);
+
+    // Move tail onto the item found, or past everything
+    uint64_t tail = found ? blk.offset : meta->head;
+    if(tail == meta->tail) return 0;
+    uint64_t dropped = tail - meta->tail;
+    meta->tail = tail;
+    if(meta->codec.type != LFRB_CODEC_NONE) {
+        meta->codec.frame_tail = found ? blk.seq : meta->codec.frame_head;
+        meta->codec.tail_pos = found ? blk.first : meta->codec.open_num;
+    }
+    return dropped;
+}
+
+/**
+ * @brief Check on the index entry of the oldest block alone whether nothing has expired.
+ *
+ * @return 1 if every unread item is at or after @p cutoff, 0 if unknown.
+ */
+static int ringbuf_ttl_fresh(ringbuf_meta_t *meta, uint64_t cutoff) {
+    ringbuf_block_t blk;
+    if(!ringbuf_block_first(meta, &blk) || !blk.exact) return 0;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "idx");
+    FILE *idx = fopen(path, "rb");
+    ringbuf_block_index_t rec;
+    int fresh = ringbuf_index_get(idx, blk.index, &rec) && rec.ts_min >= cutoff;
+    if(idx != NULL) fclose(idx);
+    return fresh;
+}
+
+/**
+ * @brief Drop the unread items older than the ring's TTL.
+ *
+ * Called by the consuming reads with the lock held and the offsets loaded.
+ * Most calls end on the index entry of the oldest block. Pending items are
+ * newer than every stored one, so they are written out only once the walk
+ * reached head and the oldest of them has expired as well.
+ */
+void ringbuf_ttl_expire(ringbuf_meta_t *meta) {
+    ringbuf_ttl_t *t = &meta->ttl;
+    if(t->clock == NULL) return;
+    uint64_t now = t->clock(t->ctx);
+    if(now <= t->ttl) return;
+    uint64_t cutoff = now - t->ttl;
+
+    uint64_t n = 0;
+    if(!ringbuf_is_empty(meta) && !ringbuf_ttl_fresh(meta, cutoff)) {
+        n = ringbuf_seek_time(meta, cutoff);
+    }
+    const ringbuf_pending_t *p = &meta->pending;
+    if(ringbuf_is_empty(meta) && p->num > 0 && ringbuf_item_ts(meta, p->buf) < cutoff) {
+        // Writing them reloads the offsets, so the tail moved so far is saved first
+        if(n > 0) save_ringbuf_meta(meta);
+        ringbuf_pending_flush(meta);
+        n += ringbuf_seek_time(meta, cutoff);
+    }
+    if(n > 0) {
+        ESP_LOGD(TAG, "%s: %" PRIu64 " items expired", meta->nvs_namespace, n);
+        t->expired += n;
+        save_ringbuf_meta(meta);
+    }
+}
+
+// -------------------- zone maps -------------------- //
+/*
+ * Rings configured with agg_fields keep one ringbuf_block_stats_t per block
+ * in <namespace>.agg: min, max and sum of each summarised field over a run
+ * of consecutive items stored in the block. Entries name the logical offset
+ * of their first item, so an entry is only used when its run lies entirely
+ * inside the live items and the queried range; LFRingAggregate() reads the
+ * payload of the other (edge) blocks. Blocks are the same as the time
+ * index uses: frame slots sealed with their entry, or groups of
+ * block_items raw slots whose entry grows with each write.
+ */
+
+/**
+ * @brief Numeric value of a schema field of a row-format item.
+ */
+double ringbuf_field_value(const uint8_t *item, const ringbuf_field_t *f) {
+    uint64_t v = ringbuf_field_load(item, f);
+    if(f->type == LFRB_FIELD_FLOAT) {
+        if(f->width == 4) {
+            float x;
+            uint32_t bits = (uint32_t)v;
+            memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+        double x;
+        memcpy(&x, &v, sizeof(x));
+        return x;
+    }
+    if(f->type == LFRB_FIELD_INT) {
+        if(f->width < 8 && (v >> (f->width * 8 - 1)) & 1) v |= ~ringbuf_field_mask(f);
+        return (double)(int64_t)v;
+    }
+    return (double)v;
+}
+
+/**
+ * @brief Start an empty summary at logical offset @p first.
+ */
+void ringbuf_stats_start(ringbuf_meta_t *meta, ringbuf_block_stats_t *rec, uint64_t first) {
+    memset(rec, 0, sizeof(*rec));
+    rec->first = first;
+    rec->mask = meta->codec.agg_mask;
+    for(uint8_t k = 0; k < LFRB_AGG_MAX_FIELDS; k++) {
+        rec->f[k].min = DBL_MAX;
+        rec->f[k].max = -DBL_MAX;
+    }
+}
+
+/**
+ * @brief Add one row-format item to a summary.
+ */
+void ringbuf_stats_add(ringbuf_meta_t *meta, ringbuf_block_stats_t *rec, const uint8_t *item) {
+    uint8_t k = 0;
+    for(uint8_t i = 0; i < meta->codec.user_field_num; i++) {
+        if(!(rec->mask & (1u << i))) continue;
+        double v = ringbuf_field_value(item, &meta->codec.fields[i]);
+        if(v < rec->f[k].min) rec->f[k].min = v;
+        if(v > rec->f[k].max) rec->f[k].max = v;
+        rec->f[k].sum += v;
+        k++;
+    }
+    rec->count++;
+}
+
+/**
+ * @brief Summarise @p count row-format items starting at logical offset @p first.
+ */
+void ringbuf_stats_rows(ringbuf_meta_t *meta, const uint8_t *rows, uint32_t count, uint64_t first, ringbuf_block_stats_t *rec) {
+    ringbuf_stats_start(meta, rec, first);
+    for(uint32_t i = 0; i < count; i++) {
+        ringbuf_stats_add(meta, rec, rows + i * meta->item_size);
+    }
+}
+
+/**
+ * @brief Read the summary of @p block from an open .agg file.
+ *
+ * @return 1 if an entry built for the current agg_fields was read, 0 otherwise.
+ */
+int ringbuf_stats_get(ringbuf_meta_t *meta, FILE *f, uint32_t block, ringbuf_block_stats_t *rec) {
+    if(f == NULL || ringbuf_seek(f, (uint64_t)block * sizeof(*rec)) != 0) return 0;
+    if(fread(rec, sizeof(*rec), 1, f) != 1) return 0;
+    return rec->mask == meta->codec.agg_mask && rec->count > 0;
+}
+
+/**
+ * @brief Write the summary of @p block.
+ *
+ * @return
+ *      - LFRB_OK: Entry written.
+ *      - LFRB_LFS_ERROR: .agg file could not be written.
+ */
+int ringbuf_stats_put(ringbuf_meta_t *meta, FILE *f, uint32_t block, const ringbuf_block_stats_t *rec) {
+    char path[LFRB_MAX_PATH];
+    int own = (f == NULL);
+    if(own) {
+        ringbuf_get_path_ext(meta, path, "agg");
+        f = fopen(path, "rb+");
+        if(f == NULL) f = fopen(path, "wb+");
+        if(f == NULL) {
+            ESP_LOGE(TAG, "ringbuf_stats_put: failed to open %s", path);
+            return -LFRB_LFS_ERROR;
+        }
+    }
+    size_t n = 0;
+    if(ringbuf_seek(f, (uint64_t)block * sizeof(*rec)) == 0) {
+        ringbuf_fault_point(LFRB_FAULT_LFS);
+        n = fwrite(rec, sizeof(*rec), 1, f);
+    }
+    if(own) fclose(f);
+    return n == 1 ? LFRB_OK : -LFRB_LFS_ERROR;
+}
+
+/**
+ * @brief Fold items just written to a raw ring at logical offset @p offset.
+ *
+ * The stored entry of a block is continued only by the item right after
+ * its run; any other item starts a new run.
+ *
+ * @return
+ *      - LFRB_OK: Summaries updated.
+ *      - LFRB_LFS_ERROR: .agg file could not be written.
+ */
+int ringbuf_stats_fold(ringbuf_meta_t *meta, uint64_t offset, const uint8_t *data, size_t num) {
+    ringbuf_codec_t *c = &meta->codec;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "agg");
+    FILE *f = fopen(path, "rb+");
+    if(f == NULL) f = fopen(path, "wb+");
+    if(f == NULL) {
+        ESP_LOGE(TAG, "ringbuf_stats_fold: failed to open %s", path);
+        return -LFRB_LFS_ERROR;
+    }
+
+    int status = LFRB_OK;
+    for(size_t i = 0; i < num; i++) {
+        uint64_t o = offset + i;
+        uint32_t s = ringbuf_slot(meta, o);
+        uint32_t block = s / c->block_items;
+        if(c->agg_block != block) {
+            if(c->agg_block != UINT32_MAX && ringbuf_stats_put(meta, f, c->agg_block, &c->agg_cur) < 0) {
+                status = -LFRB_LFS_ERROR;
+            }
+            if(!ringbuf_stats_get(meta, f, block, &c->agg_cur) || c->agg_cur.first + c->agg_cur.count != o) {
+                ringbuf_stats_start(meta, &c->agg_cur, o);
+            }
+            c->agg_block = block;
+        }
+        if(s % c->block_items == 0 || c->agg_cur.first + c->agg_cur.count != o) {
+            ringbuf_stats_start(meta, &c->agg_cur, o);
+        }
+        ringbuf_stats_add(meta, &c->agg_cur, data + i * meta->item_size);
+    }
+    if(c->agg_block != UINT32_MAX && ringbuf_stats_put(meta, f, c->agg_block, &c->agg_cur) < 0) {
+        status = -LFRB_LFS_ERROR;
+    }
+    fclose(f);
+    return status;
+}
+
+/**
+ * @brief Drop all summaries, e.g. when logical offsets start over.
+ */
+void ringbuf_stats_reset(ringbuf_meta_t *meta) {
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "agg");
+    remove(path);
+    meta->codec.agg_block = UINT32_MAX;
+}
@@ -0,0 +1,192 @@
+#ifndef LFRING_INTERNAL_H
+#define LFRING_INTERNAL_H
+// Declarations shared by the LFRing source files, not part of the public API.
+#include "LFRing.h"
+#include "nvs.h"
+#include <string.h>
+#include "esp_log.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include <float.h>
+#include <limits.h>
+
+// Header of a sealed frame of an encoded ring, see LFRingCodec.c
+#define LFRB_FRAME_MAGIC 0x464C
+#define LFRB_FRAME_VERSION 2
+
+typedef struct {
+    uint16_t magic;
+    uint16_t count;         // items in the block
+    uint16_t bytes;         // encoded length, header included
+    uint8_t field_num;
+    uint8_t codec;
+    uint64_t first;         // logical offset of the first item
+    uint32_t crc;           // crc32 over first and [sizeof(header), bytes)
+} ringbuf_frame_hdr_t;
+
+// Numeric fields of row-format items
+static inline uint8_t ringbuf_bit_width(uint64_t v) {
+    return v ? (uint8_t)(64 - __builtin_clzll(v)) : 0;
+}
+
+static inline uint64_t ringbuf_field_mask(const ringbuf_field_t *f) {
+    return f->width >= 8 ? UINT64_MAX : ((1ULL << (f->width * 8)) - 1);
+}
+
+static inline uint64_t ringbuf_field_load(const uint8_t *item, const ringbuf_field_t *f) {
+    uint64_t v = 0;
+    memcpy(&v, item + f->offset, f->width);
+    return v;
+}
+
+static inline void ringbuf_field_store(uint8_t *item, const ringbuf_field_t *f, uint64_t v) {
+    memcpy(item + f->offset, &v, f->width);
+}
+
+// Slot of a logical offset; a mask replaces the division for power-of-two rings
+static inline void ringbuf_set_item_num(ringbuf_meta_t *meta, uint32_t itemNum) {
+    meta->item_num = itemNum;
+    meta->slot_mask = itemNum > 1 && (itemNum & (itemNum - 1)) == 0 ? itemNum - 1 : 0;
+}
+
+static inline uint32_t ringbuf_slot(const ringbuf_meta_t *meta, uint64_t offset) {
+    return meta->slot_mask != 0 ? (uint32_t)(offset & meta->slot_mask) : (uint32_t)(offset % meta->item_num);
+}
+
+// Live part of one block, walked by ringbuf_block_first()/ringbuf_block_next()
+typedef struct {
+    uint64_t offset;    // logical offset of the first live item
+    uint64_t seq;       // frame sequence number (encoded ring)
+    uint32_t index;     // block (raw ring) or frame slot (encoded ring), UINT32_MAX for the open block
+    uint32_t first;     // first live item of the block
+    uint32_t num;       // live items from first on
+    uint8_t exact;      // index entry covers every live item
+} ringbuf_block_t;
+
+// Record header of a shared log, see LFRingLog.c
+#define LFRB_LOG_MAGIC 0x4C47
+#define LFRB_LOG_VERSION 1
+
+typedef struct {
+    uint16_t magic;
+    uint8_t ring;           // index in log->rings
+    uint8_t reserved;
+    uint32_t count;         // items in the record
+    uint32_t len;           // payload bytes
+    uint32_t crc;           // crc32 over the payload
+    uint64_t pos;           // log position of this record
+    uint64_t first;         // logical offset of the first item in its ring
+    uint64_t tail;          // log tail once this record was appended
+} ringbuf_log_hdr_t;
+
+// Slot header of a ring with priority lanes, see LFRingLanes.c
+#define LFRB_LANE_MAGIC 0x4C4E
+#define LFRB_LANE_VERSION 1
+
+typedef struct {
+    uint16_t magic;
+    uint8_t lane;
+    uint8_t reserved;
+    uint32_t crc;           // crc32 over offset, lane and the item
+    uint64_t offset;        // offset of the item in its lane
+} ringbuf_lane_hdr_t;
+
+// ringbuf_stream_t.busy
+#define LFRB_STREAM_FREE 0
+#define LFRB_STREAM_FULL 1          // waiting for the flush task
+#define LFRB_STREAM_WRITING 2
+
+// LFRing.c: meta data, LFS ring buf, rollup, offsets, boot, fault injection
+int reset_ringbuf_meta(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum);
+int init_ringbuf_meta(ringbuf_meta_t *meta, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum);
+int save_ringbuf_meta(ringbuf_meta_t *meta);
+int load_ringbuf_meta(ringbuf_meta_t *meta);
+int ringbuf_seek(FILE *f, uint64_t pos);
+size_t ringbuf_pio(int fd, uint64_t pos, void *buf, size_t len, int write);
+int reset_ringbuf_lfs(ringbuf_meta_t *meta);
+int ringbuf_write(ringbuf_meta_t *meta, uint64_t offset, const void* data, size_t num);
+int ringbuf_read_items(ringbuf_meta_t *meta, uint64_t offset, void* out_data, size_t num);
+int ringbuf_read(ringbuf_meta_t *meta, void* out_data, size_t num);
+void ringbuf_get_path(ringbuf_meta_t *meta, char *path);
+void ringbuf_get_path_ext(ringbuf_meta_t *meta, char *path, const char *ext);
+void ringbuf_rollup_feed(ringbuf_meta_t *meta, const uint8_t *rows, size_t num);
+void ringbuf_rollup_raw(ringbuf_meta_t *meta, uint64_t end);
+void ringbuf_fault_point(uint8_t op);
+int ringbuf_boot_finish(ringbuf_meta_t *meta);
+
+// LFRingCodec.c: block codec
+int ringbuf_codec_config(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum, const ringbuf_config_t *config);
+void ringbuf_codec_free(ringbuf_meta_t *meta);
+int ringbuf_stage_load(ringbuf_meta_t *meta);
+int ringbuf_codec_header(ringbuf_meta_t *meta, FILE *f, uint64_t seq, ringbuf_frame_hdr_t *hdr);
+int ringbuf_codec_write(ringbuf_meta_t *meta, const void* data, size_t num);
+int ringbuf_codec_load_frame(ringbuf_meta_t *meta, uint64_t seq, uint32_t mask);
+int ringbuf_codec_read(ringbuf_meta_t *meta, void* out_data, size_t num, uint32_t mask);
+int ringbuf_codec_find(ringbuf_meta_t *meta, uint64_t lo, uint64_t offset, uint64_t *seq);
+int ringbuf_codec_read_at(ringbuf_meta_t *meta, uint64_t lo, uint64_t offset, void* out_data, size_t num);
+int ringbuf_is_empty(ringbuf_meta_t *meta);
+
+// LFRingIndex.c: time index, zone maps
+uint64_t ringbuf_item_ts(ringbuf_meta_t *meta, const uint8_t *item);
+void ringbuf_index_rows(ringbuf_meta_t *meta, const uint8_t *rows, uint32_t count, ringbuf_block_index_t *rec);
+int ringbuf_index_get(FILE *f, uint32_t block, ringbuf_block_index_t *rec);
+int ringbuf_index_put(ringbuf_meta_t *meta, FILE *f, uint32_t block, const ringbuf_block_index_t *rec);
+int ringbuf_index_append(ringbuf_meta_t *meta, uint32_t slot, const uint8_t *data, size_t num);
+int ringbuf_index_fold(ringbuf_meta_t *meta, FILE *f, uint32_t slot, const uint8_t *data, size_t num);
+int ringbuf_block_at_offset(ringbuf_meta_t *meta, uint64_t offset, ringbuf_block_t *blk);
+int ringbuf_block_first(ringbuf_meta_t *meta, ringbuf_block_t *blk);
+int ringbuf_block_next(ringbuf_meta_t *meta, ringbuf_block_t *blk);
+const uint8_t *ringbuf_block_rows(ringbuf_meta_t *meta, ringbuf_block_t *blk);
+int ringbuf_block_outside(FILE *idx, const ringbuf_block_t *blk, uint64_t from, uint64_t to);
+uint64_t ringbuf_seek_time(ringbuf_meta_t *meta, uint64_t ts);
+void ringbuf_ttl_expire(ringbuf_meta_t *meta);
+double ringbuf_field_value(const uint8_t *item, const ringbuf_field_t *f);
+void ringbuf_stats_rows(ringbuf_meta_t *meta, const uint8_t *rows, uint32_t count, uint64_t first, ringbuf_block_stats_t *rec);
+int ringbuf_stats_get(ringbuf_meta_t *meta, FILE *f, uint32_t block, ringbuf_block_stats_t *rec);
+int ringbuf_stats_put(ringbuf_meta_t *meta, FILE *f, uint32_t block, const ringbuf_block_stats_t *rec);
+int ringbuf_stats_fold(ringbuf_meta_t *meta, uint64_t offset, const uint8_t *data, size_t num);
+void ringbuf_stats_reset(ringbuf_meta_t *meta);
+
+// LFRingLog.c: shared log
+void ringbuf_log_path(ringbuf_log_t *log, char *path);
+int ringbuf_log_header(ringbuf_log_t *log, FILE *f, uint64_t pos, ringbuf_log_hdr_t *hdr);
+int ringbuf_log_save(ringbuf_log_t *log);
+int ringbuf_log_append(ringbuf_log_t *log, uint8_t ring, const void *data, size_t num);
+int ringbuf_log_copy(ringbuf_log_t *log, uint8_t ring, uint64_t offset, void *out, size_t num, uint64_t *next);
+int ringbuf_log_read(ringbuf_meta_t *meta, void *out_data, size_t num);
+void ringbuf_log_sync_meta(ringbuf_meta_t *meta);
+
+// LFRingLanes.c: priority lanes
+int ringbuf_lanes_save(ringbuf_meta_t *meta);
+void ringbuf_lanes_sync_meta(ringbuf_meta_t *meta);
+int ringbuf_lanes_write(ringbuf_meta_t *meta, uint8_t lane, const void *data, size_t num);
+int ringbuf_lanes_read(ringbuf_meta_t *meta, void *out_data, size_t num);
+void ringbuf_lanes_free(ringbuf_meta_t *meta);
+
+// LFRingMigrate.c: migration
+int ringbuf_migrate_resume(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace);
+int ringbuf_migrate_begin(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum);
+int ringbuf_migrate_step(ringbuf_meta_t *meta, uint32_t max);
+
+// LFRingFlush.c: flush scheduler
+int ringbuf_write_through(ringbuf_meta_t *meta, const void* data, size_t num);
+int ringbuf_commit(ringbuf_meta_t *meta);
+void ringbuf_wake(ringbuf_meta_t *meta, int num);
+uint32_t ringbuf_isr_collect(ringbuf_meta_t *meta);
+int ringbuf_pending_put(ringbuf_meta_t *meta, const void *data, size_t num);
+int ringbuf_pending_flush(ringbuf_meta_t *meta);
+void ringbuf_pending_need(ringbuf_meta_t *meta, uint64_t end);
+int ringbuf_pending_release(ringbuf_meta_t *meta);
+void ringbuf_stream_release(ringbuf_meta_t *meta);
+void ringbuf_isr_release(ringbuf_meta_t *meta);
+int ringbuf_flush_register(ringbuf_meta_t *meta, int add);
+
+#endif
@@ -0,0 +1,507 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+// -------------------- priority lanes -------------------- //
+/*
+ * A ring with lanes stores items of up to LFRB_LANE_MAX priorities in one
+ * file, <namespace>.bin, of item_num fixed slots:
+ *
+ *     [ringbuf_lane_hdr_t][item_size bytes]
+ *
+ * Any slot may hold an item of any lane. Every lane numbers its items with
+ * offsets of its own; an item is live while its offset lies in
+ * [tail, head) of its lane, so reading or evicting an item only moves a
+ * tail and frees its slot. RAM chains the slots of every lane oldest first,
+ * and the free slots, through next[]; LFRingInitLanes() rebuilds the chains
+ * from the slot headers.
+ *
+ * A write takes free slots first, then the slots of the oldest items of the
+ * lowest lane holding any, up to its own lane. The heads and tails moved by
+ * a batch are committed before its slots are overwritten: after a power cut
+ * in between, a slot still holds an item that is already dead, never one
+ * that an offset committed later would bring back.
+ */
+typedef struct {
+    uint32_t version;
+    uint32_t item_size;
+    uint32_t item_num;
+    uint32_t lane_num;
+    uint64_t head[LFRB_LANE_MAX];
+    uint64_t tail[LFRB_LANE_MAX];
+} ringbuf_lanes_state_t;
+
+// Slot of a rebuilt lane, sorted by lane and offset
+typedef struct {
+    uint64_t offset;
+    uint32_t slot;
+    uint8_t lane;
+} ringbuf_lane_entry_t;
+
+static uint32_t ringbuf_lane_crc(const ringbuf_lane_hdr_t *hdr, const void *item, uint32_t size) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->offset, sizeof(hdr->offset));
+    crc = esp_rom_crc32_le(crc, &hdr->lane, 1);
+    return esp_rom_crc32_le(crc, item, size);
+}
+
+static uint64_t ringbuf_lane_pos(ringbuf_meta_t *meta, uint32_t slot) {
+    return (uint64_t)slot * (sizeof(ringbuf_lane_hdr_t) + meta->item_size);
+}
+
+static void ringbuf_lane_free_slot(ringbuf_lanes_t *l, uint32_t slot) {
+    l->next[slot] = l->free;
+    l->free = slot;
+}
+
+static void ringbuf_lane_push(ringbuf_lanes_t *l, uint8_t lane, uint32_t slot) {
+    l->next[slot] = UINT32_MAX;
+    if(l->count[lane] == 0) l->first[lane] = slot;
+    else l->next[l->last[lane]] = slot;
+    l->last[lane] = slot;
+    l->count[lane]++;
+}
+
+static uint32_t ringbuf_lane_pop(ringbuf_lanes_t *l, uint8_t lane) {
+    uint32_t slot = l->first[lane];
+    l->first[lane] = l->next[slot];
+    l->count[lane]--;
+    return slot;
+}
+
+/**
+ * @brief Checkpoint the heads and tails of all lanes to NVS.
+ *
+ * @return
+ *      - LFRB_OK: State saved.
+ *      - LFRB_NVS_ERROR: NVS namespace cannot be opened or written; the
+ *        ring stays dirty.
+ */
+int ringbuf_lanes_save(ringbuf_meta_t *meta) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    ringbuf_lanes_state_t state = {
+        .version = LFRB_LANE_VERSION,
+        .item_size = meta->item_size,
+        .item_num = meta->item_num,
+        .lane_num = l->num,
+    };
+    memcpy(state.head, l->head, sizeof(state.head));
+    memcpy(state.tail, l->tail, sizeof(state.tail));
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(meta->nvs_namespace, NVS_READWRITE, &handle);
+    if(err == ESP_OK) {
+        err = nvs_set_blob(handle, "lanes", &state, sizeof(state));
+        ringbuf_fault_point(LFRB_FAULT_NVS);
+        if(err == ESP_OK) err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit lanes of %s (%s)", meta->nvs_namespace, esp_err_to_name(err));
+        meta->dirty = 1;
+        return -LFRB_NVS_ERROR;
+    }
+    meta->dirty = 0;
+    return LFRB_OK;
+}
+
+/**
+ * @brief Load the heads and tails of the last checkpoint.
+ *
+ * @return 1 if a checkpoint of the same geometry was loaded, 0 otherwise.
+ */
+static int ringbuf_lanes_load(ringbuf_meta_t *meta) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    ringbuf_lanes_state_t state;
+    size_t len = sizeof(state);
+    nvs_handle_t handle;
+    if(nvs_open(meta->nvs_namespace, NVS_READONLY, &handle) != ESP_OK) return 0;
+    esp_err_t err = nvs_get_blob(handle, "lanes", &state, &len);
+    nvs_close(handle);
+    if(err != ESP_OK || len != sizeof(state)) return 0;
+    if(state.version != LFRB_LANE_VERSION || state.item_size != meta->item_size ||
+       state.item_num != meta->item_num || state.lane_num != l->num) {
+        ESP_LOGW(TAG, "Item structure of %s changed. Resetting ring.", meta->nvs_namespace);
+        return 0;
+    }
+    for(uint8_t i = 0; i < l->num; i++) {
+        if(state.tail[i] > state.head[i]) return 0;
+    }
+    memcpy(l->head, state.head, sizeof(l->head));
+    memcpy(l->tail, state.tail, sizeof(l->tail));
+    return 1;
+}
+
+/**
+ * @brief Empty every lane, truncate the data file and checkpoint.
+ *
+ * Offsets keep counting, so items of the old file stay dead.
+ *
+ * @return Propagate errors from reset_ringbuf_lfs() and ringbuf_lanes_save().
+ */
+static int ringbuf_lanes_reset(ringbuf_meta_t *meta) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    l->free = UINT32_MAX;
+    for(uint32_t slot = meta->item_num; slot-- > 0; ) ringbuf_lane_free_slot(l, slot);
+    for(uint8_t i = 0; i < l->num; i++) {
+        l->tail[i] = l->head[i];
+        l->count[i] = 0;
+    }
+    int status = reset_ringbuf_lfs(meta);
+    int saved = ringbuf_lanes_save(meta);
+    return status < 0 ? status : saved;
+}
+
+static int ringbuf_lane_entry_cmp(const void *a, const void *b) {
+    const ringbuf_lane_entry_t *x = a, *y = b;
+    if(x->lane != y->lane) return x->lane < y->lane ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/**
+ * @brief Chain the slots of every lane from the slot headers.
+ *
+ * Only the headers are read; a torn item is found by its crc once read.
+ * Slots past the end of the file, or holding dead items, are free.
+ *
+ * @return
+ *      - LFRB_OK: Lanes rebuilt.
+ *      - LFRB_NO_MEM_ERROR: No room to sort the slots.
+ *      - Propagate errors from ringbuf_lanes_reset() if the file is missing.
+ */
+static int ringbuf_lanes_rebuild(ringbuf_meta_t *meta) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        ESP_LOGW(TAG, "Data file of %s missing. Resetting ring.", meta->nvs_namespace);
+        return ringbuf_lanes_reset(meta);
+    }
+    ringbuf_lane_entry_t *live = malloc((size_t)meta->item_num * sizeof(*live));
+    if(live == NULL) {
+        close(fd);
+        return -LFRB_NO_MEM_ERROR;
+    }
+
+    uint32_t n = 0;
+    l->free = UINT32_MAX;
+    for(uint32_t slot = meta->item_num; slot-- > 0; ) {
+        ringbuf_lane_hdr_t hdr;
+        size_t k = ringbuf_pio(fd, ringbuf_lane_pos(meta, slot), &hdr, sizeof(hdr), 0);
+        if(k == sizeof(hdr) && hdr.magic == LFRB_LANE_MAGIC && hdr.lane < l->num &&
+           hdr.offset >= l->tail[hdr.lane] && hdr.offset < l->head[hdr.lane]) {
+            live[n++] = (ringbuf_lane_entry_t){hdr.offset, slot, hdr.lane};
+        } else {
+            ringbuf_lane_free_slot(l, slot);
+        }
+    }
+    close(fd);
+
+    qsort(live, n, sizeof(*live), ringbuf_lane_entry_cmp);
+    memset(l->count, 0, sizeof(l->count));
+    for(uint32_t i = 0; i < n; i++) ringbuf_lane_push(l, live[i].lane, live[i].slot);
+    free(live);
+    return LFRB_OK;
+}
+
+/**
+ * @brief Copy the item counts of all lanes into @p meta.
+ *
+ * head counts the items ever stored, tail trails it by the items held, so
+ * the offset getters and LFRingIsEmpty() see the ring as a whole.
+ */
+void ringbuf_lanes_sync_meta(ringbuf_meta_t *meta) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    uint64_t head = 0, held = 0;
+    for(uint8_t i = 0; i < l->num; i++) {
+        head += l->head[i];
+        held += l->count[i];
+    }
+    meta->head = head;
+    meta->tail = head - held;
+}
+
+/**
+ * @brief Take a slot for an item of @p lane: a free one, else the oldest
+ *        item of the lowest lane not above @p lane.
+ *
+ * The evicted item's lane tail moves past it, read from the slot header.
+ *
+ * @return Slot, UINT32_MAX if every held item outranks @p lane.
+ */
+static uint32_t ringbuf_lane_take(ringbuf_meta_t *meta, int fd, uint8_t lane) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    if(l->free != UINT32_MAX) {
+        uint32_t slot = l->free;
+        l->free = l->next[slot];
+        return slot;
+    }
+    uint8_t victim = 0;
+    while(victim <= lane && l->count[victim] == 0) victim++;
+    if(victim > lane) return UINT32_MAX;
+
+    uint32_t slot = ringbuf_lane_pop(l, victim);
+    ringbuf_lane_hdr_t hdr;
+    if(ringbuf_pio(fd, ringbuf_lane_pos(meta, slot), &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+       hdr.magic == LFRB_LANE_MAGIC && hdr.lane == victim && hdr.offset >= l->tail[victim]) {
+        l->tail[victim] = hdr.offset + 1;
+    }
+    l->evicted[victim]++;
+    return slot;
+}
+
+/**
+ * @brief Write @p num items into lane @p lane and commit them.
+ *
+ * Items that do not fit beside the items of higher lanes are the lowest
+ * priority of all: the oldest of them are counted as evicted right away.
+ *
+ * @return
+ *      - Number of items accepted, evicted ones included.
+ *      - LFRB_NFILE_ERROR: Data file could not be recreated.
+ *      - LFRB_LFS_ERROR: No item could be written.
+ *      - Propagate errors from ringbuf_lanes_save() if nothing was written.
+ */
+int ringbuf_lanes_write(ringbuf_meta_t *meta, uint8_t lane, const void *data, size_t num) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    int fd = open(path, O_RDWR);
+    if(fd < 0) {
+        // Same recovery as ringbuf_write(): start over empty
+        ringbuf_lanes_reset(meta);
+        fd = open(path, O_RDWR);
+        if(fd < 0) {
+            ESP_LOGE(TAG, "ringbuf_lanes_write: failed to recreate file %s", path);
+            return -LFRB_NFILE_ERROR;
+        }
+    }
+
+    uint32_t room = meta->item_num;
+    for(uint8_t i = lane + 1; i < l->num; i++) room -= l->count[i];
+    size_t skip = num > room ? num - room : 0;
+    const uint8_t *src = (const uint8_t *)data + skip * meta->item_size;
+    uint64_t evicted = 0;
+    for(uint8_t i = 0; i <= lane; i++) evicted -= l->evicted[i];
+    l->evicted[lane] += skip;
+
+    size_t n = 0;
+    int status = LFRB_OK;
+    ringbuf_lane_hdr_t *hdr = (ringbuf_lane_hdr_t *)l->buf;
+    while(skip + n < num && status == LFRB_OK) {
+        uint32_t slots[LFRB_LANE_BATCH];
+        uint32_t k = num - skip - n < LFRB_LANE_BATCH ? (uint32_t)(num - skip - n) : LFRB_LANE_BATCH;
+        for(uint32_t i = 0; i < k; i++) {
+            slots[i] = ringbuf_lane_take(meta, fd, lane);
+            if(slots[i] == UINT32_MAX) k = i;
+        }
+
+        // Reserve the offsets before the slots are reused
+        uint64_t first = l->head[lane];
+        l->head[lane] += k;
+        status = ringbuf_lanes_save(meta);
+        uint32_t done = 0;
+        if(status == LFRB_OK) {
+            for(; done < k; done++) {
+                memset(hdr, 0, sizeof(*hdr));
+                hdr->magic = LFRB_LANE_MAGIC;
+                hdr->lane = lane;
+                hdr->offset = first + done;
+                memcpy(l->buf + sizeof(*hdr), src + (n + done) * meta->item_size, meta->item_size);
+                hdr->crc = ringbuf_lane_crc(hdr, l->buf + sizeof(*hdr), meta->item_size);
+                size_t len = sizeof(*hdr) + meta->item_size;
+                if(ringbuf_pio(fd, ringbuf_lane_pos(meta, slots[done]), l->buf, len, 1) != len) {
+                    status = -LFRB_LFS_ERROR;
+                    break;
+                }
+                ringbuf_lane_push(l, lane, slots[done]);
+            }
+        } else {
+            l->head[lane] = first;
+        }
+        // Slots of items not written are free again; their offsets stay unused
+        for(uint32_t i = done; i < k; i++) ringbuf_lane_free_slot(l, slots[i]);
+        n += done;
+    }
+    if(close(fd) != 0 && status == LFRB_OK) status = -LFRB_LFS_ERROR;
+
+    for(uint8_t i = 0; i <= lane; i++) evicted += l->evicted[i];
+    if(evicted != 0) {
+        ESP_LOGW(TAG, "LFRingWriteLane: %s full, overwrote %" PRIu64 " items of lanes up to %u",
+                 meta->nvs_namespace, evicted, (unsigned int)lane);
+    }
+    if(status < 0) {
+        ESP_LOGE(TAG, "ringbuf_lanes_write: wrote %u of %u items", (unsigned int)n, (unsigned int)(num - skip));
+        if(n == 0) return status;
+    }
+    return skip + n;
+}
+
+/**
+ * @brief Consume up to @p num items, highest lane first, and commit the tails.
+ *
+ * Items whose slot fails its crc are skipped.
+ *
+ * @return Number of items read.
+ */
+int ringbuf_lanes_read(ringbuf_meta_t *meta, void *out_data, size_t num) {
+    ringbuf_lanes_t *l = &meta->lanes;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        ringbuf_lanes_reset(meta);
+        return 0;
+    }
+
+    size_t n = 0;
+    size_t len = sizeof(ringbuf_lane_hdr_t) + meta->item_size;
+    const ringbuf_lane_hdr_t *hdr = (const ringbuf_lane_hdr_t *)l->buf;
+    for(int lane = l->num - 1; lane >= 0 && n < num; lane--) {
+        while(n < num && l->count[lane] > 0) {
+            uint32_t slot = ringbuf_lane_pop(l, (uint8_t)lane);
+            ringbuf_lane_free_slot(l, slot);
+            if(ringbuf_pio(fd, ringbuf_lane_pos(meta, slot), l->buf, len, 0) != len ||
+               hdr->magic != LFRB_LANE_MAGIC || hdr->lane != lane || hdr->offset < l->tail[lane] ||
+               hdr->crc != ringbuf_lane_crc(hdr, l->buf + sizeof(*hdr), meta->item_size)) {
+                ESP_LOGW(TAG, "LFRingRead: corrupt item in slot %u of %s", (unsigned int)slot, meta->nvs_namespace);
+                continue;
+            }
+            l->tail[lane] = hdr->offset + 1;
+            memcpy((uint8_t *)out_data + n * meta->item_size, l->buf + sizeof(*hdr), meta->item_size);
+            n++;
+        }
+    }
+    close(fd);
+    ringbuf_lanes_save(meta);
+    return n;
+}
+
+/**
+ * @brief Release the slot chains of a ring with lanes.
+ */
+void ringbuf_lanes_free(ringbuf_meta_t *meta) {
+    free(meta->lanes.next);
+    free(meta->lanes.buf);
+    memset(&meta->lanes, 0, sizeof(meta->lanes));
+}
+
+/**
+ * @brief  Initialize a ring whose items are served by priority.
+ *
+ * The ring holds up to @p itemNum items of @p itemSize bytes in @p laneNum
+ * lanes sharing one data file, <root>/<nvs_namespace>.bin, and one NVS
+ * checkpoint. Lane i holds the items of priority i, higher is more
+ * important; LFRingWrite() writes to lane 0, LFRingWriteLane() to any lane.
+ * LFRingRead() returns the oldest items of the highest non-empty lane
+ * first and goes on with the lanes below. A full ring makes room by
+ * evicting the oldest items of its lowest non-empty lane, never those of a
+ * lane above the one written; items that do not fit beside higher lanes
+ * are counted in lanes.evicted like the ones overwritten.
+ *
+ * Every slot carries a 16-byte header, and RAM keeps 4 bytes per slot to
+ * chain the lanes, rebuilt at init from the slot headers. A change of
+ * geometry or lane number starts the ring over empty. LFRingIsEmpty(),
+ * LFRingSetWake() and the offset getters work as usual, the offsets counting
+ * the items of all lanes; calls that address items by offset, pending
+ * buffers and streams fail with LFRB_CONFIG_ERROR.
+ *
+ * @param meta          Pointer to the ring buffer metadata structure.
+ * @param root          Path to the LittleFS directory used for storing ring buffer data.
+ * @param nvs_namespace Name of the NVS namespace used to store metadata.
+ * @param itemSize      Size (in bytes) of each data item.
+ * @param itemNum       Number of items all lanes hold together.
+ * @param laneNum       Number of lanes, 1 to LFRB_LANE_MAX.
+ *
+ * @return
+ *      - LFRB_OK: Ring ready.
+ *      - LFRB_CONFIG_ERROR: Invalid geometry or lane number.
+ *      - LFRB_ROOT_NOT_FOUND_ERROR: LittleFS root path not found.
+ *      - LFRB_NO_MEM_ERROR: Slot chains could not be allocated.
+ *      - Propagate errors from ringbuf_lanes_reset().
+ */
+int LFRingInitLanes(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace, uint32_t itemSize, uint32_t itemNum, uint8_t laneNum) {
+    if(itemSize == 0 || itemNum == 0 || itemNum == UINT32_MAX || laneNum == 0 || laneNum > LFRB_LANE_MAX) {
+        return -LFRB_CONFIG_ERROR;
+    }
+    int64_t start = esp_timer_get_time();
+    struct stat st;
+    if(stat(root, &st) != 0) {
+        ESP_LOGE(TAG, "Root path not found: %s", root);
+        return -LFRB_ROOT_NOT_FOUND_ERROR;
+    }
+
+    meta->mem = NULL;
+    meta->log = NULL;
+    ringbuf_codec_config(meta, itemSize, itemNum, NULL);
+    memset(&meta->boot, 0, sizeof(meta->boot));
+    // Slots are checked by their crc when read
+    meta->boot.verify_next = UINT64_MAX;
+    memset(&meta->pending, 0, sizeof(meta->pending));
+    memset(&meta->isr, 0, sizeof(meta->isr));
+    memset(&meta->stream, 0, sizeof(meta->stream));
+    memset(&meta->cache, 0, sizeof(meta->cache));
+    memset(&meta->rollup, 0, sizeof(meta->rollup));
+    memset(&meta->ttl, 0, sizeof(meta->ttl));
+    meta->wake = NULL;
+    meta->wake_ctx = NULL;
+    meta->dirty = 0;
+    strncpy(meta->root, root, sizeof(meta->root)-1);
+    meta->root[sizeof(meta->root)-1] = '\0';
+    strncpy(meta->nvs_namespace, nvs_namespace, sizeof(meta->nvs_namespace)-1);
+    meta->nvs_namespace[sizeof(meta->nvs_namespace)-1] = '\0';
+    meta->item_size = itemSize;
+    ringbuf_set_item_num(meta, itemNum);
+
+    ringbuf_lanes_t *l = &meta->lanes;
+    memset(l, 0, sizeof(*l));
+    l->num = laneNum;
+    l->next = malloc((size_t)itemNum * sizeof(uint32_t));
+    l->buf = malloc(sizeof(ringbuf_lane_hdr_t) + itemSize);
+    if(l->next == NULL || l->buf == NULL) {
+        ringbuf_lanes_free(meta);
+        return -LFRB_NO_MEM_ERROR;
+    }
+
+    int status = ringbuf_lanes_load(meta) ? ringbuf_lanes_rebuild(meta) : ringbuf_lanes_reset(meta);
+    if(status == -LFRB_NO_MEM_ERROR) {
+        ringbuf_lanes_free(meta);
+        return status;
+    }
+    ringbuf_lanes_sync_meta(meta);
+    meta->pending.durable = meta->pending.notified = meta->head;
+    meta->lock = xSemaphoreCreateMutex();
+    meta->boot.total_us = (uint32_t)(esp_timer_get_time() - start);
+    return status;
+}
+
+/**
+ * @brief  Write items into one lane of a ring set up with LFRingInitLanes().
+ *
+ * The items are committed before the call returns, like LFRingWrite() on a
+ * plain ring. Room is made by evicting the oldest items of the lowest
+ * non-empty lane up to @p lane; when the lanes above hold the rest of the
+ * ring, the oldest of the new items are dropped instead and counted in
+ * lanes.evicted[@p lane].
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param lane Lane to write to, its priority; below lanes.num.
+ * @param data Items to write.
+ * @param num  Number of items to write.
+ *
+ * @return >= 0 as number of items accepted, evicted ones included, or:
+ *          - LFRB_CONFIG_ERROR: Ring has no lanes, or no lane @p lane.
+ *          - LFRB_ENUM_EXCEED: @p num exceeds the ring capacity.
+ *          - Propagate errors from ringbuf_lanes_write().
+ */
+int LFRingWriteLane(ringbuf_meta_t *meta, uint8_t lane, const void* data, size_t num) {
+    if(lane >= meta->lanes.num) return -LFRB_CONFIG_ERROR;
+    if(num > meta->item_num) return -LFRB_ENUM_EXCEED;
+
+    xSemaphoreTake(meta->lock, portMAX_DELAY);
+    int n = ringbuf_lanes_write(meta, lane, data, num);
+    ringbuf_lanes_sync_meta(meta);
+    ringbuf_wake(meta, n);
+    xSemaphoreGive(meta->lock);
+    return n;
+}
@@ -0,0 +1,545 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+int ringbuf_log_replay(ringbuf_log_t *log, FILE *f);
+
+// -------------------- shared log -------------------- //
+/*
+ * A shared log stores the items of up to LFRB_LOG_MAX_RINGS logical rings in
+ * one circular file, <namespace>.log, as a sequence of records:
+ *
+ *     [ringbuf_log_hdr_t][count * item_size payload bytes]
+ *
+ * Records are addressed by a monotonic 64-bit log position; a record lives at
+ * byte pos % capacity and may wrap around the end of the file. Writes to
+ * different rings land next to each other, and the oldest records are evicted
+ * when the file is full.
+ *
+ * The state of all rings is checkpointed as a single NVS blob. Appending does
+ * not need a checkpoint: every record carries its own position, the logical
+ * offset of its first item and the log tail after it was appended, so
+ * ringbuf_log_replay() re-applies the records written after the last
+ * checkpoint. Reads only move the tails in RAM. Checkpoints are taken every
+ * LFRB_LOG_SYNC_RECORDS appends and reads, by LFRingLogSync(), and before an
+ * append would overwrite the record replay starts from; items read after the
+ * last checkpoint are returned again after a reset.
+ */
+typedef struct {
+    uint32_t version;
+    uint32_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint32_t ring_num;
+    uint32_t reserved;
+} ringbuf_log_state_t;
+
+void ringbuf_log_path(ringbuf_log_t *log, char *path) {
+    snprintf(path, LFRB_MAX_PATH, "%s/%s.log", log->root, log->nvs_namespace);
+}
+
+/**
+ * @brief Read or write @p len bytes at log position @p pos, wrapping at the end.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int ringbuf_log_io(ringbuf_log_t *log, FILE *f, uint64_t pos, void *buf, uint32_t len, int write) {
+    uint8_t *p = buf;
+    while(len > 0) {
+        uint32_t at = pos % log->capacity;
+        uint32_t k = log->capacity - at < len ? log->capacity - at : len;
+        if(ringbuf_seek(f, at) != 0) return -1;
+        if(write) ringbuf_fault_point(LFRB_FAULT_LFS);
+        size_t n = write ? fwrite(p, 1, k, f) : fread(p, 1, k, f);
+        if(n != k) return -1;
+        p += k;
+        pos += k;
+        len -= k;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read and check the header of the record at log position @p pos.
+ *
+ * @return
+ *      - LFRB_OK: @p hdr holds a plausible header.
+ *      - LFRB_CORRUPT_ERROR: No valid record at @p pos.
+ */
+int ringbuf_log_header(ringbuf_log_t *log, FILE *f, uint64_t pos, ringbuf_log_hdr_t *hdr) {
+    if(ringbuf_log_io(log, f, pos, hdr, sizeof(*hdr), 0) < 0) return -LFRB_CORRUPT_ERROR;
+    if(hdr->magic != LFRB_LOG_MAGIC || hdr->pos != pos || hdr->ring >= log->ring_num ||
+       hdr->count == 0 || hdr->len < hdr->count || sizeof(*hdr) + hdr->len > log->capacity) {
+        return -LFRB_CORRUPT_ERROR;
+    }
+    return LFRB_OK;
+}
+
+/**
+ * @brief Checkpoint the log and ring states to NVS.
+ *
+ * @return
+ *      - LFRB_OK: State saved.
+ *      - LFRB_NVS_ERROR: NVS namespace cannot be opened or written.
+ */
+int ringbuf_log_save(ringbuf_log_t *log) {
+    uint8_t blob[sizeof(ringbuf_log_state_t) + sizeof(log->rings)];
+    ringbuf_log_state_t state = {
+        .version = LFRB_LOG_VERSION,
+        .capacity = log->capacity,
+        .head = log->head,
+        .tail = log->tail,
+        .ring_num = log->ring_num,
+    };
+    size_t len = sizeof(state) + log->ring_num * sizeof(ringbuf_log_ring_t);
+    memcpy(blob, &state, sizeof(state));
+    memcpy(blob + sizeof(state), log->rings, len - sizeof(state));
+
+    nvs_handle_t handle;
+    if(nvs_open(log->nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) return -LFRB_NVS_ERROR;
+    esp_err_t err = nvs_set_blob(handle, "log", blob, len);
+    ringbuf_fault_point(LFRB_FAULT_NVS);
+    if(err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if(err != ESP_OK) return -LFRB_NVS_ERROR;
+    log->unsynced = 0;
+    log->synced = log->head;
+    return LFRB_OK;
+}
+
+/**
+ * @brief Load the last checkpoint from NVS.
+ *
+ * @return 1 if a checkpoint matching the capacity was loaded, 0 otherwise.
+ */
+int ringbuf_log_load(ringbuf_log_t *log) {
+    uint8_t blob[sizeof(ringbuf_log_state_t) + sizeof(log->rings)];
+    size_t len = sizeof(blob);
+    nvs_handle_t handle;
+    if(nvs_open(log->nvs_namespace, NVS_READONLY, &handle) != ESP_OK) return 0;
+    esp_err_t err = nvs_get_blob(handle, "log", blob, &len);
+    nvs_close(handle);
+
+    ringbuf_log_state_t state;
+    if(err != ESP_OK || len < sizeof(state)) return 0;
+    memcpy(&state, blob, sizeof(state));
+    if(state.version != LFRB_LOG_VERSION || state.capacity != log->capacity || state.ring_num > LFRB_LOG_MAX_RINGS ||
+       len != sizeof(state) + state.ring_num * sizeof(ringbuf_log_ring_t) || state.tail > state.head) {
+        return 0;
+    }
+    log->head = state.head;
+    log->synced = state.head;
+    log->tail = state.tail;
+    log->ring_num = state.ring_num;
+    memcpy(log->rings, blob + sizeof(state), len - sizeof(state));
+    return 1;
+}
+
+/**
+ * @brief Evict the oldest records until @p len more bytes fit into the log.
+ *
+ * Rings whose oldest items are evicted have their tail moved past them.
+ */
+void ringbuf_log_evict(ringbuf_log_t *log, FILE *f, uint32_t len) {
+    while(log->head + len - log->tail > log->capacity) {
+        ringbuf_log_hdr_t hdr;
+        if(ringbuf_log_header(log, f, log->tail, &hdr) < 0) {
+            // Lost framing: give up the whole log rather than guess
+            ESP_LOGE(TAG, "ringbuf_log_evict: corrupt record at %" PRIu64 ", dropping log", log->tail);
+            for(uint8_t i = 0; i < log->ring_num; i++) {
+                log->rings[i].tail = log->rings[i].head;
+                log->rings[i].pos = log->head;
+            }
+            log->tail = log->head;
+            return;
+        }
+        ringbuf_log_ring_t *r = &log->rings[hdr.ring];
+        if(r->tail < hdr.first + hdr.count) {
+            ESP_LOGW(TAG, "Shared log full, overwrote %" PRIu64 " items of %s",
+                     hdr.first + hdr.count - r->tail, r->name);
+            r->tail = hdr.first + hdr.count;
+        }
+        log->tail += sizeof(hdr) + hdr.len;
+        if(r->pos < log->tail) r->pos = log->tail;
+    }
+}
+
+/**
+ * @brief Append one record of @p num items to ring @p ring.
+ *
+ * @return
+ *      - Number of items written.
+ *      - LFRB_ENUM_EXCEED: The record would not fit into the log.
+ *      - LFRB_NFILE_ERROR: Log file could not be opened.
+ *      - LFRB_LFS_ERROR: Record could not be written.
+ */
+int ringbuf_log_append(ringbuf_log_t *log, uint8_t ring, const void *data, size_t num) {
+    ringbuf_log_ring_t *r = &log->rings[ring];
+    if(num == 0) return 0;
+    if(sizeof(ringbuf_log_hdr_t) + num * r->item_size > log->capacity) return -LFRB_ENUM_EXCEED;
+    char path[LFRB_MAX_PATH];
+    ringbuf_log_path(log, path);
+    FILE *f = fopen(path, "rb+");
+    if(f == NULL) return -LFRB_NFILE_ERROR;
+
+    ringbuf_log_hdr_t hdr = {
+        .magic = LFRB_LOG_MAGIC,
+        .ring = ring,
+        .count = num,
+        .len = num * r->item_size,
+        .crc = esp_rom_crc32_le(0, data, num * r->item_size),
+        .pos = log->head,
+        .first = r->head,
+    };
+    // Replay needs the record at the checkpointed head: move the checkpoint first
+    if(log->head + sizeof(hdr) + hdr.len - log->synced > log->capacity) ringbuf_log_save(log);
+    ringbuf_log_evict(log, f, sizeof(hdr) + hdr.len);
+    hdr.tail = log->tail;
+    int ok = ringbuf_log_io(log, f, log->head, &hdr, sizeof(hdr), 1) == 0 &&
+             ringbuf_log_io(log, f, log->head + sizeof(hdr), (void *)data, hdr.len, 1) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if(!ok) {
+        ESP_LOGE(TAG, "ringbuf_log_append: short record write");
+        return -LFRB_LFS_ERROR;
+    }
+
+    if(r->tail == r->head) r->pos = log->head;
+    log->head += sizeof(hdr) + hdr.len;
+    r->head += num;
+    if(r->head - r->tail > r->item_num) r->tail = r->head - r->item_num;
+    if(++log->unsynced >= LFRB_LOG_SYNC_RECORDS) ringbuf_log_save(log);
+    return num;
+}
+
+/**
+ * @brief Copy items of ring @p ring starting at logical offset @p offset.
+ *
+ * Records of other rings are skipped by their header alone.
+ *
+ * @param log    Pointer to the shared log.
+ * @param ring   Index of the ring.
+ * @param offset Logical offset of the first item to copy.
+ * @param out    Output buffer, NULL to only locate @p offset.
+ * @param num    Maximum number of items to copy.
+ * @param next   Output, log position to continue from after the copied items.
+ *
+ * @return
+ *      - Number of items copied.
+ *      - LFRB_NFILE_ERROR: Log file could not be opened.
+ *      - LFRB_CORRUPT_ERROR: A record on the way is invalid or @p offset is missing.
+ */
+int ringbuf_log_copy(ringbuf_log_t *log, uint8_t ring, uint64_t offset, void *out, size_t num, uint64_t *next) {
+    ringbuf_log_ring_t *r = &log->rings[ring];
+    char path[LFRB_MAX_PATH];
+    ringbuf_log_path(log, path);
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) return -LFRB_NFILE_ERROR;
+
+    uint64_t pos = r->pos > log->tail ? r->pos : log->tail;
+    size_t n = 0;
+    int status = LFRB_OK;
+    while(n < num && offset + n < r->head) {
+        ringbuf_log_hdr_t hdr;
+        if(pos >= log->head || ringbuf_log_header(log, f, pos, &hdr) < 0) {
+            status = -LFRB_CORRUPT_ERROR;
+            break;
+        }
+        uint64_t o = offset + n;
+        if(hdr.ring != ring || hdr.first + hdr.count <= o) {
+            pos += sizeof(hdr) + hdr.len;
+            continue;
+        }
+        if(hdr.first > o) {
+            status = -LFRB_CORRUPT_ERROR;
+            break;
+        }
+        size_t k = hdr.first + hdr.count - o;
+        if(k > num - n) k = num - n;
+        uint64_t at = pos + sizeof(hdr) + (o - hdr.first) * r->item_size;
+        if(ringbuf_log_io(log, f, at, (uint8_t *)out + n * r->item_size, k * r->item_size, 0) < 0) {
+            status = -LFRB_CORRUPT_ERROR;
+            break;
+        }
+        n += k;
+        if(o + k == hdr.first + hdr.count) pos += sizeof(hdr) + hdr.len;
+    }
+    fclose(f);
+    *next = pos;
+    if(status < 0 && n == 0) return status;
+    return n;
+}
+
+/**
+ * @brief Consume items of the ring attached to @p meta from the shared log.
+ *
+ * @return Number of items read.
+ */
+int ringbuf_log_read(ringbuf_meta_t *meta, void *out_data, size_t num) {
+    ringbuf_log_t *log = meta->log;
+    ringbuf_log_ring_t *r = &log->rings[meta->log_ring];
+    if(r->tail == r->head) return 0;
+
+    uint64_t next;
+    int n = ringbuf_log_copy(log, meta->log_ring, r->tail, out_data, num, &next);
+    if(n < 0) {
+        ESP_LOGW(TAG, "LFRingRead: %s lost its records in the shared log", r->name);
+        r->tail = r->head;
+        r->pos = log->head;
+        n = 0;
+    } else {
+        r->tail += n;
+        r->pos = next;
+    }
+    // Tail moves are checkpointed in batches, like appends
+    if(++log->unsynced >= LFRB_LOG_SYNC_RECORDS) ringbuf_log_save(log);
+    return n;
+}
+
+/**
+ * @brief Re-apply the records appended after the last checkpoint.
+ *
+ * A record continues the log only if it sits at the expected position,
+ * continues the logical offsets of its ring and its payload checksum
+ * matches; the first record failing that ends the replay. The records those
+ * appends evicted may already be overwritten, so rings left behind the new
+ * log tail are located again by a pass over the remaining records.
+ *
+ * @return Number of records replayed.
+ */
+int ringbuf_log_replay(ringbuf_log_t *log, FILE *f) {
+    int replayed = 0;
+    uint8_t chunk[64];
+    for(;;) {
+        ringbuf_log_hdr_t hdr;
+        if(ringbuf_log_header(log, f, log->head, &hdr) < 0) break;
+        ringbuf_log_ring_t *r = &log->rings[hdr.ring];
+        uint64_t end = log->head + sizeof(hdr) + hdr.len;
+        if(hdr.first != r->head || hdr.count > r->item_num ||
+           hdr.tail < log->tail || hdr.tail > log->head || end - hdr.tail > log->capacity) break;
+
+        uint32_t crc = 0;
+        int ok = 1;
+        for(uint32_t done = 0; done < hdr.len && ok; ) {
+            uint32_t k = hdr.len - done < sizeof(chunk) ? hdr.len - done : sizeof(chunk);
+            ok = ringbuf_log_io(log, f, log->head + sizeof(hdr) + done, chunk, k, 0) == 0;
+            crc = esp_rom_crc32_le(crc, chunk, k);
+            done += k;
+        }
+        if(!ok || crc != hdr.crc) break;
+
+        if(r->tail == r->head) r->pos = log->head;
+        log->tail = hdr.tail;
+        log->head = end;
+        r->head += hdr.count;
+        if(r->head - r->tail > r->item_num) r->tail = r->head - r->item_num;
+        replayed++;
+    }
+    if(replayed == 0) return 0;
+
+    // Find the oldest surviving record of every ring the new tail passed
+    for(uint64_t pos = log->tail; pos < log->head; ) {
+        ringbuf_log_hdr_t hdr;
+        if(ringbuf_log_header(log, f, pos, &hdr) < 0) break;
+        ringbuf_log_ring_t *r = &log->rings[hdr.ring];
+        if(r->pos < log->tail && hdr.first + hdr.count > r->tail) {
+            if(hdr.first > r->tail) r->tail = hdr.first;
+            r->pos = pos;
+        }
+        pos += sizeof(hdr) + hdr.len;
+    }
+    // No record left at all: everything unread was evicted
+    for(uint8_t i = 0; i < log->ring_num; i++) {
+        ringbuf_log_ring_t *r = &log->rings[i];
+        if(r->pos < log->tail) {
+            r->tail = r->head;
+            r->pos = log->tail;
+        }
+    }
+    return replayed;
+}
+
+/**
+ * @brief Copy the state of the attached ring into @p meta.
+ */
+void ringbuf_log_sync_meta(ringbuf_meta_t *meta) {
+    const ringbuf_log_ring_t *r = &meta->log->rings[meta->log_ring];
+    meta->head = r->head;
+    meta->tail = r->tail;
+}
+
+/**
+ * @brief  Initialize a physical log shared by several logical rings.
+ *
+ * All rings attached with LFRingInitShared() store their items in one
+ * circular file, <root>/<nvs_namespace>.log, of @p capacity bytes, and
+ * share one mutex and one NVS checkpoint. When the file is full, the oldest
+ * records are evicted whichever ring they belong to.
+ *
+ * @param log           Pointer to the shared log structure.
+ * @param root          Path to the LittleFS directory used for storing the log.
+ * @param nvs_namespace Name of the NVS namespace used for the checkpoint.
+ * @param capacity      Size of the log file in bytes.
+ *
+ * @return
+ *      - LFRB_OK: Log ready.
+ *      - LFRB_CONFIG_ERROR: Capacity too small.
+ *      - LFRB_ROOT_NOT_FOUND_ERROR: LittleFS root path not found.
+ *      - LFRB_LFS_ERROR: Log file could not be created.
+ *      - Propagate errors from ringbuf_log_save().
+ */
+int LFRingLogInit(ringbuf_log_t *log, const char *root, const char *nvs_namespace, uint32_t capacity) {
+    if(capacity <= sizeof(ringbuf_log_hdr_t)) return -LFRB_CONFIG_ERROR;
+    struct stat st;
+    if(stat(root, &st) != 0) {
+        ESP_LOGE(TAG, "Root path not found: %s", root);
+        return -LFRB_ROOT_NOT_FOUND_ERROR;
+    }
+
+    memset(log, 0, sizeof(*log));
+    strncpy(log->root, root, sizeof(log->root)-1);
+    strncpy(log->nvs_namespace, nvs_namespace, sizeof(log->nvs_namespace)-1);
+    log->capacity = capacity;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_log_path(log, path);
+    FILE *f = NULL;
+    if(ringbuf_log_load(log)) {
+        f = fopen(path, "rb");
+    }
+    int status = LFRB_OK;
+    if(f == NULL) {
+        // No usable checkpoint or file: start an empty log
+        ESP_LOGI(TAG, "Creating shared log %s", path);
+        log->head = log->tail = 0;
+        log->ring_num = 0;
+        f = fopen(path, "wb");
+        if(f == NULL) return -LFRB_LFS_ERROR;
+        fclose(f);
+        status = ringbuf_log_save(log);
+    } else {
+        int replayed = ringbuf_log_replay(log, f);
+        fclose(f);
+        if(replayed > 0) {
+            ESP_LOGI(TAG, "Replayed %d records of shared log %s", replayed, path);
+            status = ringbuf_log_save(log);
+        }
+    }
+    log->lock = xSemaphoreCreateMutexStatic(&log->lock_buf);
+    return status;
+}
+
+/**
+ * @brief  Attach a logical ring to a shared log.
+ *
+ * The ring is found again by @p name after a restart. A ring whose item
+ * size or number changed starts over empty. The returned @p meta works with
+ * LFRingWrite(), LFRingRead(), LFRingReadAt(), LFRingIsEmpty() and the
+ * offset getters; detach it with LFRingDeinit().
+ *
+ * @param meta     Pointer to the ring buffer metadata structure.
+ * @param log      Shared log initialized by LFRingLogInit().
+ * @param name     Name of the ring, up to NVS_KEY_NAME_MAX_SIZE-1 characters.
+ * @param itemSize Size (in bytes) of each data item in the ring buffer.
+ * @param itemNum  Maximum number of items the ring retains.
+ *
+ * @return
+ *      - LFRB_OK: Ring attached.
+ *      - LFRB_CONFIG_ERROR: Invalid geometry or LFRB_LOG_MAX_RINGS rings in use.
+ *      - Propagate errors from ringbuf_log_save().
+ */
+int LFRingInitShared(ringbuf_meta_t *meta, ringbuf_log_t *log, const char *name, uint32_t itemSize, uint32_t itemNum) {
+    if(itemSize == 0 || itemNum == 0) return -LFRB_CONFIG_ERROR;
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+
+    uint8_t id = 0;
+    while(id < log->ring_num && strncmp(log->rings[id].name, name, sizeof(log->rings[id].name)-1) != 0) id++;
+    ringbuf_log_ring_t *r = &log->rings[id];
+    if(id == log->ring_num) {
+        if(log->ring_num == LFRB_LOG_MAX_RINGS) {
+            xSemaphoreGive(log->lock);
+            ESP_LOGE(TAG, "Shared log %s already holds %d rings", log->nvs_namespace, LFRB_LOG_MAX_RINGS);
+            return -LFRB_CONFIG_ERROR;
+        }
+        memset(r, 0, sizeof(*r));
+        strncpy(r->name, name, sizeof(r->name)-1);
+        r->item_size = itemSize;
+        r->item_num = itemNum;
+        r->pos = log->head;
+        log->ring_num++;
+    } else if(r->item_size != itemSize || r->item_num != itemNum) {
+        ESP_LOGW(TAG, "Item structure of %s changed. Resetting ring.", r->name);
+        r->item_size = itemSize;
+        r->item_num = itemNum;
+        r->tail = r->head;
+        r->pos = log->head;
+    }
+
+    meta->mem = NULL;
+    memset(&meta->lanes, 0, sizeof(meta->lanes));
+    ringbuf_codec_config(meta, itemSize, itemNum, NULL);
+    memset(&meta->boot, 0, sizeof(meta->boot));
+    // Log records are checked by their crc when the log is replayed
+    meta->boot.verify_next = UINT64_MAX;
+    memset(&meta->pending, 0, sizeof(meta->pending));
+    memset(&meta->isr, 0, sizeof(meta->isr));
+    memset(&meta->stream, 0, sizeof(meta->stream));
+    memset(&meta->cache, 0, sizeof(meta->cache));
+    memset(&meta->rollup, 0, sizeof(meta->rollup));
+    memset(&meta->ttl, 0, sizeof(meta->ttl));
+    meta->wake = NULL;
+    meta->wake_ctx = NULL;
+    meta->dirty = 0;
+    strncpy(meta->root, log->root, sizeof(meta->root)-1);
+    meta->root[sizeof(meta->root)-1] = '\0';
+    strncpy(meta->nvs_namespace, r->name, sizeof(meta->nvs_namespace)-1);
+    meta->nvs_namespace[sizeof(meta->nvs_namespace)-1] = '\0';
+    meta->item_size = itemSize;
+    ringbuf_set_item_num(meta, itemNum);
+    meta->log = log;
+    meta->log_ring = id;
+    meta->lock = log->lock;
+    ringbuf_log_sync_meta(meta);
+    meta->pending.durable = meta->pending.notified = meta->head;
+    int status = ringbuf_log_save(log);
+
+    xSemaphoreGive(log->lock);
+    meta->boot.total_us = (uint32_t)(esp_timer_get_time() - start);
+    return status;
+}
+
+/**
+ * @brief  Checkpoint a shared log to NVS.
+ *
+ * Appended records survive a reset without it; syncing bounds the number
+ * of records LFRingLogInit() has to replay. Reads are only durable once
+ * checkpointed: without it, up to LFRB_LOG_SYNC_RECORDS reads are returned
+ * again after a reset.
+ *
+ * @param log Pointer to the shared log structure.
+ *
+ * @return Propagate errors from ringbuf_log_save().
+ */
+int LFRingLogSync(ringbuf_log_t *log) {
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    int status = ringbuf_log_save(log);
+    xSemaphoreGive(log->lock);
+    return status;
+}
+
+/**
+ * @brief  Checkpoint a shared log and release its mutex.
+ *
+ * Rings attached to the log must be detached with LFRingDeinit() first.
+ *
+ * @param log Pointer to the shared log structure.
+ */
+void LFRingLogDeinit(ringbuf_log_t *log) {
+    if(log->lock == NULL) return;
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    ringbuf_log_save(log);
+    xSemaphoreGive(log->lock);
+    vSemaphoreDelete(log->lock);
+    log->lock = NULL;
+}
@@ -0,0 +1,413 @@
+#include "LFRingInternal.h"
+
+static const char *TAG = "LFRING";
+
+// -------------------- migration -------------------- //
+/*
+ * A change of item number, or of item size on a raw ring with a conversion
+ * callback, migrates the live items instead of dropping them. The items are
+ * streamed into <namespace>.new (and the index into <namespace>.ndx), a few
+ * at a time, at the same logical offsets. Once both files are complete the
+ * target metadata is committed to NVS as one "mig" blob; from then on the
+ * migration is finished by renaming the files and saving the metadata, which
+ * ringbuf_migrate_resume() repeats after a power cut. A cut before the blob
+ * is written leaves the old ring untouched and only stale .new/.ndx files.
+ *
+ * Init copies at most LFRB_MIGRATE_BOOT_CHUNKS chunks, so boot time does not
+ * grow with the ring. Until the copy is complete, meta holds the target
+ * geometry in RAM only and meta->boot the stored one; LFRingVerify() copies
+ * more chunks per call, and the first other access to the ring (through
+ * load_ringbuf_meta()) copies the rest before it goes on. The stored ring
+ * does not change meanwhile, and a reset restarts the copy from scratch.
+ *
+ * Static rings copy raw items through mem->scratch; init fails with
+ * LFRB_NO_MEM_ERROR before anything changes if it cannot hold one item of
+ * each geometry, so the stored ring survives until the buffer is provided.
+ */
+
+typedef struct {
+    uint32_t item_size;
+    uint32_t item_num;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t frame_head;
+    uint64_t frame_tail;
+    uint32_t tail_pos;
+    uint32_t open_num;      // items staged in <namespace>.stg, kept as they are
+} ringbuf_migration_t;
+
+/**
+ * @brief Rename the migrated files into place and commit the new metadata.
+ *
+ * Safe to repeat: every step is idempotent until the "mig" blob is erased.
+ *
+ * @return
+ *      - LFRB_OK: Migration finished.
+ *      - LFRB_LFS_ERROR: Migrated files could not be renamed.
+ *      - LFRB_NVS_ERROR: NVS namespace cannot be opened.
+ */
+int ringbuf_migrate_finish(ringbuf_meta_t *meta, const ringbuf_migration_t *mig) {
+    char from[LFRB_MAX_PATH], to[LFRB_MAX_PATH];
+    struct stat st;
+
+    ringbuf_get_path_ext(meta, from, "ndx");
+    ringbuf_get_path_ext(meta, to, "idx");
+    ringbuf_fault_point(LFRB_FAULT_LFS);
+    if(stat(from, &st) == 0 && rename(from, to) != 0) return -LFRB_LFS_ERROR;
+    ringbuf_get_path_ext(meta, from, "new");
+    ringbuf_get_path(meta, to);
+    ringbuf_fault_point(LFRB_FAULT_LFS);
+    if(stat(from, &st) == 0 && rename(from, to) != 0) return -LFRB_LFS_ERROR;
+
+    meta->item_size = mig->item_size;
+    ringbuf_set_item_num(meta, mig->item_num);
+    meta->head = mig->head;
+    meta->tail = mig->tail;
+    meta->codec.frame_head = mig->frame_head;
+    meta->codec.frame_tail = mig->frame_tail;
+    meta->codec.tail_pos = mig->tail_pos;
+    meta->codec.open_num = mig->open_num;
+    meta->codec.dec_seq = UINT64_MAX;
+    meta->codec.idx_block = UINT32_MAX;
+    meta->cache.len = 0;
+    ringbuf_stats_reset(meta);
+    int status = save_ringbuf_meta(meta);
+    if(status < 0) return status;
+
+    nvs_handle_t handle;
+    if(nvs_open(meta->nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) return -LFRB_NVS_ERROR;
+    nvs_erase_key(handle, "mig");
+    ringbuf_fault_point(LFRB_FAULT_NVS);
+    nvs_commit(handle);
+    nvs_close(handle);
+    ESP_LOGI(TAG, "Migration finished (size=%u num=%u)", (unsigned int)mig->item_size, (unsigned int)mig->item_num);
+    return LFRB_OK;
+}
+
+/**
+ * @brief Complete or discard a migration interrupted by a reset.
+ *
+ * Must run before init_ringbuf_meta() so that it loads the migrated state.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param root Path to the root directory for storing ring buffer data.
+ * @param nvs_namespace The NVS namespace used to store metadata.
+ *
+ * @return
+ *      - LFRB_OK: Nothing pending, or migration finished.
+ *      - Propagate errors from ringbuf_migrate_finish().
+ */
+int ringbuf_migrate_resume(ringbuf_meta_t *meta, const char *root, const char *nvs_namespace) {
+    strncpy(meta->root, root, sizeof(meta->root)-1);
+    meta->root[sizeof(meta->root)-1] = '\0';
+    strncpy(meta->nvs_namespace, nvs_namespace, sizeof(meta->nvs_namespace)-1);
+    meta->nvs_namespace[sizeof(meta->nvs_namespace)-1] = '\0';
+
+    ringbuf_migration_t mig;
+    size_t len = sizeof(mig);
+    nvs_handle_t handle;
+    int pending = 0;
+    if(nvs_open(meta->nvs_namespace, NVS_READONLY, &handle) == ESP_OK) {
+        pending = nvs_get_blob(handle, "mig", &mig, &len) == ESP_OK && len == sizeof(mig);
+        nvs_close(handle);
+    }
+
+    if(pending) {
+        ESP_LOGW(TAG, "Resuming interrupted migration");
+        return ringbuf_migrate_finish(meta, &mig);
+    }
+
+    // Leftovers of a migration cut short before its commit point
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "new");
+    remove(path);
+    ringbuf_get_path_ext(meta, path, "ndx");
+    remove(path);
+    return LFRB_OK;
+}
+
+/**
+ * @brief Items of a raw ring copied at once when migrating from @p oldSize to @p newSize.
+ *
+ * @return LFRB_MIGRATE_CHUNK, fewer if mem->scratch of a static ring is
+ *         smaller, 0 if it cannot hold one item of each size.
+ */
+static uint32_t ringbuf_migrate_chunk(ringbuf_meta_t *meta, uint32_t oldSize, uint32_t newSize) {
+    if(meta->mem == NULL) return LFRB_MIGRATE_CHUNK;
+    uint32_t k = meta->mem->scratch != NULL ? meta->mem->scratch_size / (oldSize + newSize) : 0;
+    return k < LFRB_MIGRATE_CHUNK ? k : LFRB_MIGRATE_CHUNK;
+}
+
+/**
+ * @brief Copy the items at offsets @p from to @p to of a raw ring into the new geometry.
+ *
+ * @return
+ *      - LFRB_OK: Items copied.
+ *      - LFRB_NO_MEM_ERROR: Chunk buffers could not be allocated.
+ *      - LFRB_LFS_ERROR: Files could not be read or written.
+ */
+int ringbuf_migrate_items(ringbuf_meta_t *meta, ringbuf_meta_t *next, FILE *bin, FILE *ndx, uint64_t from, uint64_t to) {
+    uint32_t chunk = ringbuf_migrate_chunk(next, meta->item_size, next->item_size);
+    uint8_t *src, *dst;
+    if(next->mem != NULL) {
+        if(chunk == 0) return -LFRB_NO_MEM_ERROR;
+        src = next->mem->scratch;
+        dst = src + (size_t)chunk * meta->item_size;
+    } else {
+        src = malloc((size_t)chunk * meta->item_size);
+        dst = malloc((size_t)chunk * next->item_size);
+        if(src == NULL || dst == NULL) {
+            free(src);
+            free(dst);
+            return -LFRB_NO_MEM_ERROR;
+        }
+    }
+
+    int status = LFRB_OK;
+    for(uint64_t offset = from; offset < to && status == LFRB_OK; ) {
+        size_t k = to - offset < chunk ? to - offset : chunk;
+        if(ringbuf_read_items(meta, offset, src, k) != (int)k) {
+            status = -LFRB_LFS_ERROR;
+            break;
+        }
+        for(size_t i = 0; i < k; i++) {
+            uint8_t *item = dst + i * next->item_size;
+            if(meta->item_size == next->item_size) {
+                memcpy(item, src + i * meta->item_size, meta->item_size);
+            } else {
+                memset(item, 0, next->item_size);
+                next->codec.convert(src + i * meta->item_size, meta->item_size, item, next->item_size, next->codec.convert_ctx);
+            }
+            uint64_t pos = (uint64_t)ringbuf_slot(next, offset + i) * next->item_size;
+            ringbuf_fault_point(LFRB_FAULT_LFS);
+            if(ringbuf_seek(bin, pos) != 0 || fwrite(item, next->item_size, 1, bin) != 1) {
+                status = -LFRB_LFS_ERROR;
+                break;
+            }
+        }
+        if(status == LFRB_OK && ndx != NULL) {
+            status = ringbuf_index_fold(next, ndx, ringbuf_slot(next, offset), dst, k);
+        }
+        offset += k;
+    }
+    if(next->mem == NULL) {
+        free(src);
+        free(dst);
+    }
+    return status;
+}
+
+/**
+ * @brief Copy the frames @p from to @p to of an encoded ring into the new frame count.
+ *
+ * Frames keep their sequence number and move to slot seq % frame_num.
+ *
+ * @return
+ *      - LFRB_OK: Frames copied.
+ *      - LFRB_NFILE_ERROR: Data file could not be opened.
+ *      - LFRB_LFS_ERROR: Files could not be read or written.
+ */
+int ringbuf_migrate_frames(ringbuf_meta_t *meta, ringbuf_meta_t *next, FILE *bin, FILE *ndx, uint64_t from, uint64_t to) {
+    ringbuf_codec_t *c = &meta->codec;
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path(meta, path);
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) return -LFRB_NFILE_ERROR;
+    ringbuf_get_path_ext(meta, path, "idx");
+    FILE *idx = ndx != NULL ? fopen(path, "rb") : NULL;
+
+    int status = LFRB_OK;
+    for(uint64_t seq = from; seq < to; seq++) {
+        uint64_t src = (seq % c->frame_num) * c->frame_size;
+        uint64_t dst = (seq % next->codec.frame_num) * c->frame_size;
+        size_t n = ringbuf_seek(f, src) == 0 ? fread(c->frame_buf, 1, c->frame_size, f) : 0;
+        ringbuf_fault_point(LFRB_FAULT_LFS);
+        if(ringbuf_seek(bin, dst) != 0 || fwrite(c->frame_buf, 1, n, bin) != n) {
+            status = -LFRB_LFS_ERROR;
+            break;
+        }
+        ringbuf_block_index_t rec;
+        if(ndx != NULL && ringbuf_index_get(idx, seq % c->frame_num, &rec) &&
+           ringbuf_index_put(next, ndx, seq % next->codec.frame_num, &rec) < 0) {
+            status = -LFRB_LFS_ERROR;
+            break;
+        }
+    }
+    if(idx != NULL) fclose(idx);
+    fclose(f);
+    return status;
+}
+
+/**
+ * @brief View of the stored ring while @p meta holds the target geometry.
+ *
+ * The copy shares the buffers of @p meta but reads the old file directly.
+ */
+static void ringbuf_migrate_source(ringbuf_meta_t *meta, ringbuf_meta_t *old, uint32_t itemSize, uint32_t itemNum) {
+    *old = *meta;
+    old->item_size = itemSize;
+    ringbuf_set_item_num(old, itemNum);
+    old->cache.size = 0;
+    // The codec is configured for the new geometry, the stored frames use the old one
+    old->codec.frame_num = meta->codec.type != LFRB_CODEC_NONE ? (uint32_t)((uint64_t)itemSize * itemNum / meta->codec.frame_size) : 0;
+}
+
+/**
+ * @brief Start migrating the ring from its stored geometry to @p itemSize x @p itemNum.
+ *
+ * Logical offsets are kept. If the new ring is smaller, the oldest items
+ * are dropped. Sets @p meta to the target geometry in RAM and creates the
+ * migration files; ringbuf_migrate_step() copies the items.
+ *
+ * @param meta Pointer to the ring buffer metadata structure, stored geometry.
+ * @param itemSize New size of each item in the ring buffer (in bytes).
+ * @param itemNum New total number of items in the ring buffer.
+ *
+ * @return
+ *      - LFRB_OK: Migration started.
+ *      - LFRB_NO_MEM_ERROR: mem->scratch of a static ring is missing or too small; nothing changed.
+ *      - LFRB_LFS_ERROR: Migration files could not be created.
+ */
+int ringbuf_migrate_begin(ringbuf_meta_t *meta, uint32_t itemSize, uint32_t itemNum) {
+    ringbuf_codec_t *c = &meta->codec;
+    if(c->type == LFRB_CODEC_NONE && ringbuf_migrate_chunk(meta, meta->item_size, itemSize) == 0) {
+        ESP_LOGE(TAG, "ringbuf_migrate: mem->scratch too small, keeping the stored ring");
+        return -LFRB_NO_MEM_ERROR;
+    }
+    ringbuf_meta_t old;
+    ringbuf_migrate_source(meta, &old, meta->item_size, meta->item_num);
+    uint64_t tail = meta->tail, frame_tail = c->frame_tail;
+    meta->item_size = itemSize;
+    ringbuf_set_item_num(meta, itemNum);
+    c->idx_block = UINT32_MAX;
+    c->agg_block = UINT32_MAX;
+
+    if(c->type == LFRB_CODEC_NONE) {
+        if(meta->head - meta->tail > itemNum) meta->tail = meta->head - itemNum;
+    } else if(c->frame_head - c->frame_tail > c->frame_num) {
+        c->frame_tail = c->frame_head - c->frame_num;
+        c->tail_pos = 0;
+        char path[LFRB_MAX_PATH];
+        ringbuf_get_path(meta, path);
+        FILE *f = fopen(path, "rb");
+        ringbuf_frame_hdr_t hdr;
+        if(f != NULL && ringbuf_codec_header(&old, f, c->frame_tail, &hdr) == LFRB_OK && hdr.first > meta->tail) {
+            meta->tail = hdr.first;
+        }
+        if(f != NULL) fclose(f);
+    }
+    if(meta->tail != tail || c->frame_tail != frame_tail) {
+        ESP_LOGW(TAG, "Migration drops %" PRIu64 " oldest items", meta->tail - tail);
+    }
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "new");
+    FILE *bin = fopen(path, "wb");
+    int ok = bin != NULL && fclose(bin) == 0;
+    if(ok && (c->flags & LFRB_TIME_INDEX)) {
+        ringbuf_get_path_ext(meta, path, "ndx");
+        FILE *ndx = fopen(path, "wb");
+        ok = ndx != NULL && fclose(ndx) == 0;
+    }
+    if(!ok) {
+        ESP_LOGE(TAG, "ringbuf_migrate: failed to create migration files");
+        return -LFRB_LFS_ERROR;
+    }
+    meta->boot.migrate_size = old.item_size;
+    meta->boot.migrate_num = old.item_num;
+    meta->boot.migrate_next = c->type == LFRB_CODEC_NONE ? meta->tail : c->frame_tail;
+    return LFRB_OK;
+}
+
+/**
+ * @brief Write the commit point of a completed copy and finish the migration.
+ *
+ * @return
+ *      - LFRB_NVS_ERROR: Commit point could not be written.
+ *      - Propagate errors from ringbuf_migrate_finish().
+ */
+int ringbuf_migrate_commit(ringbuf_meta_t *meta) {
+    // Commit point: from here on the migration is finished even across a reset
+    ringbuf_migration_t mig = {
+        .item_size = meta->item_size,
+        .item_num = meta->item_num,
+        .head = meta->head,
+        .tail = meta->tail,
+        .frame_head = meta->codec.frame_head,
+        .frame_tail = meta->codec.frame_tail,
+        .tail_pos = meta->codec.tail_pos,
+        .open_num = meta->codec.open_num,
+    };
+    nvs_handle_t handle;
+    if(nvs_open(meta->nvs_namespace, NVS_READWRITE, &handle) != ESP_OK) return -LFRB_NVS_ERROR;
+    esp_err_t err = nvs_set_blob(handle, "mig", &mig, sizeof(mig));
+    ringbuf_fault_point(LFRB_FAULT_NVS);
+    if(err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if(err != ESP_OK) return -LFRB_NVS_ERROR;
+
+    return ringbuf_migrate_finish(meta, &mig);
+}
+
+/**
+ * @brief Copy up to @p max chunks of a migration started by ringbuf_migrate_begin().
+ *
+ * A chunk is LFRB_MIGRATE_CHUNK items (one frame for encoded rings). After
+ * the last one the migration is committed and the ring opened in the new
+ * geometry. A failed migration resets the ring to the new geometry, like a
+ * layout change does.
+ *
+ * @param meta Pointer to the ring buffer metadata structure.
+ * @param max  Chunks to copy in this call.
+ *
+ * @return
+ *      - 1: The ring is ready in the new geometry.
+ *      - 0: More chunks remain.
+ *      - Propagate errors from reset_ringbuf_lfs() and ringbuf_boot_finish().
+ */
+int ringbuf_migrate_step(ringbuf_meta_t *meta, uint32_t max) {
+    ringbuf_boot_t *b = &meta->boot;
+    ringbuf_codec_t *c = &meta->codec;
+    if(b->migrate_size == 0) return 1;
+
+    ringbuf_meta_t old;
+    ringbuf_migrate_source(meta, &old, b->migrate_size, b->migrate_num);
+    uint64_t end = c->type == LFRB_CODEC_NONE ? meta->head : c->frame_head;
+    uint64_t chunk = c->type == LFRB_CODEC_NONE ? LFRB_MIGRATE_CHUNK : 1;
+    uint64_t to = (end - b->migrate_next) / chunk < max ? end : b->migrate_next + max * chunk;
+
+    char path[LFRB_MAX_PATH];
+    ringbuf_get_path_ext(meta, path, "new");
+    FILE *bin = fopen(path, "rb+");
+    FILE *ndx = NULL;
+    if(c->flags & LFRB_TIME_INDEX) {
+        ringbuf_get_path_ext(meta, path, "ndx");
+        ndx = fopen(path, "rb+");
+    }
+    int status = LFRB_OK;
+    if(bin == NULL || ((c->flags & LFRB_TIME_INDEX) && ndx == NULL)) {
+        status = -LFRB_LFS_ERROR;
+    } else if(c->type == LFRB_CODEC_NONE) {
+        status = ringbuf_migrate_items(&old, meta, bin, ndx, b->migrate_next, to);
+    } else {
+        status = ringbuf_migrate_frames(&old, meta, bin, ndx, b->migrate_next, to);
+    }
+    if(bin != NULL && fclose(bin) != 0 && status == LFRB_OK) status = -LFRB_LFS_ERROR;
+    if(ndx != NULL && fclose(ndx) != 0 && status == LFRB_OK) status = -LFRB_LFS_ERROR;
+    if(status == LFRB_OK) {
+        b->migrate_next = to;
+        if(to < end) return 0;
+        b->migrate_size = 0;
+        status = ringbuf_migrate_commit(meta);
+    }
+    b->migrate_size = 0;
+    if(status < 0) {
+        // Keep the ring usable in the new geometry, like a layout change does
+        ESP_LOGE(TAG, "Migration failed (status=%d). Resetting ring buffer.", status);
+        reset_ringbuf_meta(meta, meta->item_size, meta->item_num);
+        status = reset_ringbuf_lfs(meta);
+        if(status < 0) return status;
+    }
+    status = ringbuf_boot_finish(meta);
+    return status < 0 ? status : 1;
+}
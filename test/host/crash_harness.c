@@ -0,0 +1,254 @@
+// Power-cut harness: runs a workload against simulated flash and NVS, cuts
+// power before storage operation N, restarts and checks the recovered ring.
+// Repeated for every N the workload performs. Every item carries its own
+// logical offset, so the checks after a restart are:
+//  - tail <= head and head - tail <= item_num,
+//  - no acknowledged write is lost, at most the write in flight is kept,
+//  - no item consumed by an acknowledged read reappears (for shared logs,
+//    reads are acknowledged by the next LFRingLogSync()),
+//  - the retained items come back in order with the right content,
+//  - the ring accepts and returns new items.
+// The time to reopen the rings after every cut is reported as a distribution.
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host_test.h"
+
+#define RING_ITEMS 16
+#define STEPS 40
+#define MAX_RUNS 4096
+
+typedef struct {
+    uint32_t ts;
+    uint32_t value;
+} sample_t;
+
+static const ringbuf_field_t sample_fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_UINT},
+};
+
+// Acknowledged state of one ring, updated only once a call returned
+typedef struct {
+    uint64_t head;
+    uint64_t tail;
+    uint32_t writing;               // items of the write in flight
+} acked_t;
+
+typedef struct {
+    const char *name;
+    int shared;                     // two rings in one shared log
+    const ringbuf_config_t *config;
+    uint32_t item_size;
+} scenario_t;
+
+static const ringbuf_config_t delta_config = {
+    .fields = sample_fields,
+    .field_num = 2,
+    .codec = LFRB_CODEC_DELTA,
+    .block_items = 4,
+    .frame_size = 64,
+};
+
+static const scenario_t scenarios[] = {
+    {"raw", 0, NULL, sizeof(uint64_t)},
+    {"delta", 0, &delta_config, sizeof(sample_t)},
+    {"shared", 1, NULL, sizeof(uint64_t)},
+};
+
+static jmp_buf power_cut;
+static uint32_t cut_seq;
+static uint32_t ops;
+static acked_t acked[2];
+static ringbuf_meta_t rings[2];
+static ringbuf_log_t log_;
+
+static void cut_hook(uint8_t op, uint32_t seq, void *ctx) {
+    ops = seq + 1;
+    if(seq == cut_seq) longjmp(power_cut, 1);
+}
+
+static void make_item(const scenario_t *s, uint64_t offset, void *out) {
+    if(s->config == NULL) {
+        memcpy(out, &offset, sizeof(offset));
+    } else {
+        sample_t item = {(uint32_t)offset, (uint32_t)offset * 3u};
+        memcpy(out, &item, sizeof(item));
+    }
+}
+
+static int item_matches(const scenario_t *s, const void *item, uint64_t offset) {
+    uint8_t expected[sizeof(sample_t) > 8 ? sizeof(sample_t) : 8];
+    make_item(s, offset, expected);
+    return memcmp(item, expected, s->item_size) == 0;
+}
+
+static int ring_count(const scenario_t *s) { return s->shared ? 2 : 1; }
+
+static int open_rings(const scenario_t *s) {
+    memset(rings, 0, sizeof(rings));
+    if(!s->shared) return LFRingInitEx(&rings[0], HOST_ROOT, "crash", s->item_size, RING_ITEMS, s->config);
+    memset(&log_, 0, sizeof(log_));
+    int status = LFRingLogInit(&log_, HOST_ROOT, "crashlog", 1024);
+    if(status >= 0) status = LFRingInitShared(&rings[0], &log_, "a", s->item_size, RING_ITEMS);
+    if(status >= 0) status = LFRingInitShared(&rings[1], &log_, "b", s->item_size, RING_ITEMS / 2);
+    return status;
+}
+
+static void close_rings(const scenario_t *s) {
+    for(int r = 0; r < ring_count(s); r++) LFRingDeinit(&rings[r]);
+    if(s->shared) LFRingLogDeinit(&log_);
+}
+
+static void write_items(const scenario_t *s, int r, uint32_t num) {
+    uint8_t buf[8 * sizeof(sample_t)];
+    for(uint32_t i = 0; i < num; i++) make_item(s, acked[r].head + i, buf + i * s->item_size);
+    acked[r].writing = num;
+    CHECK(LFRingWrite(&rings[r], buf, num) == (int)num);
+    acked[r].head += num;
+    acked[r].writing = 0;
+    uint64_t cap = rings[r].item_num;
+    if(s->config == NULL && acked[r].head - acked[r].tail > cap) acked[r].tail = acked[r].head - cap;
+}
+
+static void read_items(const scenario_t *s, int r, uint32_t num) {
+    uint8_t buf[8 * sizeof(sample_t)];
+    uint64_t tail = LFRingOldestOffset(&rings[r]);
+    int n = LFRingRead(&rings[r], buf, num);
+    CHECK(n >= 0);
+    for(int i = 0; i < n; i++) CHECK(item_matches(s, buf + i * s->item_size, tail + i));
+    if(n > 0 && !s->shared) acked[r].tail = tail + n;
+}
+
+// The workload: batches of 1..4 items, a read of 1..5 items every third step
+static void workload(const scenario_t *s) {
+    memset(acked, 0, sizeof(acked));
+    CHECK(open_rings(s) == LFRB_OK);
+    for(int step = 0; step < STEPS; step++) {
+        int r = s->shared ? step % 2 : 0;
+        write_items(s, r, (uint32_t)(step % 4) + 1);
+        if(step % 3 == 2) read_items(s, r, (uint32_t)(step % 5) + 1);
+        if(s->shared && step % 7 == 6) {
+            CHECK(LFRingLogSync(&log_) == LFRB_OK);
+            for(int i = 0; i < 2; i++) acked[i].tail = LFRingOldestOffset(&rings[i]);
+        }
+    }
+    close_rings(s);
+}
+
+// Checks of one ring after the restart
+static void check_recovered(const scenario_t *s, int r, uint32_t cut) {
+    ringbuf_meta_t *m = &rings[r];
+    uint64_t head = LFRingNewestOffset(m);
+    uint64_t tail = LFRingOldestOffset(m);
+    int ok = tail <= head && head >= acked[r].head && head <= acked[r].head + acked[r].writing && tail >= acked[r].tail;
+    if(s->config == NULL) ok = ok && head - tail <= m->item_num;
+    if(!ok) {
+        fprintf(stderr, "%s cut %u ring %d: head %llu tail %llu, acked head %llu (+%u) tail %llu\n", s->name, cut, r,
+                (unsigned long long)head, (unsigned long long)tail, (unsigned long long)acked[r].head,
+                acked[r].writing, (unsigned long long)acked[r].tail);
+    }
+    CHECK(ok);
+
+    // Retained items in order, then the ring still takes new ones
+    uint8_t item[sizeof(sample_t) > 8 ? sizeof(sample_t) : 8];
+    for(uint64_t offset = tail; offset < head; offset++) {
+        int n = LFRingRead(m, item, 1);
+        CHECK(n == 1);
+        if(n != 1) break;
+        if(!item_matches(s, item, offset)) {
+            fprintf(stderr, "%s cut %u ring %d: wrong item at %llu\n", s->name, cut, r, (unsigned long long)offset);
+            CHECK(0);
+            break;
+        }
+    }
+    CHECK(LFRingIsEmpty(m));
+    acked[r].head = head;
+    acked[r].tail = head;
+    write_items(s, r, 3);
+    for(uint64_t offset = head; offset < head + 3; offset++) {
+        CHECK(LFRingRead(m, item, 1) == 1 && item_matches(s, item, offset));
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_scenario(const scenario_t *s) {
+    static uint32_t boot_us[MAX_RUNS];
+
+    // Dry run to count the storage operations of the workload
+    host_reset();
+    cut_seq = UINT32_MAX;
+    ops = 0;
+    LFRingSetFaultHook(cut_hook, NULL);
+    workload(s);
+    LFRingSetFaultHook(NULL, NULL);
+    uint32_t total = ops < MAX_RUNS ? ops : MAX_RUNS;
+    CHECK(total > 0);
+
+    uint32_t runs = 0;
+    for(uint32_t cut = 0; cut < total; cut++) {
+        host_reset();
+        cut_seq = cut;
+        LFRingSetFaultHook(cut_hook, NULL);
+        if(setjmp(power_cut) == 0) {
+            workload(s);
+            CHECK(0);           // the workload must reach operation cut
+            continue;
+        }
+        // The interrupted ring still owns its locks and buffers; like the
+        // RAM of a reset device it is abandoned, not deinitialized.
+        host_power_cut();
+        int64_t start = esp_timer_get_time();
+        int status = open_rings(s);
+        int64_t elapsed = esp_timer_get_time() - start;
+        if(status != LFRB_OK) fprintf(stderr, "%s cut %u: init failed (%d)\n", s->name, cut, status);
+        CHECK(status == LFRB_OK);
+        if(status != LFRB_OK) continue;
+        boot_us[runs++] = (uint32_t)elapsed;
+        for(int r = 0; r < ring_count(s); r++) check_recovered(s, r, cut);
+        close_rings(s);
+        CHECK(lfs_sim_open_handles() == 0);
+    }
+
+    if(runs == 0) return;
+    qsort(boot_us, runs, sizeof(boot_us[0]), cmp_u32);
+    printf("%-7s %4u cuts, recovery us: min %u median %u p95 %u max %u\n", s->name, runs, boot_us[0],
+           boot_us[runs / 2], boot_us[(runs * 95) / 100], boot_us[runs - 1]);
+}
+
+// A failed NVS commit still counts the items as written; they become
+// durable with the next commit
+static void check_commit_failure(void) {
+    const scenario_t *s = &scenarios[0];
+    host_reset();
+    memset(acked, 0, sizeof(acked));
+    CHECK(open_rings(s) == LFRB_OK);
+    uint64_t items[3] = {0, 1, 2};
+    CHECK(LFRingWrite(&rings[0], items, 2) == 2);
+    nvs_sim_fail_commits(1);
+    CHECK(LFRingWrite(&rings[0], &items[2], 1) == 1);
+    CHECK(rings[0].dirty);
+    CHECK(LFRingNewestOffset(&rings[0]) == 3);
+    CHECK(LFRingDurableOffset(&rings[0]) == 2);
+    uint64_t next = 3;
+    CHECK(LFRingWrite(&rings[0], &next, 1) == 1);
+    CHECK(!rings[0].dirty);
+    CHECK(LFRingDurableOffset(&rings[0]) == 4);
+
+    host_power_cut();
+    CHECK(open_rings(s) == LFRB_OK);
+    acked[0].head = 4;
+    check_recovered(s, 0, 0);
+    close_rings(s);
+}
+
+int main(void) {
+    for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) run_scenario(&scenarios[i]);
+    check_commit_failure();
+    return host_report("crash_harness");
+}
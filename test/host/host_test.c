@@ -0,0 +1,33 @@
+#include "host_test.h"
+#include <stdlib.h>
+
+static int checks;
+static int failures;
+
+void host_reset(void) {
+    LFRingSetFaultHook(NULL, NULL);
+    lfs_sim_format();
+    lfs_sim_mkdir(HOST_ROOT);
+    nvs_sim_erase_all();
+}
+
+void host_power_cut(void) {
+    LFRingSetFaultHook(NULL, NULL);
+    lfs_sim_power_cut();
+    nvs_sim_power_cut();
+}
+
+void host_check(int ok, const char *file, int line, const char *expr) {
+    checks++;
+    if(ok) return;
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    if(++failures >= 20) {
+        fprintf(stderr, "too many failures\n");
+        exit(1);
+    }
+}
+
+int host_report(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, checks, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Shared helpers of the host tests.
+#include <stdint.h>
+#include <stdio.h>
+#include "LFRing.h"
+#include "lfs_sim.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_ROOT "/lfs"
+
+#define CHECK(cond) host_check((cond) != 0, __FILE__, __LINE__, #cond)
+
+// Fresh flash and NVS with HOST_ROOT mounted, no fault hook
+void host_reset(void);
+// Reset: unclosed files and uncommitted NVS writes are lost
+void host_power_cut(void);
+void host_check(int ok, const char *file, int line, const char *expr);
+// Exit status of the test: 0 if every CHECK passed
+int host_report(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
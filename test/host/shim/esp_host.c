@@ -0,0 +1,63 @@
+// Host versions of the ESP-IDF helpers LFRing calls
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int level_rank(char level) {
+    switch(level) {
+    case 'E': return 0;
+    case 'W': return 1;
+    case 'I': return 2;
+    default: return 3;
+    }
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...) {
+    const char *env = getenv("LFRING_LOG");
+    if(level_rank(level) > level_rank(env != NULL && env[0] != '\0' ? env[0] : 'E')) return;
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%c (%s) ", level, tag);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Same result as the ROM routine: reflected CRC-32, inverted on entry and exit
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for(uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for(int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+
+void heap_caps_free(void *ptr) { free(ptr); }
+
+const char *esp_err_to_name(esp_err_t err) {
+    switch(err) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    default: return "ESP_ERR_UNKNOWN";
+    }
+}
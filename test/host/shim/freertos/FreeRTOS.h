@@ -0,0 +1,29 @@
+#pragma once
+// Host stand-in for the FreeRTOS kernel used by LFRing, backed by pthreads.
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define configSUPPORT_STATIC_ALLOCATION 1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+
+// Storage of a statically created semaphore or task, see the *Static() calls
+typedef struct { uint64_t opaque[24]; } StaticSemaphore_t;
+typedef struct { uint64_t opaque[24]; } StaticTask_t;
+
+typedef struct { pthread_mutex_t m; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+#define taskENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->m)
+#define taskEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->m)
+#define portYIELD_FROM_ISR(...) ((void)0)
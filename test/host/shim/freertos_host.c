@@ -0,0 +1,190 @@
+// pthread implementation of the FreeRTOS calls in freertos/*.h
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct host_sem {
+    pthread_mutex_t m;
+    pthread_cond_t cv;
+    uint32_t count;
+    uint32_t max;
+    int heap;
+};
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t m;
+    pthread_cond_t cv;
+    uint32_t notify;
+    TaskFunction_t fn;
+    void *arg;
+    int heap;
+};
+
+_Static_assert(sizeof(struct host_sem) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+_Static_assert(sizeof(struct host_task) <= sizeof(StaticTask_t), "StaticTask_t too small");
+
+static __thread struct host_task *current;
+
+static void deadline(struct timespec *ts, TickType_t ticks) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if(ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void cond_init(pthread_cond_t *cv) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cv, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Wait on cv until ready() or the timeout; returns ready()
+static int wait_for(pthread_mutex_t *m, pthread_cond_t *cv, const uint32_t *value, TickType_t wait) {
+    struct timespec ts;
+    if(wait != portMAX_DELAY) deadline(&ts, wait);
+    while(*value == 0) {
+        if(wait == 0) return 0;
+        if(wait == portMAX_DELAY) {
+            pthread_cond_wait(cv, m);
+        } else if(pthread_cond_timedwait(cv, m, &ts) == ETIMEDOUT) {
+            return *value != 0;
+        }
+    }
+    return 1;
+}
+
+static SemaphoreHandle_t sem_init(struct host_sem *s, uint32_t count, uint32_t max, int heap) {
+    if(s == NULL) return NULL;
+    pthread_mutex_init(&s->m, NULL);
+    cond_init(&s->cv);
+    s->count = count;
+    s->max = max;
+    s->heap = heap;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return sem_init(malloc(sizeof(struct host_sem)), 1, 1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf) {
+    return sem_init((struct host_sem *)buf, 1, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return sem_init(malloc(sizeof(struct host_sem)), 0, 1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf) {
+    return sem_init((struct host_sem *)buf, 0, 1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+    pthread_mutex_lock(&s->m);
+    int ok = wait_for(&s->m, &s->cv, &s->count, wait);
+    if(ok) s->count--;
+    pthread_mutex_unlock(&s->m);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    pthread_mutex_lock(&s->m);
+    int ok = s->count < s->max;
+    if(ok) s->count++;
+    pthread_mutex_unlock(&s->m);
+    if(ok) pthread_cond_signal(&s->cv);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s) {
+    if(s == NULL) return;
+    pthread_mutex_destroy(&s->m);
+    pthread_cond_destroy(&s->cv);
+    if(s->heap) free(s);
+}
+
+static struct host_task *task_init(struct host_task *t, TaskFunction_t fn, void *arg, int heap) {
+    memset(t, 0, sizeof(*t));
+    pthread_mutex_init(&t->m, NULL);
+    cond_init(&t->cv);
+    t->fn = fn;
+    t->arg = arg;
+    t->heap = heap;
+    return t;
+}
+
+static void *task_main(void *arg) {
+    current = arg;
+    current->fn(current->arg);
+    return NULL;
+}
+
+static TaskHandle_t task_start(struct host_task *t) {
+    if(pthread_create(&t->thread, NULL, task_main, t) != 0) return NULL;
+    pthread_detach(t->thread);
+    return t;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out) {
+    struct host_task *t = malloc(sizeof(*t));
+    if(t == NULL) return pdFAIL;
+    task_init(t, fn, arg, 1);
+    if(out != NULL) *out = t;
+    if(task_start(t) == NULL) {
+        free(t);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                               StackType_t *stackBuf, StaticTask_t *taskBuf) {
+    return task_start(task_init((struct host_task *)taskBuf, fn, arg, 0));
+}
+
+// Tasks only delete themselves here; the control block of a heap task leaks
+// on purpose, since a notifier may still hold its handle.
+void vTaskDelete(TaskHandle_t task) {
+    if(task == NULL || task == current) pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {.tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if(current == NULL) {
+        current = task_init(malloc(sizeof(struct host_task)), NULL, NULL, 1);
+        current->thread = pthread_self();
+    }
+    return current;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t) {
+    pthread_mutex_lock(&t->m);
+    t->notify++;
+    pthread_mutex_unlock(&t->m);
+    pthread_cond_signal(&t->cv);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *woken) {
+    xTaskNotifyGive(t);
+    if(woken != NULL) *woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    struct host_task *t = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&t->m);
+    wait_for(&t->m, &t->cv, &t->notify, wait);
+    uint32_t value = t->notify;
+    if(value > 0) t->notify = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&t->m);
+    return value;
+}
@@ -0,0 +1,389 @@
+#include "lfs_sim.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LFS_SIM_MAX_FILES 64
+#define LFS_SIM_MAX_DIRS 8
+#define LFS_SIM_MAX_HANDLES 32
+#define LFS_SIM_PATH 96
+#define LFS_SIM_FD_BASE 1000
+
+typedef struct {
+    char path[LFS_SIM_PATH];
+    uint8_t *data;
+    size_t size;
+    int used;
+} lfs_sim_node_t;
+
+struct lfs_sim_file {
+    char path[LFS_SIM_PATH];
+    uint8_t *data;              // private copy, written back on close
+    size_t size;
+    size_t cap;
+    uint64_t pos;
+    int readable;
+    int writable;
+    int dirty;
+    int used;
+};
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static lfs_sim_node_t nodes[LFS_SIM_MAX_FILES];
+static char dirs[LFS_SIM_MAX_DIRS][LFS_SIM_PATH];
+static struct lfs_sim_file handles[LFS_SIM_MAX_HANDLES];
+static int fail_skip;
+static int fail_writes;
+
+static lfs_sim_node_t *node_find(const char *path) {
+    for(int i = 0; i < LFS_SIM_MAX_FILES; i++) {
+        if(nodes[i].used && strcmp(nodes[i].path, path) == 0) return &nodes[i];
+    }
+    return NULL;
+}
+
+static lfs_sim_node_t *node_create(const char *path) {
+    lfs_sim_node_t *n = node_find(path);
+    if(n != NULL) return n;
+    for(int i = 0; i < LFS_SIM_MAX_FILES; i++) {
+        if(!nodes[i].used) {
+            memset(&nodes[i], 0, sizeof(nodes[i]));
+            strncpy(nodes[i].path, path, LFS_SIM_PATH - 1);
+            nodes[i].used = 1;
+            return &nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static void node_free(lfs_sim_node_t *n) {
+    free(n->data);
+    memset(n, 0, sizeof(*n));
+}
+
+static int dir_of_exists(const char *path) {
+    const char *slash = strrchr(path, '/');
+    if(slash == NULL) return 0;
+    size_t len = (size_t)(slash - path);
+    for(int i = 0; i < LFS_SIM_MAX_DIRS; i++) {
+        if(dirs[i][0] != '\0' && strlen(dirs[i]) == len && strncmp(dirs[i], path, len) == 0) return 1;
+    }
+    return 0;
+}
+
+static int reserve(struct lfs_sim_file *h, size_t size) {
+    if(size <= h->cap) return 0;
+    size_t cap = h->cap ? h->cap : 256;
+    while(cap < size) cap *= 2;
+    uint8_t *data = realloc(h->data, cap);
+    if(data == NULL) return -1;
+    memset(data + h->cap, 0, cap - h->cap);
+    h->data = data;
+    h->cap = cap;
+    return 0;
+}
+
+// Open a handle on path; read/write/create/truncate as decoded from the mode
+static struct lfs_sim_file *handle_open(const char *path, int readable, int writable, int create, int trunc) {
+    if(!dir_of_exists(path)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    lfs_sim_node_t *n = node_find(path);
+    if(n == NULL && !create) {
+        errno = ENOENT;
+        return NULL;
+    }
+    struct lfs_sim_file *h = NULL;
+    for(int i = 0; i < LFS_SIM_MAX_HANDLES; i++) {
+        if(!handles[i].used) {
+            h = &handles[i];
+            break;
+        }
+    }
+    if(h == NULL) {
+        errno = EMFILE;
+        return NULL;
+    }
+    // Creating the directory entry is committed at once, the content on close
+    if(n == NULL) n = node_create(path);
+    if(n == NULL) {
+        errno = ENOSPC;
+        return NULL;
+    }
+    memset(h, 0, sizeof(*h));
+    strncpy(h->path, path, LFS_SIM_PATH - 1);
+    h->readable = readable;
+    h->writable = writable;
+    h->used = 1;
+    if(trunc) {
+        h->dirty = 1;
+    } else if(n->size > 0) {
+        if(reserve(h, n->size) != 0) {
+            h->used = 0;
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(h->data, n->data, n->size);
+        h->size = n->size;
+    }
+    return h;
+}
+
+static int handle_close(struct lfs_sim_file *h) {
+    if(h == NULL || !h->used) return -1;
+    if(h->writable && h->dirty) {
+        lfs_sim_node_t *n = node_create(h->path);
+        if(n != NULL) {
+            free(n->data);
+            n->data = malloc(h->size ? h->size : 1);
+            memcpy(n->data, h->data, h->size);
+            n->size = h->size;
+        }
+    }
+    free(h->data);
+    memset(h, 0, sizeof(*h));
+    return 0;
+}
+
+static size_t handle_read(struct lfs_sim_file *h, void *buf, size_t len, uint64_t pos) {
+    if(!h->readable || pos >= h->size) return 0;
+    if(len > h->size - pos) len = h->size - pos;
+    memcpy(buf, h->data + pos, len);
+    return len;
+}
+
+static size_t handle_write(struct lfs_sim_file *h, const void *buf, size_t len, uint64_t pos) {
+    if(fail_skip > 0) {
+        fail_skip--;
+    } else if(fail_writes > 0) {
+        fail_writes--;
+        return 0;
+    }
+    if(!h->writable || reserve(h, pos + len) != 0) return 0;
+    memcpy(h->data + pos, buf, len);
+    if(pos + len > h->size) h->size = pos + len;
+    h->dirty = 1;
+    return len;
+}
+
+lfs_sim_file_t *lfs_sim_fopen(const char *path, const char *mode) {
+    int plus = strchr(mode, '+') != NULL;
+    int readable = mode[0] == 'r' || plus;
+    int writable = mode[0] != 'r' || plus;
+    int create = mode[0] != 'r';
+    int trunc = mode[0] == 'w';
+    pthread_mutex_lock(&sim_lock);
+    struct lfs_sim_file *h = handle_open(path, readable, writable, create, trunc);
+    if(h != NULL && mode[0] == 'a') h->pos = h->size;
+    pthread_mutex_unlock(&sim_lock);
+    return h;
+}
+
+int lfs_sim_fclose(lfs_sim_file_t *f) {
+    pthread_mutex_lock(&sim_lock);
+    int status = handle_close(f);
+    pthread_mutex_unlock(&sim_lock);
+    return status == 0 ? 0 : EOF;
+}
+
+size_t lfs_sim_fread(void *buf, size_t size, size_t num, lfs_sim_file_t *f) {
+    if(size == 0) return 0;
+    pthread_mutex_lock(&sim_lock);
+    size_t n = handle_read(f, buf, size * num, f->pos);
+    f->pos += n;
+    pthread_mutex_unlock(&sim_lock);
+    return n / size;
+}
+
+size_t lfs_sim_fwrite(const void *buf, size_t size, size_t num, lfs_sim_file_t *f) {
+    if(size == 0) return 0;
+    pthread_mutex_lock(&sim_lock);
+    size_t n = handle_write(f, buf, size * num, f->pos);
+    f->pos += n;
+    pthread_mutex_unlock(&sim_lock);
+    return n / size;
+}
+
+int lfs_sim_fseeko(lfs_sim_file_t *f, off_t pos, int whence) {
+    int64_t base = whence == SEEK_CUR ? (int64_t)f->pos : whence == SEEK_END ? (int64_t)f->size : 0;
+    if(base + pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->pos = (uint64_t)(base + pos);
+    return 0;
+}
+
+int lfs_sim_open(const char *path, int flags, ...) {
+    int acc = flags & O_ACCMODE;
+    pthread_mutex_lock(&sim_lock);
+    struct lfs_sim_file *h = handle_open(path, acc != O_WRONLY, acc != O_RDONLY, (flags & O_CREAT) != 0,
+                                         (flags & O_TRUNC) != 0);
+    pthread_mutex_unlock(&sim_lock);
+    return h == NULL ? -1 : LFS_SIM_FD_BASE + (int)(h - handles);
+}
+
+static struct lfs_sim_file *fd_handle(int fd) {
+    int i = fd - LFS_SIM_FD_BASE;
+    if(i < 0 || i >= LFS_SIM_MAX_HANDLES || !handles[i].used) return NULL;
+    return &handles[i];
+}
+
+int lfs_sim_close(int fd) {
+    pthread_mutex_lock(&sim_lock);
+    int status = handle_close(fd_handle(fd));
+    pthread_mutex_unlock(&sim_lock);
+    if(status != 0) errno = EBADF;
+    return status;
+}
+
+ssize_t lfs_sim_pread(int fd, void *buf, size_t len, off_t pos) {
+    pthread_mutex_lock(&sim_lock);
+    struct lfs_sim_file *h = fd_handle(fd);
+    ssize_t n = h == NULL || pos < 0 ? -1 : (ssize_t)handle_read(h, buf, len, (uint64_t)pos);
+    pthread_mutex_unlock(&sim_lock);
+    return n;
+}
+
+ssize_t lfs_sim_pwrite(int fd, const void *buf, size_t len, off_t pos) {
+    pthread_mutex_lock(&sim_lock);
+    struct lfs_sim_file *h = fd_handle(fd);
+    ssize_t n = h == NULL || pos < 0 || !h->writable ? -1 : (ssize_t)handle_write(h, buf, len, (uint64_t)pos);
+    pthread_mutex_unlock(&sim_lock);
+    return n;
+}
+
+int lfs_sim_remove(const char *path) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(path);
+    if(n != NULL) node_free(n);
+    pthread_mutex_unlock(&sim_lock);
+    if(n == NULL) errno = ENOENT;
+    return n == NULL ? -1 : 0;
+}
+
+int lfs_sim_rename(const char *from, const char *to) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(from);
+    if(n != NULL) {
+        lfs_sim_node_t *old = node_find(to);
+        if(old != NULL) node_free(old);
+        memset(n->path, 0, sizeof(n->path));
+        strncpy(n->path, to, LFS_SIM_PATH - 1);
+    }
+    pthread_mutex_unlock(&sim_lock);
+    if(n == NULL) errno = ENOENT;
+    return n == NULL ? -1 : 0;
+}
+
+int lfs_sim_stat(const char *path, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_lock(&sim_lock);
+    int found = 0;
+    for(int i = 0; i < LFS_SIM_MAX_DIRS; i++) {
+        if(dirs[i][0] != '\0' && strcmp(dirs[i], path) == 0) {
+            st->st_mode = S_IFDIR | 0755;
+            found = 1;
+        }
+    }
+    lfs_sim_node_t *n = node_find(path);
+    if(n != NULL) {
+        st->st_mode = S_IFREG | 0644;
+        st->st_size = (off_t)n->size;
+        found = 1;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    if(!found) errno = ENOENT;
+    return found ? 0 : -1;
+}
+
+void lfs_sim_format(void) {
+    pthread_mutex_lock(&sim_lock);
+    for(int i = 0; i < LFS_SIM_MAX_HANDLES; i++) {
+        free(handles[i].data);
+        memset(&handles[i], 0, sizeof(handles[i]));
+    }
+    for(int i = 0; i < LFS_SIM_MAX_FILES; i++) {
+        if(nodes[i].used) node_free(&nodes[i]);
+    }
+    memset(dirs, 0, sizeof(dirs));
+    fail_skip = 0;
+    fail_writes = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void lfs_sim_mkdir(const char *path) {
+    pthread_mutex_lock(&sim_lock);
+    for(int i = 0; i < LFS_SIM_MAX_DIRS; i++) {
+        if(strcmp(dirs[i], path) == 0) break;
+        if(dirs[i][0] == '\0') {
+            strncpy(dirs[i], path, LFS_SIM_PATH - 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void lfs_sim_power_cut(void) {
+    pthread_mutex_lock(&sim_lock);
+    for(int i = 0; i < LFS_SIM_MAX_HANDLES; i++) {
+        free(handles[i].data);
+        memset(&handles[i], 0, sizeof(handles[i]));
+    }
+    fail_skip = 0;
+    fail_writes = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void lfs_sim_fail_writes(int skip, int count) {
+    pthread_mutex_lock(&sim_lock);
+    fail_skip = skip;
+    fail_writes = count;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+int lfs_sim_open_handles(void) {
+    int n = 0;
+    pthread_mutex_lock(&sim_lock);
+    for(int i = 0; i < LFS_SIM_MAX_HANDLES; i++) n += handles[i].used;
+    pthread_mutex_unlock(&sim_lock);
+    return n;
+}
+
+long lfs_sim_size(const char *path) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(path);
+    long size = n == NULL ? -1 : (long)n->size;
+    pthread_mutex_unlock(&sim_lock);
+    return size;
+}
+
+int lfs_sim_read(const char *path, uint64_t pos, void *buf, size_t len) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(path);
+    int status = n != NULL && pos + len <= n->size ? 0 : -1;
+    if(status == 0) memcpy(buf, n->data + pos, len);
+    pthread_mutex_unlock(&sim_lock);
+    return status;
+}
+
+int lfs_sim_write(const char *path, uint64_t pos, const void *buf, size_t len) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(path);
+    int status = n != NULL && pos + len <= n->size ? 0 : -1;
+    if(status == 0) memcpy(n->data + pos, buf, len);
+    pthread_mutex_unlock(&sim_lock);
+    return status;
+}
+
+int lfs_sim_truncate(const char *path, uint64_t size) {
+    pthread_mutex_lock(&sim_lock);
+    lfs_sim_node_t *n = node_find(path);
+    int status = n != NULL && size <= n->size ? 0 : -1;
+    if(status == 0) n->size = size;
+    pthread_mutex_unlock(&sim_lock);
+    return status;
+}
@@ -0,0 +1,63 @@
+#pragma once
+// In-memory stand-in for LittleFS behind the ESP-IDF VFS.
+//
+// Models the durability rules LFRing relies on: a file's content only
+// changes on flash when the handle that wrote it is closed, creating a file
+// takes effect immediately, and rename/remove are atomic. lfs_sim_power_cut()
+// drops every open handle with its unclosed writes, as a reset would. Writes
+// can be made to fail with lfs_sim_fail_writes().
+//
+// Library sources are built with LFS_SIM_REDIRECT and this header
+// force-included, which routes their stdio/POSIX file calls here.
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct lfs_sim_file lfs_sim_file_t;
+
+lfs_sim_file_t *lfs_sim_fopen(const char *path, const char *mode);
+int lfs_sim_fclose(lfs_sim_file_t *f);
+size_t lfs_sim_fread(void *buf, size_t size, size_t num, lfs_sim_file_t *f);
+size_t lfs_sim_fwrite(const void *buf, size_t size, size_t num, lfs_sim_file_t *f);
+int lfs_sim_fseeko(lfs_sim_file_t *f, off_t pos, int whence);
+int lfs_sim_open(const char *path, int flags, ...);
+int lfs_sim_close(int fd);
+ssize_t lfs_sim_pread(int fd, void *buf, size_t len, off_t pos);
+ssize_t lfs_sim_pwrite(int fd, const void *buf, size_t len, off_t pos);
+int lfs_sim_remove(const char *path);
+int lfs_sim_rename(const char *from, const char *to);
+int lfs_sim_stat(const char *path, struct stat *st);
+
+// Simulation control
+void lfs_sim_format(void);
+void lfs_sim_mkdir(const char *path);
+void lfs_sim_power_cut(void);
+// After skip more writes (fwrite/pwrite), the next count fail without writing anything
+void lfs_sim_fail_writes(int skip, int count);
+int lfs_sim_open_handles(void);
+// Committed content of a file: size, or -1 if it does not exist
+long lfs_sim_size(const char *path);
+int lfs_sim_read(const char *path, uint64_t pos, void *buf, size_t len);
+int lfs_sim_write(const char *path, uint64_t pos, const void *buf, size_t len);
+int lfs_sim_truncate(const char *path, uint64_t size);
+
+#ifdef LFS_SIM_REDIRECT
+#define FILE lfs_sim_file_t
+#define fopen(path, mode) lfs_sim_fopen(path, mode)
+#define fclose(f) lfs_sim_fclose(f)
+#define fread(buf, size, num, f) lfs_sim_fread(buf, size, num, f)
+#define fwrite(buf, size, num, f) lfs_sim_fwrite(buf, size, num, f)
+#define fseek(f, pos, whence) lfs_sim_fseeko(f, pos, whence)
+#define fseeko(f, pos, whence) lfs_sim_fseeko(f, pos, whence)
+#define open(...) lfs_sim_open(__VA_ARGS__)
+#define close(fd) lfs_sim_close(fd)
+#define pread(fd, buf, len, pos) lfs_sim_pread(fd, buf, len, pos)
+#define pwrite(fd, buf, len, pos) lfs_sim_pwrite(fd, buf, len, pos)
+#define remove(path) lfs_sim_remove(path)
+#define rename(from, to) lfs_sim_rename(from, to)
+#define stat(path, st) lfs_sim_stat(path, st)
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+// Host stand-in for ESP-IDF NVS, see nvs_sim.c for the durability model.
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out);
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len);
+
+// Simulation control
+void nvs_sim_erase_all(void);
+void nvs_sim_power_cut(void);
+void nvs_sim_fail_commits(int count);
+uint32_t nvs_sim_commits(void);
@@ -0,0 +1,239 @@
+// In-memory NVS. Writes through a handle stay private to that handle until
+// nvs_commit() applies them all at once; closing without a commit or a
+// power cut (nvs_sim_power_cut) discards them. Commits can be made to fail
+// with nvs_sim_fail_commits().
+#include "nvs.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NVS_SIM_MAX_ENTRIES 256
+#define NVS_SIM_MAX_HANDLES 16
+#define NVS_SIM_MAX_OPS 32
+#define NVS_SIM_BLOB_MAX 512
+
+typedef enum { NVS_SIM_U32, NVS_SIM_U64, NVS_SIM_BLOB, NVS_SIM_ERASED } nvs_sim_type_t;
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_sim_type_t type;
+    uint64_t value;
+    size_t len;
+    uint8_t blob[NVS_SIM_BLOB_MAX];
+    int used;
+} nvs_sim_entry_t;
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    nvs_open_mode_t mode;
+    nvs_sim_entry_t ops[NVS_SIM_MAX_OPS];
+    int num;
+    int used;
+} nvs_sim_handle_t;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_sim_entry_t store[NVS_SIM_MAX_ENTRIES];
+static nvs_sim_handle_t handles[NVS_SIM_MAX_HANDLES];
+static int fail_commits;
+static uint32_t commits;
+
+static nvs_sim_entry_t *store_find(const char *ns, const char *key) {
+    for(int i = 0; i < NVS_SIM_MAX_ENTRIES; i++) {
+        if(store[i].used && strcmp(store[i].ns, ns) == 0 && strcmp(store[i].key, key) == 0) return &store[i];
+    }
+    return NULL;
+}
+
+static int ns_exists(const char *ns) {
+    for(int i = 0; i < NVS_SIM_MAX_ENTRIES; i++) {
+        if(store[i].used && strcmp(store[i].ns, ns) == 0) return 1;
+    }
+    return 0;
+}
+
+static nvs_sim_handle_t *handle_get(nvs_handle_t handle) {
+    if(handle == 0 || handle > NVS_SIM_MAX_HANDLES || !handles[handle - 1].used) return NULL;
+    return &handles[handle - 1];
+}
+
+// Latest value of key as seen through h: its own uncommitted ops first
+static const nvs_sim_entry_t *lookup(nvs_sim_handle_t *h, const char *key) {
+    for(int i = h->num - 1; i >= 0; i--) {
+        if(strcmp(h->ops[i].key, key) == 0) return h->ops[i].type == NVS_SIM_ERASED ? NULL : &h->ops[i];
+    }
+    return store_find(h->ns, key);
+}
+
+static esp_err_t record(nvs_handle_t handle, const char *key, nvs_sim_type_t type, uint64_t value, const void *blob,
+                        size_t len) {
+    if(strlen(key) >= NVS_KEY_NAME_MAX_SIZE || len > NVS_SIM_BLOB_MAX) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_lock);
+    nvs_sim_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_OK;
+    if(h == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if(h->mode != NVS_READWRITE) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if(h->num == NVS_SIM_MAX_OPS) {
+        err = ESP_ERR_NO_MEM;
+    } else {
+        nvs_sim_entry_t *op = &h->ops[h->num++];
+        memset(op, 0, sizeof(*op));
+        strcpy(op->ns, h->ns);
+        strcpy(op->key, key);
+        op->type = type;
+        op->value = value;
+        op->len = len;
+        if(len > 0) memcpy(op->blob, blob, len);
+        op->used = 1;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+static esp_err_t fetch(nvs_handle_t handle, const char *key, nvs_sim_type_t type, uint64_t *value, void *blob,
+                       size_t *len) {
+    pthread_mutex_lock(&sim_lock);
+    nvs_sim_handle_t *h = handle_get(handle);
+    const nvs_sim_entry_t *e = h == NULL ? NULL : lookup(h, key);
+    esp_err_t err = ESP_OK;
+    if(h == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if(e == NULL || e->type != type) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if(type != NVS_SIM_BLOB) {
+        *value = e->value;
+    } else if(blob == NULL) {
+        *len = e->len;
+    } else if(*len < e->len) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(blob, e->blob, e->len);
+        *len = e->len;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out) {
+    if(strlen(name) >= NVS_KEY_NAME_MAX_SIZE) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_lock);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if(mode == NVS_READONLY && !ns_exists(name)) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        for(int i = 0; i < NVS_SIM_MAX_HANDLES; i++) {
+            if(!handles[i].used) {
+                memset(&handles[i], 0, sizeof(handles[i]));
+                strcpy(handles[i].ns, name);
+                handles[i].mode = mode;
+                handles[i].used = 1;
+                *out = (nvs_handle_t)(i + 1);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&sim_lock);
+    nvs_sim_handle_t *h = handle_get(handle);
+    if(h != NULL) h->used = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&sim_lock);
+    nvs_sim_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_OK;
+    if(h == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if(fail_commits > 0) {
+        fail_commits--;
+        err = ESP_FAIL;
+    } else {
+        for(int i = 0; i < h->num && err == ESP_OK; i++) {
+            nvs_sim_entry_t *e = store_find(h->ns, h->ops[i].key);
+            if(h->ops[i].type == NVS_SIM_ERASED) {
+                if(e != NULL) e->used = 0;
+                continue;
+            }
+            for(int j = 0; e == NULL && j < NVS_SIM_MAX_ENTRIES; j++) {
+                if(!store[j].used) e = &store[j];
+            }
+            if(e == NULL) {
+                err = ESP_ERR_NO_MEM;
+            } else {
+                *e = h->ops[i];
+            }
+        }
+        h->num = 0;
+        commits++;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    return record(handle, key, NVS_SIM_ERASED, 0, NULL, 0);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out) {
+    uint64_t value;
+    esp_err_t err = fetch(handle, key, NVS_SIM_U32, &value, NULL, NULL);
+    if(err == ESP_OK) *out = (uint32_t)value;
+    return err;
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out) {
+    return fetch(handle, key, NVS_SIM_U64, out, NULL, NULL);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return record(handle, key, NVS_SIM_U32, value, NULL, 0);
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value) {
+    return record(handle, key, NVS_SIM_U64, value, NULL, 0);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len) {
+    return fetch(handle, key, NVS_SIM_BLOB, NULL, out, len);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len) {
+    return record(handle, key, NVS_SIM_BLOB, 0, value, len);
+}
+
+void nvs_sim_erase_all(void) {
+    pthread_mutex_lock(&sim_lock);
+    memset(store, 0, sizeof(store));
+    memset(handles, 0, sizeof(handles));
+    fail_commits = 0;
+    commits = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void nvs_sim_power_cut(void) {
+    pthread_mutex_lock(&sim_lock);
+    memset(handles, 0, sizeof(handles));
+    fail_commits = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+void nvs_sim_fail_commits(int count) {
+    pthread_mutex_lock(&sim_lock);
+    fail_commits = count;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+uint32_t nvs_sim_commits(void) {
+    pthread_mutex_lock(&sim_lock);
+    uint32_t n = commits;
+    pthread_mutex_unlock(&sim_lock);
+    return n;
+}
@@ -0,0 +1,170 @@
+// Zone maps of raw and encoded rings: LFRingAggregate() against a brute
+// force over LFRingReadAt(), for whole and partial blocks, after reads,
+// wraps and a reset; whole blocks answered from their summary alone, and
+// fields without a summary refused.
+#include <float.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 64
+
+typedef struct {
+    uint32_t ts;
+    int16_t temp;
+    uint16_t pad;
+    float value;
+} sample_t;
+
+enum { F_TS, F_TEMP, F_VALUE };
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, temp), 2, LFRB_FIELD_INT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_FLOAT},
+};
+
+static const ringbuf_config_t configs[] = {
+    {.fields = fields, .field_num = 3, .block_items = 8, .agg_fields = (1u << F_TEMP) | (1u << F_VALUE)},
+    {.fields = fields, .field_num = 3, .codec = LFRB_CODEC_DELTA, .block_items = 8, .frame_size = 64,
+     .agg_fields = (1u << F_TEMP) | (1u << F_VALUE)},
+};
+
+static ringbuf_meta_t ring;
+
+// Sums of these values are exact in a double, so results compare with ==
+static sample_t make_item(uint64_t offset) {
+    uint32_t i = (uint32_t)offset;
+    return (sample_t){1000 + i, (int16_t)((i % 23) * 5 - 60), 0, (float)(i % 11) * 0.5f - 2.0f};
+}
+
+static void open_ring(const ringbuf_config_t *config) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "agg", sizeof(sample_t), ITEMS, config) == LFRB_OK);
+}
+
+static void write_items(uint64_t from, uint64_t to) {
+    for(uint64_t o = from; o < to; ) {
+        sample_t batch[3];
+        uint32_t k = to - o < 3 ? (uint32_t)(to - o) : 3;
+        for(uint32_t i = 0; i < k; i++) batch[i] = make_item(o + i);
+        CHECK(LFRingWrite(&ring, batch, k) == (int)k);
+        o += k;
+    }
+}
+
+static double value_of(const sample_t *s, uint8_t field) { return field == F_TEMP ? s->temp : s->value; }
+
+// The same aggregate from the live items themselves
+static void brute_force(uint8_t field, uint64_t from, uint64_t to, ringbuf_agg_t *out) {
+    uint64_t lo = from > LFRingOldestOffset(&ring) ? from : LFRingOldestOffset(&ring);
+    uint64_t hi = to < LFRingNewestOffset(&ring) ? to : LFRingNewestOffset(&ring);
+    *out = (ringbuf_agg_t){0, DBL_MAX, -DBL_MAX, 0};
+    for(uint64_t o = lo; o < hi; o++) {
+        sample_t s;
+        CHECK(LFRingReadAt(&ring, o, &s, 1) == 1);
+        double v = value_of(&s, field);
+        if(v < out->min) out->min = v;
+        if(v > out->max) out->max = v;
+        out->sum += v;
+        out->count++;
+    }
+}
+
+static void check_agg(uint8_t field, uint64_t from, uint64_t to) {
+    ringbuf_agg_t got, want;
+    CHECK(LFRingAggregate(&ring, field, from, to, &got) == LFRB_OK);
+    brute_force(field, from, to, &want);
+    int ok = got.count == want.count && got.sum == want.sum && (want.count == 0 || (got.min == want.min && got.max == want.max));
+    if(!ok) {
+        fprintf(stderr, "field %u [%llu, %llu): count %llu/%llu min %g/%g max %g/%g sum %g/%g\n", field,
+                (unsigned long long)from, (unsigned long long)to, (unsigned long long)got.count,
+                (unsigned long long)want.count, got.min, want.min, got.max, want.max, got.sum, want.sum);
+    }
+    CHECK(ok);
+}
+
+// Whole ring, block-aligned and ragged ranges, single items and empty ones
+static void check_ranges(void) {
+    uint64_t tail = LFRingOldestOffset(&ring), head = LFRingNewestOffset(&ring);
+    uint64_t ranges[][2] = {
+        {0, UINT64_MAX},
+        {tail, head},
+        {tail + 1, head - 1},
+        {tail + 3, tail + 21},
+        {(tail + 8) & ~7ull, ((tail + 8) & ~7ull) + 16},
+        {tail + 5, tail + 6},
+        {head - 1, head + 5},
+        {tail + 4, tail + 4},
+        {head, UINT64_MAX},
+        {0, tail},
+    };
+    for(size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        check_agg(F_TEMP, ranges[r][0], ranges[r][1]);
+        check_agg(F_VALUE, ranges[r][0], ranges[r][1]);
+    }
+}
+
+static void test_aggregate(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, 45);
+    check_ranges();
+
+    // Consumed items drop out, including those of a partly read block
+    sample_t s[5];
+    CHECK(LFRingRead(&ring, s, 5) == 5);
+    check_ranges();
+
+    // Summaries survive a reset and keep up with a ring that wrapped
+    LFRingDeinit(&ring);
+    host_power_cut();
+    open_ring(config);
+    check_ranges();
+    write_items(45, 400);
+    CHECK(LFRingOldestOffset(&ring) > 300);
+    check_ranges();
+    LFRingDeinit(&ring);
+}
+
+// A whole raw block in the range is answered from its summary: changing its
+// stored items behind the ring's back does not change the result
+static void test_summary_used(void) {
+    host_reset();
+    open_ring(&configs[0]);
+    write_items(0, 24);
+    ringbuf_agg_t before, after;
+    CHECK(LFRingAggregate(&ring, F_TEMP, 8, 16, &before) == LFRB_OK);
+    sample_t fake = make_item(9);
+    fake.temp = 30000;
+    CHECK(lfs_sim_write(HOST_ROOT "/agg.bin", 9 * sizeof(fake), &fake, sizeof(fake)) == 0);
+    CHECK(LFRingAggregate(&ring, F_TEMP, 8, 16, &after) == LFRB_OK);
+    CHECK(after.count == 8 && after.max == before.max && after.sum == before.sum);
+
+    // An edge block is read
+    CHECK(LFRingAggregate(&ring, F_TEMP, 9, 16, &after) == LFRB_OK);
+    CHECK(after.count == 7 && after.max == 30000);
+    LFRingDeinit(&ring);
+}
+
+static void test_not_summarised(void) {
+    host_reset();
+    open_ring(&configs[0]);
+    write_items(0, 4);
+    ringbuf_agg_t agg;
+    CHECK(LFRingAggregate(&ring, F_TS, 0, UINT64_MAX, &agg) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingAggregate(&ring, LFRB_MAX_FIELDS, 0, UINT64_MAX, &agg) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "plain", sizeof(sample_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingAggregate(&ring, F_TEMP, 0, UINT64_MAX, &agg) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_aggregate(&configs[0]);
+    test_aggregate(&configs[1]);
+    test_summary_used();
+    test_not_summarised();
+    return host_report("test_aggregate");
+}
@@ -0,0 +1,109 @@
+// Overflow policies of LFRingWriteAsync(): what is queued, what is dropped
+// and which logical offsets the kept items end up with.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 32
+#define PENDING 4
+
+static ringbuf_meta_t ring;
+static uint64_t durable;
+static int calls;
+
+static void on_durable(uint64_t offset, int status, void *ctx) {
+    CHECK(status == LFRB_OK);
+    durable = offset;
+    calls++;
+}
+
+static void open_ring(uint8_t overflow) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    durable = 0;
+    calls = 0;
+    CHECK(LFRingInit(&ring, HOST_ROOT, "async", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingSetFlush(&ring, PENDING, 0, 0) == LFRB_OK);
+    CHECK(LFRingSetAsync(&ring, overflow, on_durable, NULL) == LFRB_OK);
+}
+
+static int queue(uint32_t first, uint32_t num) {
+    uint32_t items[8];
+    for(uint32_t i = 0; i < num; i++) items[i] = first + i;
+    return LFRingWriteAsync(&ring, items, num);
+}
+
+// The ring holds exactly the values expected[0..num-1], at offsets 0..num-1
+static void check_items(const uint32_t *expected, uint32_t num) {
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(LFRingNewestOffset(&ring) == num);
+    CHECK(LFRingDurableOffset(&ring) == num);
+    CHECK(calls > 0 && durable == num);
+    for(uint32_t i = 0; i < num; i++) {
+        uint32_t item;
+        CHECK(LFRingReadAt(&ring, i, &item, 1) == 1 && item == expected[i]);
+    }
+    LFRingDeinit(&ring);
+}
+
+static void test_block(void) {
+    open_ring(LFRB_OVERFLOW_BLOCK);
+    CHECK(queue(0, 3) == 3);
+    CHECK(LFRingNewestOffset(&ring) == 3);
+    // The caller writes the full buffer out, nothing is lost
+    CHECK(queue(3, 3) == 3);
+    CHECK(LFRingNewestOffset(&ring) == 6);
+    static const uint32_t expected[] = {0, 1, 2, 3, 4, 5};
+    check_items(expected, 6);
+}
+
+static void test_drop_new(void) {
+    open_ring(LFRB_OVERFLOW_DROP_NEW);
+    CHECK(queue(0, 3) == 3);
+    CHECK(queue(3, 3) == 1);
+    CHECK(queue(6, 1) == 0);
+    CHECK(LFRingNewestOffset(&ring) == 4);
+    static const uint32_t expected[] = {0, 1, 2, 3};
+    check_items(expected, 4);
+}
+
+static void test_drop_old(void) {
+    open_ring(LFRB_OVERFLOW_DROP_OLD);
+    CHECK(queue(0, 3) == 3);
+    // Queued items may still be dropped: no offsets handed out yet
+    CHECK(LFRingNewestOffset(&ring) == 0);
+    CHECK(!LFRingIsEmpty(&ring));
+    CHECK(queue(3, 3) == 3);
+    CHECK(LFRingNewestOffset(&ring) == 0);
+    // Values 0 and 1 were dropped; the kept ones take offsets 0..3
+    static const uint32_t expected[] = {2, 3, 4, 5};
+    check_items(expected, 4);
+
+    // A batch larger than the buffer keeps its newest items
+    open_ring(LFRB_OVERFLOW_DROP_OLD);
+    CHECK(queue(0, 1) == 1);
+    CHECK(queue(1, 6) == PENDING);
+    static const uint32_t newest[] = {3, 4, 5, 6};
+    check_items(newest, 4);
+}
+
+static void test_drop_old_after_write(void) {
+    // Offsets reported for written items are never handed out again
+    open_ring(LFRB_OVERFLOW_DROP_OLD);
+    CHECK(queue(0, 2) == 2);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    uint64_t newest = LFRingNewestOffset(&ring);
+    CHECK(newest == 2);
+    CHECK(queue(2, 4) == 4);
+    CHECK(queue(6, 2) == 2);
+    CHECK(LFRingNewestOffset(&ring) == newest);
+    static const uint32_t expected[] = {0, 1, 4, 5, 6, 7};
+    check_items(expected, 6);
+}
+
+int main(void) {
+    test_block();
+    test_drop_new();
+    test_drop_old();
+    test_drop_old_after_write();
+    return host_report("test_async");
+}
@@ -0,0 +1,136 @@
+// Read-ahead window of a raw ring: reads served from it match the file
+// while writes wrap over the cached slots, also when a write fails whole
+// or in part, and after a reset, a ring reset and a geometry migration.
+#include <string.h>
+#include "host_test.h"
+
+// Items straddle LittleFS blocks, and a block is a third of the file
+#define ITEMS 1000
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+    uint32_t pad;
+} item_t;
+
+static ringbuf_meta_t ring;
+
+static item_t make_item(uint64_t offset) { return (item_t){(uint32_t)offset, ~(uint32_t)offset, 0}; }
+
+static void open_ring(uint32_t items) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "cache", sizeof(item_t), items) == LFRB_OK);
+    CHECK(LFRingSetReadAhead(&ring, 1) == LFRB_OK);
+}
+
+static int write_items(uint64_t from, uint64_t to) {
+    static item_t batch[2 * ITEMS];
+    for(uint64_t o = from; o < to; o++) batch[o - from] = make_item(o);
+    return LFRingWrite(&ring, batch, to - from);
+}
+
+// Every live item, one read each
+static void check_live(void) {
+    for(uint64_t o = LFRingOldestOffset(&ring); o < LFRingNewestOffset(&ring); o++) {
+        item_t got;
+        item_t want = make_item(o);
+        if(LFRingReadAt(&ring, o, &got, 1) != 1 || got.seq != want.seq || got.check != want.check) {
+            fprintf(stderr, "wrong item at %llu: %u %u\n", (unsigned long long)o, got.seq, got.check);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+// Loads the window around the slot of offset
+static void prime(uint64_t offset) {
+    item_t got;
+    CHECK(LFRingReadAt(&ring, offset, &got, 1) == 1 && got.seq == offset);
+}
+
+static void test_window(void) {
+    host_reset();
+    open_ring(ITEMS);
+    CHECK(write_items(0, 900) == 900);
+    for(uint64_t o = 0; o < 400; o++) {
+        item_t got;
+        CHECK(LFRingRead(&ring, &got, 1) == 1 && got.seq == o);
+    }
+    check_live();
+
+    // Wrapping writes over the window
+    prime(LFRingOldestOffset(&ring));
+    CHECK(write_items(900, ITEMS + 500) == 600);
+    CHECK(LFRingOldestOffset(&ring) == 500);
+    check_live();
+
+    // A failed write leaves the cached slots as they are on flash
+    prime(550);
+    lfs_sim_fail_writes(0, 1);
+    CHECK(write_items(1500, 1600) <= 0);
+    CHECK(LFRingNewestOffset(&ring) == 1500);
+    check_live();
+    CHECK(write_items(1500, 1600) == 100);
+    check_live();
+
+    // A write split at the end of the file, whose second part fails
+    prime(650);
+    lfs_sim_fail_writes(1, 1);
+    CHECK(write_items(1600, 2050) == 400);
+    CHECK(LFRingNewestOffset(&ring) == 2000);
+    check_live();
+    CHECK(write_items(2000, 2050) == 50);
+    check_live();
+    LFRingDeinit(&ring);
+}
+
+static void test_reset(void) {
+    host_reset();
+    open_ring(ITEMS);
+    CHECK(write_items(0, 700) == 700);
+    prime(10);
+
+    // A reset starts with an empty window
+    LFRingDeinit(&ring);
+    host_power_cut();
+    open_ring(ITEMS);
+    check_live();
+
+    // A data file gone missing resets the ring, and the window with it
+    prime(10);
+    CHECK(lfs_sim_remove(HOST_ROOT "/cache.bin") == 0);
+    CHECK(write_items(0, 1) == 1);
+    CHECK(LFRingOldestOffset(&ring) == 0 && LFRingNewestOffset(&ring) == 1);
+    check_live();
+    CHECK(write_items(1, 500) == 499);
+    check_live();
+    LFRingDeinit(&ring);
+}
+
+// The window of a ring still migrating to more slots
+static void test_migration(void) {
+    host_reset();
+    open_ring(ITEMS);
+    CHECK(write_items(0, 650) == 650);
+    CHECK(write_items(650, ITEMS + 300) == 650);
+    LFRingDeinit(&ring);
+
+    // The first read finishes the copy and fills the window in the new slots
+    open_ring(2 * ITEMS);
+    CHECK(ring.boot.migrate_size != 0);
+    CHECK(LFRingOldestOffset(&ring) == 300);
+    CHECK(ring.item_num == 2 * ITEMS && ring.boot.migrate_size == 0);
+    check_live();
+    prime(ITEMS + 250);
+    CHECK(write_items(ITEMS + 300, 2 * ITEMS + 600) == ITEMS + 300);
+    CHECK(LFRingOldestOffset(&ring) == 600);
+    check_live();
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_window();
+    test_reset();
+    test_migration();
+    return host_report("test_cache");
+}
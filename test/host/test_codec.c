@@ -0,0 +1,166 @@
+// Block codec round trips: every field type and width, residuals from 0 to
+// full width, blocks closed by count and by frame size, the open block kept
+// across a reopen and frames evicted once the ring wraps. Column reads of
+// both layouts return the selected fields only.
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 64
+#define TOTAL 300
+
+typedef struct {
+    uint32_t ts;
+    int16_t temp;
+    uint8_t flags;                  // byte 7 is left to a generated gap field
+    uint8_t pad;
+    float value;
+    uint64_t big;
+    uint16_t tag[2];
+} sample_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, temp), 2, LFRB_FIELD_INT},
+    {offsetof(sample_t, flags), 1, LFRB_FIELD_RAW},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_FLOAT},
+    {offsetof(sample_t, big), 8, LFRB_FIELD_UINT},
+    {offsetof(sample_t, tag), 4, LFRB_FIELD_RAW},
+};
+
+static ringbuf_meta_t ring;
+
+// Item at a logical offset: slow ramps, sign changes, constant runs and,
+// every 37th item, values that need the full width of their field
+static sample_t make_item(uint64_t offset) {
+    sample_t s;
+    memset(&s, 0, sizeof(s));
+    uint32_t i = (uint32_t)offset;
+    s.ts = 1000 + i * 10;
+    s.temp = (int16_t)((i % 20) * 7 - 70);
+    s.flags = (uint8_t)(i / 16);
+    s.pad = (uint8_t)(i * 31);
+    s.value = 20.0f + (float)(i % 9) * 0.25f;
+    s.big = (uint64_t)i << 20;
+    s.tag[0] = 0xBEEF;
+    s.tag[1] = (uint16_t)i;
+    if(i % 37 == 0) {
+        s.temp = i % 2 ? INT16_MIN : INT16_MAX;
+        s.value = i % 2 ? -INFINITY : NAN;
+        s.big = i % 2 ? 0 : UINT64_MAX;
+        s.tag[1] = 0xFFFF;
+    }
+    return s;
+}
+
+static void open_ring(uint8_t codec) {
+    static const ringbuf_config_t configs[] = {
+        {.fields = fields, .field_num = 6, .codec = LFRB_CODEC_DELTA, .block_items = 8, .frame_size = 128},
+        {.fields = fields, .field_num = 6, .codec = LFRB_CODEC_COLUMNAR, .block_items = 8, .frame_size = 256},
+    };
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "codec", sizeof(sample_t), ITEMS, &configs[codec - 1]) == LFRB_OK);
+}
+
+static void write_items(uint64_t from, uint64_t to) {
+    for(uint64_t o = from; o < to; ) {
+        sample_t batch[5];
+        uint32_t k = to - o < 5 ? (uint32_t)(to - o) : 5;
+        for(uint32_t i = 0; i < k; i++) batch[i] = make_item(o + i);
+        CHECK(LFRingWrite(&ring, batch, k) == (int)k);
+        o += k;
+    }
+}
+
+// The unread items are exactly the ones at [tail, head), bit for bit
+static int check_items(const char *name, uint64_t head) {
+    uint64_t tail = LFRingOldestOffset(&ring);
+    CHECK(LFRingNewestOffset(&ring) == head);
+    CHECK(tail <= head);
+    for(uint64_t o = tail; o < head; o++) {
+        sample_t got, want = make_item(o);
+        if(LFRingRead(&ring, &got, 1) != 1 || memcmp(&got, &want, sizeof(got)) != 0) {
+            fprintf(stderr, "%s: wrong item at %llu\n", name, (unsigned long long)o);
+            CHECK(0);
+            return 0;
+        }
+    }
+    CHECK(LFRingIsEmpty(&ring));
+    return 1;
+}
+
+static void test_round_trip(uint8_t codec, const char *name) {
+    host_reset();
+    open_ring(codec);
+    write_items(0, 13);
+    check_items(name, 13);
+
+    // The open block is staged and picked up again by the next init
+    write_items(13, 20);
+    LFRingDeinit(&ring);
+    open_ring(codec);
+    write_items(20, 27);
+    check_items(name, 27);
+
+    // Far past the capacity: whole frames are evicted from the tail
+    write_items(27, TOTAL);
+    uint64_t tail = LFRingOldestOffset(&ring);
+    CHECK(tail > 27 && TOTAL - tail <= (uint64_t)ring.codec.frame_num * ring.codec.block_items);
+    check_items(name, TOTAL);
+    LFRingDeinit(&ring);
+}
+
+// Selected fields come back in place, everything else zeroed
+static void test_columns(uint8_t codec, const char *name) {
+    host_reset();
+    open_ring(codec);
+    write_items(0, 30);
+    uint32_t mask = (1u << 0) | (1u << 3);      // ts and value
+    sample_t got[7];
+    uint64_t offset = 0;
+    while(offset < 30) {
+        int n = LFRingReadColumns(&ring, mask, got, 7);
+        CHECK(n > 0);
+        if(n <= 0) break;
+        for(int i = 0; i < n; i++, offset++) {
+            sample_t full = make_item(offset), want;
+            memset(&want, 0, sizeof(want));
+            want.ts = full.ts;
+            want.value = full.value;
+            if(memcmp(&got[i], &want, sizeof(want)) != 0) {
+                fprintf(stderr, "%s: wrong columns at %llu\n", name, (unsigned long long)offset);
+                CHECK(0);
+            }
+        }
+    }
+    CHECK(offset == 30 && LFRingIsEmpty(&ring));
+
+    // Whole items through the same call
+    write_items(30, 35);
+    sample_t all[5];
+    CHECK(LFRingReadColumns(&ring, LFRB_ALL_FIELDS, all, 5) == 5);
+    for(int i = 0; i < 5; i++) {
+        sample_t want = make_item(30 + i);
+        CHECK(memcmp(&all[i], &want, sizeof(want)) == 0);
+    }
+    LFRingDeinit(&ring);
+}
+
+static void test_raw_ring(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "raw", sizeof(sample_t), ITEMS) == LFRB_OK);
+    sample_t s = make_item(0);
+    CHECK(LFRingWrite(&ring, &s, 1) == 1);
+    CHECK(LFRingReadColumns(&ring, 1, &s, 1) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_round_trip(LFRB_CODEC_DELTA, "delta");
+    test_round_trip(LFRB_CODEC_COLUMNAR, "columnar");
+    test_columns(LFRB_CODEC_DELTA, "delta");
+    test_columns(LFRB_CODEC_COLUMNAR, "columnar");
+    test_raw_ring();
+    return host_report("test_codec");
+}
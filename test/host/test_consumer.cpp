@@ -0,0 +1,162 @@
+// Executor and Consumer of LFRingAsync.hpp over a real ring: queue order and
+// limits, spawn() on a full queue, consumers woken by writes, and wakes that
+// find the executor's queue full.
+#include <thread>
+#include "host_test.h"
+#include "LFRingAsync.hpp"
+
+#define ITEMS 64
+#define WRITES 1000
+
+using Ring = lfring::Ring<uint32_t, ITEMS>;
+using Consumer = lfring::Consumer<uint32_t, ITEMS>;
+
+static int order[LFRING_EXECUTOR_QUEUE + 1];
+static int ran;
+
+static void record(void *arg) { order[ran++] = static_cast<int>(reinterpret_cast<intptr_t>(arg)); }
+static void nothing(void *arg) {}
+
+static void fill(lfring::Executor &exec) {
+    while(exec.post(&nothing, nullptr)) {}
+}
+
+static void test_executor() {
+    lfring::Executor exec;
+    ran = 0;
+    for(intptr_t i = 0; i < LFRING_EXECUTOR_QUEUE; i++) CHECK(exec.post(&record, reinterpret_cast<void *>(i)));
+    CHECK(!exec.post(&record, nullptr));
+    CHECK(exec.poll() == LFRING_EXECUTOR_QUEUE);
+    CHECK(ran == LFRING_EXECUTOR_QUEUE);
+    for(int i = 0; i < ran; i++) CHECK(order[i] == i);
+    CHECK(exec.poll() == 0);
+
+    // run() returns once stopped, after the work queued before
+    ran = 0;
+    CHECK(exec.post(&record, reinterpret_cast<void *>(7)));
+    std::thread t([&exec] { exec.run(); });
+    while(ran == 0) std::this_thread::yield();
+    exec.stop();
+    t.join();
+    CHECK(ran == 1 && order[0] == 7);
+}
+
+// Counts its destruction, to see whether a coroutine frame was freed
+struct Tracker {
+    int *count;
+    explicit Tracker(int *c) : count(c) {}
+    Tracker(Tracker &&o) noexcept : count(o.count) { o.count = nullptr; }
+    ~Tracker() {
+        if(count != nullptr) (*count)++;
+    }
+};
+
+static lfring::Task step(Tracker t, int *steps) {
+    (*steps)++;
+    co_return;
+}
+
+static void test_spawn() {
+    lfring::Executor exec;
+    int freed = 0, steps = 0;
+    CHECK(lfring::spawn(exec, step(Tracker(&freed), &steps)));
+    CHECK(exec.poll() == 1);
+    CHECK(steps == 1 && freed == 1);
+
+    // A task refused by a full queue is destroyed without running
+    fill(exec);
+    CHECK(!lfring::spawn(exec, step(Tracker(&freed), &steps)));
+    CHECK(steps == 1 && freed == 2);
+    exec.poll();
+}
+
+static lfring::Task read_into(Consumer &c, uint32_t *out, size_t num, int *got) {
+    *got = co_await c.next_batch(out, num);
+}
+
+static void write_one(Ring &ring, uint32_t v) { CHECK(ring.write(v) == 1); }
+
+static void test_wake() {
+    host_reset();
+    lfring::Executor exec;
+    Ring ring;
+    CHECK(ring.open(HOST_ROOT, "cons") == LFRB_OK);
+    Consumer c(ring, exec);
+    uint32_t out[4] = {};
+    int got = 0;
+
+    // Items already there: no wait
+    write_one(ring, 1);
+    CHECK(lfring::spawn(exec, read_into(c, out, 4, &got)));
+    exec.poll();
+    CHECK(got == 1 && out[0] == 1);
+
+    // Empty ring: the consumer waits for the write
+    got = 0;
+    CHECK(lfring::spawn(exec, read_into(c, out, 4, &got)));
+    exec.poll();
+    CHECK(got == 0);
+    write_one(ring, 2);
+    exec.poll();
+    CHECK(got == 1 && out[0] == 2);
+
+    // A wake that finds the queue full leaves the consumer armed
+    got = 0;
+    CHECK(lfring::spawn(exec, read_into(c, out, 4, &got)));
+    exec.poll();
+    fill(exec);
+    write_one(ring, 3);
+    exec.poll();
+    CHECK(got == 0);
+    write_one(ring, 4);
+    exec.poll();
+    CHECK(got == 2 && out[0] == 3 && out[1] == 4);
+}
+
+static Ring stress_ring;
+static uint64_t stress_sum;
+static int stress_got;
+
+static lfring::Task drain(lfring::Executor &exec, Consumer &c) {
+    uint32_t buf[8];
+    while(stress_got < WRITES) {
+        int n = co_await c.next_batch(buf, 8);
+        CHECK(n > 0);
+        if(n <= 0) break;
+        for(int i = 0; i < n; i++) stress_sum += buf[i];
+        stress_got += n;
+        co_await exec.yield();
+    }
+    exec.stop();
+}
+
+// A writer task and the executor's task running concurrently
+static void test_threads() {
+    host_reset();
+    lfring::Executor exec;
+    CHECK(stress_ring.open(HOST_ROOT, "stress") == LFRB_OK);
+    {
+        Consumer c(stress_ring, exec);
+        CHECK(lfring::spawn(exec, drain(exec, c)));
+        std::thread writer([] {
+            // Stay within half the ring, so no unread item is overwritten
+            for(uint32_t i = 0; i < WRITES; i++) {
+                while(stress_ring.newest_offset() - stress_ring.oldest_offset() >= ITEMS / 2) std::this_thread::yield();
+                CHECK(stress_ring.write(i) == 1);
+            }
+        });
+        exec.run();
+        writer.join();
+    }
+    CHECK(stress_got == WRITES);
+    CHECK(stress_sum == (uint64_t)WRITES * (WRITES - 1) / 2);
+    stress_ring.close();
+}
+
+int main() {
+    test_executor();
+    test_spawn();
+    test_wake();
+    test_threads();
+    return host_report("test_consumer");
+}
@@ -0,0 +1,169 @@
+// LFRingDrainTo(): chunks of one LittleFS block, the tail moved only past
+// whole items a sink accepted, a failing sink leaving the rest in the ring,
+// and a power cut between the sink and the tail commit sending the chunk
+// again rather than losing it.
+#include <setjmp.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 64
+
+// Eight items per LittleFS block
+typedef struct {
+    uint32_t seq;
+    uint8_t pad[LFRB_LFS_BLOCK_SIZE / 8 - 4];
+} item_t;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t fail_at;               // call that accepts nothing, 0 for none
+    uint32_t short_by;              // bytes refused of every chunk
+    uint32_t cut_at;                // call after which power is cut, 0 for none
+    uint32_t got[ITEMS * 4];
+    uint32_t got_num;
+    uint32_t partial;               // bytes of a partly accepted item
+} sink_t;
+
+static ringbuf_meta_t ring;
+static jmp_buf power_cut;
+static int cut_armed;
+
+static void cut_hook(uint8_t op, uint32_t seq, void *ctx) {
+    if(cut_armed) longjmp(power_cut, 1);
+}
+
+static size_t sink(const void *data, size_t len, void *ctx) {
+    sink_t *s = ctx;
+    s->calls++;
+    if(s->calls == s->fail_at) return 0;
+    size_t accepted = len > s->short_by ? len - s->short_by : 0;
+    for(size_t i = 0; i + sizeof(item_t) <= accepted; i += sizeof(item_t)) {
+        const item_t *item = (const item_t *)((const uint8_t *)data + i);
+        s->got[s->got_num++] = item->seq;
+    }
+    s->partial = accepted % sizeof(item_t);
+    // The next storage operation is the tail commit of this chunk
+    if(s->calls == s->cut_at) cut_armed = 1;
+    return accepted;
+}
+
+static void open_ring(void) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "drain", sizeof(item_t), ITEMS) == LFRB_OK);
+}
+
+static void write_items(uint32_t from, uint32_t to) {
+    static item_t item;
+    for(uint32_t v = from; v < to; v++) {
+        item.seq = v;
+        CHECK(LFRingWrite(&ring, &item, 1) == 1);
+    }
+}
+
+static void check_got(const sink_t *s, uint32_t first, uint32_t num) {
+    CHECK(s->got_num == num);
+    for(uint32_t i = 0; i < s->got_num && i < num; i++) CHECK(s->got[i] == first + i);
+}
+
+static void test_full(void) {
+    host_reset();
+    open_ring();
+    write_items(0, 20);
+    static sink_t s;
+    memset(&s, 0, sizeof(s));
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 20 * (int)sizeof(item_t));
+    CHECK(s.calls == 3);            // 8 + 8 + 4 items
+    check_got(&s, 0, 20);
+    CHECK(LFRingIsEmpty(&ring));
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 0);
+
+    // maxBytes below one item offers nothing; above, whole items only
+    write_items(20, 30);
+    memset(&s, 0, sizeof(s));
+    CHECK(LFRingDrainTo(&ring, sink, &s, sizeof(item_t) - 1) == 0);
+    CHECK(s.calls == 0);
+    CHECK(LFRingDrainTo(&ring, sink, &s, 3 * sizeof(item_t) + 5) == 3 * (int)sizeof(item_t));
+    check_got(&s, 20, 3);
+    CHECK(LFRingOldestOffset(&ring) == 23);
+    LFRingDeinit(&ring);
+}
+
+// Bytes of an item the sink took only in part are offered again
+static void test_partial(void) {
+    host_reset();
+    open_ring();
+    write_items(0, 12);
+    static sink_t s;
+    memset(&s, 0, sizeof(s));
+    s.short_by = 10;
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 7 * (int)sizeof(item_t));
+    CHECK(s.calls == 1 && s.partial == sizeof(item_t) - 10);
+    CHECK(LFRingOldestOffset(&ring) == 7);
+
+    s.short_by = 0;
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 5 * (int)sizeof(item_t));
+    check_got(&s, 0, 12);
+    CHECK(LFRingIsEmpty(&ring));
+    LFRingDeinit(&ring);
+}
+
+// A failing sink keeps what it already accepted and leaves the rest
+static void test_failing_sink(void) {
+    host_reset();
+    open_ring();
+    write_items(0, 30);
+    static sink_t s;
+    memset(&s, 0, sizeof(s));
+    s.fail_at = 3;
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 16 * (int)sizeof(item_t));
+    check_got(&s, 0, 16);
+    CHECK(LFRingOldestOffset(&ring) == 16);
+
+    // The failure is not remembered; the rest of the ring still reads
+    LFRingDeinit(&ring);
+    host_power_cut();
+    open_ring();
+    CHECK(LFRingOldestOffset(&ring) == 16);
+    s.fail_at = 0;
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 14 * (int)sizeof(item_t));
+    check_got(&s, 0, 30);
+    LFRingDeinit(&ring);
+}
+
+// A reset after the sink took a chunk but before its tail commit sends
+// that chunk again: delivery is at least once, nothing is lost
+static void test_power_cut(void) {
+    host_reset();
+    open_ring();
+    write_items(0, 20);
+    static sink_t s;
+    memset(&s, 0, sizeof(s));
+    s.cut_at = 2;
+    cut_armed = 0;
+    LFRingSetFaultHook(cut_hook, NULL);
+    if(setjmp(power_cut) == 0) {
+        LFRingDrainTo(&ring, sink, &s, SIZE_MAX);
+        CHECK(0);                   // the commit of chunk 2 must be reached
+    }
+    // The interrupted ring is abandoned like the RAM of a reset device
+    LFRingSetFaultHook(NULL, NULL);
+    cut_armed = 0;
+    host_power_cut();
+    check_got(&s, 0, 16);
+
+    open_ring();
+    CHECK(LFRingOldestOffset(&ring) == 8);
+    s.got_num = 0;
+    s.cut_at = 0;
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 12 * (int)sizeof(item_t));
+    check_got(&s, 8, 12);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_full();
+    test_partial();
+    test_failing_sink();
+    test_power_cut();
+    return host_report("test_drain");
+}
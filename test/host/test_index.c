@@ -0,0 +1,127 @@
+// Time index of raw and encoded rings: LFRingReadRange() and LFRingSeekTime()
+// against the timestamps written, blocks skipped on their index entry alone,
+// the index kept across a reset and after the ring wraps, and rings without
+// an index refused.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 64
+
+typedef struct {
+    uint32_t ts;
+    uint32_t value;
+} sample_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_UINT},
+};
+
+static const ringbuf_config_t configs[] = {
+    {.fields = fields, .field_num = 2, .block_items = 4, .flags = LFRB_TIME_INDEX, .ts_field = 0},
+    {.fields = fields, .field_num = 2, .codec = LFRB_CODEC_DELTA, .block_items = 4, .frame_size = 64,
+     .flags = LFRB_TIME_INDEX, .ts_field = 0},
+};
+
+static ringbuf_meta_t ring;
+
+static uint32_t ts_of(uint64_t offset) { return 1000 + (uint32_t)offset * 10; }
+
+static void open_ring(const ringbuf_config_t *config) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "idx", sizeof(sample_t), ITEMS, config) == LFRB_OK);
+}
+
+static void write_items(uint64_t from, uint64_t to) {
+    for(uint64_t o = from; o < to; o++) {
+        sample_t s = {ts_of(o), (uint32_t)o};
+        CHECK(LFRingWrite(&ring, &s, 1) == 1);
+    }
+}
+
+// LFRingReadRange() returns exactly the offsets [first, first + num)
+static void check_range(uint64_t from, uint64_t to, uint64_t first, int num) {
+    sample_t got[ITEMS];
+    int n = LFRingReadRange(&ring, from, to, got, ITEMS);
+    CHECK(n == num);
+    for(int i = 0; i < n && i < num; i++) CHECK(got[i].value == first + i && got[i].ts == ts_of(first + i));
+}
+
+static void test_index(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, 22);
+
+    // Bounds are inclusive, and fall inside blocks as well as between them
+    check_range(1040, 1080, 4, 5);
+    check_range(1035, 1085, 4, 5);
+    check_range(1000, 1000, 0, 1);
+    check_range(0, 999, 0, 0);
+    check_range(1220, UINT64_MAX, 0, 0);
+    check_range(0, UINT64_MAX, 0, 22);
+    sample_t two[2];
+    CHECK(LFRingReadRange(&ring, 1050, 1200, two, 2) == 2);
+    CHECK(two[0].value == 5 && two[1].value == 6);
+    CHECK(LFRingOldestOffset(&ring) == 0);
+
+    // The index outlives a reset
+    LFRingDeinit(&ring);
+    host_power_cut();
+    open_ring(config);
+    check_range(1035, 1085, 4, 5);
+
+    // Seeking drops the older items, never moves back, and may empty the ring
+    CHECK(LFRingSeekTime(&ring, 1045) == LFRB_OK);
+    CHECK(LFRingOldestOffset(&ring) == 5);
+    CHECK(LFRingSeekTime(&ring, 1000) == LFRB_OK);
+    CHECK(LFRingOldestOffset(&ring) == 5);
+    check_range(0, UINT64_MAX, 5, 17);
+    CHECK(LFRingSeekTime(&ring, 1130) == LFRB_OK);
+    sample_t s;
+    CHECK(LFRingRead(&ring, &s, 1) == 1 && s.value == 13);
+    CHECK(LFRingSeekTime(&ring, UINT64_MAX) == LFRB_OK);
+    CHECK(LFRingIsEmpty(&ring));
+
+    // Far past the capacity the entries follow the blocks they describe
+    write_items(22, 200);
+    uint64_t tail = LFRingOldestOffset(&ring);
+    CHECK(tail > 100 && tail < 200);
+    check_range(0, ts_of(tail) - 1, 0, 0);
+    check_range(0, UINT64_MAX, tail, (int)(200 - tail));
+    check_range(ts_of(180) - 5, ts_of(185), 180, 6);
+    CHECK(LFRingSeekTime(&ring, ts_of(190)) == LFRB_OK);
+    CHECK(LFRingOldestOffset(&ring) == 190);
+    LFRingDeinit(&ring);
+}
+
+// A raw block outside the range is skipped on its index entry: a stored
+// item changed behind the ring's back is not seen
+static void test_skip(void) {
+    host_reset();
+    open_ring(&configs[0]);
+    write_items(0, 12);
+    sample_t fake = {1050, 999};
+    CHECK(lfs_sim_write(HOST_ROOT "/idx.bin", 1 * sizeof(fake), &fake, sizeof(fake)) == 0);
+    check_range(1040, 1060, 4, 3);
+    LFRingDeinit(&ring);
+}
+
+static void test_no_index(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "plain", sizeof(sample_t), ITEMS) == LFRB_OK);
+    write_items(0, 4);
+    sample_t got[4];
+    CHECK(LFRingSeekTime(&ring, 1010) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingReadRange(&ring, 0, UINT64_MAX, got, 4) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingOldestOffset(&ring) == 0);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_index(&configs[0]);
+    test_index(&configs[1]);
+    test_skip();
+    test_no_index();
+    return host_report("test_index");
+}
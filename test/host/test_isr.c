@@ -0,0 +1,128 @@
+// LFRingWriteFromISR(): a second thread stages items while the flush task
+// and a concurrent LFRingFlush() caller collect them. Items arrive once and
+// in order; none are lost while the staging ring has room, and the ones
+// refused at overflow are counted in isr.dropped.
+#include <pthread.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 8192
+#define ISR_ITEMS 5000
+#define STAGING 16
+#define PENDING 64
+
+static ringbuf_meta_t ring;
+static volatile int producing;
+static uint32_t refused;
+
+// Bursts that fit the staging ring, each waiting until the last one was collected
+static void *paced_isr(void *arg) {
+    for(uint32_t v = 0; v < ISR_ITEMS; ) {
+        while(__atomic_load_n(&ring.isr.tail, __ATOMIC_ACQUIRE) != ring.isr.head) vTaskDelay(0);
+        uint32_t burst[STAGING];
+        uint32_t k = 1 + v % STAGING;
+        if(k > ISR_ITEMS - v) k = ISR_ITEMS - v;
+        for(uint32_t i = 0; i < k; i++) burst[i] = v + i;
+        CHECK(LFRingWriteFromISR(&ring, burst, k) == (int)k);
+        v += k;
+    }
+    producing = 0;
+    return NULL;
+}
+
+// Faster than collected now and then; items that do not fit are dropped
+static void *flooding_isr(void *arg) {
+    refused = 0;
+    for(uint32_t v = 0; v < ISR_ITEMS; v++) {
+        if(LFRingWriteFromISR(&ring, &v, 1) == 0) refused++;
+        if(v % 64 == 0) vTaskDelay(0);
+    }
+    producing = 0;
+    return NULL;
+}
+
+static void *flusher(void *arg) {
+    while(producing) CHECK(LFRingFlush(&ring) == LFRB_OK);
+    return NULL;
+}
+
+static void open_ring(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "isr", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingSetFlush(&ring, PENDING, 0, 0) == LFRB_OK);
+    CHECK(LFRingSetISR(&ring, STAGING) == LFRB_OK);
+}
+
+static void run(void *(*isr)(void *), int flush_calls) {
+    producing = 1;
+    pthread_t p, f;
+    pthread_create(&p, NULL, isr, NULL);
+    if(flush_calls) pthread_create(&f, NULL, flusher, NULL);
+    pthread_join(p, NULL);
+    if(flush_calls) pthread_join(f, NULL);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(ring.isr.head == ring.isr.tail && ring.pending.num == 0);
+}
+
+// Items read back in increasing order, every one of them if all is set
+static uint32_t check_order(int all) {
+    uint32_t n = 0, last = 0, item;
+    while(LFRingRead(&ring, &item, 1) == 1) {
+        if((all && item != n) || (n > 0 && item <= last)) {
+            fprintf(stderr, "item %u after %u at %u\n", item, last, n);
+            CHECK(0);
+            break;
+        }
+        last = item;
+        n++;
+    }
+    return n;
+}
+
+static void test_paced(int task, int flush_calls) {
+    open_ring();
+    if(task) CHECK(LFRingFlushStart(5, 4096) == LFRB_OK);
+    run(paced_isr, flush_calls);
+    CHECK(ring.isr.dropped == 0);
+    CHECK(check_order(1) == ISR_ITEMS);
+    LFRingDeinit(&ring);
+    if(task) LFRingFlushStop();
+}
+
+static void test_flood(void) {
+    open_ring();
+    CHECK(LFRingFlushStart(5, 4096) == LFRB_OK);
+    run(flooding_isr, 1);
+    CHECK(ring.isr.dropped == refused);
+    CHECK(check_order(0) == ISR_ITEMS - refused);
+    LFRingDeinit(&ring);
+    LFRingFlushStop();
+}
+
+// Nobody collects: the staging ring takes STAGING items and refuses the rest
+static void test_overflow(void) {
+    open_ring();
+    for(uint32_t v = 0; v < STAGING + 5; v++) CHECK(LFRingWriteFromISR(&ring, &v, 1) == (v < STAGING));
+    uint32_t two[2] = {100, 101};
+    CHECK(LFRingWriteFromISR(&ring, two, 2) == 0);
+    CHECK(ring.isr.dropped == 7);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(check_order(1) == STAGING);
+
+    // Room again once collected
+    CHECK(LFRingWriteFromISR(&ring, two, 2) == 2);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    uint32_t got[2];
+    CHECK(LFRingRead(&ring, got, 2) == 2 && got[0] == 100 && got[1] == 101);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_paced(1, 0);
+    test_paced(1, 1);
+    test_paced(0, 1);
+    test_flood();
+    test_overflow();
+    return host_report("test_isr");
+}
@@ -0,0 +1,226 @@
+// Snapshots of raw and encoded rings: items consumed after the open stay
+// readable, items written after it are not part of it, and items lost to
+// overwrite are reported rather than returned. Iterators walk across block
+// boundaries and the wrap without consuming, and stop at overwritten items.
+// Scans match a brute force over offset ranges and honour their limit.
+#include <string.h>
+#include "host_test.h"
+
+// Not a multiple of a LittleFS block of items, so blocks straddle the wrap
+#define ITEMS 1000
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+} item_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(item_t, seq), 4, LFRB_FIELD_UINT},
+    {offsetof(item_t, check), 4, LFRB_FIELD_UINT},
+};
+
+// Raw rings use no config
+static const ringbuf_config_t encoded = {
+    .fields = fields, .field_num = 2, .codec = LFRB_CODEC_DELTA, .block_items = 8, .frame_size = 128,
+};
+
+static ringbuf_meta_t ring;
+
+static item_t make_item(uint64_t offset) { return (item_t){(uint32_t)offset, (uint32_t)offset * 3 + 7}; }
+
+static void open_ring(const ringbuf_config_t *config) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "iter", sizeof(item_t), ITEMS, config) == LFRB_OK);
+}
+
+static void write_items(uint64_t from, uint64_t to) {
+    for(uint64_t o = from; o < to; ) {
+        item_t batch[16];
+        uint32_t k = to - o < 16 ? (uint32_t)(to - o) : 16;
+        for(uint32_t i = 0; i < k; i++) batch[i] = make_item(o + i);
+        CHECK(LFRingWrite(&ring, batch, k) == (int)k);
+        o += k;
+    }
+}
+
+static int is_item(const item_t *got, uint64_t offset) {
+    item_t want = make_item(offset);
+    return got->seq == want.seq && got->check == want.check;
+}
+
+// Every item of [from, to) reads back, in odd-sized pieces
+static void check_snapshot(ringbuf_snapshot_t *snap, uint64_t from, uint64_t to) {
+    item_t got[7];
+    for(uint64_t o = from; o < to; ) {
+        int n = LFRingSnapshotRead(snap, o, got, 7);
+        CHECK(n > 0);
+        if(n <= 0) return;
+        for(int i = 0; i < n; i++) CHECK(is_item(&got[i], o + i));
+        o += n;
+    }
+}
+
+static void test_snapshot(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, 100);
+    ringbuf_snapshot_t snap;
+    CHECK(LFRingSnapshotOpen(&ring, &snap) == 100);
+
+    // Items consumed or written after the open
+    write_items(100, 120);
+    item_t got[30];
+    CHECK(LFRingRead(&ring, got, 30) == 30);
+    CHECK(LFRingOldestOffset(&ring) == 30);
+    check_snapshot(&snap, 0, 100);
+    CHECK(LFRingSnapshotRead(&snap, 100, got, 1) == 0);
+    CHECK(LFRingSnapshotRead(&snap, 95, got, 30) == 5);
+
+    // Overwriting the oldest items of the snapshot; encoded rings hold fewer items than ITEMS
+    uint64_t head = 120;
+    for(; LFRingOldestOffset(&ring) < 40; head += 8) write_items(head, head + 8);
+    uint64_t oldest = LFRingOldestOffset(&ring);
+    CHECK(oldest >= 40 && oldest < 100);
+    CHECK(LFRingSnapshotRead(&snap, 0, got, 1) == -LFRB_OFFSET_ERROR);
+    CHECK(LFRingSnapshotRead(&snap, oldest - 1, got, 1) == -LFRB_OFFSET_ERROR);
+    check_snapshot(&snap, oldest, 100);
+    LFRingSnapshotClose(&snap);
+    CHECK(LFRingSnapshotRead(&snap, oldest, got, 1) == -LFRB_OFFSET_ERROR);
+    LFRingDeinit(&ring);
+}
+
+// Items per read of an iterator
+#define BLOCK_ITEMS (LFRB_LFS_BLOCK_SIZE / sizeof(item_t))
+
+// On a raw ring the walk starts at slot 700: its first block read wraps,
+// and it crosses two block boundaries
+static void test_walk(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, ITEMS * 17 / 10);
+    uint64_t tail = LFRingOldestOffset(&ring);
+    uint64_t head = LFRingNewestOffset(&ring);
+    CHECK(tail > 0);
+
+    ringbuf_iter_t it;
+    CHECK(LFRingIterBegin(&ring, &it) == LFRB_OK);
+    const void *item;
+    uint64_t o = tail;
+    int status;
+    while((status = LFRingIterNext(&it, &item)) == 1) {
+        if(!is_item(item, o)) {
+            fprintf(stderr, "wrong item at %llu\n", (unsigned long long)o);
+            CHECK(0);
+            break;
+        }
+        o++;
+    }
+    CHECK(status == 0 && o == head);
+    CHECK(LFRingIterNext(&it, &item) == 0);
+    LFRingIterEnd(&it);
+    CHECK(LFRingOldestOffset(&ring) == tail);
+    LFRingDeinit(&ring);
+}
+
+// The block already read is returned; the next read reports the overwrite
+static void test_walk_overwritten(void) {
+    host_reset();
+    open_ring(NULL);
+    write_items(0, ITEMS * 17 / 10);
+    uint64_t tail = LFRingOldestOffset(&ring);
+    CHECK(tail == 700);
+
+    ringbuf_iter_t it;
+    CHECK(LFRingIterBegin(&ring, &it) == LFRB_OK);
+    const void *item;
+    CHECK(LFRingIterNext(&it, &item) == 1 && is_item(item, tail));
+    write_items(ITEMS * 17 / 10, ITEMS * 27 / 10);
+    uint64_t o = tail + 1;
+    int status;
+    while((status = LFRingIterNext(&it, &item)) == 1) {
+        CHECK(is_item(item, o));
+        o++;
+    }
+    CHECK(status == -LFRB_OFFSET_ERROR);
+    CHECK(o == tail + BLOCK_ITEMS);
+    LFRingIterEnd(&it);
+    CHECK(LFRingOldestOffset(&ring) == tail + ITEMS);
+    LFRingDeinit(&ring);
+}
+
+typedef struct {
+    uint32_t mod;                   // matches offsets divisible by it, 0 for none
+    int bad_offset;                 // an item came with the wrong offset
+    uint32_t calls;
+} filter_t;
+
+static int pred(const void *item, uint64_t offset, void *ctx) {
+    filter_t *f = ctx;
+    f->calls++;
+    if(!is_item(item, offset)) f->bad_offset = 1;
+    return f->mod != 0 && offset % f->mod == 0;
+}
+
+static void check_scan(uint64_t from, uint64_t to, size_t max) {
+    static item_t got[ITEMS];
+    filter_t f = {3, 0, 0};
+    int n = LFRingScanRange(&ring, from, to, pred, &f, got, max);
+    CHECK(!f.bad_offset);
+
+    uint64_t lo = from > LFRingOldestOffset(&ring) ? from : LFRingOldestOffset(&ring);
+    uint64_t hi = to < LFRingNewestOffset(&ring) ? to : LFRingNewestOffset(&ring);
+    int want = 0;
+    for(uint64_t o = lo; o < hi && (size_t)want < max; o++) {
+        if(o % 3 != 0) continue;
+        if(want < n && !is_item(&got[want], o)) {
+            fprintf(stderr, "[%llu, %llu): wrong match %d\n", (unsigned long long)from, (unsigned long long)to, want);
+            CHECK(0);
+        }
+        want++;
+    }
+    CHECK(n == want);
+}
+
+static void test_scan(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, ITEMS * 17 / 10);
+    uint64_t tail = LFRingOldestOffset(&ring);
+    uint64_t head = LFRingNewestOffset(&ring);
+
+    uint64_t ranges[][2] = {
+        {0, UINT64_MAX},
+        {tail, head},
+        {tail + 5, tail + BLOCK_ITEMS + 40},
+        {head - 10, head + 10},
+        {tail + 100, tail + 101},
+        {tail + 100, tail + 100},
+        {0, tail},
+        {head, UINT64_MAX},
+    };
+    for(size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) check_scan(ranges[i][0], ranges[i][1], ITEMS);
+
+    // Only the first matches fit
+    check_scan(0, UINT64_MAX, 5);
+    check_scan(tail + 1, head, 1);
+    check_scan(0, UINT64_MAX, 0);
+
+    // A filter that matches nothing still sees every item
+    static item_t got[ITEMS];
+    filter_t none = {0, 0, 0};
+    CHECK(LFRingScan(&ring, pred, &none, got, ITEMS) == 0);
+    CHECK(!none.bad_offset && none.calls == head - tail);
+    CHECK(LFRingOldestOffset(&ring) == tail);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_snapshot(NULL);
+    test_snapshot(&encoded);
+    test_walk(NULL);
+    test_walk(&encoded);
+    test_walk_overwritten();
+    test_scan(NULL);
+    test_scan(&encoded);
+    return host_report("test_iter");
+}
@@ -0,0 +1,236 @@
+// Priority lanes: reads serve the highest lane first and each lane oldest
+// first, overflow evicts the lowest lane first and never a lane above the
+// one written, and the lanes survive a reset, a torn slot and a power cut
+// between the commit of a write and its slot writes.
+#include <setjmp.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 32
+#define LANES 3
+// Header in front of every slot
+#define SLOT_HDR 16
+
+typedef struct {
+    uint32_t lane;
+    uint32_t seq;
+} item_t;
+
+static ringbuf_meta_t ring;
+static uint32_t seq[LANES];        // next seq written per lane
+static jmp_buf power_cut;
+static int cut_armed;
+
+static void open_ring(void) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitLanes(&ring, HOST_ROOT, "lanes", sizeof(item_t), ITEMS, LANES) == LFRB_OK);
+}
+
+static void write_lane(uint8_t lane, uint32_t num) {
+    static item_t batch[ITEMS];
+    for(uint32_t i = 0; i < num; i++) batch[i] = (item_t){lane, seq[lane]++};
+    CHECK(LFRingWriteLane(&ring, lane, batch, num) == (int)num);
+}
+
+// The next num items read are seq from..from+num-1 of lane
+static void check_read(uint32_t lane, uint32_t from, uint32_t num) {
+    for(uint32_t i = 0; i < num; i++) {
+        item_t got;
+        if(LFRingRead(&ring, &got, 1) != 1 || got.lane != lane || got.seq != from + i) {
+            fprintf(stderr, "expected %u/%u, got %u/%u\n", lane, from + i, got.lane, got.seq);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+static void check_held(uint32_t lane0, uint32_t lane1, uint32_t lane2) {
+    CHECK(ring.lanes.count[0] == lane0 && ring.lanes.count[1] == lane1 && ring.lanes.count[2] == lane2);
+    CHECK(LFRingNewestOffset(&ring) - LFRingOldestOffset(&ring) == lane0 + lane1 + lane2);
+}
+
+static void test_order(void) {
+    host_reset();
+    memset(seq, 0, sizeof(seq));
+    open_ring();
+    CHECK(LFRingIsEmpty(&ring) == 1);
+
+    // Plain writes go to lane 0
+    item_t low = {0, seq[0]++};
+    CHECK(LFRingWrite(&ring, &low, 1) == 1);
+    write_lane(2, 3);
+    write_lane(0, 2);
+    write_lane(1, 4);
+    write_lane(2, 2);
+    check_held(3, 4, 5);
+
+    // One call drains across lanes, highest first
+    item_t got[7];
+    CHECK(LFRingRead(&ring, got, 7) == 7);
+    for(uint32_t i = 0; i < 5; i++) CHECK(got[i].lane == 2 && got[i].seq == i);
+    CHECK(got[5].lane == 1 && got[5].seq == 0 && got[6].lane == 1 && got[6].seq == 1);
+    // A new high item is served before the rest of the lower lanes
+    write_lane(2, 1);
+    check_read(2, 5, 1);
+    check_read(1, 2, 2);
+    check_read(0, 0, 3);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    CHECK(LFRingRead(&ring, got, 1) == 0);
+    LFRingDeinit(&ring);
+}
+
+static void test_overflow(void) {
+    host_reset();
+    memset(seq, 0, sizeof(seq));
+    open_ring();
+    write_lane(0, ITEMS);
+
+    // Higher lanes take the slots of the oldest lane 0 items
+    write_lane(2, 10);
+    write_lane(1, 5);
+    check_held(ITEMS - 15, 5, 10);
+    CHECK(ring.lanes.evicted[0] == 15);
+
+    // Lane 1 is evicted before lane 2 once lane 0 is gone
+    write_lane(2, ITEMS - 15 + 2);
+    check_held(0, 3, ITEMS - 3);
+    CHECK(ring.lanes.evicted[0] == ITEMS && ring.lanes.evicted[1] == 2 && ring.lanes.evicted[2] == 0);
+
+    // A lower lane never evicts a higher one: its oldest new items go instead
+    item_t batch[5];
+    for(uint32_t i = 0; i < 5; i++) batch[i] = (item_t){0, seq[0]++};
+    CHECK(LFRingWriteLane(&ring, 0, batch, 5) == 5);
+    check_held(0, 3, ITEMS - 3);
+    CHECK(ring.lanes.evicted[0] == ITEMS + 5);
+    // Lane 1 evicts its own oldest items
+    write_lane(1, 2);
+    check_held(0, 3, ITEMS - 3);
+    CHECK(ring.lanes.evicted[1] == 4);
+
+    // Free slots only: the newest of a batch that partly fits are kept
+    check_read(2, 0, 4);
+    for(uint32_t i = 0; i < 5; i++) batch[i] = (item_t){0, 100 + i};
+    CHECK(LFRingWriteLane(&ring, 0, batch, 5) == 5);
+    check_held(4, 3, ITEMS - 7);
+    CHECK(ring.lanes.evicted[0] == ITEMS + 6);
+    check_read(2, 4, ITEMS - 7);
+    check_read(1, 4, 3);
+    check_read(0, 101, 4);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    LFRingDeinit(&ring);
+}
+
+// Lanes, their order and the free slots are rebuilt from the slot headers
+static void test_reset(void) {
+    host_reset();
+    memset(seq, 0, sizeof(seq));
+    open_ring();
+    write_lane(0, 20);
+    write_lane(1, 5);
+    write_lane(2, 3);
+    check_read(2, 0, 2);
+    write_lane(2, 12);              // 6 free slots, then 6 items of lane 0
+    CHECK(ring.lanes.evicted[0] == 6);
+    LFRingDeinit(&ring);
+    host_power_cut();
+
+    open_ring();
+    check_held(14, 5, 13);
+    check_read(2, 2, 13);
+    check_read(1, 0, 2);
+    write_lane(1, 2);
+    check_read(1, 2, 5);
+    check_read(0, 6, 14);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    LFRingDeinit(&ring);
+
+    // Another geometry starts over empty
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitLanes(&ring, HOST_ROOT, "lanes", sizeof(item_t), ITEMS, 2) == LFRB_OK);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    LFRingDeinit(&ring);
+}
+
+// A slot whose item does not match its crc is skipped
+static void test_torn(void) {
+    host_reset();
+    memset(seq, 0, sizeof(seq));
+    open_ring();
+    write_lane(1, 3);
+    LFRingDeinit(&ring);
+    // The item of the second slot
+    uint32_t junk = 0xDEADBEEF;
+    uint64_t at = SLOT_HDR + sizeof(item_t) + SLOT_HDR;
+    CHECK(lfs_sim_write(HOST_ROOT "/lanes.bin", at, &junk, sizeof(junk)) == 0);
+
+    open_ring();
+    check_held(0, 3, 0);
+    item_t got[3];
+    CHECK(LFRingRead(&ring, got, 3) == 2);
+    CHECK(got[0].seq == 0 && got[1].seq == 2);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    LFRingDeinit(&ring);
+}
+
+static void cut_hook(uint8_t op, uint32_t seq, void *ctx) {
+    if(cut_armed && op == LFRB_FAULT_LFS) longjmp(power_cut, 1);
+}
+
+// A power cut after a write committed its offsets but before its slots
+// were written loses the new items, not the lanes' older ones: the items
+// it evicted stay evicted
+static void test_power_cut(void) {
+    host_reset();
+    memset(seq, 0, sizeof(seq));
+    open_ring();
+    write_lane(0, ITEMS);
+    LFRingSetFaultHook(cut_hook, NULL);
+    cut_armed = 1;
+    if(setjmp(power_cut) == 0) {
+        item_t item = {2, 0};
+        LFRingWriteLane(&ring, 2, &item, 1);
+        CHECK(0);                   // the slot write must be reached
+    }
+    // The interrupted ring is abandoned like the RAM of a reset device
+    LFRingSetFaultHook(NULL, NULL);
+    cut_armed = 0;
+    host_power_cut();
+
+    open_ring();
+    check_held(ITEMS - 1, 0, 0);
+    check_read(0, 1, ITEMS - 1);
+    CHECK(LFRingIsEmpty(&ring) == 1);
+    LFRingDeinit(&ring);
+}
+
+static void test_config(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitLanes(&ring, HOST_ROOT, "lanes", sizeof(item_t), ITEMS, 0) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingInitLanes(&ring, HOST_ROOT, "lanes", sizeof(item_t), ITEMS, LFRB_LANE_MAX + 1) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingInit(&ring, HOST_ROOT, "plain", sizeof(item_t), ITEMS) == LFRB_OK);
+    item_t item = {0, 0};
+    CHECK(LFRingWriteLane(&ring, 0, &item, 1) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+
+    open_ring();
+    CHECK(LFRingWriteLane(&ring, LANES, &item, 1) == -LFRB_CONFIG_ERROR);
+    static item_t many[ITEMS + 1];
+    CHECK(LFRingWriteLane(&ring, 0, many, ITEMS + 1) == -LFRB_ENUM_EXCEED);
+    CHECK(LFRingReadAt(&ring, 0, &item, 1) == -LFRB_CONFIG_ERROR);
+    ringbuf_snapshot_t snap;
+    CHECK(LFRingSnapshotOpen(&ring, &snap) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingSetFlush(&ring, 8, 0, 0) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingSetReadAhead(&ring, 1) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_order();
+    test_overflow();
+    test_reset();
+    test_torn();
+    test_power_cut();
+    test_config();
+    return host_report("test_lanes");
+}
@@ -0,0 +1,127 @@
+// Shared log: batched checkpoints, replay of records appended after the last
+// checkpoint, eviction across rings and torn records.
+#include <string.h>
+#include "host_test.h"
+
+#define LOG_BYTES 512
+
+static ringbuf_log_t log_;
+static ringbuf_meta_t a, b;
+
+static void open_log(void) {
+    memset(&log_, 0, sizeof(log_));
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    CHECK(LFRingLogInit(&log_, HOST_ROOT, "log", LOG_BYTES) == LFRB_OK);
+    CHECK(LFRingInitShared(&a, &log_, "a", sizeof(uint32_t), 64) == LFRB_OK);
+    CHECK(LFRingInitShared(&b, &log_, "b", sizeof(uint32_t), 64) == LFRB_OK);
+}
+
+// Abandon the log as a reset would, then open it again
+static void reboot(void) {
+    host_power_cut();
+    open_log();
+}
+
+static void close_log(void) {
+    LFRingDeinit(&a);
+    LFRingDeinit(&b);
+    LFRingLogDeinit(&log_);
+}
+
+static void write_seq(ringbuf_meta_t *m, uint32_t num) {
+    for(uint32_t i = 0; i < num; i++) {
+        uint32_t v = (uint32_t)LFRingNewestOffset(m);
+        CHECK(LFRingWrite(m, &v, 1) == 1);
+    }
+}
+
+// The retained items of m are its logical offsets tail..head-1
+static void check_seq(ringbuf_meta_t *m) {
+    uint64_t tail = LFRingOldestOffset(m), head = LFRingNewestOffset(m);
+    for(uint64_t o = tail; o < head; o++) {
+        uint32_t v;
+        CHECK(LFRingRead(m, &v, 1) == 1 && v == (uint32_t)o);
+    }
+    CHECK(LFRingIsEmpty(m));
+}
+
+static void test_batched_reads(void) {
+    host_reset();
+    open_log();
+    write_seq(&a, 10);
+    uint32_t commits = nvs_sim_commits();
+    uint32_t v;
+    for(int i = 0; i < 10; i++) CHECK(LFRingRead(&a, &v, 1) == 1 && v == (uint32_t)i);
+    // 20 appends and reads stay below LFRB_LOG_SYNC_RECORDS
+    CHECK(nvs_sim_commits() == commits);
+
+    // Unsynced reads are delivered again, appends are replayed
+    reboot();
+    CHECK(LFRingNewestOffset(&a) == 10);
+    CHECK(LFRingOldestOffset(&a) == 0);
+    for(int i = 0; i < 4; i++) CHECK(LFRingRead(&a, &v, 1) == 1 && v == (uint32_t)i);
+    CHECK(LFRingLogSync(&log_) == LFRB_OK);
+
+    reboot();
+    CHECK(LFRingOldestOffset(&a) == 4);
+    check_seq(&a);
+
+    // Every LFRB_LOG_SYNC_RECORDS appends and reads end in a checkpoint, and
+    // so does every wrap of the log
+    commits = nvs_sim_commits();
+    for(int i = 0; i < LFRB_LOG_SYNC_RECORDS; i++) {
+        write_seq(&a, 1);
+        CHECK(LFRingRead(&a, &v, 1) == 1);
+    }
+    CHECK(nvs_sim_commits() - commits >= 2);
+    CHECK(log_.head - log_.synced <= LOG_BYTES);
+    close_log();
+}
+
+static void test_replay(void) {
+    host_reset();
+    open_log();
+    CHECK(LFRingLogSync(&log_) == LFRB_OK);
+    // Interleaved records of two rings, enough to wrap the log several times
+    // and evict the oldest records
+    for(int i = 0; i < 30; i++) write_seq(i % 3 ? &a : &b, 1 + i % 2);
+    uint64_t head_a = LFRingNewestOffset(&a), tail_a = LFRingOldestOffset(&a);
+    uint64_t head_b = LFRingNewestOffset(&b), tail_b = LFRingOldestOffset(&b);
+    CHECK(tail_a > 0 || tail_b > 0);
+
+    reboot();
+    CHECK(LFRingNewestOffset(&a) == head_a && LFRingOldestOffset(&a) == tail_a);
+    CHECK(LFRingNewestOffset(&b) == head_b && LFRingOldestOffset(&b) == tail_b);
+    check_seq(&a);
+    check_seq(&b);
+    close_log();
+}
+
+static void test_torn_record(void) {
+    host_reset();
+    open_log();
+    write_seq(&a, 3);
+    write_seq(&a, 1);
+
+    // Damage the payload of the last record: replay stops in front of it
+    uint32_t junk = 0xDEADBEEF;
+    uint64_t at = (log_.head + LOG_BYTES - sizeof(junk)) % LOG_BYTES;
+    CHECK(lfs_sim_write(HOST_ROOT "/log.log", at, &junk, sizeof(junk)) == 0);
+    reboot();
+    CHECK(LFRingNewestOffset(&a) == 3);
+    check_seq(&a);
+
+    // The next append takes the place of the torn record
+    write_seq(&a, 2);
+    reboot();
+    CHECK(LFRingNewestOffset(&a) == 5);
+    close_log();
+}
+
+int main(void) {
+    test_batched_reads();
+    test_replay();
+    test_torn_record();
+    return host_report("test_log");
+}
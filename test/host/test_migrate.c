@@ -0,0 +1,248 @@
+// Geometry migrations and deferred verification: init copies a bounded part
+// of a migration, LFRingVerify() or the first access copies the rest, and a
+// reset in between leaves the old ring intact. A power cut before every
+// storage operation of a migration either restarts the copy or, past the
+// commit point, resumes it from the "mig" blob; no item is lost either way.
+#include <setjmp.h>
+#include <string.h>
+#include "host_test.h"
+
+typedef struct {
+    uint32_t ts;
+    uint32_t value;
+} sample_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_UINT},
+};
+
+static const ringbuf_config_t delta_config = {
+    .fields = fields,
+    .field_num = 2,
+    .codec = LFRB_CODEC_DELTA,
+    .block_items = 4,
+    .frame_size = 64,
+};
+
+static ringbuf_meta_t ring;
+static jmp_buf power_cut;
+static uint32_t cut_seq;
+static uint32_t ops;
+
+static void cut_hook(uint8_t op, uint32_t seq, void *ctx) {
+    ops = seq + 1;
+    if(seq == cut_seq) longjmp(power_cut, 1);
+}
+
+static void open_ring(uint32_t num, const ringbuf_config_t *config) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "mig", sizeof(sample_t), num, config) == LFRB_OK);
+}
+
+static void write_samples(uint32_t first, uint32_t num) {
+    for(uint32_t i = 0; i < num; i++) {
+        sample_t s = {first + i, (first + i) * 3};
+        CHECK(LFRingWrite(&ring, &s, 1) == 1);
+    }
+}
+
+// Items first..last-1 come back in order and nothing else
+static void check_samples(uint32_t first, uint32_t last) {
+    CHECK(LFRingOldestOffset(&ring) == first);
+    CHECK(LFRingNewestOffset(&ring) == last);
+    for(uint32_t o = first; o < last; o++) {
+        sample_t s;
+        if(LFRingRead(&ring, &s, 1) != 1 || s.ts != o || s.value != o * 3) {
+            fprintf(stderr, "wrong item at %u\n", o);
+            CHECK(0);
+            return;
+        }
+    }
+    CHECK(LFRingIsEmpty(&ring));
+}
+
+// Calls of LFRingVerify(ring, 4) until done, or -1 on an error
+static int verify_calls(void) {
+    for(int calls = 1; calls < 10000; calls++) {
+        int status = LFRingVerify(&ring, 4);
+        if(status < 0) return -1;
+        if(status == 1) return calls;
+    }
+    return -1;
+}
+
+static void test_deferred(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(1024, config);
+    write_samples(0, 1000);
+    // Encoded rings hold fewer items than itemNum
+    uint32_t first = (uint32_t)LFRingOldestOffset(&ring);
+    LFRingDeinit(&ring);
+
+    // Far more than LFRB_MIGRATE_BOOT_CHUNKS chunks: init leaves the rest
+    open_ring(2048, config);
+    CHECK(ring.boot.migrate_size != 0);
+    CHECK(ring.item_num == 2048);
+    CHECK(LFRingVerify(&ring, 4) == 0);
+    CHECK(ring.boot.migrate_size != 0);
+    int calls = verify_calls();
+    CHECK(calls > 2);
+    CHECK(ring.boot.migrate_size == 0);
+    CHECK(ring.boot.corrupt == 0);
+    check_samples(first, 1000);
+    write_samples(1000, 5);
+    LFRingDeinit(&ring);
+
+    open_ring(2048, config);
+    CHECK(ring.boot.migrate_size == 0);
+    check_samples(1000, 1005);
+    LFRingDeinit(&ring);
+}
+
+static void test_first_access(void) {
+    host_reset();
+    open_ring(1024, NULL);
+    write_samples(0, 1000);
+    LFRingDeinit(&ring);
+
+    // A write finishes the migration before it lands
+    open_ring(512, NULL);
+    CHECK(ring.boot.migrate_size != 0);
+    write_samples(1000, 1);
+    CHECK(ring.boot.migrate_size == 0);
+    check_samples(1001 - 512, 1001);
+    LFRingDeinit(&ring);
+}
+
+static void test_reset_during_migration(void) {
+    host_reset();
+    open_ring(1024, NULL);
+    write_samples(0, 1000);
+    LFRingDeinit(&ring);
+
+    open_ring(2048, NULL);
+    CHECK(LFRingVerify(&ring, 4) == 0);
+    host_power_cut();
+
+    // Nothing committed yet: the old ring is intact
+    open_ring(1024, NULL);
+    CHECK(ring.boot.migrate_size == 0);
+    CHECK(lfs_sim_size(HOST_ROOT "/mig.new") < 0);
+    check_samples(0, 1000);
+    write_samples(1000, 10);
+    LFRingDeinit(&ring);
+
+    // And the migration can start over
+    open_ring(2048, NULL);
+    host_power_cut();
+    open_ring(2048, NULL);
+    CHECK(verify_calls() > 0);
+    check_samples(1000, 1010);
+    LFRingDeinit(&ring);
+}
+
+static void test_verify_raw(void) {
+    host_reset();
+    // 8 LittleFS blocks of items
+    uint32_t num = 8 * LFRB_LFS_BLOCK_SIZE / sizeof(sample_t);
+    open_ring(num, NULL);
+    write_samples(0, num);
+    LFRingDeinit(&ring);
+
+    open_ring(num, NULL);
+    for(int i = 0; i < 7; i++) CHECK(LFRingVerify(&ring, 1) == 0);
+    CHECK(LFRingVerify(&ring, 1) == 1);
+    CHECK(ring.boot.corrupt == 0);
+    CHECK(LFRingVerify(&ring, 1) == 1);
+    LFRingDeinit(&ring);
+
+    // A file cut short loses the items past its end, and all older ones
+    host_reset();
+    open_ring(64, NULL);
+    write_samples(0, 40);
+    LFRingDeinit(&ring);
+    CHECK(lfs_sim_truncate(HOST_ROOT "/mig.bin", 30 * sizeof(sample_t)) == 0);
+    open_ring(64, NULL);
+    CHECK(verify_calls() == 1);
+    CHECK(ring.boot.corrupt == 40);
+    check_samples(40, 40);
+    LFRingDeinit(&ring);
+}
+
+// The stored ring a migration starts from; returns its oldest offset
+static uint32_t prepare_sweep(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(256, config);
+    write_samples(0, 200);
+    uint32_t first = (uint32_t)LFRingOldestOffset(&ring);
+    LFRingDeinit(&ring);
+    return first;
+}
+
+static void migrate_sweep(const ringbuf_config_t *config) {
+    open_ring(512, config);
+    CHECK(verify_calls() > 0);
+    LFRingDeinit(&ring);
+}
+
+static int commit_pending(void) {
+    nvs_handle_t handle;
+    size_t len = 0;
+    if(nvs_open("mig", NVS_READONLY, &handle) != ESP_OK) return 0;
+    int pending = nvs_get_blob(handle, "mig", NULL, &len) == ESP_OK;
+    nvs_close(handle);
+    return pending;
+}
+
+static void test_power_cut_sweep(const ringbuf_config_t *config) {
+    // Dry run to count the storage operations of the migration
+    prepare_sweep(config);
+    cut_seq = UINT32_MAX;
+    ops = 0;
+    LFRingSetFaultHook(cut_hook, NULL);
+    migrate_sweep(config);
+    LFRingSetFaultHook(NULL, NULL);
+    uint32_t total = ops;
+    CHECK(total > 2 * LFRB_MIGRATE_BOOT_CHUNKS);
+
+    uint32_t resumed = 0;
+    for(uint32_t cut = 0; cut < total; cut++) {
+        uint32_t first = prepare_sweep(config);
+        cut_seq = cut;
+        LFRingSetFaultHook(cut_hook, NULL);
+        if(setjmp(power_cut) == 0) {
+            migrate_sweep(config);
+            CHECK(0);           // the migration must reach operation cut
+            continue;
+        }
+        // The interrupted ring is abandoned like the RAM of a reset device
+        LFRingSetFaultHook(NULL, NULL);
+        host_power_cut();
+        resumed += commit_pending();
+
+        open_ring(512, config);
+        CHECK(verify_calls() > 0);
+        CHECK(ring.item_num == 512 && ring.boot.corrupt == 0);
+        check_samples(first, 200);
+        write_samples(200, 3);
+        check_samples(200, 203);
+        LFRingDeinit(&ring);
+        CHECK(!commit_pending());
+        CHECK(lfs_sim_size(HOST_ROOT "/mig.new") < 0 && lfs_sim_size(HOST_ROOT "/mig.ndx") < 0);
+        CHECK(lfs_sim_open_handles() == 0);
+    }
+    // Some cuts fell between the commit point and the end of the migration
+    CHECK(resumed > 0);
+}
+
+int main(void) {
+    test_deferred(NULL);
+    test_deferred(&delta_config);
+    test_first_access();
+    test_reset_during_migration();
+    test_verify_raw();
+    test_power_cut_sweep(NULL);
+    test_power_cut_sweep(&delta_config);
+    return host_report("test_migrate");
+}
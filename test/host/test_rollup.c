@@ -0,0 +1,98 @@
+// Rollup tiers: overwritten items are folded into the next tier, tiers that
+// lead back to a ring are refused, static rings use their own buffers.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 8
+
+// One record per 4 items: the sum of their values
+static size_t sum4(const void *items, size_t num, void *out, size_t max, void *ctx) {
+    uint32_t *acc = ctx;
+    const uint32_t *v = items;
+    size_t n = 0;
+    for(size_t i = 0; i < num; i++) {
+        acc[0] += v[i];
+        if(++acc[1] == 4 && n < max) {
+            ((uint32_t *)out)[n++] = acc[0];
+            acc[0] = acc[1] = 0;
+        }
+    }
+    return n;
+}
+
+static void write_seq(ringbuf_meta_t *m, uint32_t first, uint32_t num) {
+    for(uint32_t i = 0; i < num; i++) {
+        uint32_t v = first + i;
+        CHECK(LFRingWrite(m, &v, 1) == 1);
+    }
+}
+
+static void test_fold(void) {
+    host_reset();
+    ringbuf_meta_t a = {0}, b = {0};
+    uint32_t acc[2] = {0};
+    CHECK(LFRingInit(&a, HOST_ROOT, "a", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingInit(&b, HOST_ROOT, "b", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingSetRollup(&a, &b, sum4, acc) == LFRB_OK);
+
+    // 16 items into 8 slots: items 0..7 are folded before they go
+    write_seq(&a, 0, 16);
+    CHECK(LFRingNewestOffset(&b) == 2);
+    uint32_t rec[2];
+    CHECK(LFRingRead(&b, rec, 2) == 2);
+    CHECK(rec[0] == 0 + 1 + 2 + 3 && rec[1] == 4 + 5 + 6 + 7);
+    LFRingDeinit(&a);
+    LFRingDeinit(&b);
+}
+
+static void test_cycles(void) {
+    host_reset();
+    ringbuf_meta_t a = {0}, b = {0}, c = {0};
+    uint32_t acc[2] = {0};
+    CHECK(LFRingInit(&a, HOST_ROOT, "a", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingInit(&b, HOST_ROOT, "b", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingInit(&c, HOST_ROOT, "c", sizeof(uint32_t), ITEMS) == LFRB_OK);
+
+    CHECK(LFRingSetRollup(&a, &a, sum4, acc) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingSetRollup(&a, &b, sum4, acc) == LFRB_OK);
+    CHECK(LFRingSetRollup(&b, &a, sum4, acc) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingSetRollup(&b, &c, sum4, acc) == LFRB_OK);
+    CHECK(LFRingSetRollup(&c, &a, sum4, acc) == -LFRB_CONFIG_ERROR);
+    // Without the link a -> b, c -> a no longer closes a loop
+    CHECK(LFRingSetRollup(&a, NULL, NULL, NULL) == LFRB_OK);
+    CHECK(LFRingSetRollup(&c, &a, sum4, acc) == LFRB_OK);
+    CHECK(LFRingSetRollup(&a, &b, sum4, acc) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&a);
+    LFRingDeinit(&b);
+    LFRingDeinit(&c);
+}
+
+static void test_static(void) {
+    host_reset();
+    ringbuf_meta_t a = {0}, b = {0};
+    uint32_t acc[2] = {0};
+    static ringbuf_static_t bare;
+    CHECK(LFRingInitStatic(&a, HOST_ROOT, "a", sizeof(uint32_t), ITEMS, NULL, &bare) == LFRB_OK);
+    CHECK(LFRingInit(&b, HOST_ROOT, "b", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingSetRollup(&a, &b, sum4, acc) == -LFRB_NO_MEM_ERROR);
+    LFRingDeinit(&a);
+
+    static uint8_t rollup[LFRB_ROLLUP_BYTES(sizeof(uint32_t), sizeof(uint32_t), 2)];
+    static ringbuf_static_t mem = {.rollup = rollup, .rollup_items = 2};
+    CHECK(LFRingInitStatic(&a, HOST_ROOT, "a", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    CHECK(LFRingSetRollup(&a, &b, sum4, acc) == LFRB_OK);
+    CHECK(a.rollup.buf == rollup);
+    write_seq(&a, 0, 16);
+    uint32_t rec[2];
+    CHECK(LFRingRead(&b, rec, 2) == 2);
+    CHECK(rec[0] == 6 && rec[1] == 22);
+    LFRingDeinit(&a);
+    LFRingDeinit(&b);
+}
+
+int main(void) {
+    test_fold();
+    test_cycles();
+    test_static();
+    return host_report("test_rollup");
+}
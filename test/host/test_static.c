@@ -0,0 +1,196 @@
+// Rings set up with LFRingInitStatic(): drains, streams, migrations and
+// iterators run in the buffers of ringbuf_static_t and fail without them,
+// scans work without any, and the flush task runs in caller-provided memory.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 32
+#define STREAM 4
+
+static ringbuf_meta_t ring;
+static uint32_t drained[ITEMS];
+static uint32_t drained_num;
+
+static size_t sink(const void *data, size_t len, void *ctx) {
+    memcpy(drained + drained_num, data, len);
+    drained_num += len / sizeof(uint32_t);
+    return len;
+}
+
+static int is_odd(const void *item, uint64_t offset, void *ctx) {
+    return (*(const uint32_t *)item & 1) && *(const uint32_t *)item == offset;
+}
+
+static void write_seq(uint32_t first, uint32_t num) {
+    for(uint32_t v = first; v < first + num; v++) CHECK(LFRingWrite(&ring, &v, 1) == 1);
+}
+
+static void check_seq(uint32_t first, uint32_t num) {
+    for(uint32_t v = first; v < first + num; v++) {
+        uint32_t item = UINT32_MAX;
+        CHECK(LFRingRead(&ring, &item, 1) == 1 && item == v);
+    }
+    CHECK(LFRingIsEmpty(&ring));
+}
+
+static void test_drain(void) {
+    host_reset();
+    static ringbuf_static_t bare;
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "drain", sizeof(uint32_t), ITEMS, NULL, &bare) == LFRB_OK);
+    write_seq(0, 10);
+    CHECK(LFRingDrainTo(&ring, sink, NULL, SIZE_MAX) == -LFRB_NO_MEM_ERROR);
+    ringbuf_iter_t it;
+    CHECK(LFRingIterBegin(&ring, &it) == -LFRB_NO_MEM_ERROR);
+
+    // Scans filter in the caller's buffer instead
+    uint32_t odd[8];
+    CHECK(LFRingScan(&ring, is_odd, NULL, odd, 8) == 5);
+    for(uint32_t i = 0; i < 5; i++) CHECK(odd[i] == 2 * i + 1);
+    CHECK(LFRingScanRange(&ring, 4, 10, is_odd, NULL, odd, 8) == 3);
+    CHECK(odd[0] == 5 && odd[1] == 7 && odd[2] == 9);
+    CHECK(LFRingScan(&ring, is_odd, NULL, odd, 2) == 2);
+    CHECK(odd[0] == 1 && odd[1] == 3);
+    LFRingDeinit(&ring);
+
+    // A scratch buffer of a few items drains in several chunks
+    static uint8_t scratch[3 * sizeof(uint32_t)];
+    static ringbuf_static_t mem = {.scratch = scratch, .scratch_size = sizeof(scratch)};
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "drain", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    drained_num = 0;
+    CHECK(LFRingDrainTo(&ring, sink, NULL, SIZE_MAX) == 10 * sizeof(uint32_t));
+    CHECK(drained_num == 10);
+    for(uint32_t i = 0; i < drained_num; i++) CHECK(drained[i] == i);
+    CHECK(LFRingIsEmpty(&ring));
+    LFRingDeinit(&ring);
+}
+
+// Walks the ring and returns the number of items seen, checking each
+static uint32_t walk(ringbuf_iter_t *it, uint32_t first) {
+    const void *item;
+    uint32_t n = 0;
+    while(LFRingIterNext(it, &item) == 1) {
+        CHECK(*(const uint32_t *)item == first + n);
+        n++;
+    }
+    return n;
+}
+
+static void test_iter(void) {
+    host_reset();
+    static uint8_t buf[LFRB_ITER_BYTES(sizeof(uint32_t))];
+    static ringbuf_static_t mem = {.iter = buf, .iter_size = sizeof(buf)};
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "iter", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    write_seq(0, ITEMS + 10);
+
+    // One iterator at a time
+    ringbuf_iter_t it, other;
+    CHECK(LFRingIterBegin(&ring, &it) == LFRB_OK);
+    CHECK(it.buf == buf && it.cap == LFRB_LFS_BLOCK_SIZE / sizeof(uint32_t));
+    CHECK(LFRingIterBegin(&ring, &other) == -LFRB_NO_MEM_ERROR);
+    CHECK(walk(&it, 10) == ITEMS);
+    LFRingIterEnd(&it);
+    CHECK(LFRingIterBegin(&ring, &other) == LFRB_OK);
+    LFRingIterEnd(&other);
+    CHECK(LFRingOldestOffset(&ring) == 10);
+    LFRingDeinit(&ring);
+
+    // A buffer of a few items reads a few at a time
+    static uint8_t small[3 * sizeof(uint32_t)];
+    static ringbuf_static_t few = {.iter = small, .iter_size = sizeof(small)};
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "iter", sizeof(uint32_t), ITEMS, NULL, &few) == LFRB_OK);
+    CHECK(LFRingIterBegin(&ring, &it) == LFRB_OK);
+    CHECK(it.cap == 3);
+    CHECK(walk(&it, 10) == ITEMS);
+    LFRingIterEnd(&it);
+    LFRingDeinit(&ring);
+}
+
+static void test_stream(void) {
+    host_reset();
+    static ringbuf_static_t bare;
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "stream", sizeof(uint32_t), ITEMS, NULL, &bare) == LFRB_OK);
+    CHECK(LFRingSetStream(&ring, STREAM) == -LFRB_NO_MEM_ERROR);
+    LFRingDeinit(&ring);
+
+    static uint8_t buf[LFRB_STREAM_BYTES(sizeof(uint32_t), STREAM)];
+    static ringbuf_static_t mem = {.stream = buf, .stream_items = STREAM};
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "stream", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    CHECK(LFRingSetStream(&ring, STREAM + 1) == -LFRB_NO_MEM_ERROR);
+    CHECK(LFRingSetStream(&ring, STREAM) == LFRB_OK);
+    CHECK(ring.stream.buf[0] == buf && ring.stream.buf[1] == buf + STREAM * sizeof(uint32_t));
+    for(uint32_t v = 0; v < 11; v++) CHECK(LFRingWriteStream(&ring, &v, 1) == 1);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    check_seq(0, 11);
+    // Deinit writes out the items still buffered
+    for(uint32_t v = 11; v < 14; v++) CHECK(LFRingWriteStream(&ring, &v, 1) == 1);
+    LFRingDeinit(&ring);
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "stream", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    check_seq(11, 3);
+    LFRingDeinit(&ring);
+}
+
+static void test_migrate(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "mig", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    write_seq(0, 20);
+    LFRingDeinit(&ring);
+
+    // Without scratch space the stored ring is kept as it is
+    static ringbuf_static_t bare;
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "mig", sizeof(uint32_t), 2 * ITEMS, NULL, &bare) == -LFRB_NO_MEM_ERROR);
+
+    static uint8_t scratch[LFRB_SCRATCH_BYTES(sizeof(uint32_t))];
+    static ringbuf_static_t mem = {.scratch = scratch, .scratch_size = sizeof(scratch)};
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "mig", sizeof(uint32_t), 2 * ITEMS, NULL, &mem) == LFRB_OK);
+    CHECK(ring.item_num == 2 * ITEMS);
+    check_seq(0, 20);
+    LFRingDeinit(&ring);
+}
+
+static void test_flush_task(void) {
+    host_reset();
+    static StackType_t stack[4096];
+    static StaticTask_t task;
+    CHECK(LFRingFlushStartStatic(5, sizeof(stack) / sizeof(stack[0]), stack, NULL) == -LFRB_CONFIG_ERROR);
+    CHECK(LFRingFlushStartStatic(5, sizeof(stack) / sizeof(stack[0]), stack, &task) == LFRB_OK);
+
+    static uint8_t pending[LFRB_ITEMS_BYTES(sizeof(uint32_t), 8)];
+    static ringbuf_static_t mem = {.pending = pending, .pending_items = 8};
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitStatic(&ring, HOST_ROOT, "task", sizeof(uint32_t), ITEMS, NULL, &mem) == LFRB_OK);
+    CHECK(LFRingSetFlush(&ring, 8, 0, 1) == LFRB_OK);
+    write_seq(0, 3);
+    for(int i = 0; i < 1000 && LFRingDurableOffset(&ring) < 3; i++) vTaskDelay(1);
+    CHECK(LFRingDurableOffset(&ring) == 3);
+    LFRingFlushStop();
+    check_seq(0, 3);
+    LFRingDeinit(&ring);
+}
+
+// The footprint is the struct plus every buffer it points to
+static void test_bytes(void) {
+    size_t bytes = LFRB_STATIC_BYTES(8, 0, 0, 16, 4, 1, 12, 2, 8, 8, 1);
+    CHECK(bytes == sizeof(ringbuf_static_t) + 16 * 8 + 4 * 8 + LFRB_LFS_BLOCK_SIZE + 2 * (8 + 12) + 2 * 8 * 8 +
+                       2 * LFRB_MIGRATE_CHUNK * 8 + LFRB_LFS_BLOCK_SIZE);
+    CHECK(LFRB_STATIC_BYTES(8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) == sizeof(ringbuf_static_t));
+    CHECK(LFRB_ITER_BYTES(12) == LFRB_LFS_BLOCK_SIZE / 12 * 12);
+    CHECK(LFRB_ITER_BYTES(LFRB_LFS_BLOCK_SIZE + 1) == LFRB_LFS_BLOCK_SIZE + 1);
+}
+
+int main(void) {
+    test_drain();
+    test_iter();
+    test_stream();
+    test_migrate();
+    test_flush_task();
+    test_bytes();
+    return host_report("test_static");
+}
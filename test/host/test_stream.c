@@ -0,0 +1,117 @@
+// Double-buffered streams: a producer and a concurrent LFRingFlush() caller
+// wait on the same buffer, with and without the flush task. Every item must
+// arrive once and in order, also when writes fail and are retried.
+#include <pthread.h>
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 4096
+#define STREAM_ITEMS 3000
+#define BUFFER_ITEMS 8
+
+static ringbuf_meta_t ring;
+static volatile int producing;
+
+static void *producer(void *arg) {
+    for(uint32_t v = 0; v < STREAM_ITEMS; ) {
+        uint32_t batch[3];
+        uint32_t k = STREAM_ITEMS - v < 3 ? STREAM_ITEMS - v : 3;
+        for(uint32_t i = 0; i < k; i++) batch[i] = v + i;
+        CHECK(LFRingWriteStream(&ring, batch, k) == (int)k);
+        v += k;
+    }
+    producing = 0;
+    return NULL;
+}
+
+static void *flusher(void *arg) {
+    while(producing) CHECK(LFRingFlush(&ring) == LFRB_OK);
+    return NULL;
+}
+
+static void check_stream(int task) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "stream", sizeof(uint32_t), ITEMS) == LFRB_OK);
+    if(task) CHECK(LFRingFlushStart(5, 4096) == LFRB_OK);
+    CHECK(LFRingSetStream(&ring, BUFFER_ITEMS) == LFRB_OK);
+
+    producing = 1;
+    pthread_t p, f;
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_create(&f, NULL, flusher, NULL);
+    pthread_join(p, NULL);
+    pthread_join(f, NULL);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(ring.stream.waiters == 0);
+
+    CHECK(LFRingNewestOffset(&ring) == STREAM_ITEMS);
+    for(uint32_t v = 0; v < STREAM_ITEMS; v++) {
+        uint32_t item;
+        if(LFRingRead(&ring, &item, 1) != 1 || item != v) {
+            fprintf(stderr, "task %d: wrong item at %u\n", task, v);
+            CHECK(0);
+            break;
+        }
+    }
+    LFRingDeinit(&ring);
+    if(task) LFRingFlushStop();
+}
+
+static void stream_items(uint32_t from, uint32_t to) {
+    for(uint32_t v = from; v < to; v++) CHECK(LFRingWriteStream(&ring, &v, 1) == 1);
+}
+
+// A buffer that fails to write keeps its items, also the unwritten part of
+// one that wrapped, and the producer waits until a retry succeeds
+static void check_retry(int task) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "retry", sizeof(uint32_t), 20) == LFRB_OK);
+    if(task) CHECK(LFRingFlushStart(5, 4096) == LFRB_OK);
+    CHECK(LFRingSetStream(&ring, BUFFER_ITEMS) == LFRB_OK);
+    stream_items(0, 8);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(LFRingNewestOffset(&ring) == 8);
+
+    lfs_sim_fail_writes(0, 2);
+    stream_items(8, 16);
+    if(task) {
+        // The flush task retries on its own
+        while(LFRingNewestOffset(&ring) < 16) vTaskDelay(1);
+    } else {
+        CHECK(LFRingFlush(&ring) == -LFRB_LFS_ERROR);
+        CHECK(LFRingNewestOffset(&ring) == 8);
+    }
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(LFRingNewestOffset(&ring) == 16);
+
+    // Slots 16-19 are written, 0-3 fail
+    lfs_sim_fail_writes(1, 1);
+    stream_items(16, 24);
+    if(!task) CHECK(LFRingNewestOffset(&ring) == 20);
+    stream_items(24, 32);
+
+    // The producer blocks on the second buffer until the first is written
+    lfs_sim_fail_writes(0, 3);
+    stream_items(32, 48);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    CHECK(ring.stream.waiters == 0);
+
+    CHECK(LFRingNewestOffset(&ring) == 48);
+    CHECK(LFRingOldestOffset(&ring) == 28);
+    for(uint32_t v = 28; v < 48; v++) {
+        uint32_t item;
+        CHECK(LFRingRead(&ring, &item, 1) == 1 && item == v);
+    }
+    LFRingDeinit(&ring);
+    if(task) LFRingFlushStop();
+}
+
+int main(void) {
+    check_stream(0);
+    check_stream(1);
+    check_retry(0);
+    check_retry(1);
+    return host_report("test_stream");
+}
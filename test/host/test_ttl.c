@@ -0,0 +1,171 @@
+// Expiry of unread items: whole expired blocks skipped on their index entry
+// alone, the block straddling the cutoff decoded, LFRingRead(),
+// LFRingReadColumns() and LFRingDrainTo() all honouring it, pending items
+// written out only once they expired too, and every skipped item counted.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 64
+
+typedef struct {
+    uint32_t ts;
+    uint32_t value;
+} sample_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_UINT},
+};
+
+static const ringbuf_config_t configs[] = {
+    {.fields = fields, .field_num = 2, .block_items = 4, .flags = LFRB_TIME_INDEX, .ts_field = 0},
+    {.fields = fields, .field_num = 2, .codec = LFRB_CODEC_DELTA, .block_items = 4, .frame_size = 64,
+     .flags = LFRB_TIME_INDEX, .ts_field = 0},
+};
+
+#define TTL 100
+
+static ringbuf_meta_t ring;
+static uint64_t now;
+
+static uint64_t clock_now(void *ctx) { return now; }
+
+static uint32_t ts_of(uint64_t offset) { return 1000 + (uint32_t)offset * 10; }
+
+// Items older than the one at offset expire
+static void expire_before(uint64_t offset) { now = ts_of(offset) + TTL; }
+
+static void open_ring(const ringbuf_config_t *config) {
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "ttl", sizeof(sample_t), ITEMS, config) == LFRB_OK);
+    expire_before(0);
+    CHECK(LFRingSetTTL(&ring, TTL, clock_now, NULL) == LFRB_OK);
+}
+
+static void write_items(uint64_t from, uint64_t to) {
+    for(uint64_t o = from; o < to; o++) {
+        sample_t s = {ts_of(o), (uint32_t)o};
+        CHECK(LFRingWrite(&ring, &s, 1) == 1);
+    }
+}
+
+static void check_read(uint64_t offset) {
+    sample_t s;
+    CHECK(LFRingRead(&ring, &s, 1) == 1 && s.value == offset && s.ts == ts_of(offset));
+}
+
+// Raw ring: a block behind the cutoff is never read, so a stored item
+// changed behind the ring's back to look fresh does not stop the expiry
+static void test_skip(void) {
+    host_reset();
+    open_ring(&configs[0]);
+    write_items(0, 22);
+    check_read(0);
+    CHECK(ring.ttl.expired == 0);
+
+    sample_t fake = {5000, 999};
+    CHECK(lfs_sim_write(HOST_ROOT "/ttl.bin", 5 * sizeof(fake), &fake, sizeof(fake)) == 0);
+    // Block 2 holds offsets 8-11 and straddles the cutoff
+    expire_before(10);
+    check_read(10);
+    CHECK(ring.ttl.expired == 9);
+    check_read(11);
+    CHECK(ring.ttl.expired == 9);
+    LFRingDeinit(&ring);
+}
+
+// Pending items stay in RAM while stored items are still fresh
+static void test_pending(void) {
+    host_reset();
+    open_ring(&configs[0]);
+    CHECK(LFRingSetFlush(&ring, 8, 0, 0) == LFRB_OK);
+    write_items(0, 8);
+    CHECK(LFRingFlush(&ring) == LFRB_OK);
+    write_items(8, 13);
+    CHECK(ring.pending.num == 5);
+
+    expire_before(5);
+    check_read(5);
+    CHECK(ring.pending.num == 5);
+    CHECK(ring.ttl.expired == 5);
+
+    // Every stored item expired, and so did the oldest pending one
+    expire_before(10);
+    check_read(10);
+    CHECK(ring.pending.num == 0);
+    CHECK(ring.ttl.expired == 9);
+
+    // Everything expired
+    expire_before(20);
+    sample_t s;
+    CHECK(LFRingRead(&ring, &s, 1) == 0);
+    CHECK(ring.ttl.expired == 11);
+    CHECK(LFRingIsEmpty(&ring));
+    LFRingDeinit(&ring);
+}
+
+// The block straddling the cutoff is decoded; reads of selected columns expire as well
+static void test_encoded(void) {
+    host_reset();
+    open_ring(&configs[1]);
+    write_items(0, 22);
+    expire_before(9);
+    sample_t s;
+    CHECK(LFRingReadColumns(&ring, 1u << 1, &s, 1) == 1 && s.value == 9 && s.ts == 0);
+    CHECK(ring.ttl.expired == 9);
+    expire_before(17);
+    check_read(17);
+    CHECK(ring.ttl.expired == 16);
+
+    // Also once the open block holds the cutoff
+    expire_before(21);
+    check_read(21);
+    CHECK(ring.ttl.expired == 19);
+    LFRingDeinit(&ring);
+}
+
+typedef struct {
+    uint32_t got[ITEMS];
+    uint32_t got_num;
+} sink_t;
+
+static size_t sink(const void *data, size_t len, void *ctx) {
+    sink_t *s = ctx;
+    for(size_t i = 0; i + sizeof(sample_t) <= len; i += sizeof(sample_t)) {
+        const sample_t *item = (const sample_t *)((const uint8_t *)data + i);
+        s->got[s->got_num++] = item->value;
+    }
+    return len;
+}
+
+static void test_drain(const ringbuf_config_t *config) {
+    host_reset();
+    open_ring(config);
+    write_items(0, 20);
+    expire_before(6);
+    static sink_t s;
+    memset(&s, 0, sizeof(s));
+    CHECK(LFRingDrainTo(&ring, sink, &s, SIZE_MAX) == 14 * (int)sizeof(sample_t));
+    CHECK(s.got_num == 14);
+    for(uint32_t i = 0; i < s.got_num; i++) CHECK(s.got[i] == 6 + i);
+    CHECK(ring.ttl.expired == 6);
+    LFRingDeinit(&ring);
+}
+
+static void test_no_index(void) {
+    host_reset();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInit(&ring, HOST_ROOT, "plain", sizeof(sample_t), ITEMS) == LFRB_OK);
+    CHECK(LFRingSetTTL(&ring, TTL, clock_now, NULL) == -LFRB_CONFIG_ERROR);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    test_skip();
+    test_pending();
+    test_encoded();
+    test_drain(&configs[0]);
+    test_drain(&configs[1]);
+    test_no_index();
+    return host_report("test_ttl");
+}
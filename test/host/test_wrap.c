@@ -0,0 +1,75 @@
+// Regression test: a raw write that wraps around the end of the data file
+// must continue at slot 0 with the items after the wrap and advance head
+// from where it started, not from slot 0.
+#include <string.h>
+#include "host_test.h"
+
+#define ITEMS 8
+
+typedef struct {
+    uint32_t ts;
+    uint32_t value;
+} sample_t;
+
+static const ringbuf_field_t fields[] = {
+    {offsetof(sample_t, ts), 4, LFRB_FIELD_UINT},
+    {offsetof(sample_t, value), 4, LFRB_FIELD_UINT},
+};
+
+static void fill(sample_t *items, uint32_t first, uint32_t num) {
+    for(uint32_t i = 0; i < num; i++) items[i] = (sample_t){100 + first + i, first + i};
+}
+
+static void check_wrap(const ringbuf_config_t *config) {
+    host_reset();
+    ringbuf_meta_t ring = {0};
+    sample_t items[ITEMS];
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "wrap", sizeof(sample_t), ITEMS, config) == LFRB_OK);
+
+    // Move head to slot 5, then write 6 items across the end of the file
+    fill(items, 0, 5);
+    CHECK(LFRingWrite(&ring, items, 5) == 5);
+    CHECK(LFRingRead(&ring, items, 5) == 5);
+    fill(items, 5, 6);
+    CHECK(LFRingWrite(&ring, items, 6) == 6);
+    CHECK(LFRingNewestOffset(&ring) == 11);
+    CHECK(LFRingOldestOffset(&ring) == 5);
+
+    // Slots 5..7 hold offsets 5..7, slots 0..2 offsets 8..10
+    static const uint32_t slots[] = {5, 6, 7, 0, 1, 2};
+    for(uint32_t i = 0; i < 6; i++) {
+        sample_t slot;
+        CHECK(lfs_sim_read(HOST_ROOT "/wrap.bin", slots[i] * sizeof(slot), &slot, sizeof(slot)) == 0);
+        CHECK(slot.value == 5 + i);
+    }
+    if(config != NULL) {
+        // A time range across the wrap
+        CHECK(LFRingReadRange(&ring, 107, 109, items, ITEMS) == 3);
+        CHECK(items[0].value == 7 && items[1].value == 8 && items[2].value == 9);
+    }
+
+    // The same items come back after a reset, in order
+    LFRingDeinit(&ring);
+    host_power_cut();
+    memset(&ring, 0, sizeof(ring));
+    CHECK(LFRingInitEx(&ring, HOST_ROOT, "wrap", sizeof(sample_t), ITEMS, config) == LFRB_OK);
+    CHECK(LFRingNewestOffset(&ring) == 11);
+    CHECK(LFRingRead(&ring, items, ITEMS) == 6);
+    for(uint32_t i = 0; i < 6; i++) CHECK(items[i].value == 5 + i && items[i].ts == 105 + i);
+    LFRingDeinit(&ring);
+}
+
+int main(void) {
+    check_wrap(NULL);
+
+    // The time index is written per slot block and must follow the same slots
+    ringbuf_config_t indexed = {
+        .fields = fields,
+        .field_num = 2,
+        .block_items = 4,
+        .flags = LFRB_TIME_INDEX,
+        .ts_field = 0,
+    };
+    check_wrap(&indexed);
+    return host_report("test_wrap");
+}